@@ -23,12 +23,18 @@ Camera::Camera(
 	nearClip(nearClip),
 	farClip(farClip),
 	projectionType(projType),
-	orthographicWidth(2.0f)
+	orthographicWidth(2.0f),
+	transformVersion(0),
+	viewGeneration(0),
+	projectionGeneration(0)
 {
 	transform.SetPosition(x, y, z);
 
-	UpdateViewMatrix();
+	// Both of these rebuild the view-projection, so neither
+	// matrix can be left unset when the other one runs
+	XMStoreFloat4x4(&viewMatrix, XMMatrixIdentity());
 	UpdateProjectionMatrix(aspectRatio);
+	UpdateViewMatrix();
 }
 
 Camera::Camera(
@@ -47,12 +53,19 @@ Camera::Camera(
 	aspectRatio(aspectRatio),
 	nearClip(nearClip),
 	farClip(farClip),
-	projectionType(projType)
+	projectionType(projType),
+	orthographicWidth(2.0f),
+	transformVersion(0),
+	viewGeneration(0),
+	projectionGeneration(0)
 {
 	transform.SetPosition(position);
 
-	UpdateViewMatrix();
+	// Both of these rebuild the view-projection, so neither
+	// matrix can be left unset when the other one runs
+	XMStoreFloat4x4(&viewMatrix, XMMatrixIdentity());
 	UpdateProjectionMatrix(aspectRatio);
+	UpdateViewMatrix();
 }
 
 // Nothing to really do
@@ -84,20 +97,26 @@ void Camera::Update(float dt)
 	// Handle mouse movement only when button is down
 	if (input.MouseLeftDown())
 	{
-		// Calculate cursor change
-		float xDiff = mouseLookSpeed * input.GetMouseXDelta();
-		float yDiff = mouseLookSpeed * input.GetMouseYDelta();
-		transform.Rotate(yDiff, xDiff, 0);
-
-		// Clamp the X rotation
-		XMFLOAT3 rot = transform.GetPitchYawRoll();
-		if (rot.x > XM_PIDIV2) rot.x = XM_PIDIV2;
-		if (rot.x < -XM_PIDIV2) rot.x = -XM_PIDIV2;
-		transform.SetRotation(rot);
+		// Calculate cursor change - a still cursor leaves the
+		// transform (and so the view matrix) alone
+		int xDelta = input.GetMouseXDelta();
+		int yDelta = input.GetMouseYDelta();
+		if (xDelta != 0 || yDelta != 0)
+		{
+			float xDiff = mouseLookSpeed * xDelta;
+			float yDiff = mouseLookSpeed * yDelta;
+			transform.Rotate(yDiff, xDiff, 0);
+
+			// Clamp the X rotation
+			XMFLOAT3 rot = transform.GetPitchYawRoll();
+			if (rot.x > XM_PIDIV2) rot.x = XM_PIDIV2;
+			if (rot.x < -XM_PIDIV2) rot.x = -XM_PIDIV2;
+			transform.SetRotation(rot);
+		}
 	}
 
-	// Update the view every frame - could be optimized
-	UpdateViewMatrix();
+	// Only rebuild the view if the camera actually moved
+	UpdateViewMatrixIfDirty();
 
 }
 
@@ -114,6 +133,48 @@ void Camera::UpdateViewMatrix()
 		XMLoadFloat3(&forward),
 		XMVectorSet(0, 1, 0, 0)); // World up axis
 	XMStoreFloat4x4(&viewMatrix, view);
+
+	// Remember which version of the transform this matches
+	transformVersion = transform.GetVersion();
+	viewGeneration++;
+	UpdateViewProjection();
+}
+
+// Rebuilds the view matrix only if the transform has changed
+// since the last time the view matrix was created
+void Camera::UpdateViewMatrixIfDirty()
+{
+	if (transform.GetVersion() != transformVersion)
+		UpdateViewMatrix();
+}
+
+// Updates the combined view-projection matrix and the frustum
+// planes, which are extracted directly from that matrix
+void Camera::UpdateViewProjection()
+{
+	XMMATRIX VP = XMMatrixMultiply(XMLoadFloat4x4(&viewMatrix), XMLoadFloat4x4(&projMatrix));
+	XMStoreFloat4x4(&viewProjMatrix, VP);
+
+	// Each plane is a sum or difference of the 4th column and one of
+	// the others (since DirectXMath uses row vectors), and the near
+	// plane is just the 3rd column due to D3D's [0,1] depth range
+	XMFLOAT4X4& m = viewProjMatrix;
+	XMVECTOR col0 = XMVectorSet(m._11, m._21, m._31, m._41);
+	XMVECTOR col1 = XMVectorSet(m._12, m._22, m._32, m._42);
+	XMVECTOR col2 = XMVectorSet(m._13, m._23, m._33, m._43);
+	XMVECTOR col3 = XMVectorSet(m._14, m._24, m._34, m._44);
+
+	XMVECTOR planes[6] = {
+		col3 + col0,	// Left
+		col3 - col0,	// Right
+		col3 + col1,	// Bottom
+		col3 - col1,	// Top
+		col2,			// Near
+		col3 - col2		// Far
+	};
+
+	for (int i = 0; i < 6; i++)
+		XMStoreFloat4(&frustumPlanes[i], XMPlaneNormalize(planes[i]));
 }
 
 // Updates the projection matrix
@@ -142,10 +203,61 @@ void Camera::UpdateProjectionMatrix(float aspectRatio)
 	}
 
 	XMStoreFloat4x4(&projMatrix, P);
+
+	projectionGeneration++;
+	UpdateViewProjection();
+}
+
+// Matrix getters make sure the view is current, in case the
+// transform was changed directly since the last Update()
+const DirectX::XMFLOAT4X4& Camera::GetView() 
+{ 
+	UpdateViewMatrixIfDirty();
+	return viewMatrix; 
+}
+
+const DirectX::XMFLOAT4X4& Camera::GetProjection() { return projMatrix; }
+
+const DirectX::XMFLOAT4X4& Camera::GetViewProjection() 
+{
+	UpdateViewMatrixIfDirty();
+	return viewProjMatrix; 
+}
+
+const DirectX::XMFLOAT4* Camera::GetFrustumPlanes()
+{
+	UpdateViewMatrixIfDirty();
+	return frustumPlanes;
+}
+
+// --------------------------------------------------------
+// Is any part of the world space box inside the frustum?
+// Conservative - boxes near a frustum corner can pass
+// --------------------------------------------------------
+bool Camera::IsBoxVisible(const DirectX::XMFLOAT3& boxMin, const DirectX::XMFLOAT3& boxMax)
+{
+	UpdateViewMatrixIfDirty();
+	for (int i = 0; i < 6; i++)
+	{
+		// The corner furthest along the plane's normal
+		const XMFLOAT4& p = frustumPlanes[i];
+		float x = p.x >= 0 ? boxMax.x : boxMin.x;
+		float y = p.y >= 0 ? boxMax.y : boxMin.y;
+		float z = p.z >= 0 ? boxMax.z : boxMin.z;
+		if (p.x * x + p.y * y + p.z * z + p.w < 0)
+			return false;
+	}
+	return true;
+}
+
+unsigned int Camera::GetViewGeneration() 
+{ 
+	UpdateViewMatrixIfDirty();
+	return viewGeneration; 
 }
 
-DirectX::XMFLOAT4X4 Camera::GetView() { return viewMatrix; }
-DirectX::XMFLOAT4X4 Camera::GetProjection() { return projMatrix; }
+unsigned int Camera::GetProjectionGeneration() { return projectionGeneration; }
+unsigned int Camera::GetGeneration() { return GetViewGeneration() + projectionGeneration; }
 Transform* Camera::GetTransform() { return &transform; }
 
 float Camera::GetAspectRatio() { return aspectRatio; }
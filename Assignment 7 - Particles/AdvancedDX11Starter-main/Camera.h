@@ -40,8 +40,11 @@ public:
 	void UpdateProjectionMatrix(float aspectRatio);
 
 	// Getters
-	DirectX::XMFLOAT4X4 GetView();
-	DirectX::XMFLOAT4X4 GetProjection();
+	const DirectX::XMFLOAT4X4& GetView();
+	const DirectX::XMFLOAT4X4& GetProjection();
+	const DirectX::XMFLOAT4X4& GetViewProjection();
+	const DirectX::XMFLOAT4* GetFrustumPlanes();
+	bool IsBoxVisible(const DirectX::XMFLOAT3& boxMin, const DirectX::XMFLOAT3& boxMax);
 	Transform* GetTransform();
 	float GetAspectRatio();
 
@@ -66,10 +69,30 @@ public:
 	CameraProjectionType GetProjectionType();
 	void SetProjectionType(CameraProjectionType type);
 
+	// Generation numbers - these change whenever the corresponding
+	// matrices change, so users of the camera's data can skip
+	// work (culling, constant buffer uploads) when they don't
+	unsigned int GetViewGeneration();
+	unsigned int GetProjectionGeneration();
+	unsigned int GetGeneration();
+
 private:
 	// Camera matrices
 	DirectX::XMFLOAT4X4 viewMatrix;
 	DirectX::XMFLOAT4X4 projMatrix;
+	DirectX::XMFLOAT4X4 viewProjMatrix;
+
+	// World space frustum planes (left, right, bottom, top, near, far)
+	// as (normal, distance), with normals pointing into the frustum
+	DirectX::XMFLOAT4 frustumPlanes[6];
+
+	// Change tracking
+	unsigned int transformVersion;
+	unsigned int viewGeneration;
+	unsigned int projectionGeneration;
+
+	void UpdateViewMatrixIfDirty();
+	void UpdateViewProjection();
 
 	Transform transform;
 
@@ -0,0 +1,153 @@
+#include "D3D11Renderer.h"
+
+#include <string.h>
+
+D3D11Renderer::D3D11Renderer(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context) :
+	context(context),
+	noOverwriteAcrossFrames(false)
+{
+	// Writing to a buffer with NO_OVERWRITE while it's bound as
+	// a shader resource needs an 11.1 runtime and driver support
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	context->GetDevice(device.GetAddressOf());
+
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	noOverwriteAcrossFrames =
+		SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+		options.MapNoOverwriteOnDynamicBufferSRV;
+}
+
+// --------------------------------------------------------
+// Maps the buffer once, copies each range to its offset and
+// unmaps it again
+// --------------------------------------------------------
+bool D3D11Renderer::WriteBufferRanges(ID3D11Buffer* buffer, RenderMapType mapType, const RenderBufferRange* ranges, unsigned int rangeCount)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	D3D11_MAP map = mapType == RenderMapType::WriteDiscard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (FAILED(context->Map(buffer, 0, map, 0, &mapped)))
+	{
+		frameStats.FailedMaps++;
+		return false;
+	}
+
+	for (unsigned int i = 0; i < rangeCount; i++)
+	{
+		memcpy((unsigned char*)mapped.pData + ranges[i].ByteOffset, ranges[i].Data, ranges[i].Size);
+		frameStats.BufferBytesWritten += ranges[i].Size;
+	}
+	context->Unmap(buffer, 0);
+
+	frameStats.BufferWrites++;
+	return true;
+}
+
+void D3D11Renderer::UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size)
+{
+	context->UpdateSubresource(buffer, 0, 0, data, 0, 0);
+	frameStats.ConstantBufferUpdates++;
+	frameStats.ConstantBufferBytes += size;
+}
+
+void D3D11Renderer::SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride)
+{
+	UINT offset = 0;
+	context->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
+	frameStats.Bindings++;
+}
+
+void D3D11Renderer::SetIndexBuffer(ID3D11Buffer* buffer)
+{
+	context->IASetIndexBuffer(buffer, DXGI_FORMAT_R32_UINT, 0);
+	frameStats.Bindings++;
+}
+
+void D3D11Renderer::SetVertexShader(ID3D11VertexShader* shader, ID3D11InputLayout* inputLayout)
+{
+	context->IASetInputLayout(inputLayout);
+	context->VSSetShader(shader, 0, 0);
+	frameStats.Bindings++;
+}
+
+void D3D11Renderer::SetPixelShader(ID3D11PixelShader* shader)
+{
+	context->PSSetShader(shader, 0, 0);
+	frameStats.Bindings++;
+}
+
+void D3D11Renderer::SetConstantBuffer(RenderShaderStage stage, unsigned int slot, ID3D11Buffer* buffer)
+{
+	if (stage == RenderShaderStage::Vertex)
+		context->VSSetConstantBuffers(slot, 1, &buffer);
+	else
+		context->PSSetConstantBuffers(slot, 1, &buffer);
+	frameStats.Bindings++;
+}
+
+void D3D11Renderer::SetShaderResource(RenderShaderStage stage, unsigned int slot, ID3D11ShaderResourceView* srv)
+{
+	if (stage == RenderShaderStage::Vertex)
+		context->VSSetShaderResources(slot, 1, &srv);
+	else
+		context->PSSetShaderResources(slot, 1, &srv);
+	frameStats.Bindings++;
+}
+
+void D3D11Renderer::SetSampler(RenderShaderStage stage, unsigned int slot, ID3D11SamplerState* sampler)
+{
+	if (stage == RenderShaderStage::Vertex)
+		context->VSSetSamplers(slot, 1, &sampler);
+	else
+		context->PSSetSamplers(slot, 1, &sampler);
+	frameStats.Bindings++;
+}
+
+void D3D11Renderer::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	context->RSSetState(state);
+	frameStats.Bindings++;
+}
+
+void D3D11Renderer::SetDepthStencilState(ID3D11DepthStencilState* state)
+{
+	context->OMSetDepthStencilState(state, 0);
+	frameStats.Bindings++;
+}
+
+void D3D11Renderer::SetBlendState(ID3D11BlendState* state)
+{
+	context->OMSetBlendState(state, 0, 0xffffffff);
+	frameStats.Bindings++;
+}
+
+void D3D11Renderer::SetRenderTarget(ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv)
+{
+	context->OMSetRenderTargets(1, &rtv, dsv);
+	frameStats.Bindings++;
+}
+
+void D3D11Renderer::ClearRenderTarget(ID3D11RenderTargetView* rtv, const float color[4])
+{
+	context->ClearRenderTargetView(rtv, color);
+	frameStats.Clears++;
+}
+
+void D3D11Renderer::ClearDepth(ID3D11DepthStencilView* dsv, float depth)
+{
+	context->ClearDepthStencilView(dsv, D3D11_CLEAR_DEPTH, depth, 0);
+	frameStats.Clears++;
+}
+
+void D3D11Renderer::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	context->Draw(vertexCount, startVertex);
+	frameStats.DrawCalls++;
+	frameStats.VerticesDrawn += vertexCount;
+}
+
+void D3D11Renderer::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	context->DrawIndexed(indexCount, startIndex, baseVertex);
+	frameStats.DrawCalls++;
+	frameStats.IndicesDrawn += indexCount;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+#include "Renderer.h"
+
+// --------------------------------------------------------
+// Forwards renderer commands to a Direct3D 11 context
+// --------------------------------------------------------
+class D3D11Renderer : public IRenderer
+{
+public:
+	D3D11Renderer(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	bool CanNoOverwriteAcrossFrames() { return noOverwriteAcrossFrames; }
+
+	bool WriteBufferRanges(ID3D11Buffer* buffer, RenderMapType mapType, const RenderBufferRange* ranges, unsigned int rangeCount);
+	void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size);
+
+	void SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride);
+	void SetIndexBuffer(ID3D11Buffer* buffer);
+
+	void SetVertexShader(ID3D11VertexShader* shader, ID3D11InputLayout* inputLayout);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetConstantBuffer(RenderShaderStage stage, unsigned int slot, ID3D11Buffer* buffer);
+	void SetShaderResource(RenderShaderStage stage, unsigned int slot, ID3D11ShaderResourceView* srv);
+	void SetSampler(RenderShaderStage stage, unsigned int slot, ID3D11SamplerState* sampler);
+
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetDepthStencilState(ID3D11DepthStencilState* state);
+	void SetBlendState(ID3D11BlendState* state);
+
+	void SetRenderTarget(ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv);
+	void ClearRenderTarget(ID3D11RenderTargetView* rtv, const float color[4]);
+	void ClearDepth(ID3D11DepthStencilView* dsv, float depth);
+
+	void Draw(unsigned int vertexCount, unsigned int startVertex);
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	bool noOverwriteAcrossFrames;
+};
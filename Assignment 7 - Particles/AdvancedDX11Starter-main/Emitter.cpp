@@ -1,9 +1,50 @@
 #include "Emitter.h"
 
+#include <float.h>
+#include <math.h>
+
 using namespace DirectX;
 
+Emitter::AllocationCounts Emitter::allocationCounts;
+
+namespace
+{
+	void GrowBox(XMFLOAT3& boxMin, XMFLOAT3& boxMax, const XMFLOAT3& point)
+	{
+		boxMin.x = fminf(boxMin.x, point.x); boxMax.x = fmaxf(boxMax.x, point.x);
+		boxMin.y = fminf(boxMin.y, point.y); boxMax.y = fmaxf(boxMax.y, point.y);
+		boxMin.z = fminf(boxMin.z, point.z); boxMax.z = fmaxf(boxMax.z, point.z);
+	}
+
+	// Range of v * t + a * t^2 / 2 for any v in [vMin, vMax] and
+	// t in [0, life].  It's linear in v, so only the ends of that
+	// range matter, and each parabola peaks at t = -v / a.
+	void DisplacementRange(float vMin, float vMax, float a, float life, float& outMin, float& outMax)
+	{
+		outMin = 0.0f;
+		outMax = 0.0f;
+		float v[2] = { vMin, vMax };
+		for (int i = 0; i < 2; i++)
+		{
+			float end = v[i] * life + 0.5f * a * life * life;
+			outMin = fminf(outMin, end);
+			outMax = fmaxf(outMax, end);
+
+			float apexTime = a != 0.0f ? -v[i] / a : 0.0f;
+			if (apexTime > 0.0f && apexTime < life)
+			{
+				float apex = v[i] * apexTime + 0.5f * a * apexTime * apexTime;
+				outMin = fminf(outMin, apex);
+				outMax = fmaxf(outMax, apex);
+			}
+		}
+	}
+}
+
 Emitter::Emitter(
 	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	std::shared_ptr<IRenderer> renderer,
+	unsigned int seed,
 	std::shared_ptr<Material> material,
 	int maxParticles,
 	int particlesPerSecond,
@@ -15,9 +56,11 @@ Emitter::Emitter(
 	bool isBox,
 	DirectX::XMFLOAT3 emitterPosition,
 	DirectX::XMFLOAT3 startVelocity,
-	DirectX::XMFLOAT3 acceleration) 
+	DirectX::XMFLOAT3 acceleration,
+	std::shared_ptr<ParticleArena> arena)
 	:
 	device(device),
+	renderer(renderer),
 	material(material),
 	maxParticles(maxParticles),
 	particlesPerSecond(particlesPerSecond),
@@ -29,50 +72,58 @@ Emitter::Emitter(
 	isBox(isBox),
 	startVelocity(startVelocity),
 	acceleration(acceleration),
-	particles(0)
+	simulate(false),
+	sizeVariance(0.0f),
+	priority(1.0f),
+	budgetRateScale(1.0f),
+	budgetLifetimeScale(1.0f),
+	paused(false),
+	frustumCulling(true),
+	deltaUploads(true),
+	sortParticles(false),
+	sortInterval(1),
+	alphaBlend(false),
+	particles(0),
+	arena(arena)
 {
-	secondsPerParticle = 1.0f / particlesPerSecond;
+	// Burst emitters don't emit on their own
+	secondsPerParticle = particlesPerSecond > 0 ? 1.0f / particlesPerSecond : FLT_MAX;
+	allocationCounts.EmittersCreated++;
 
-	timeSinceLastEmit = 0.0f;
-	numLiving = 0;
-	firstAliveIndex = 0;
-	firstDeadIndex = 0;
+	SetRandomSeed(seed);
+
+	ResetState();
+
+	// Delta uploads leave the ring bound between frames and keep
+	// writing into it, which needs an 11.1 runtime and driver support
+	canWriteNoOverwrite = renderer->CanNoOverwriteAcrossFrames();
 
 	this->transform.SetPosition(emitterPosition);
 
 	
 	if (particles) delete[] particles;
-	indexBuffer.Reset();
 	particleDataBuffer.Reset();
 	particleDataSRV.Reset();
 
 	
-	particles = new Particle[maxParticles];
-	ZeroMemory(particles, sizeof(Particle) * maxParticles);
+	// Pooled emitters take their particles from an arena, unless
+	// there are too many for any of its classes
+	if (this->arena && maxParticles > ParticleArena::MaxCapacity)
+		this->arena.reset();
+	if (this->arena)
+	{
+		particles = this->arena->Allocate(ParticleArena::GetCapacityClass(maxParticles));
+	}
+	else
+	{
+		particles = new Particle[maxParticles];
+		ZeroMemory(particles, sizeof(Particle) * maxParticles);
+		allocationCounts.ParticleArrays++;
+	}
 
-	
-	int numIndices = maxParticles * 6;
-	unsigned int* indices = new unsigned int[numIndices];
-	int indexCount = 0;
-	for (int i = 0; i < maxParticles * 4; i += 4)
-	{
-		indices[indexCount++] = i;
-		indices[indexCount++] = i + 1;
-		indices[indexCount++] = i + 2;
-		indices[indexCount++] = i;
-		indices[indexCount++] = i + 2;
-		indices[indexCount++] = i + 3;
-	}
-	D3D11_SUBRESOURCE_DATA indexData = {};
-	indexData.pSysMem = indices;
-
-	D3D11_BUFFER_DESC ibDesc = {};
-	ibDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibDesc.CPUAccessFlags = 0;
-	ibDesc.Usage = D3D11_USAGE_DEFAULT;
-	ibDesc.ByteWidth = sizeof(unsigned int) * maxParticles * 6;
-	device->CreateBuffer(&ibDesc, &indexData, indexBuffer.GetAddressOf());
-	delete[] indices; 
+	// Unsorted particles all share the same quad indices
+	quadIndices = QuadIndexBuffer::GetShared(device, renderer);
+	quadIndices->Reserve(maxParticles);
 
 	
 	D3D11_BUFFER_DESC allParticleBufferDesc = {};
@@ -83,6 +134,8 @@ Emitter::Emitter(
 	allParticleBufferDesc.StructureByteStride = sizeof(Particle);
 	allParticleBufferDesc.ByteWidth = sizeof(Particle) * maxParticles;
 	device->CreateBuffer(&allParticleBufferDesc, 0, particleDataBuffer.GetAddressOf());
+	allocationCounts.GpuResources++;
+	renderer->DescribeBuffer(particleDataBuffer.Get(), allParticleBufferDesc.ByteWidth, true);
 
 	
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
@@ -91,11 +144,171 @@ Emitter::Emitter(
 	srvDesc.Buffer.FirstElement = 0;
 	srvDesc.Buffer.NumElements = maxParticles;
 	device->CreateShaderResourceView(particleDataBuffer.Get(), &srvDesc, particleDataSRV.GetAddressOf());
+	allocationCounts.GpuResources++;
+
+	spawnOffsets.resize(maxParticles);
+	spawnAges.resize(maxParticles);
+	spawnSizeScales.resize(maxParticles);
+	spawnVelocities.resize(maxParticles);
+
+	UpdateBounds();
+}
+
+// --------------------------------------------------------
+// Creates or frees the CPU simulation's state and buffer to
+// match the simulate flag.  Analytic emitters never need them,
+// so they're only made once simulation is turned on, starting
+// every living particle from where the analytic path has it
+// at currentTime.  Creates GPU resources, so this has to be
+// called from the main thread, before the update's jobs.
+// --------------------------------------------------------
+void Emitter::PrepareSimulation(float currentTime)
+{
+	bool allocated = simulation.GetCapacity() > 0;
+	if (simulate == allocated)
+		return;
+
+	if (!simulate)
+	{
+		simulation = ParticleSoA();
+		packedParticles = std::vector<SimulatedParticle>();
+		simulatedDataBuffer.Reset();
+		simulatedDataSRV.Reset();
+		neighborX = neighborY = neighborZ = std::vector<float>();
+		neighborVX = neighborVY = neighborVZ = std::vector<float>();
+		return;
+	}
+
+	// Their own state and buffer, since the GPU layout is
+	// completely different from the analytic particles'
+	simulation.Resize(maxParticles);
+	packedParticles.resize(maxParticles);
+
+	D3D11_BUFFER_DESC simBufferDesc = {};
+	simBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	simBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	simBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	simBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	simBufferDesc.StructureByteStride = sizeof(SimulatedParticle);
+	simBufferDesc.ByteWidth = sizeof(SimulatedParticle) * maxParticles;
+	device->CreateBuffer(&simBufferDesc, 0, simulatedDataBuffer.GetAddressOf());
+	renderer->DescribeBuffer(simulatedDataBuffer.Get(), simBufferDesc.ByteWidth, true);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = maxParticles;
+	device->CreateShaderResourceView(simulatedDataBuffer.Get(), &srvDesc, simulatedDataSRV.GetAddressOf());
+	allocationCounts.GpuResources += 2;
+
+	for (int n = 0; n < numLiving; n++)
+	{
+		int i = (firstAliveIndex + n) % maxParticles;
+		float age = currentTime - particles[i].EmitTime;
+		SpawnSimulated(i, age > 0.0f ? age : 0.0f, 1.0f);
+	}
+}
+
+// --------------------------------------------------------
+// Creates or frees the sorting storage (the depth arrays and
+// keys, the sorter's scratch space and the sorted index
+// buffer) to match the sortParticles flag.  Called by
+// SortParticles(), which always runs on the main thread.
+// --------------------------------------------------------
+void Emitter::PrepareSorting()
+{
+	bool allocated = sortedIndexBuffer.Get() != 0;
+	if (sortParticles == allocated)
+		return;
+
+	if (!sortParticles)
+	{
+		sorter = ParticleSorter();
+		depthX = depthY = depthZ = std::vector<float>();
+		depthKeys = std::vector<unsigned int>();
+		sortedSequence = std::vector<long long>();
+		sortedIndices = std::vector<unsigned int>();
+		sortedIndexBuffer.Reset();
+		return;
+	}
+
+	// Positions are evaluated four at a time, so the depth
+	// arrays are padded out to a multiple of four
+	int paddedCount = (maxParticles + 3) & ~3;
+	int numIndices = maxParticles * 6;
+	depthX.resize(paddedCount);
+	depthY.resize(paddedCount);
+	depthZ.resize(paddedCount);
+	depthKeys.resize(maxParticles);
+	sortedSequence.reserve(maxParticles);
+	sortedIndices.resize(numIndices);
+
+	// Sorted particles are drawn with their own, dynamic index buffer
+	D3D11_BUFFER_DESC sortedIBDesc = {};
+	sortedIBDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	sortedIBDesc.Usage = D3D11_USAGE_DYNAMIC;
+	sortedIBDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	sortedIBDesc.ByteWidth = sizeof(unsigned int) * numIndices;
+	device->CreateBuffer(&sortedIBDesc, 0, sortedIndexBuffer.GetAddressOf());
+	allocationCounts.GpuResources++;
+	renderer->DescribeBuffer(sortedIndexBuffer.Get(), sortedIBDesc.ByteWidth, true);
+	framesSinceSort = 0;
 }
 
 Emitter::~Emitter()
 {
-	delete[] particles;
+	if (arena)
+		arena->Free(particles, ParticleArena::GetCapacityClass(maxParticles));
+	else
+		delete[] particles;
+}
+
+// --------------------------------------------------------
+// Clears out every particle, along with everything that
+// tracks them (uploads, sorting, bounds and the budget)
+// --------------------------------------------------------
+void Emitter::ResetState()
+{
+	timeSinceLastEmit = 0.0f;
+	numLiving = 0;
+	firstAliveIndex = 0;
+	firstDeadIndex = 0;
+	spawnCount = 0;
+	uploadedSpawnCount = 0;
+	uploadFrame = 0;
+	for (int i = 0; i < FramesInFlight; i++)
+		inFlightRetired[i] = 0;
+	ringUploaded = false;
+	sortedSequence.clear();
+	sortedSpawnCount = 0;
+	framesSinceSort = 0;
+	boundsEpochStart = 0;
+	spawnBounds[0].Empty = true;
+	spawnBounds[1].Empty = true;
+	budgetRateScale = 1.0f;
+	budgetLifetimeScale = 1.0f;
+	paused = false;
+}
+
+// --------------------------------------------------------
+// Starts the emitter over with a new material and rate.  The
+// next upload discards the old GPU contents, so the buffers
+// are safe to reuse even if they're still in flight.
+// --------------------------------------------------------
+void Emitter::Reset(std::shared_ptr<Material> material, int particlesPerSecond)
+{
+	this->material = material;
+	this->particlesPerSecond = particlesPerSecond;
+	secondsPerParticle = particlesPerSecond > 0 ? 1.0f / particlesPerSecond : FLT_MAX;
+
+	ResetState();
+	UpdateBounds();
+}
+
+const Emitter::AllocationCounts& Emitter::GetAllocationCounts()
+{
+	return allocationCounts;
 }
 
 Transform* Emitter::GetTransform() 
@@ -107,123 +320,646 @@ std::shared_ptr<Material> Emitter::GetMaterial()
 	return material; 
 }
 
+void Emitter::SetSimulationShader(std::shared_ptr<SimpleVertexShader> vs)
+{
+	simulationVS = vs;
+}
+
+ParticleSoA* Emitter::GetSimulation()
+{
+	return &simulation;
+}
+
+// --------------------------------------------------------
+// Are the particles drawn from the CPU simulation?  That
+// takes a simulation shader, as well as the state itself.
+// --------------------------------------------------------
+bool Emitter::IsSimulated()
+{
+	return simulate && simulationVS && simulation.GetCapacity() > 0;
+}
+
+ParticleInteraction* Emitter::GetInteraction()
+{
+	return &interaction;
+}
+
+int Emitter::GetLivingCount()
+{
+	return numLiving;
+}
+
+int Emitter::GetMaxParticles()
+{
+	return maxParticles;
+}
+
+// --------------------------------------------------------
+// How many particles this emitter keeps alive when it runs
+// at full rate, with its lifetime scaled by lifetimeScale
+// --------------------------------------------------------
+float Emitter::GetParticleDemand(float lifetimeScale)
+{
+	float demand = particlesPerSecond * lifetime * lifetimeScale;
+	return demand < maxParticles ? demand : (float)maxParticles;
+}
+
+float Emitter::GetCurrentLifetime()
+{
+	return lifetime * budgetLifetimeScale;
+}
+
+float Emitter::GetBudgetRateScale()
+{
+	return budgetRateScale;
+}
+
+float Emitter::GetBudgetLifetimeScale()
+{
+	return budgetLifetimeScale;
+}
+
+bool Emitter::IsPaused()
+{
+	return paused;
+}
+
+// --------------------------------------------------------
+// Bytes reserved per particle, on the CPU and the GPU, with
+// or without the CPU simulation's and the sorting's storage
+// --------------------------------------------------------
+unsigned long long Emitter::GetBytesPerParticle(bool simulated, bool sorted)
+{
+	unsigned long long bytes =
+		sizeof(Particle) * 2 +				// CPU ring and GPU mirror
+		sizeof(XMFLOAT3) * 2 + sizeof(float) * 2;	// Spawn offsets, velocities, ages and size scales
+
+	if (sorted)
+	{
+		bytes +=
+			sizeof(float) * 3 +				// Depth arrays
+			sizeof(unsigned int) * 6 * 2 +	// Sorted CPU and GPU indices (the static ones are shared)
+			sizeof(unsigned int) * 5 +		// Depth keys and the sorter's keys and indices
+			sizeof(long long);				// Sort order
+	}
+
+	if (simulated)
+	{
+		bytes +=
+			sizeof(SimulatedParticle) * 2 +	// Packed copy and its GPU buffer
+			sizeof(float) * 14;				// Simulation arrays
+	}
+	return bytes;
+}
+
+// --------------------------------------------------------
+// Bytes reserved for all of this emitter's particles,
+// whether or not they're alive
+// --------------------------------------------------------
+unsigned long long Emitter::GetMemoryUsage()
+{
+	return GetBytesPerParticle(simulation.GetCapacity() > 0, sortedIndexBuffer.Get() != 0) * maxParticles;
+}
+
+// --------------------------------------------------------
+// Bytes of this emitter's own sorted indices, on the CPU and
+// the GPU.  Unsorted emitters use the shared quad indices.
+// --------------------------------------------------------
+unsigned long long Emitter::GetIndexMemoryUsage()
+{
+	if (!sortedIndexBuffer)
+		return 0;
+	return sizeof(unsigned int) * 6 * 2 * (unsigned long long)maxParticles;
+}
+
+// --------------------------------------------------------
+// Applies the particle budget's decisions
+//  rateScale     - Multiplies the spawn rate
+//  lifetimeScale - Multiplies the particle lifetime
+//  pause         - Stops spawning and drawing (time still passes)
+// --------------------------------------------------------
+void Emitter::SetBudget(float rateScale, float lifetimeScale, bool pause)
+{
+	budgetRateScale = rateScale;
+	budgetLifetimeScale = lifetimeScale;
+	paused = pause;
+}
+
+void Emitter::SetRandomSeed(unsigned int seed)
+{
+	random.Seed(seed);
+}
+
 
 void Emitter::Update(float dt, float currentTime)
 {
-	
-	if (numLiving > 0)
+	PrepareSimulation(currentTime);
+	ApplyInteractions(dt, 0);
+
+	int ranges[2][2];
+	int rangeCount = GetSimulationRanges(ranges);
+	for (int r = 0; r < rangeCount; r++)
+		SimulateRange(ranges[r][0], ranges[r][1], dt, currentTime);
+
+	UpdateLifetimes(dt, currentTime);
+}
+
+// --------------------------------------------------------
+// Adds forces between neighboring simulated particles to
+// their velocities.  The living particles are gathered into
+// plain arrays, which the interaction spreads over the job
+// system itself - so unlike the rest of the update, this must
+// not be called from inside a job.
+// --------------------------------------------------------
+void Emitter::ApplyInteractions(float dt, JobSystem* jobs)
+{
+	if (!simulate || !simulationVS || paused || numLiving < 2 || simulation.GetCapacity() == 0 ||
+		forces.Interaction.Mode == ParticleInteractionMode::None)
+		return;
+
+	if (neighborX.size() < (size_t)numLiving)
 	{
-		
-		if (firstAliveIndex < firstDeadIndex)
-		{
-			
-			for (int i = firstAliveIndex; i < firstDeadIndex; i++)
-				UpdateParticle(currentTime, i);
-		}
-		else if (firstDeadIndex < firstAliveIndex)
-		{
-			
-			for (int i = firstAliveIndex; i < maxParticles; i++)
-				UpdateParticle(currentTime, i);
+		neighborX.resize(maxParticles);
+		neighborY.resize(maxParticles);
+		neighborZ.resize(maxParticles);
+		neighborVX.resize(maxParticles);
+		neighborVY.resize(maxParticles);
+		neighborVZ.resize(maxParticles);
+	}
 
-			
-			for (int i = 0; i < firstDeadIndex; i++)
-				UpdateParticle(currentTime, i);
-		}
-		else
-		{
-			
-			for (int i = 0; i < maxParticles; i++)
-				UpdateParticle(currentTime, i);
-		}
+	for (int n = 0; n < numLiving; n++)
+	{
+		int i = (firstAliveIndex + n) % maxParticles;
+		neighborX[n] = simulation.PositionX[i];
+		neighborY[n] = simulation.PositionY[i];
+		neighborZ[n] = simulation.PositionZ[i];
+		neighborVX[n] = simulation.VelocityX[i];
+		neighborVY[n] = simulation.VelocityY[i];
+		neighborVZ[n] = simulation.VelocityZ[i];
 	}
 
-	
-	timeSinceLastEmit += dt;
+	interaction.Apply(
+		neighborX.data(), neighborY.data(), neighborZ.data(),
+		neighborVX.data(), neighborVY.data(), neighborVZ.data(),
+		numLiving,
+		forces.Interaction,
+		dt,
+		jobs);
 
-	while (timeSinceLastEmit > secondsPerParticle)
+	for (int n = 0; n < numLiving; n++)
 	{
-		SpawnParticle(currentTime);
-		timeSinceLastEmit -= secondsPerParticle;
+		int i = (firstAliveIndex + n) % maxParticles;
+		simulation.VelocityX[i] = neighborVX[n];
+		simulation.VelocityY[i] = neighborVY[n];
+		simulation.VelocityZ[i] = neighborVZ[n];
 	}
 }
 
-
-void Emitter::UpdateParticle(float currentTime, int index)
+// --------------------------------------------------------
+// Steps the CPU simulation for particles [start, end), which
+// should come from GetSimulationRanges().  Ranges don't share
+// any data, so they can be simulated on different threads.
+// --------------------------------------------------------
+void Emitter::SimulateRange(int start, int end, float dt, float currentTime)
 {
-	float age = currentTime - particles[index].EmitTime;
+	simulation.Simulate(start, end, acceleration, forces, currentTime, dt);
+	simulation.UpdateAppearance(start, end, startSize, endSize, startColor, endColor);
+}
 
-	
-	if (age >= lifetime)
+// --------------------------------------------------------
+// Retires old particles, spawns new ones and updates the
+// bounds.  This only touches this emitter (including its
+// random numbers), so different emitters can be updated on
+// different threads.
+// --------------------------------------------------------
+void Emitter::UpdateLifetimes(float dt, float currentTime)
+{
+	// Particles leave the ring oldest first.  Each one keeps the
+	// lifetime it spawned with, so if the budget has shortened
+	// lifetimes since, a newer particle can expire while an older
+	// one is still alive - it stays in the ring (but isn't drawn)
+	// until everything ahead of it has died.
+	while (numLiving > 0)
 	{
-		
+		const Particle& oldest = particles[firstAliveIndex];
+		if (currentTime - oldest.EmitTime < oldest.Lifetime)
+			break;
+
 		firstAliveIndex++;
 		firstAliveIndex %= maxParticles;
 		numLiving--;
 	}
+
+
+	EmitParticles(dt, currentTime);
+	UpdateBounds();
 }
 
-void Emitter::SpawnParticle(float currentTime)
+// --------------------------------------------------------
+// Spawns however many particles are due since the last update
+// --------------------------------------------------------
+void Emitter::EmitParticles(float dt, float currentTime)
+{
+	// A budget of zero means nothing would have spawned at all
+	if (budgetRateScale <= 0.0f)
+	{
+		timeSinceLastEmit = 0.0f;
+		return;
+	}
+
+	// While paused, time keeps adding up so that everything the
+	// emitter missed can be spawned (already aged) on resuming
+	timeSinceLastEmit += dt;
+	if (paused)
+		return;
+
+	// Particles that would already be dead, or that wouldn't fit
+	// even in an empty buffer, are skipped outright (oldest first)
+	float spawnInterval = secondsPerParticle / budgetRateScale;
+	float currentLifetime = GetCurrentLifetime();
+	if (timeSinceLastEmit > currentLifetime + spawnInterval)
+	{
+		int skipped = (int)((timeSinceLastEmit - currentLifetime) / spawnInterval);
+		timeSinceLastEmit -= skipped * spawnInterval;
+	}
+
+	int pendingCount = (int)(timeSinceLastEmit / spawnInterval);
+	if (pendingCount > maxParticles)
+		timeSinceLastEmit -= (pendingCount - maxParticles) * spawnInterval;
+
+	// Particles due this frame spawn fresh, as they always have.
+	// Only ones that were due before it (while the emitter was
+	// paused) spawn already aged, by how long ago that was.
+	int newCount = 0;
+	while (timeSinceLastEmit > spawnInterval && newCount < maxParticles)
+	{
+		timeSinceLastEmit -= spawnInterval;
+		spawnAges[newCount++] = timeSinceLastEmit > dt ? timeSinceLastEmit - dt : 0.0f;
+	}
+
+	// Anything past a full buffer wouldn't spawn anyway, and
+	// the oldest ones would die first, so keep the newest
+	int freeCount = maxParticles - numLiving;
+	int firstNew = newCount > freeCount ? newCount - freeCount : 0;
+	newCount -= firstNew;
+
+	// Random offsets for the whole batch at once - box emitters
+	// spread their particles up to 2 units from the center
+	if (isBox)
+		random.FillBox(spawnOffsets.data(), newCount, XMFLOAT3(0, 0, 0), XMFLOAT3(2, 2, 2));
+	bool scaled = FillSizeScales(newCount);
+
+	for (int i = 0; i < newCount; i++)
+	{
+		float age = spawnAges[firstNew + i];
+		SpawnParticle(currentTime - age, age, isBox ? spawnOffsets[i] : XMFLOAT3(0, 0, 0), startVelocity, scaled ? spawnSizeScales[i] : 1.0f);
+	}
+}
+
+// --------------------------------------------------------
+// Spawns up to count particles all at once (as many as fit)
+// --------------------------------------------------------
+void Emitter::EmitBurst(int count, float speed, float currentTime)
+{
+	int freeCount = maxParticles - numLiving;
+	if (count > freeCount)
+		count = freeCount;
+	if (count <= 0)
+		return;
+
+	if (isBox)
+		random.FillBox(spawnOffsets.data(), count, XMFLOAT3(0, 0, 0), XMFLOAT3(2, 2, 2));
+	random.FillSphere(spawnVelocities.data(), count, startVelocity, speed);
+	bool scaled = FillSizeScales(count);
+
+	for (int i = 0; i < count; i++)
+		SpawnParticle(currentTime, 0.0f, isBox ? spawnOffsets[i] : XMFLOAT3(0, 0, 0), spawnVelocities[i], scaled ? spawnSizeScales[i] : 1.0f);
+
+	UpdateBounds();
+}
+
+
+// --------------------------------------------------------
+// Picks random size scales for the next count simulated
+// particles.  Returns false (without using any random numbers,
+// so analytic emitters see the same sequence as before) if
+// every particle should just be scale 1.
+// --------------------------------------------------------
+bool Emitter::FillSizeScales(int count)
+{
+	if (!simulate || sizeVariance <= 0.0f)
+		return false;
+
+	random.FillUniform(spawnSizeScales.data(), count, 1.0f - sizeVariance, 1.0f + sizeVariance);
+	return true;
+}
+
+// --------------------------------------------------------
+// Adds a particle that was emitted at emitTime, which is age
+// seconds before the current time.  Only simulated particles
+// use the size scale.
+// --------------------------------------------------------
+void Emitter::SpawnParticle(float emitTime, float age, XMFLOAT3 offset, XMFLOAT3 velocity, float sizeScale)
 {
 	if (numLiving == maxParticles)
 		return;
 
 	int spawnIndex = firstDeadIndex;
 
-	particles[spawnIndex].EmitTime = currentTime;
+	particles[spawnIndex].EmitTime = emitTime;
 	particles[spawnIndex].StartPosition = transform.GetPosition();
+	particles[spawnIndex].StartPosition.x += offset.x;
+	particles[spawnIndex].StartPosition.y += offset.y;
+	particles[spawnIndex].StartPosition.z += offset.z;
 
-	// if is box then the start position needs to be moved randomly in a box
-	if (isBox)
+	
+	particles[spawnIndex].StartVelocity = velocity;
+	particles[spawnIndex].Lifetime = GetCurrentLifetime();
+
+	SpawnBounds& bounds = spawnBounds[1];
+	if (bounds.Empty)
 	{
-		int max = 2;
-		int min = -2;
-		particles[spawnIndex].StartPosition.x += ((float)rand() / RAND_MAX * (max - min) + min);
-		particles[spawnIndex].StartPosition.y += ((float)rand() / RAND_MAX * (max - min) + min);
-		particles[spawnIndex].StartPosition.z += ((float)rand() / RAND_MAX * (max - min) + min);
+		bounds.PositionMin = bounds.PositionMax = particles[spawnIndex].StartPosition;
+		bounds.VelocityMin = bounds.VelocityMax = velocity;
+		bounds.LifetimeMax = particles[spawnIndex].Lifetime;
+		bounds.Empty = false;
 	}
-	
+	GrowBox(bounds.PositionMin, bounds.PositionMax, particles[spawnIndex].StartPosition);
+	GrowBox(bounds.VelocityMin, bounds.VelocityMax, velocity);
+	bounds.LifetimeMax = fmaxf(bounds.LifetimeMax, particles[spawnIndex].Lifetime);
 
-	
-	particles[spawnIndex].StartVelocity = startVelocity;
+	if (simulation.GetCapacity() > 0)
+		SpawnSimulated(spawnIndex, age, sizeScale);
 
 	firstDeadIndex++;
 	firstDeadIndex %= maxParticles; 
 
 	numLiving++;
+	spawnCount++;
 }
 
-void Emitter::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera, float currentTime)
+// --------------------------------------------------------
+// Starts the simulated state of the particle in ring slot
+// index.  Particles that start part way through their life
+// are moved along ballistically to catch up.
+// --------------------------------------------------------
+void Emitter::SpawnSimulated(int index, float age, float sizeScale)
 {
-	D3D11_MAPPED_SUBRESOURCE mapped = {};
-	context->Map(particleDataBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	XMFLOAT3 position = particles[index].StartPosition;
+	XMFLOAT3 velocity = particles[index].StartVelocity;
+	if (age > 0.0f)
+	{
+		position.x += (velocity.x + acceleration.x * age * 0.5f) * age;
+		position.y += (velocity.y + acceleration.y * age * 0.5f) * age;
+		position.z += (velocity.z + acceleration.z * age * 0.5f) * age;
+		velocity.x += acceleration.x * age;
+		velocity.y += acceleration.y * age;
+		velocity.z += acceleration.z * age;
+	}
+	simulation.Spawn(index, position, velocity, particles[index].Lifetime, sizeScale);
+	simulation.Age[index] = age;
+	simulation.Size[index] = startSize * sizeScale;
+	simulation.ColorR[index] = startColor.x;
+	simulation.ColorG[index] = startColor.y;
+	simulation.ColorB[index] = startColor.z;
+	simulation.ColorA[index] = startColor.w;
+}
+
+// --------------------------------------------------------
+// Billboard corners sit up to sqrt(2) * size from the center
+// of the particle, and every shader uses the emitter's sizes
+// (times the random scale, for simulated particles)
+// --------------------------------------------------------
+float Emitter::GetBillboardRadius()
+{
+	float size = fmaxf(fabsf(startSize), fabsf(endSize));
+	if (IsSimulated() && sizeVariance > 0.0f)
+		size *= 1.0f + sizeVariance;
+	return 1.41421356f * size;
+}
+
+// --------------------------------------------------------
+// Recalculates the bounds after particles are spawned
+//
+// Analytic particles follow p + v * t + a * t^2 / 2 for t up
+// to the lifetime, so the bounds are the spawn positions
+// pushed out by the range of that motion.  Simulated particles
+// aren't closed form, so their current positions are used.
+// --------------------------------------------------------
+void Emitter::UpdateBounds()
+{
+	// Once everything from the older epoch has died it's no longer
+	// needed, and the current epoch becomes the older one
+	if (spawnCount - numLiving >= boundsEpochStart)
+	{
+		spawnBounds[0] = spawnBounds[1];
+		spawnBounds[1].Empty = true;
+		boundsEpochStart = spawnCount;
+	}
+
+	// A particle spawned right now, anywhere in the spawn volume
+	// - box emitters spread their particles up to 2 units out
+	float jitter = isBox ? 2.0f : 0.0f;
+	XMFLOAT3 center = transform.GetPosition();
+	SpawnBounds next;
+	next.PositionMin = XMFLOAT3(center.x - jitter, center.y - jitter, center.z - jitter);
+	next.PositionMax = XMFLOAT3(center.x + jitter, center.y + jitter, center.z + jitter);
+	next.VelocityMin = startVelocity;
+	next.VelocityMax = startVelocity;
+	next.LifetimeMax = GetCurrentLifetime();
+	next.Empty = false;
+
+	bool simulated = IsSimulated();
+	const SpawnBounds* sources[3] = { &next, &spawnBounds[0], &spawnBounds[1] };
+	int sourceCount = simulated ? 1 : 3;
+
+	boundsMin = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	boundsMax = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int s = 0; s < sourceCount; s++)
+	{
+		const SpawnBounds& b = *sources[s];
+		if (b.Empty)
+			continue;
+
+		// Each epoch moves for as long as its longest lived particle
+		XMFLOAT3 dMin, dMax;
+		DisplacementRange(b.VelocityMin.x, b.VelocityMax.x, acceleration.x, b.LifetimeMax, dMin.x, dMax.x);
+		DisplacementRange(b.VelocityMin.y, b.VelocityMax.y, acceleration.y, b.LifetimeMax, dMin.y, dMax.y);
+		DisplacementRange(b.VelocityMin.z, b.VelocityMax.z, acceleration.z, b.LifetimeMax, dMin.z, dMax.z);
+		GrowBox(boundsMin, boundsMax, XMFLOAT3(b.PositionMin.x + dMin.x, b.PositionMin.y + dMin.y, b.PositionMin.z + dMin.z));
+		GrowBox(boundsMin, boundsMax, XMFLOAT3(b.PositionMax.x + dMax.x, b.PositionMax.y + dMax.y, b.PositionMax.z + dMax.z));
+	}
 
+	if (simulated)
+	{
+		for (int n = 0; n < numLiving; n++)
+		{
+			int i = (firstAliveIndex + n) % maxParticles;
+			GrowBox(boundsMin, boundsMax, XMFLOAT3(simulation.PositionX[i], simulation.PositionY[i], simulation.PositionZ[i]));
+		}
+	}
+
+	float pad = GetBillboardRadius();
+	boundsMin = XMFLOAT3(boundsMin.x - pad, boundsMin.y - pad, boundsMin.z - pad);
+	boundsMax = XMFLOAT3(boundsMax.x + pad, boundsMax.y + pad, boundsMax.z + pad);
+}
+
+void Emitter::GetBounds(XMFLOAT3& boundsMin, XMFLOAT3& boundsMax)
+{
+	boundsMin = this->boundsMin;
+	boundsMax = this->boundsMax;
+}
+
+bool Emitter::IsVisible(std::shared_ptr<Camera> camera)
+{
+	return !frustumCulling || camera->IsBoxVisible(boundsMin, boundsMax);
+}
+
+// --------------------------------------------------------
+// Checks the bounds against every living particle, placed
+// exactly where the vertex shader puts it.  Returns how many
+// billboards poke outside (which should always be zero).
+// --------------------------------------------------------
+int Emitter::CountParticlesOutsideBounds(float currentTime)
+{
+	bool simulated = IsSimulated();
+	float pad = GetBillboardRadius();
+
+	int outside = 0;
+	for (int n = 0; n < numLiving; n++)
+	{
+		int i = (firstAliveIndex + n) % maxParticles;
+
+		XMFLOAT3 pos;
+		if (simulated)
+		{
+			pos = XMFLOAT3(simulation.PositionX[i], simulation.PositionY[i], simulation.PositionZ[i]);
+		}
+		else
+		{
+			// Expired particles waiting to leave the ring aren't drawn
+			const Particle& p = particles[i];
+			float age = currentTime - p.EmitTime;
+			if (age >= p.Lifetime)
+				continue;
+
+			pos.x = acceleration.x * age * age / 2.0f + p.StartVelocity.x * age + p.StartPosition.x;
+			pos.y = acceleration.y * age * age / 2.0f + p.StartVelocity.y * age + p.StartPosition.y;
+			pos.z = acceleration.z * age * age / 2.0f + p.StartVelocity.z * age + p.StartPosition.z;
+		}
+
+		// Allow for rounding differences in the two calculations
+		float tolerance = 0.0001f * (1.0f + fabsf(pos.x) + fabsf(pos.y) + fabsf(pos.z));
+		if (pos.x - pad < boundsMin.x - tolerance || pos.x + pad > boundsMax.x + tolerance ||
+			pos.y - pad < boundsMin.y - tolerance || pos.y + pad > boundsMax.y + tolerance ||
+			pos.z - pad < boundsMin.z - tolerance || pos.z + pad > boundsMax.z + tolerance)
+			outside++;
+	}
+	return outside;
+}
+
+// --------------------------------------------------------
+// Gets the living part of the ring buffer as at most two
+// [start, end) ranges, widened to whole groups of four for
+// the SIMD kernels without ever overlapping each other.
+// Returns no ranges if this emitter isn't simulating.
+// --------------------------------------------------------
+int Emitter::GetSimulationRanges(int ranges[2][2])
+{
+	int capacity = simulation.GetCapacity();
+	int aliveGroup = firstAliveIndex & ~3;
+	int deadGroup = (firstDeadIndex + 3) & ~3;
+
+	if (!simulate || paused || numLiving == 0 || capacity == 0)
+		return 0;
+
+	// Everything is alive
+	if (numLiving == maxParticles)
+	{
+		ranges[0][0] = 0;
+		ranges[0][1] = capacity;
+		return 1;
+	}
+
+	// One contiguous range
 	if (firstAliveIndex < firstDeadIndex)
 	{
-		memcpy(
-			mapped.pData,
-			particles + firstAliveIndex,
-			sizeof(Particle) * numLiving);
+		ranges[0][0] = aliveGroup;
+		ranges[0][1] = deadGroup;
+		return 1;
 	}
-	else
+
+	// Wrapped around - the start of the buffer, then the end,
+	// which may share a group with the first range
+	ranges[0][0] = 0;
+	ranges[0][1] = deadGroup;
+	ranges[1][0] = aliveGroup > deadGroup ? aliveGroup : deadGroup;
+	ranges[1][1] = capacity;
+	return ranges[1][0] < ranges[1][1] ? 2 : 1;
+}
+
+// --------------------------------------------------------
+// Can this emitter be drawn as part of a batch?  Simulated
+// and sorted particles need their own data and order.
+// --------------------------------------------------------
+bool Emitter::CanBatch()
+{
+	return !alphaBlend && !IsSimulated() && !sortParticles;
+}
+
+// --------------------------------------------------------
+// Copies the living particles, oldest first, tagged with the
+// index of this emitter's parameters in the batch
+// --------------------------------------------------------
+int Emitter::CopyBatchParticles(BatchedParticle* out, unsigned int emitterIndex)
+{
+	for (int n = 0; n < numLiving; n++)
 	{
-		memcpy(
-			mapped.pData, 
-			particles, 
-			sizeof(Particle) * firstDeadIndex);
-		memcpy(
-			(void*)((Particle*)mapped.pData + firstDeadIndex),
-			particles + firstAliveIndex, 
-			sizeof(Particle) * (maxParticles - firstAliveIndex)); 
+		const Particle& p = particles[(firstAliveIndex + n) % maxParticles];
+		out[n].EmitTime = p.EmitTime;
+		out[n].StartPosition = p.StartPosition;
+		out[n].StartVelocity = p.StartVelocity;
+		out[n].EmitterIndex = emitterIndex;
+		out[n].Lifetime = p.Lifetime;
 	}
+	return numLiving;
+}
+
+BatchedEmitter Emitter::GetBatchParameters()
+{
+	BatchedEmitter params = {};
+	params.StartColor = startColor;
+	params.EndColor = endColor;
+	params.Acceleration = acceleration;
+	params.StartSize = startSize;
+	params.EndSize = endSize;
+	return params;
+}
+
+bool Emitter::Draw(std::shared_ptr<Camera> camera, float currentTime)
+{
+	// Paused emitters are off screen, and culled ones skip
+	// their uploads as well as the draw itself
+	if (paused || !IsVisible(camera))
+		return false;
+
+	if (IsSimulated())
+	{
+		DrawSimulated(camera);
+		return true;
+	}
+
+	// Whatever is in the ring after a failed map can't be drawn
+	if (!UploadParticles())
+		return false;
 
-	context->Unmap(particleDataBuffer.Get(), 0);
+	// Sorted indices point straight at ring slots, while the
+	// regular ones count from the oldest living particle
+	ID3D11Buffer* indices = PrepareIndexBuffer(false);
+	bool sorted = indices != quadIndices->GetBuffer();
 
-	UINT stride = 0;
-	UINT offset = 0;
-	ID3D11Buffer* nullBuffer = 0;
-	context->IASetVertexBuffers(0, 1, &nullBuffer, &stride, &offset);
-	context->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	renderer->SetVertexBuffer(0, 0);
+	renderer->SetIndexBuffer(indices);
 
 	material->PrepareMaterial(&transform, camera);
 
@@ -231,19 +967,280 @@ void Emitter::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::sha
 	vs->SetMatrix4x4("view", camera->GetView());
 	vs->SetMatrix4x4("projection", camera->GetProjection());
 	vs->SetFloat("currentTime", currentTime);
-	vs->SetFloat("lifetime", lifetime);
 	vs->SetFloat3("acceleration", acceleration);
 	vs->SetFloat("startSize", startSize);
 	vs->SetFloat("endSize", endSize);
 	vs->SetFloat4("startColor", startColor);
 	vs->SetFloat4("endColor", endColor);
+	vs->SetInt("ringStart", sorted ? 0 : firstAliveIndex);
+	vs->SetInt("ringSize", maxParticles);
 	vs->CopyAllBufferData();
 
 	vs->SetShaderResourceView("ParticleData", particleDataSRV);
 
 
-	context->DrawIndexed(numLiving * 6, 0, 0);
+	renderer->DrawIndexed(numLiving * 6, 0, 0);
+	return true;
+}
+
+// --------------------------------------------------------
+// Keeps the GPU copy of the particle ring in sync with the
+// CPU one.  Particles never change after being spawned, so
+// normally only the ones spawned since the last upload are
+// written, with NO_OVERWRITE, and the shader reads the living
+// particles straight out of the ring.
+//
+// NO_OVERWRITE is only safe if none of those slots were
+// drawn by a frame the GPU might still be working on.  Each
+// spawn gets a sequence number (and lands in slot number %
+// maxParticles), so that's easy to check: the slot's previous
+// particle must be older than anything drawn in those frames.
+//
+// Everything living is rewritten with a DISCARD instead when
+// that check fails, when the ring hasn't been uploaded yet,
+// or when delta uploads are off or unsupported.
+//
+// Returns false if the write failed, which also forces a
+// full upload next time.
+// --------------------------------------------------------
+bool Emitter::UploadParticles()
+{
+	long long pendingCount = spawnCount - uploadedSpawnCount;
+
+	long long oldestInFlight = inFlightRetired[0];
+	for (int i = 1; i < FramesInFlight; i++)
+		if (inFlightRetired[i] < oldestInFlight) oldestInFlight = inFlightRetired[i];
+
+	bool fullUpload =
+		!deltaUploads ||
+		!canWriteNoOverwrite ||
+		!ringUploaded ||
+		pendingCount >= maxParticles ||
+		spawnCount - maxParticles > oldestInFlight;
+
+	bool written = true;
+	if (fullUpload)
+	{
+		// Both halves of a wrapped ring go in under the same discard
+		// (which happens even if nothing is alive)
+		written = WriteParticles(RenderMapType::WriteDiscard, firstAliveIndex, numLiving);
+	}
+	else if (pendingCount > 0)
+	{
+		// Newly spawned particles, which may wrap around the end
+		int start = (int)(uploadedSpawnCount % maxParticles);
+		int count = (int)pendingCount;
+		written = WriteParticles(RenderMapType::WriteNoOverwrite, start, count);
+	}
+
+	ringUploaded = written;
+	if (!written)
+		return false;
+
+	// Remember the oldest particle this frame will draw
+	uploadedSpawnCount = spawnCount;
+	inFlightRetired[uploadFrame % FramesInFlight] = spawnCount - numLiving;
+	uploadFrame++;
+	return true;
 }
 
+// --------------------------------------------------------
+// Copies count particles starting at ring slot start from the
+// CPU ring to the same place in the GPU ring, wrapping around
+// the end of both, with a single map
+// --------------------------------------------------------
+bool Emitter::WriteParticles(RenderMapType mapType, int start, int count)
+{
+	int firstCount = count < maxParticles - start ? count : maxParticles - start;
+	RenderBufferRange ranges[2] =
+	{
+		{ (unsigned int)(sizeof(Particle) * start), particles + start, (unsigned int)(sizeof(Particle) * firstCount) },
+		{ 0, particles, (unsigned int)(sizeof(Particle) * (count - firstCount)) }
+	};
 
+	return renderer->WriteBufferRanges(particleDataBuffer.Get(), mapType, ranges, count > firstCount ? 2 : 1);
+}
 
+// --------------------------------------------------------
+// Uploads the CPU simulated particles (oldest first, like
+// the analytic path) and draws them with the simulation shader
+// --------------------------------------------------------
+void Emitter::DrawSimulated(std::shared_ptr<Camera> camera)
+{
+	if (numLiving == 0)
+		return;
+
+	if (firstAliveIndex < firstDeadIndex)
+	{
+		simulation.Pack(firstAliveIndex, firstDeadIndex, packedParticles.data());
+	}
+	else
+	{
+		int tailCount = maxParticles - firstAliveIndex;
+		simulation.Pack(firstAliveIndex, maxParticles, packedParticles.data());
+		simulation.Pack(0, firstDeadIndex, packedParticles.data() + tailCount);
+	}
+
+	renderer->WriteBuffer(
+		simulatedDataBuffer.Get(),
+		RenderMapType::WriteDiscard,
+		0,
+		packedParticles.data(),
+		sizeof(SimulatedParticle) * numLiving);
+
+	renderer->SetVertexBuffer(0, 0);
+	renderer->SetIndexBuffer(PrepareIndexBuffer(true));
+
+	// Material handles the pixel shader and its resources,
+	// then the simulation shader replaces its vertex shader
+	material->PrepareMaterial(&transform, camera);
+
+	simulationVS->SetShader();
+	simulationVS->SetMatrix4x4("view", camera->GetView());
+	simulationVS->SetMatrix4x4("projection", camera->GetProjection());
+	simulationVS->CopyAllBufferData();
+	simulationVS->SetShaderResourceView("ParticleData", simulatedDataSRV);
+
+	renderer->DrawIndexed(numLiving * 6, 0, 0);
+}
+
+// --------------------------------------------------------
+// Works out this frame's back to front order.  Called after
+// the emitters are updated, so the order matches what's drawn.
+// --------------------------------------------------------
+void Emitter::SortParticles(std::shared_ptr<Camera> camera, float currentTime, JobSystem* jobs)
+{
+	PrepareSorting();
+	if (!sortParticles)
+		return;
+
+	if (paused)
+		return;
+
+	long long oldestSequence = spawnCount - numLiving;
+	framesSinceSort++;
+
+	if (framesSinceSort >= sortInterval || sortedSequence.empty())
+	{
+		// Full sort of everything alive
+		framesSinceSort = 0;
+		GatherSortPositions(currentTime);
+		ParticleSorter::ComputeDepthKeys(
+			depthX.data(), depthY.data(), depthZ.data(),
+			numLiving,
+			camera->GetTransform()->GetPosition(),
+			camera->GetTransform()->GetForward(),
+			depthKeys.data());
+
+		const std::vector<unsigned int>& order = sorter.Sort(depthKeys.data(), numLiving, jobs);
+		sortedSequence.resize(numLiving);
+		for (int i = 0; i < numLiving; i++)
+			sortedSequence[i] = oldestSequence + order[i];
+	}
+	else
+	{
+		// Keep the old order, minus anything that died, with
+		// newer particles drawn on top
+		size_t kept = 0;
+		for (size_t i = 0; i < sortedSequence.size(); i++)
+			if (sortedSequence[i] >= oldestSequence)
+				sortedSequence[kept++] = sortedSequence[i];
+		sortedSequence.resize(kept);
+
+		long long firstNew = sortedSpawnCount > oldestSequence ? sortedSpawnCount : oldestSequence;
+		for (long long seq = firstNew; seq < spawnCount; seq++)
+			sortedSequence.push_back(seq);
+	}
+
+	sortedSpawnCount = spawnCount;
+}
+
+// --------------------------------------------------------
+// Fills the depth position arrays, oldest particle first.
+// Simulated positions are copied as they are, while analytic
+// ones are evaluated at the current time four at a time.
+// --------------------------------------------------------
+void Emitter::GatherSortPositions(float currentTime)
+{
+	if (IsSimulated())
+	{
+		for (int i = 0; i < numLiving; i++)
+		{
+			int slot = (firstAliveIndex + i) % maxParticles;
+			depthX[i] = simulation.PositionX[slot];
+			depthY[i] = simulation.PositionY[slot];
+			depthZ[i] = simulation.PositionZ[slot];
+		}
+		return;
+	}
+
+	// pos = start + velocity * age + acceleration * age^2 / 2
+	XMVECTOR time = XMVectorReplicate(currentTime);
+	XMVECTOR halfAccelX = XMVectorReplicate(acceleration.x * 0.5f);
+	XMVECTOR halfAccelY = XMVectorReplicate(acceleration.y * 0.5f);
+	XMVECTOR halfAccelZ = XMVectorReplicate(acceleration.z * 0.5f);
+
+	for (int i = 0; i < numLiving; i += 4)
+	{
+		// Gather up to four particles (repeating the last one
+		// to fill the group), then evaluate them together
+		const Particle* p[4];
+		for (int lane = 0; lane < 4; lane++)
+		{
+			int index = i + lane < numLiving ? i + lane : numLiving - 1;
+			p[lane] = &particles[(firstAliveIndex + index) % maxParticles];
+		}
+
+		XMVECTOR age = XMVectorSubtract(time, XMVectorSet(p[0]->EmitTime, p[1]->EmitTime, p[2]->EmitTime, p[3]->EmitTime));
+		XMVECTOR ageSq = XMVectorMultiply(age, age);
+
+		XMVECTOR x = XMVectorSet(p[0]->StartPosition.x, p[1]->StartPosition.x, p[2]->StartPosition.x, p[3]->StartPosition.x);
+		XMVECTOR y = XMVectorSet(p[0]->StartPosition.y, p[1]->StartPosition.y, p[2]->StartPosition.y, p[3]->StartPosition.y);
+		XMVECTOR z = XMVectorSet(p[0]->StartPosition.z, p[1]->StartPosition.z, p[2]->StartPosition.z, p[3]->StartPosition.z);
+		XMVECTOR vx = XMVectorSet(p[0]->StartVelocity.x, p[1]->StartVelocity.x, p[2]->StartVelocity.x, p[3]->StartVelocity.x);
+		XMVECTOR vy = XMVectorSet(p[0]->StartVelocity.y, p[1]->StartVelocity.y, p[2]->StartVelocity.y, p[3]->StartVelocity.y);
+		XMVECTOR vz = XMVectorSet(p[0]->StartVelocity.z, p[1]->StartVelocity.z, p[2]->StartVelocity.z, p[3]->StartVelocity.z);
+
+		x = XMVectorMultiplyAdd(halfAccelX, ageSq, XMVectorMultiplyAdd(vx, age, x));
+		y = XMVectorMultiplyAdd(halfAccelY, ageSq, XMVectorMultiplyAdd(vy, age, y));
+		z = XMVectorMultiplyAdd(halfAccelZ, ageSq, XMVectorMultiplyAdd(vz, age, z));
+
+		XMStoreFloat4((XMFLOAT4*)&depthX[i], x);
+		XMStoreFloat4((XMFLOAT4*)&depthY[i], y);
+		XMStoreFloat4((XMFLOAT4*)&depthZ[i], z);
+	}
+}
+
+// --------------------------------------------------------
+// Gets the index buffer to draw with.  Unsorted particles use
+// the shared quad indices.  Sorted ones get their quads written
+// in back to front order, using either ring slots (the analytic
+// data) or offsets from the oldest particle (the packed data).
+// --------------------------------------------------------
+ID3D11Buffer* Emitter::PrepareIndexBuffer(bool packedOrder)
+{
+	if (!sortParticles || !sortedIndexBuffer || sortedSequence.size() != (size_t)numLiving || numLiving == 0)
+		return quadIndices->GetBuffer();
+
+	long long oldestSequence = spawnCount - numLiving;
+	unsigned int* out = sortedIndices.data();
+	for (long long seq : sortedSequence)
+	{
+		unsigned int quad = (unsigned int)(packedOrder ? seq - oldestSequence : seq % maxParticles);
+		unsigned int v = quad * 4;
+		*out++ = v;
+		*out++ = v + 1;
+		*out++ = v + 2;
+		*out++ = v;
+		*out++ = v + 2;
+		*out++ = v + 3;
+	}
+
+	renderer->WriteBuffer(
+		sortedIndexBuffer.Get(),
+		RenderMapType::WriteDiscard,
+		0,
+		sortedIndices.data(),
+		sizeof(unsigned int) * numLiving * 6);
+	return sortedIndexBuffer.Get();
+}
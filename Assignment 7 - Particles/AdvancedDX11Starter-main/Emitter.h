@@ -7,6 +7,14 @@
 #include "Camera.h"
 #include "Material.h"
 #include "Transform.h"
+#include "Renderer.h"
+#include "ParticleArena.h"
+#include "ParticleInteraction.h"
+#include "ParticleSimulation.h"
+#include "ParticleSort.h"
+#include "QuadIndexBuffer.h"
+#include "Random.h"
+#include "SimpleShader.h"
 
 
 struct Particle
@@ -14,6 +22,28 @@ struct Particle
 	float EmitTime;
 	DirectX::XMFLOAT3 StartPosition;
 	DirectX::XMFLOAT3 StartVelocity;
+	float Lifetime;		// Fixed when spawned, so budget changes only affect new particles
+};
+
+// Particles and per-emitter parameters for drawing several
+// emitters at once - see ParticleBatcher and ParticleBatchVS
+struct BatchedParticle
+{
+	float EmitTime;
+	DirectX::XMFLOAT3 StartPosition;
+	DirectX::XMFLOAT3 StartVelocity;
+	unsigned int EmitterIndex;
+	float Lifetime;
+};
+
+struct BatchedEmitter
+{
+	DirectX::XMFLOAT4 StartColor;
+	DirectX::XMFLOAT4 EndColor;
+	DirectX::XMFLOAT3 Acceleration;
+	float StartSize;
+	float EndSize;
+	DirectX::XMFLOAT3 Padding;
 };
 
 class Emitter
@@ -21,6 +51,8 @@ class Emitter
 public:
 	Emitter(
 		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		std::shared_ptr<IRenderer> renderer,
+		unsigned int seed,
 		std::shared_ptr<Material> material,
 		int maxParticles,
 		int particlesPerSecond,
@@ -32,15 +64,48 @@ public:
 		bool isbox = false,
 		DirectX::XMFLOAT3 emitterPosition = DirectX::XMFLOAT3(0, 0, 0),
 		DirectX::XMFLOAT3 startVelocity = DirectX::XMFLOAT3(0, 0, 0),
-		DirectX::XMFLOAT3 acceleration = DirectX::XMFLOAT3(0, 0, 0)
+		DirectX::XMFLOAT3 acceleration = DirectX::XMFLOAT3(0, 0, 0),
+		std::shared_ptr<ParticleArena> arena = 0
 	);
 	~Emitter();
 
 	void Update(float dt, float currentTime);
-	void Draw(
-		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
-		std::shared_ptr<Camera> camera,
-		float currentTime);
+
+	// Update() split up, so the work can be spread over threads
+	// - Create or free the simulation's storage (main thread only)
+	// - Apply neighbor interactions (which use the threads themselves)
+	// - Simulate each range (or pieces of them, in groups of four)
+	// - Then update lifetimes, once the simulation is done
+	void PrepareSimulation(float currentTime);
+	void ApplyInteractions(float dt, JobSystem* jobs);
+	int GetSimulationRanges(int ranges[2][2]);
+	void SimulateRange(int start, int end, float dt, float currentTime);
+	void UpdateLifetimes(float dt, float currentTime);
+
+	// Emitters seeded the same way spawn the same particles,
+	// no matter when they're made or which thread updates them
+	void SetRandomSeed(unsigned int seed);
+
+	// Pooled emitters (see EmitterPool) start over with no
+	// particles, keeping their storage and GPU buffers
+	void Reset(std::shared_ptr<Material> material, int particlesPerSecond);
+
+	// Spawns count particles right away, with velocities spread
+	// up to speed away from the start velocity
+	void EmitBurst(int count, float speed, float currentTime);
+
+	// Allocations made by every emitter's constructor so far
+	struct AllocationCounts
+	{
+		long long EmittersCreated = 0;
+		long long ParticleArrays = 0;
+		long long GpuResources = 0;
+	};
+	static const AllocationCounts& GetAllocationCounts();
+
+	// Returns false if nothing was drawn because the emitter
+	// was paused or outside the camera's frustum
+	bool Draw(std::shared_ptr<Camera> camera, float currentTime);
 
 	float lifetime;
 
@@ -53,10 +118,68 @@ public:
 	float startSize;
 	float endSize;
 	bool isBox;
-	
+
+	// CPU simulation - when enabled (and a simulation shader is
+	// set) particles are integrated each frame with the forces
+	// below, rather than evaluated analytically on the GPU.  The
+	// simulation's storage only exists while this is on (see
+	// PrepareSimulation), so GetSimulation() is empty otherwise.
+	bool simulate;
+	ParticleForces forces;
+
+	// Simulated particles are each scaled by a random amount
+	// in [1 - sizeVariance, 1 + sizeVariance] when spawned
+	float sizeVariance;
+	void SetSimulationShader(std::shared_ptr<SimpleVertexShader> vs);
+
+	// Only upload newly spawned particles each frame?
+	bool deltaUploads;
+
+	// Back to front sorting for alpha blended particles.  A full
+	// sort happens every sortInterval frames - in between, dead
+	// particles are dropped and new ones are drawn last.  The
+	// sorting's storage only exists while this is on.
+	bool sortParticles;
+	int sortInterval;
+
+	// Alpha blended particles cover what's behind them, so they
+	// can't be drawn in any order like additive ones.  They're
+	// never batched, and are drawn after every additive emitter.
+	bool alphaBlend;
+	void SortParticles(std::shared_ptr<Camera> camera, float currentTime, JobSystem* jobs);
 
 	Transform* GetTransform();
 	std::shared_ptr<Material> GetMaterial();
+	ParticleSoA* GetSimulation();
+	ParticleInteraction* GetInteraction();
+	int GetLivingCount();
+	int GetMaxParticles();
+	unsigned long long GetMemoryUsage();
+	static unsigned long long GetBytesPerParticle(bool simulated = true, bool sorted = true);
+	unsigned long long GetIndexMemoryUsage();
+
+	// Particle budget - see ParticleBudget
+	float priority;
+	float GetParticleDemand(float lifetimeScale);
+	float GetCurrentLifetime();
+	void SetBudget(float rateScale, float lifetimeScale, bool pause);
+	float GetBudgetRateScale();
+	float GetBudgetLifetimeScale();
+	bool IsPaused();
+
+	// Conservative world space bounds of every living particle's
+	// billboard, plus anywhere a particle spawned right now could
+	// go.  Updated along with the particle lifetimes.
+	bool frustumCulling;
+	void GetBounds(DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax);
+	bool IsVisible(std::shared_ptr<Camera> camera);
+	int CountParticlesOutsideBounds(float currentTime);
+
+	// Batched drawing - analytic, unsorted emitters can hand
+	// their particles over to be drawn along with others
+	bool CanBatch();
+	int CopyBatchParticles(BatchedParticle* out, unsigned int emitterIndex);
+	BatchedEmitter GetBatchParameters();
 private:
 	
 	int particlesPerSecond;
@@ -65,20 +188,98 @@ private:
 
 	Particle* particles;
 	int maxParticles;
+	std::shared_ptr<ParticleArena> arena;
+	static AllocationCounts allocationCounts;
 
 	int firstDeadIndex;
 	int firstAliveIndex;
 	int numLiving;
 
+	// Each emitter has its own random numbers
+	Xoshiro128Plus4 random;
+	std::vector<DirectX::XMFLOAT3> spawnOffsets;
+	std::vector<float> spawnAges;
+	std::vector<DirectX::XMFLOAT3> spawnVelocities;
+	std::vector<float> spawnSizeScales;
+
+	// Start positions and velocities of particles spawned in the
+	// last two "epochs".  A new epoch starts once every particle
+	// from the older one has died, so together they always cover
+	// everything alive (even if the emitter moves around).
+	struct SpawnBounds
+	{
+		DirectX::XMFLOAT3 PositionMin;
+		DirectX::XMFLOAT3 PositionMax;
+		DirectX::XMFLOAT3 VelocityMin;
+		DirectX::XMFLOAT3 VelocityMax;
+		float LifetimeMax;
+		bool Empty;
+	};
+	SpawnBounds spawnBounds[2];
+	long long boundsEpochStart;
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+
+	// Set by the particle budget
+	float budgetRateScale;
+	float budgetLifetimeScale;
+	bool paused;
+
+	// Tracks which spawned particles still need uploading, and
+	// the oldest particle drawn by each of the last few frames
+	static const int FramesInFlight = 3;
+	long long spawnCount;
+	long long uploadedSpawnCount;
+	long long inFlightRetired[FramesInFlight];
+	unsigned int uploadFrame;
+	bool ringUploaded;
+	bool canWriteNoOverwrite;
+
+	// Sorting - the order is kept as spawn sequence numbers,
+	// so it stays meaningful as the ring moves along
+	ParticleSorter sorter;
+	std::vector<float> depthX, depthY, depthZ;
+	std::vector<unsigned int> depthKeys;
+	std::vector<long long> sortedSequence;
+	long long sortedSpawnCount;
+	int framesSinceSort;
+	std::vector<unsigned int> sortedIndices;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> sortedIndexBuffer;
+
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	std::shared_ptr<IRenderer> renderer;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> particleDataBuffer;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> particleDataSRV;
-	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
+	std::shared_ptr<QuadIndexBuffer> quadIndices;
+
+	// Simulated particle state and its GPU copy
+	ParticleSoA simulation;
+	std::vector<SimulatedParticle> packedParticles;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> simulatedDataBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> simulatedDataSRV;
+	std::shared_ptr<SimpleVertexShader> simulationVS;
+
+	// Living simulated particles, gathered for neighbor interactions
+	ParticleInteraction interaction;
+	std::vector<float> neighborX, neighborY, neighborZ;
+	std::vector<float> neighborVX, neighborVY, neighborVZ;
 
 	Transform transform;
 	std::shared_ptr<Material> material;
 
-	void UpdateParticle(float currentTime, int index);
-	void SpawnParticle(float currentTime);
+	void ResetState();
+	void SpawnParticle(float emitTime, float age, DirectX::XMFLOAT3 offset, DirectX::XMFLOAT3 velocity, float sizeScale);
+	void SpawnSimulated(int index, float age, float sizeScale);
+	bool IsSimulated();
+	void PrepareSorting();
+	bool FillSizeScales(int count);
+	void EmitParticles(float dt, float currentTime);
+	void UpdateBounds();
+	float GetBillboardRadius();
+	void DrawSimulated(std::shared_ptr<Camera> camera);
+	bool UploadParticles();
+	bool WriteParticles(RenderMapType mapType, int start, int count);
+	void GatherSortPositions(float currentTime);
+	ID3D11Buffer* PrepareIndexBuffer(bool packedOrder);
 };
 
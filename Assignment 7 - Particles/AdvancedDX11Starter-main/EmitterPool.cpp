@@ -0,0 +1,108 @@
+#include "EmitterPool.h"
+
+using namespace DirectX;
+
+
+EmitterPool::EmitterPool(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	std::shared_ptr<IRenderer> renderer,
+	int reservedParticles)
+	:
+	device(device),
+	renderer(renderer),
+	nextSeed(1)
+{
+	arena = std::make_shared<ParticleArena>(reservedParticles);
+}
+
+// --------------------------------------------------------
+// Grabs an idle emitter of the right capacity class (or makes
+// one), sets it up for the burst and spawns every particle
+// --------------------------------------------------------
+std::shared_ptr<Emitter> EmitterPool::Burst(const ParticleBurst& burst, float currentTime)
+{
+	// Bursts bigger than the arena's largest class are cut down to it
+	int count = burst.Count < ParticleArena::MaxCapacity ? burst.Count : ParticleArena::MaxCapacity;
+	int capacity = ParticleArena::GetCapacityClass(count);
+	int classIndex = ParticleArena::GetClassIndex(capacity);
+
+	std::shared_ptr<Emitter> e;
+	if (!idle[classIndex].empty())
+	{
+		e = idle[classIndex].back();
+		idle[classIndex].pop_back();
+		stats.EmittersReused++;
+		stats.PooledCount--;
+	}
+	else
+	{
+		e = std::make_shared<Emitter>(
+			device,
+			renderer,
+			nextSeed,
+			burst.MaterialPtr,
+			capacity,
+			0,
+			burst.Lifetime,
+			burst.StartSize,
+			burst.EndSize,
+			burst.StartColor,
+			burst.EndColor,
+			burst.IsBox,
+			burst.Position,
+			burst.Velocity,
+			burst.Acceleration,
+			arena);
+		stats.EmittersCreated++;
+	}
+
+	// Reused emitters may have been changed by whoever had
+	// them last, so everything is set every time
+	e->lifetime = burst.Lifetime;
+	e->startSize = burst.StartSize;
+	e->endSize = burst.EndSize;
+	e->startColor = burst.StartColor;
+	e->endColor = burst.EndColor;
+	e->isBox = burst.IsBox;
+	e->startVelocity = burst.Velocity;
+	e->acceleration = burst.Acceleration;
+	e->simulate = false;
+	e->forces = ParticleForces();
+	e->sizeVariance = 0.0f;
+	e->sortParticles = false;
+	e->alphaBlend = false;
+	e->deltaUploads = true;
+	e->frustumCulling = true;
+	e->priority = 1.0f;
+	e->GetTransform()->SetPosition(burst.Position);
+	e->Reset(burst.MaterialPtr, 0);
+
+	// Pooled emitters get their own sequence of seeds, so bursts
+	// play out the same no matter which emitter they land on
+	e->SetRandomSeed(nextSeed++);
+	e->EmitBurst(count, burst.Speed, currentTime);
+
+	active.push_back(e);
+	stats.Bursts++;
+	stats.ActiveCount = (int)active.size();
+	return e;
+}
+
+void EmitterPool::Recycle()
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < active.size(); i++)
+	{
+		if (active[i]->GetLivingCount() > 0)
+		{
+			active[kept++] = active[i];
+			continue;
+		}
+
+		int classIndex = ParticleArena::GetClassIndex(active[i]->GetMaxParticles());
+		idle[classIndex].push_back(active[i]);
+		stats.PooledCount++;
+	}
+	active.resize(kept);
+	stats.ActiveCount = (int)active.size();
+}
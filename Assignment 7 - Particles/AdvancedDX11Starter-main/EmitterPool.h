@@ -0,0 +1,81 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+#include "Emitter.h"
+#include "Material.h"
+#include "ParticleArena.h"
+#include "Renderer.h"
+
+// --------------------------------------------------------
+// Everything needed to fire off a one-shot burst
+// --------------------------------------------------------
+struct ParticleBurst
+{
+	std::shared_ptr<Material> MaterialPtr;
+	int Count = 100;
+	float Lifetime = 1.0f;
+	DirectX::XMFLOAT3 Position = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3 Velocity = DirectX::XMFLOAT3(0, 0, 0);
+	float Speed = 2.0f;			// Random spread around the velocity
+	DirectX::XMFLOAT3 Acceleration = DirectX::XMFLOAT3(0, 0, 0);
+	float StartSize = 1.0f;
+	float EndSize = 1.0f;
+	DirectX::XMFLOAT4 StartColor = DirectX::XMFLOAT4(1, 1, 1, 1);
+	DirectX::XMFLOAT4 EndColor = DirectX::XMFLOAT4(1, 1, 1, 0);
+	bool IsBox = false;
+};
+
+// --------------------------------------------------------
+// Recycles emitters for short lived, fire-and-forget bursts
+// (explosions, impacts and so on).
+//
+// Emitters are kept by capacity class, so a new burst reuses
+// an idle emitter that's big enough - along with its GPU
+// buffers - instead of creating a new one.  Particle storage
+// comes from a shared arena.  Once a burst's last particle
+// dies, Recycle() returns its emitter to the pool.
+// --------------------------------------------------------
+class EmitterPool
+{
+public:
+	EmitterPool(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		std::shared_ptr<IRenderer> renderer,
+		int reservedParticles);
+
+	// Fires a burst, returning the emitter in case the caller
+	// wants to adjust it (it goes back to the pool regardless)
+	std::shared_ptr<Emitter> Burst(const ParticleBurst& burst, float currentTime);
+
+	// Returns every finished burst's emitter to the pool - call
+	// this after updating the active emitters
+	void Recycle();
+
+	// Bursts that still have living particles
+	std::vector<std::shared_ptr<Emitter>>& GetActive() { return active; }
+
+	struct Stats
+	{
+		long long Bursts = 0;
+		long long EmittersCreated = 0;
+		long long EmittersReused = 0;
+		int ActiveCount = 0;
+		int PooledCount = 0;
+	};
+	const Stats& GetStats() { return stats; }
+	const ParticleArena::Stats& GetArenaStats() { return arena->GetStats(); }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	std::shared_ptr<IRenderer> renderer;
+	std::shared_ptr<ParticleArena> arena;
+
+	std::vector<std::shared_ptr<Emitter>> active;
+	std::vector<std::shared_ptr<Emitter>> idle[ParticleArena::ClassCount];
+	unsigned int nextSeed;
+	Stats stats;
+};
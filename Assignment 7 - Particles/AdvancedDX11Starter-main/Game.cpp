@@ -1,11 +1,13 @@
 
-#include <stdlib.h>     // For seeding random and rand()
+#include <stdlib.h>
 #include <time.h>       // For grabbing time (to seed random)
+#include <algorithm>
 
 #include "Game.h"
 #include "Vertex.h"
 #include "Input.h"
 #include "Helpers.h"
+#include "D3D11Renderer.h"
 
 #include "WICTextureLoader.h"
 #include "ImGui/imgui.h"
@@ -20,9 +22,6 @@
 // For the DirectX Math library
 using namespace DirectX;
 
-// Helper macro for getting a float between min and max
-#define RandomRange(min, max) (float)rand() / RAND_MAX * (max - min) + min
-
 // Helper macros for making texture and shader loading code more succinct
 #define LoadTexture(file, srv) CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(file).c_str(), 0, srv.GetAddressOf())
 #define LoadShader(type, file) std::make_shared<type>(device.Get(), context.Get(), FixPath(file).c_str())
@@ -48,15 +47,25 @@ Game::Game(HINSTANCE hInstance)
 	sky(0),
 	lightCount(0),
 	showUIDemoWindow(false),
-	showPointLights(false)
+	showPointLights(false),
+	headless(false),
+	jobThreadCount(0),
+	emittersDrawn(0),
+	burstsPerSecond(2.0f),
+	timeSinceBurst(0.0f),
+	batchParticles(true)
 {
 	// Seed random
-	srand((unsigned int)time(0));
+	random.Seed((unsigned long long)time(0));
 
 #if defined(DEBUG) || defined(_DEBUG)
 	// Do we want a console window?  Probably only in debug mode
 	CreateConsoleWindow(500, 120, 32, 120);
 	printf("Console window created successfully.  Feel free to printf() here.\n");
+
+	// Print how long each shader takes to load (and whether
+	// its reflection data came from the cache)
+	ISimpleShader::ReportLoadTimes = true;
 #endif
 
 }
@@ -92,6 +101,12 @@ void Game::Init()
 	ImGui_ImplDX11_Init(device.Get(), context.Get());
 	ImGui::StyleColorsDark();
 
+	// Per-frame rendering work goes through the renderer, which
+	// InitHeadless() will already have swapped for a null backend
+	if (!renderer)
+		renderer = std::make_shared<D3D11Renderer>(context);
+	ISimpleShader::Renderer = renderer;
+
 	// Asset loading and entity creation
 	LoadAssetsAndCreateEntities();
 	
@@ -139,6 +154,8 @@ void Game::LoadAssetsAndCreateEntities()
 	
 	std::shared_ptr<SimpleVertexShader> particlesVS		= LoadShader(SimpleVertexShader, L"ParticleVS.cso");
 	std::shared_ptr<SimplePixelShader> particlesPS		= LoadShader(SimplePixelShader, L"ParticleShader.cso");
+	std::shared_ptr<SimpleVertexShader> particleSimVS	= LoadShader(SimpleVertexShader, L"ParticleSimVS.cso");
+	std::shared_ptr<SimpleVertexShader> particleBatchVS	= LoadShader(SimpleVertexShader, L"ParticleBatchVS.cso");
 	
 	std::shared_ptr<SimpleVertexShader> skyVS = LoadShader(SimpleVertexShader, L"SkyVS.cso");
 	std::shared_ptr<SimplePixelShader> skyPS  = LoadShader(SimplePixelShader, L"SkyPS.cso");
@@ -452,27 +469,18 @@ void Game::LoadAssetsAndCreateEntities()
 	blend.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
 	blend.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
 
-	//D3D11_BLEND_DESC blend = {};
-	//blend.RenderTarget[0].BlendEnable = true;
-	//blend.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD; // Add both colors
-	//blend.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD; // Add both alpha values
-	//blend.RenderTarget[0].SrcBlend = D3D11_BLEND_INV_SRC_ALPHA;
-	//blend.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
-	//blend.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
-	//blend.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
-	//blend.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
-
-
-
-
-
-
 	device->CreateBlendState(&blend, particleBlendState.GetAddressOf());
 
+	// Alpha blended emitters (see Emitter::alphaBlend)
+	blend.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	device->CreateBlendState(&blend, particleAlphaBlendState.GetAddressOf());
+
 	
 
 	emitterList.push_back(std::make_shared<Emitter>(
 		device,
+		renderer,
+		1,
 		testParticleMat, 
 		180, 
 		30, 
@@ -485,6 +493,8 @@ void Game::LoadAssetsAndCreateEntities()
 
 	emitterList.push_back(std::make_shared<Emitter>(
 		device,
+		renderer,
+		2,
 		sparkMat,
 		15,
 		3,
@@ -500,6 +510,8 @@ void Game::LoadAssetsAndCreateEntities()
 
 	emitterList.push_back(std::make_shared<Emitter>(
 		device,
+		renderer,
+		3,
 		traceMat,
 		60,
 		5,
@@ -512,6 +524,26 @@ void Game::LoadAssetsAndCreateEntities()
 		XMFLOAT3(7.0f, 0, 0),
 		XMFLOAT3(0, 0.2, 0)));
 
+	// Every emitter can switch to CPU simulation, but only
+	// the trace emitter starts that way - swirling in curl
+	// noise while being pulled back towards its origin
+	for (auto& e : emitterList)
+		e->SetSimulationShader(particleSimVS);
+
+	particleBatcher = std::make_shared<ParticleBatcher>(device, renderer, particleBatchVS);
+
+	// Sparks go off around the scene every so often
+	burstPool = std::make_shared<EmitterPool>(device, renderer, 65536);
+	burstMaterial = sparkMat;
+	burstRandom.Seed(542, 40);
+
+	std::shared_ptr<Emitter> traceEmitter = emitterList.back();
+	traceEmitter->simulate = true;
+	traceEmitter->forces.Drag = 0.3f;
+	traceEmitter->forces.CurlStrength = 1.5f;
+	traceEmitter->forces.Attractors.push_back({ XMFLOAT3(7.0f, 2.0f, 0), 2.0f });
+	traceEmitter->sizeVariance = 0.5f;
+
 	
 
 
@@ -561,10 +593,10 @@ void Game::GenerateLights()
 	{
 		Light point = {};
 		point.Type = LIGHT_TYPE_POINT;
-		point.Position = XMFLOAT3(RandomRange(-10.0f, 10.0f), RandomRange(-5.0f, 5.0f), RandomRange(-10.0f, 10.0f));
-		point.Color = XMFLOAT3(RandomRange(0, 1), RandomRange(0, 1), RandomRange(0, 1));
-		point.Range = RandomRange(5.0f, 10.0f);
-		point.Intensity = RandomRange(0.1f, 3.0f);
+		point.Position = XMFLOAT3(random.Range(-10.0f, 10.0f), random.Range(-5.0f, 5.0f), random.Range(-10.0f, 10.0f));
+		point.Color = XMFLOAT3(random.Range(0.0f, 1.0f), random.Range(0.0f, 1.0f), random.Range(0.0f, 1.0f));
+		point.Range = random.Range(5.0f, 10.0f);
+		point.Intensity = random.Range(0.1f, 3.0f);
 
 		// Add to the list
 		lights.push_back(point);
@@ -602,12 +634,18 @@ void Game::Update(float deltaTime, float totalTime)
 	// Update the camera
 	camera->Update(deltaTime);
 
-	for (int i = 0; i < emitterList.size(); i++)
-	{
-		emitterList[i]->Update(deltaTime, totalTime);
-		if(i == 0)
-		emitterList[i]->GetTransform()->MoveRelative(DirectX::XMFLOAT3(sin(totalTime) * deltaTime, 0, cos(totalTime) * deltaTime));
-	}
+	// Bursts are fired before the update, and go back to
+	// the pool as soon as their last particle has died
+	SpawnBursts(deltaTime, totalTime);
+	GatherFrameEmitters();
+	particleBudget.Update(frameEmitters, camera, deltaTime);
+	UpdateEmitters(frameEmitters, deltaTime, totalTime);
+	burstPool->Recycle();
+	GatherFrameEmitters();
+	for (auto& e : frameEmitters)
+		e->SortParticles(camera, totalTime, &jobs);
+	if (emitterList.size() > 0)
+		emitterList[0]->GetTransform()->MoveRelative(DirectX::XMFLOAT3(sin(totalTime) * deltaTime, 0, cos(totalTime) * deltaTime));
 
 	// Check individual input
 	Input& input = Input::GetInstance();
@@ -615,6 +653,95 @@ void Game::Update(float deltaTime, float totalTime)
 	if (input.KeyPress(VK_TAB)) GenerateLights();
 }
 
+// --------------------------------------------------------
+// Fires off bursts of sparks at random spots in the scene
+// --------------------------------------------------------
+void Game::SpawnBursts(float deltaTime, float totalTime)
+{
+	if (burstsPerSecond <= 0.0f)
+	{
+		timeSinceBurst = 0.0f;
+		return;
+	}
+
+	timeSinceBurst += deltaTime;
+	float interval = 1.0f / burstsPerSecond;
+	while (timeSinceBurst >= interval)
+	{
+		timeSinceBurst -= interval;
+
+		ParticleBurst burst;
+		burst.MaterialPtr = burstMaterial;
+		burst.Count = (int)burstRandom.Range(50.0f, 400.0f);
+		burst.Lifetime = burstRandom.Range(0.75f, 1.5f);
+		burst.Position = XMFLOAT3(burstRandom.Range(-8.0f, 8.0f), burstRandom.Range(0.0f, 4.0f), burstRandom.Range(-4.0f, 4.0f));
+		burst.Speed = burstRandom.Range(2.0f, 5.0f);
+		burst.Acceleration = XMFLOAT3(0, -4.0f, 0);
+		burst.StartSize = 0.3f;
+		burst.EndSize = 0.05f;
+		burst.StartColor = XMFLOAT4(1.0f, 0.8f, 0.3f, 1.0f);
+		burst.EndColor = XMFLOAT4(1.0f, 0.2f, 0.0f, 0.0f);
+		burstPool->Burst(burst, totalTime);
+	}
+}
+
+// --------------------------------------------------------
+// Collects the regular emitters and the active bursts
+// --------------------------------------------------------
+void Game::GatherFrameEmitters()
+{
+	std::vector<std::shared_ptr<Emitter>>& bursts = burstPool->GetActive();
+	frameEmitters.assign(emitterList.begin(), emitterList.end());
+	frameEmitters.insert(frameEmitters.end(), bursts.begin(), bursts.end());
+}
+
+// --------------------------------------------------------
+// Updates a set of emitters across the job system's threads
+//  - First the simulation, in chunks of particles
+//  - Then each emitter's lifetimes (spawning uses the
+//    emitter's own random numbers, so order doesn't matter)
+// Both passes are joined before returning, so every emitter
+// is finished before anything is uploaded in Draw()
+// --------------------------------------------------------
+void Game::UpdateEmitters(std::vector<std::shared_ptr<Emitter>>& emitters, float deltaTime, float totalTime)
+{
+	// Simulation storage is created here, on the main thread.
+	// Neighbor interactions need all of an emitter's particles at
+	// once, so emitters take turns using every thread for them
+	for (auto& e : emitters)
+	{
+		e->PrepareSimulation(totalTime);
+		e->ApplyInteractions(deltaTime, &jobs);
+	}
+
+	emitterChunks.clear();
+	for (auto& e : emitters)
+	{
+		int ranges[2][2];
+		int rangeCount = e->GetSimulationRanges(ranges);
+		for (int r = 0; r < rangeCount; r++)
+		{
+			// Ranges start on a group of four, and so does each chunk
+			for (int start = ranges[r][0]; start < ranges[r][1]; start += ParticlesPerChunk)
+			{
+				int end = start + ParticlesPerChunk;
+				emitterChunks.push_back({ e.get(), start, end < ranges[r][1] ? end : ranges[r][1] });
+			}
+		}
+	}
+
+	jobs.ParallelFor((int)emitterChunks.size(), [&](int i)
+		{
+			EmitterChunk& chunk = emitterChunks[i];
+			chunk.EmitterPtr->SimulateRange(chunk.Start, chunk.End, deltaTime, totalTime);
+		});
+
+	jobs.ParallelFor((int)emitters.size(), [&](int i)
+		{
+			emitters[i]->UpdateLifetimes(deltaTime, totalTime);
+		});
+}
+
 // --------------------------------------------------------
 // Clear the screen, redraw everything, present to the user
 // --------------------------------------------------------
@@ -624,12 +751,15 @@ void Game::Draw(float deltaTime, float totalTime)
 	// - These things should happen ONCE PER FRAME
 	// - At the beginning of Game::Draw() before drawing *anything*
 	{
+		renderer->BeginFrame();
+		renderer->SetRenderTarget(backBufferRTV.Get(), depthBufferDSV.Get());
+
 		// Clear the back buffer (erases what's on the screen)
 		const float bgColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f }; // Black
-		context->ClearRenderTargetView(backBufferRTV.Get(), bgColor);
+		renderer->ClearRenderTarget(backBufferRTV.Get(), bgColor);
 
 		// Clear the depth buffer (resets per-pixel occlusion information)
-		context->ClearDepthStencilView(depthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+		renderer->ClearDepth(depthBufferDSV.Get(), 1.0f);
 	}
 
 
@@ -648,7 +778,7 @@ void Game::Draw(float deltaTime, float totalTime)
 		ps->CopyBufferData("perFrame");
 
 		// Draw the entity
-		ge->Draw(context, camera);
+		ge->Draw(renderer, camera);
 	}
 
 	// Draw the light sources?
@@ -656,23 +786,38 @@ void Game::Draw(float deltaTime, float totalTime)
 		DrawPointLights();
 
 	// Draw the sky
-	sky->Draw(camera);
+	sky->Draw(renderer, camera);
 
 
 	// Draw Particles
 
-	context->OMSetBlendState(particleBlendState.Get(), 0, 0xffffffff);
-	context->OMSetDepthStencilState(particleDepthState.Get(), 0);
+	renderer->SetBlendState(particleBlendState.Get());
+	renderer->SetDepthStencilState(particleDepthState.Get());
 
-	for (int i = 0; i < emitterList.size(); i++)
+	if (batchParticles)
 	{
-		emitterList[i]->Draw(context, camera, totalTime);
-		
+		emittersDrawn = particleBatcher->Draw(frameEmitters, camera, totalTime);
+	}
+	else
+	{
+		emittersDrawn = 0;
+		for (int i = 0; i < frameEmitters.size(); i++)
+		{
+			if (!frameEmitters[i]->alphaBlend && frameEmitters[i]->Draw(camera, totalTime))
+				emittersDrawn++;
+		}
 	}
-	
 
-	context->OMSetBlendState(0, 0, 0xffffffff);
-	context->OMSetDepthStencilState(0, 0);
+	// Alpha blended emitters go on top of the additive ones
+	renderer->SetBlendState(particleAlphaBlendState.Get());
+	for (int i = 0; i < frameEmitters.size(); i++)
+	{
+		if (frameEmitters[i]->alphaBlend && frameEmitters[i]->Draw(camera, totalTime))
+			emittersDrawn++;
+	}
+
+	renderer->SetBlendState(0);
+	renderer->SetDepthStencilState(0);
 
 
 
@@ -691,8 +836,15 @@ void Game::Draw(float deltaTime, float totalTime)
 	// - These should happen exactly ONCE PER FRAME
 	// - At the very end of the frame (after drawing *everything*)
 	{
+		renderer->EndFrame();
+
 		// Draw the UI after everything else
 		ImGui::Render();
+
+		// Nothing is presented when running headless
+		if (headless)
+			return;
+
 		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
 
 		// Present the back buffer to the user
@@ -709,6 +861,698 @@ void Game::Draw(float deltaTime, float totalTime)
 }
 
 
+// --------------------------------------------------------
+// Runs Update() and Draw() for a fixed number of frames with
+// a null renderer, so nothing is submitted to the GPU, then
+// prints the CPU cost of each frame and what was submitted.
+// The window and device still exist, since assets are loaded
+// as usual, but nothing is ever presented.  The benchmarks and
+// stress tests each have their own mode (see Main.cpp).
+//
+// Fails (and so exits with a non-zero code) if the renderer
+// reported validation errors.
+//
+// frameCount - How many frames to simulate (at a fixed 60fps)
+// --------------------------------------------------------
+HRESULT Game::RunHeadless(int frameCount)
+{
+	std::shared_ptr<NullRenderer> nullRenderer = InitHeadless();
+
+	__int64 frequency = 0;
+	__int64 start = 0;
+	__int64 mid = 0;
+	__int64 end = 0;
+	__int64 updateTicks = 0;
+	__int64 drawTicks = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+
+	const float deltaTime = 1.0f / 60.0f;
+	for (int i = 0; i < frameCount; i++)
+	{
+		float totalTime = i * deltaTime;
+
+		QueryPerformanceCounter((LARGE_INTEGER*)&start);
+		Update(deltaTime, totalTime);
+		QueryPerformanceCounter((LARGE_INTEGER*)&mid);
+		Draw(deltaTime, totalTime);
+		QueryPerformanceCounter((LARGE_INTEGER*)&end);
+
+		updateTicks += mid - start;
+		drawTicks += end - mid;
+	}
+
+	// Report averages per frame
+	double frames = frameCount > 0 ? (double)frameCount : 1.0;
+	const RenderStats& stats = nullRenderer->GetTotalStats();
+	printf("Headless run: %d frames\n", frameCount);
+	printf("  Update: %.4f ms/frame\n", updateTicks * 1000.0 / frequency / frames);
+	printf("  Draw:   %.4f ms/frame\n", drawTicks * 1000.0 / frequency / frames);
+	printf("  Draw calls: %.1f, indices: %.0f\n", stats.DrawCalls / frames, stats.IndicesDrawn / frames);
+	printf("  Buffer writes: %.1f (%.0f bytes), failed maps: %llu\n", stats.BufferWrites / frames, stats.BufferBytesWritten / frames, stats.FailedMaps);
+	printf("  Constant buffer updates: %.1f (%.0f bytes)\n", stats.ConstantBufferUpdates / frames, stats.ConstantBufferBytes / frames);
+	printf("  Bindings: %.1f, clears: %.1f\n", stats.Bindings / frames, stats.Clears / frames);
+	printf("  No-overwrite across frames: %s\n", nullRenderer->CanNoOverwriteAcrossFrames() ? "yes" : "no");
+	printf("  Validation errors: %u\n", nullRenderer->GetErrorCount());
+	for (const std::string& error : nullRenderer->GetErrors())
+		printf("    %s\n", error.c_str());
+
+	// Particle upload traffic with full and delta uploads, by
+	// continuing the same scene for a while in each mode
+	printf("\nParticle uploads (analytic emitters):\n");
+	const char* uploadModes[] = { "Full", "Delta" };
+	for (int mode = 0; mode < 2; mode++)
+	{
+		for (auto& e : emitterList)
+			e->deltaUploads = mode == 1;
+
+		const int uploadFrames = 600;
+		unsigned long long bytesBefore = stats.BufferBytesWritten;
+		unsigned long long writesBefore = stats.BufferWrites;
+		for (int i = 0; i < uploadFrames; i++)
+		{
+			float totalTime = (frameCount + mode * uploadFrames + i) * deltaTime;
+			Update(deltaTime, totalTime);
+			Draw(deltaTime, totalTime);
+		}
+
+		printf("  %-5s %10.1f bytes/frame, %5.2f writes/frame\n",
+			uploadModes[mode],
+			(stats.BufferBytesWritten - bytesBefore) / (double)uploadFrames,
+			(stats.BufferWrites - writesBefore) / (double)uploadFrames);
+	}
+
+	// Validation errors fail the whole run, so the exit code
+	// can be used by scripts
+	bool passed = nullRenderer->GetErrorCount() == 0;
+	printf("\nHeadless run %s\n", passed ? "passed" : "FAILED");
+	return passed ? S_OK : E_FAIL;
+}
+
+// --------------------------------------------------------
+// Sets the game up to run without presenting: a console, a
+// null renderer matching the device's map rules, and the
+// usual scene.  The device is still needed to load shaders
+// and textures, and to create each emitter's buffers.
+// --------------------------------------------------------
+std::shared_ptr<NullRenderer> Game::InitHeadless()
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	// Debug builds already have a console
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	// Match the real device's map rules, so emitters take the same
+	// upload paths they would when presenting
+	bool noOverwriteAcrossFrames = D3D11Renderer(context).CanNoOverwriteAcrossFrames();
+	std::shared_ptr<NullRenderer> nullRenderer = std::make_shared<NullRenderer>(noOverwriteAcrossFrames);
+	renderer = nullRenderer;
+	headless = true;
+	Init();
+	return nullRenderer;
+}
+
+// --------------------------------------------------------
+// Prints any validation errors from a headless mode, and
+// whether it passed overall
+// --------------------------------------------------------
+HRESULT Game::FinishHeadless(std::shared_ptr<NullRenderer> nullRenderer, bool passed)
+{
+	printf("\nValidation errors: %u\n", nullRenderer->GetErrorCount());
+	for (const std::string& error : nullRenderer->GetErrors())
+		printf("  %s\n", error.c_str());
+
+	passed = passed && nullRenderer->GetErrorCount() == 0;
+	printf("%s\n", passed ? "Passed" : "FAILED");
+	return passed ? S_OK : E_FAIL;
+}
+
+// --------------------------------------------------------
+// Throughput of the CPU particle simulation on its own
+// --------------------------------------------------------
+HRESULT Game::RunSimulationBenchmark()
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	// Debug builds already have a console
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	ParticleSoA::Benchmark(1000000, 20);
+	return S_OK;
+}
+
+// --------------------------------------------------------
+// Back to front sorting of a million particles
+// --------------------------------------------------------
+HRESULT Game::RunSortBenchmark()
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	// Debug builds already have a console
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	ParticleSorter::Benchmark(1000000, &jobs);
+	return S_OK;
+}
+
+// --------------------------------------------------------
+// Neighbor searches and interactions for 100k particles
+// --------------------------------------------------------
+HRESULT Game::RunNeighborBenchmark()
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	// Debug builds already have a console
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	SpatialHashGrid::Benchmark(100000, &jobs);
+	printf("\n");
+	ParticleInteraction::Benchmark(100000, 10, &jobs);
+	return S_OK;
+}
+
+// --------------------------------------------------------
+// How emitter updates scale with more threads
+// --------------------------------------------------------
+HRESULT Game::RunEmitterScalingBenchmark()
+{
+	std::shared_ptr<NullRenderer> nullRenderer = InitHeadless();
+	BenchmarkEmitterScaling(256, 600);
+	return FinishHeadless(nullRenderer, true);
+}
+
+// --------------------------------------------------------
+// Checks that emitter bounds hold every particle
+// --------------------------------------------------------
+HRESULT Game::RunEmitterBoundsTest()
+{
+	std::shared_ptr<NullRenderer> nullRenderer = InitHeadless();
+	bool passed = CheckEmitterBounds(1200);
+	return FinishHeadless(nullRenderer, passed);
+}
+
+// --------------------------------------------------------
+// Individual vs. batched draws of many small emitters
+// --------------------------------------------------------
+HRESULT Game::RunParticleBatchingBenchmark()
+{
+	std::shared_ptr<NullRenderer> nullRenderer = InitHeadless();
+	BenchmarkParticleBatching(500, 120);
+	return FinishHeadless(nullRenderer, true);
+}
+
+// --------------------------------------------------------
+// Thousands of emitters fighting over the particle budget
+// --------------------------------------------------------
+HRESULT Game::RunParticleBudgetStressTest()
+{
+	std::shared_ptr<NullRenderer> nullRenderer = InitHeadless();
+	StressTestParticleBudget(2000, 600);
+	return FinishHeadless(nullRenderer, true);
+}
+
+// --------------------------------------------------------
+// Short lived bursts, with and without the emitter pool
+// --------------------------------------------------------
+HRESULT Game::RunEmitterPoolStressTest()
+{
+	std::shared_ptr<NullRenderer> nullRenderer = InitHeadless();
+	StressTestEmitterPool(200, 600);
+	return FinishHeadless(nullRenderer, true);
+}
+
+// --------------------------------------------------------
+// Runs ShaderReflectionCache::Test() in a console
+// --------------------------------------------------------
+HRESULT Game::RunReflectionCacheTest()
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	// Debug builds already have a console
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	return ShaderReflectionCache::Test() ? S_OK : E_FAIL;
+}
+
+
+// --------------------------------------------------------
+// Times UpdateEmitters() on a large, simulated set of emitters
+// with every thread count from 1 to the hardware's limit.
+// Each run uses identically seeded emitters, so the final
+// checksum should match no matter how many threads were used.
+// --------------------------------------------------------
+void Game::BenchmarkEmitterScaling(int emitterCount, int frameCount)
+{
+	__int64 frequency = 0;
+	__int64 start = 0;
+	__int64 end = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+
+	unsigned int maxThreads = JobSystem::GetHardwareThreadCount();
+	printf("Emitter update scaling: %d emitters, %d frames\n", emitterCount, frameCount);
+
+	double singleThreadMS = 0;
+	for (unsigned int threads = 1; threads <= maxThreads; threads++)
+	{
+		std::vector<std::shared_ptr<Emitter>> emitters;
+		for (int i = 0; i < emitterCount; i++)
+		{
+			std::shared_ptr<Emitter> e = std::make_shared<Emitter>(
+				device,
+				renderer,
+				i + 1,
+				emitterList[0]->GetMaterial(),
+				2000,
+				400,
+				5.0f,
+				1.0f,
+				2.0f,
+				XMFLOAT4(1, 1, 1, 1),
+				XMFLOAT4(1, 1, 1, 0),
+				true,
+				XMFLOAT3((float)(i % 16), 0, (float)(i / 16)),
+				XMFLOAT3(0, 1, 0),
+				XMFLOAT3(0, -0.5f, 0));
+			e->simulate = true;
+			e->forces.Drag = 0.2f;
+			e->forces.CurlStrength = 1.0f;
+			emitters.push_back(e);
+		}
+
+		jobs.SetThreadCount(threads);
+
+		const float deltaTime = 1.0f / 60.0f;
+		QueryPerformanceCounter((LARGE_INTEGER*)&start);
+		for (int f = 0; f < frameCount; f++)
+			UpdateEmitters(emitters, deltaTime, f * deltaTime);
+		QueryPerformanceCounter((LARGE_INTEGER*)&end);
+
+		// Sum up every position so runs can be compared
+		double checksum = 0;
+		for (auto& e : emitters)
+		{
+			ParticleSoA* sim = e->GetSimulation();
+			for (int p = 0; p < sim->GetCapacity(); p++)
+				checksum += sim->PositionX[p] + sim->PositionY[p] + sim->PositionZ[p];
+		}
+
+		double ms = (end - start) * 1000.0 / frequency / frameCount;
+		if (threads == 1) singleThreadMS = ms;
+		printf("  %2u thread(s): %8.3f ms/frame, %5.2fx, checksum %.3f\n", threads, ms, singleThreadMS / ms, checksum);
+	}
+
+	jobs.SetThreadCount(jobThreadCount);
+}
+
+// --------------------------------------------------------
+// Runs a few differently configured emitters and checks,
+// every frame, that their bounds contain every particle.
+// Returns false if any particle was ever outside.
+// --------------------------------------------------------
+bool Game::CheckEmitterBounds(int frameCount)
+{
+	struct BoundsCase
+	{
+		const char* Name;
+		std::shared_ptr<Emitter> EmitterPtr;
+		int Outside;
+		int Checked;
+	};
+
+	// Emitter ctor params: seed, material, max, rate, lifetime, sizes, colors, box, position, velocity, acceleration
+	std::vector<BoundsCase> cases;
+	cases.push_back({ "Fountain", std::make_shared<Emitter>(device, renderer, 1, emitterList[0]->GetMaterial(),
+		500, 100, 3.0f, 1.0f, 1.0f, XMFLOAT4(1, 1, 1, 1), XMFLOAT4(1, 1, 1, 1),
+		false, XMFLOAT3(0, 0, 0), XMFLOAT3(0.5f, 5, -1), XMFLOAT3(0, -4, 0)), 0, 0 });
+	cases.push_back({ "Box", std::make_shared<Emitter>(device, renderer, 2, emitterList[0]->GetMaterial(),
+		500, 100, 4.0f, 1.0f, 1.0f, XMFLOAT4(1, 1, 1, 1), XMFLOAT4(1, 1, 1, 1),
+		true, XMFLOAT3(10, -3, 5), XMFLOAT3(-2, 0, 1), XMFLOAT3(1, 0.5f, -0.5f)), 0, 0 });
+	cases.push_back({ "Moving", std::make_shared<Emitter>(device, renderer, 3, emitterList[0]->GetMaterial(),
+		500, 100, 2.0f, 1.0f, 1.0f, XMFLOAT4(1, 1, 1, 1), XMFLOAT4(1, 1, 1, 1),
+		true, XMFLOAT3(-5, 0, 0), XMFLOAT3(0, 1, 0), XMFLOAT3(0, 0, 0)), 0, 0 });
+	cases.push_back({ "Changing", std::make_shared<Emitter>(device, renderer, 4, emitterList[0]->GetMaterial(),
+		500, 100, 3.0f, 1.0f, 1.0f, XMFLOAT4(1, 1, 1, 1), XMFLOAT4(1, 1, 1, 1),
+		false, XMFLOAT3(0, 5, 0), XMFLOAT3(3, 0, 0), XMFLOAT3(0, -1, 0)), 0, 0 });
+
+	printf("Emitter bounds check: %d frames\n", frameCount);
+
+	const float deltaTime = 1.0f / 60.0f;
+	for (int f = 0; f < frameCount; f++)
+	{
+		float totalTime = f * deltaTime;
+
+		// Keep things changing while particles from before are still alive
+		Emitter* moving = cases[2].EmitterPtr.get();
+		moving->GetTransform()->MoveAbsolute(sinf(totalTime * 3.0f) * 0.2f, 0, cosf(totalTime * 2.0f) * 0.2f);
+
+		Emitter* changing = cases[3].EmitterPtr.get();
+		float turn = totalTime * 0.7f;
+		changing->startVelocity = XMFLOAT3(cosf(turn) * 3.0f, 1.0f, sinf(turn) * 3.0f);
+		changing->SetBudget(1.0f, (f / 90) % 2 ? 0.5f : 1.0f, false);
+
+		for (BoundsCase& c : cases)
+		{
+			c.EmitterPtr->Update(deltaTime, totalTime);
+			c.Outside += c.EmitterPtr->CountParticlesOutsideBounds(totalTime);
+			c.Checked += c.EmitterPtr->GetLivingCount();
+		}
+	}
+
+	bool passed = true;
+	for (BoundsCase& c : cases)
+	{
+		// A case that never had anything alive didn't check anything
+		bool ok = c.Outside == 0 && c.Checked > 0;
+		passed = passed && ok;
+
+		XMFLOAT3 boundsMin, boundsMax;
+		c.EmitterPtr->GetBounds(boundsMin, boundsMax);
+		printf("  %-9s %8d particles checked, %d outside - %s (final size %.1f x %.1f x %.1f)\n",
+			c.Name, c.Checked, c.Outside, ok ? "OK" : "FAILED",
+			boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z);
+	}
+	return passed;
+}
+
+// --------------------------------------------------------
+// Draws a wall of small emitters (split between two materials)
+// one at a time and then batched, and compares the work
+// submitted along with the index buffer memory saved by
+// sharing one quad index buffer
+// --------------------------------------------------------
+void Game::BenchmarkParticleBatching(int emitterCount, int frameCount)
+{
+	__int64 frequency = 0;
+	__int64 start = 0;
+	__int64 end = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+
+	const int maxParticles = 100;
+	std::vector<std::shared_ptr<Emitter>> emitters;
+	for (int i = 0; i < emitterCount; i++)
+	{
+		emitters.push_back(std::make_shared<Emitter>(
+			device,
+			renderer,
+			i + 1,
+			emitterList[i % 2]->GetMaterial(),
+			maxParticles,
+			20,
+			3.0f,
+			0.5f,
+			0.5f,
+			XMFLOAT4(1, 0.5f, 0.2f, 1),
+			XMFLOAT4(0.2f, 0.5f, 1, 0),
+			false,
+			XMFLOAT3((i % 25 - 12) * 0.8f, (i / 25 - 10) * 0.5f, 10.0f),
+			XMFLOAT3(0, 0.5f, 0)));
+	}
+
+	// Fill the emitters up before measuring
+	const float deltaTime = 1.0f / 60.0f;
+	int frame = 0;
+	for (; frame < 180; frame++)
+		UpdateEmitters(emitters, deltaTime, frame * deltaTime);
+
+	printf("Particle batching: %d emitters, %d frames\n", emitterCount, frameCount);
+
+	const char* modes[] = { "Individual", "Batched" };
+	for (int mode = 0; mode < 2; mode++)
+	{
+		RenderStats total;
+		__int64 drawTicks = 0;
+		int drawn = 0;
+		for (int f = 0; f < frameCount; f++, frame++)
+		{
+			float totalTime = frame * deltaTime;
+			UpdateEmitters(emitters, deltaTime, totalTime);
+
+			renderer->BeginFrame();
+			QueryPerformanceCounter((LARGE_INTEGER*)&start);
+			if (mode == 1)
+			{
+				drawn = particleBatcher->Draw(emitters, camera, totalTime);
+			}
+			else
+			{
+				drawn = 0;
+				for (auto& e : emitters)
+					if (e->Draw(camera, totalTime)) drawn++;
+			}
+			QueryPerformanceCounter((LARGE_INTEGER*)&end);
+			renderer->EndFrame();
+
+			drawTicks += end - start;
+			total.Add(renderer->GetFrameStats());
+		}
+
+		double frames = frameCount > 0 ? (double)frameCount : 1.0;
+		printf("  %-10s %4d emitters drawn, %6.1f draw calls, %7.1f CB updates, %6.1f buffer writes (%.0f bytes), %.4f ms/frame\n",
+			modes[mode], drawn,
+			total.DrawCalls / frames,
+			total.ConstantBufferUpdates / frames,
+			total.BufferWrites / frames,
+			total.BufferBytesWritten / frames,
+			drawTicks * 1000.0 / frequency / frames);
+	}
+
+	// Each emitter used to build its own maxParticles * 6 indices,
+	// while now only sorted emitters have any of their own
+	unsigned long long perEmitterBytes = (unsigned long long)emitterCount * maxParticles * 6 * sizeof(unsigned int);
+	unsigned long long sharedBytes = QuadIndexBuffer::GetShared(device, renderer)->GetMemoryUsage();
+	unsigned long long sortedBytes = 0;
+	for (auto& e : emitters)
+		sortedBytes += e->GetIndexMemoryUsage();
+	unsigned long long allocatedBytes = sharedBytes + sortedBytes;
+	printf("  Index buffers: %.1f KB as one per emitter, %.1f KB allocated (%.1f KB shared, %.1f KB sorted, %.1f KB saved)\n",
+		perEmitterBytes / 1024.0, allocatedBytes / 1024.0, sharedBytes / 1024.0, sortedBytes / 1024.0,
+		perEmitterBytes > allocatedBytes ? (perEmitterBytes - allocatedBytes) / 1024.0 : 0.0);
+}
+
+// --------------------------------------------------------
+// Runs thousands of emitters, scattered around a slowly
+// spinning camera, through the particle budget and reports
+// how well the live particle cap holds
+// --------------------------------------------------------
+void Game::StressTestParticleBudget(int emitterCount, int frameCount)
+{
+	__int64 frequency = 0;
+	__int64 start = 0;
+	__int64 mid = 0;
+	__int64 end = 0;
+	__int64 budgetTicks = 0;
+	__int64 updateTicks = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+
+	// Same layout every run
+	PCG32 layout;
+	layout.Seed(542, 36);
+
+	std::vector<std::shared_ptr<Emitter>> emitters;
+	for (int i = 0; i < emitterCount; i++)
+	{
+		float angle = layout.Range(0.0f, XM_2PI);
+		float distance = layout.Range(5.0f, 150.0f);
+		std::shared_ptr<Emitter> e = std::make_shared<Emitter>(
+			device,
+			renderer,
+			i + 1,
+			emitterList[0]->GetMaterial(),
+			200,
+			50,
+			4.0f,
+			0.5f,
+			1.0f,
+			XMFLOAT4(1, 1, 1, 1),
+			XMFLOAT4(1, 1, 1, 0),
+			false,
+			XMFLOAT3(cosf(angle) * distance, layout.Range(-5.0f, 5.0f), sinf(angle) * distance),
+			XMFLOAT3(0, 1, 0),
+			XMFLOAT3(0, 0, 0));
+		e->priority = layout.Range(0.5f, 2.0f);
+		emitters.push_back(e);
+	}
+
+	// A budget of its own, with the default limits, so neither
+	// the scene's budget nor its UI settings affect the results
+	ParticleBudget budget;
+
+	// The camera turns all the way around over the run
+	std::shared_ptr<Camera> stressCamera = std::make_shared<Camera>(
+		0.0f, 0.0f, 0.0f, 1.0f, 1.0f, XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f);
+
+	double liveSum = 0;
+	double pausedSum = 0;
+	double throttledSum = 0;
+	int peakLive = 0;
+	int framesOverCap = 0;
+
+	const float deltaTime = 1.0f / 60.0f;
+	for (int f = 0; f < frameCount; f++)
+	{
+		stressCamera->GetTransform()->Rotate(0, XM_2PI / frameCount, 0);
+
+		QueryPerformanceCounter((LARGE_INTEGER*)&start);
+		budget.Update(emitters, stressCamera, deltaTime);
+		QueryPerformanceCounter((LARGE_INTEGER*)&mid);
+		UpdateEmitters(emitters, deltaTime, f * deltaTime);
+		QueryPerformanceCounter((LARGE_INTEGER*)&end);
+
+		budgetTicks += mid - start;
+		updateTicks += end - mid;
+
+		// Live counts lag the budget by a frame, so count after updating
+		int live = 0;
+		for (auto& e : emitters)
+			live += e->GetLivingCount();
+
+		const ParticleBudget::Stats& stats = budget.GetStats();
+		liveSum += live;
+		pausedSum += stats.PausedCount;
+		throttledSum += stats.ThrottledCount;
+		if (live > peakLive) peakLive = live;
+		if (live > stats.ParticleCap) framesOverCap++;
+	}
+
+	const ParticleBudget::Stats& stats = budget.GetStats();
+	double frames = frameCount > 0 ? (double)frameCount : 1.0;
+	printf("Particle budget stress test: %d emitters, %d frames\n", emitterCount, frameCount);
+	printf("  Cap: %d particles, demand: %.0f particles\n", stats.ParticleCap, stats.TotalDemand);
+	printf("  Live: %.0f average, %d peak, over cap on %d frame(s)\n", liveSum / frames, peakLive, framesOverCap);
+	printf("  Paused: %.1f average, throttled: %.1f average\n", pausedSum / frames, throttledSum / frames);
+	printf("  Memory: %.2f MB live, %.2f MB reserved\n", stats.LiveMemory / 1048576.0, stats.ReservedMemory / 1048576.0);
+	printf("  Budget: %.4f ms/frame, emitter update: %.4f ms/frame\n",
+		budgetTicks * 1000.0 / frequency / frames,
+		updateTicks * 1000.0 / frequency / frames);
+	printf("  Rate scale histogram (last frame):\n");
+	for (int b = 0; b < ParticleBudget::HistogramBuckets; b++)
+		printf("    %3d%% - %3d%%: %d\n", b * 10, (b + 1) * 10, stats.RateScaleHistogram[b]);
+}
+
+// --------------------------------------------------------
+// Fires a steady stream of short lived bursts, first with a
+// new emitter for each (destroyed once it's done) and then
+// through an emitter pool, and reports how often each one
+// allocates particle storage and GPU resources
+// --------------------------------------------------------
+void Game::StressTestEmitterPool(int burstsPerSecond, int frameCount)
+{
+	__int64 frequency = 0;
+	__int64 start = 0;
+	__int64 end = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+
+	const float deltaTime = 1.0f / 60.0f;
+	const float interval = 1.0f / burstsPerSecond;
+	double seconds = frameCount * deltaTime;
+
+	printf("Burst emitter stress test: %d bursts/second, %d frames\n", burstsPerSecond, frameCount);
+	for (int pooled = 0; pooled < 2; pooled++)
+	{
+		// Same bursts both times
+		PCG32 layout;
+		layout.Seed(542, 40);
+
+		EmitterPool pool(device, renderer, 65536);
+		std::vector<std::shared_ptr<Emitter>> unpooled;
+		Emitter::AllocationCounts before = Emitter::GetAllocationCounts();
+
+		float timeSinceBurst = 0.0f;
+		long long bursts = 0;
+		int peakActive = 0;
+		int peakParticles = 0;
+
+		QueryPerformanceCounter((LARGE_INTEGER*)&start);
+		for (int f = 0; f < frameCount; f++)
+		{
+			float totalTime = f * deltaTime;
+			timeSinceBurst += deltaTime;
+			while (timeSinceBurst >= interval)
+			{
+				timeSinceBurst -= interval;
+
+				ParticleBurst burst;
+				burst.MaterialPtr = burstMaterial;
+				burst.Count = (int)layout.Range(50.0f, 2000.0f);
+				burst.Lifetime = layout.Range(0.25f, 1.5f);
+				burst.Position = XMFLOAT3(layout.Range(-20.0f, 20.0f), layout.Range(0.0f, 10.0f), layout.Range(-20.0f, 20.0f));
+				burst.Speed = layout.Range(2.0f, 5.0f);
+				burst.Acceleration = XMFLOAT3(0, -4.0f, 0);
+				bursts++;
+
+				if (pooled)
+				{
+					pool.Burst(burst, totalTime);
+					continue;
+				}
+
+				// Seeded like the pool seeds its bursts
+				std::shared_ptr<Emitter> e = std::make_shared<Emitter>(
+					device,
+					renderer,
+					(unsigned int)bursts,
+					burst.MaterialPtr,
+					burst.Count,
+					0,
+					burst.Lifetime,
+					burst.StartSize,
+					burst.EndSize,
+					burst.StartColor,
+					burst.EndColor,
+					burst.IsBox,
+					burst.Position,
+					burst.Velocity,
+					burst.Acceleration);
+				e->EmitBurst(burst.Count, burst.Speed, totalTime);
+				unpooled.push_back(e);
+			}
+
+			std::vector<std::shared_ptr<Emitter>>& emitters = pooled ? pool.GetActive() : unpooled;
+			UpdateEmitters(emitters, deltaTime, totalTime);
+
+			int particles = 0;
+			for (auto& e : emitters)
+				particles += e->GetLivingCount();
+			if ((int)emitters.size() > peakActive) peakActive = (int)emitters.size();
+			if (particles > peakParticles) peakParticles = particles;
+
+			// Finished bursts go back to the pool, or are destroyed
+			if (pooled)
+			{
+				pool.Recycle();
+			}
+			else
+			{
+				unpooled.erase(
+					std::remove_if(unpooled.begin(), unpooled.end(),
+						[](const std::shared_ptr<Emitter>& e) { return e->GetLivingCount() == 0; }),
+					unpooled.end());
+			}
+		}
+		QueryPerformanceCounter((LARGE_INTEGER*)&end);
+
+		// Pooled particle storage comes from the arena instead
+		Emitter::AllocationCounts after = Emitter::GetAllocationCounts();
+		long long emittersCreated = after.EmittersCreated - before.EmittersCreated;
+		long long gpuResources = after.GpuResources - before.GpuResources;
+		long long particleArrays = after.ParticleArrays - before.ParticleArrays;
+		if (pooled)
+			particleArrays += pool.GetArenaStats().HeapAllocations;
+
+		printf("  %-8s %lld bursts, %d peak active (%d particles), %.4f ms/frame\n",
+			pooled ? "Pooled" : "Unpooled",
+			bursts, peakActive, peakParticles,
+			(end - start) * 1000.0 / frequency / frameCount);
+		printf("           Per second: %.1f emitters created, %.1f GPU resources created, %.1f particle storage allocations\n",
+			emittersCreated / seconds, gpuResources / seconds, particleArrays / seconds);
+		if (pooled)
+		{
+			const ParticleArena::Stats& arenaStats = pool.GetArenaStats();
+			printf("           Arena: %.2f MB reserved, %lld allocations (%lld reused)\n",
+				arenaStats.ReservedBytes / 1048576.0, arenaStats.Allocations, arenaStats.Reuses);
+		}
+	}
+}
+
 // --------------------------------------------------------
 // Draws the point lights as solid color spheres
 // --------------------------------------------------------
@@ -760,7 +1604,7 @@ void Game::DrawPointLights()
 		lightPS->CopyAllBufferData();
 
 		// Draw
-		lightMesh->SetBuffersAndDraw(context);
+		lightMesh->SetBuffersAndDraw(renderer);
 	}
 
 }
@@ -925,6 +1769,124 @@ void Game::BuildUI()
 			// Finalize the tree node
 			ImGui::TreePop();
 		}
+
+		// === Particles ===
+		if (ImGui::TreeNode("Particles"))
+		{
+			int maxThreads = (int)JobSystem::GetHardwareThreadCount();
+			int threads = (int)jobs.GetThreadCount();
+			if (ImGui::SliderInt("Update Threads", &threads, 1, maxThreads))
+			{
+				jobThreadCount = threads;
+				jobs.SetThreadCount(threads);
+			}
+			ImGui::Text("Emitters drawn: %d / %d", emittersDrawn, (int)frameEmitters.size());
+			ImGui::Checkbox("Batch Emitters", &batchParticles);
+			if (batchParticles)
+				ImGui::Text("Batches: %d, holding %d emitter(s)", particleBatcher->GetBatchCount(), particleBatcher->GetBatchedEmitterCount());
+
+			ImGui::SliderFloat("Bursts Per Second", &burstsPerSecond, 0.0f, 20.0f);
+			const EmitterPool::Stats& poolStats = burstPool->GetStats();
+			const ParticleArena::Stats& arenaStats = burstPool->GetArenaStats();
+			ImGui::Text("Bursts: %d active, %d pooled emitter(s)", poolStats.ActiveCount, poolStats.PooledCount);
+			ImGui::Text("Burst emitters: %lld created, %lld reused", poolStats.EmittersCreated, poolStats.EmittersReused);
+			ImGui::Text("Particle arena: %.2f / %.2f MB, %lld heap allocation(s)",
+				arenaStats.UsedBytes / 1048576.0, arenaStats.ReservedBytes / 1048576.0, arenaStats.HeapAllocations);
+
+			for (int i = 0; i < emitterList.size(); i++)
+			{
+				ImGui::PushID(i);
+				if (ImGui::TreeNode("Emitter Node", "Emitter %d", i))
+				{
+					std::shared_ptr<Emitter> e = emitterList[i];
+					ImGui::Checkbox("CPU Simulation", &e->simulate);
+					ImGui::Checkbox("Delta Uploads", &e->deltaUploads);
+					ImGui::Checkbox("Sort Back To Front", &e->sortParticles);
+					ImGui::Checkbox("Alpha Blended", &e->alphaBlend);
+					ImGui::Checkbox("Frustum Culling", &e->frustumCulling);
+					ImGui::SliderInt("Sort Every N Frames", &e->sortInterval, 1, 30);
+					ImGui::DragFloat3("Acceleration", &e->acceleration.x, 0.01f);
+					ImGui::SliderFloat("Drag", &e->forces.Drag, 0.0f, 5.0f);
+					ImGui::SliderFloat("Curl Strength", &e->forces.CurlStrength, 0.0f, 10.0f);
+					ImGui::SliderFloat("Curl Scale", &e->forces.CurlScale, 0.01f, 2.0f);
+					ImGui::SliderFloat("Curl Speed", &e->forces.CurlSpeed, 0.0f, 5.0f);
+					ImGui::SliderFloat("Size Variance", &e->sizeVariance, 0.0f, 1.0f);
+
+					// Neighbor interactions
+					ParticleInteractionSettings& interaction = e->forces.Interaction;
+					int mode = (int)interaction.Mode;
+					const char* modeNames[] = { "None", "Boids", "Fluid" };
+					if (ImGui::Combo("Interaction", &mode, modeNames, 3))
+						interaction.Mode = (ParticleInteractionMode)mode;
+					if (interaction.Mode != ParticleInteractionMode::None)
+					{
+						ImGui::SliderFloat("Interaction Radius", &interaction.Radius, 0.1f, 5.0f);
+						ImGui::Text("Average neighbors: %.1f", e->GetInteraction()->GetAverageNeighbors());
+					}
+					if (interaction.Mode == ParticleInteractionMode::Boids)
+					{
+						ImGui::SliderFloat("Separation", &interaction.Separation, 0.0f, 5.0f);
+						ImGui::SliderFloat("Alignment", &interaction.Alignment, 0.0f, 5.0f);
+						ImGui::SliderFloat("Cohesion", &interaction.Cohesion, 0.0f, 5.0f);
+						ImGui::SliderFloat("Max Speed", &interaction.MaxSpeed, 0.1f, 20.0f);
+					}
+					else if (interaction.Mode == ParticleInteractionMode::Fluid)
+					{
+						ImGui::SliderFloat("Particle Mass", &interaction.ParticleMass, 0.1f, 5.0f);
+						ImGui::SliderFloat("Rest Density", &interaction.RestDensity, 0.0f, 20.0f);
+						ImGui::SliderFloat("Stiffness", &interaction.Stiffness, 0.0f, 20.0f);
+						ImGui::SliderFloat("Viscosity", &interaction.Viscosity, 0.0f, 5.0f);
+					}
+
+					for (int a = 0; a < e->forces.Attractors.size(); a++)
+					{
+						ImGui::PushID(a);
+						ImGui::DragFloat3("Attractor", &e->forces.Attractors[a].Position.x, 0.01f);
+						ImGui::SliderFloat("Attractor Strength", &e->forces.Attractors[a].Strength, -10.0f, 10.0f);
+						ImGui::PopID();
+					}
+					ImGui::TreePop();
+				}
+				ImGui::PopID();
+			}
+
+			// Finalize the tree node
+			ImGui::TreePop();
+		}
+
+		// === Particle Budget ===
+		if (ImGui::TreeNode("Particle Budget"))
+		{
+			ImGui::SliderInt("Max Live Particles", &particleBudget.MaxLiveParticles, 0, 200000);
+			int memoryMB = (int)(particleBudget.MaxLiveMemory / (1024 * 1024));
+			if (ImGui::SliderInt("Max Live Memory (MB)", &memoryMB, 1, 256))
+				particleBudget.MaxLiveMemory = (unsigned long long)memoryMB * 1024 * 1024;
+			ImGui::Checkbox("Pause Offscreen Emitters", &particleBudget.PauseOffscreen);
+			ImGui::SliderFloat("Full Detail Distance", &particleBudget.FullDetailDistance, 1.0f, 100.0f);
+			ImGui::SliderFloat("Min Lifetime Scale", &particleBudget.MinLifetimeScale, 0.1f, 1.0f);
+			ImGui::SliderFloat("Full Coverage", &particleBudget.FullCoverage, 0.01f, 1.0f);
+			ImGui::SliderFloat("Recovery Rate", &particleBudget.RecoveryRate, 0.1f, 10.0f);
+
+			const ParticleBudget::Stats& stats = particleBudget.GetStats();
+			ImGui::Text("Live: %d / %d", stats.LiveParticles, stats.ParticleCap);
+			ImGui::Text("Demand: %.0f, allocated: %.0f", stats.TotalDemand, stats.TotalAllocation);
+			ImGui::Text("Memory: %.2f MB live, %.2f MB reserved", stats.LiveMemory / 1048576.0, stats.ReservedMemory / 1048576.0);
+			ImGui::Text("Emitters: %d visible, %d paused, %d throttled", stats.VisibleCount, stats.PausedCount, stats.ThrottledCount);
+
+			const std::vector<ParticleBudget::EmitterRecord>& records = particleBudget.GetRecords();
+			for (int i = 0; i < emitterList.size() && i < records.size(); i++)
+			{
+				const ParticleBudget::EmitterRecord& rec = records[i];
+				ImGui::PushID(i);
+				ImGui::SliderFloat("Priority", &emitterList[i]->priority, 0.0f, 4.0f);
+				ImGui::Text("Emitter %d: rate %.0f%%, lifetime %.0f%%, %s", i,
+					rec.RateScale * 100.0f, rec.LifetimeScale * 100.0f, rec.Visible ? "visible" : "offscreen");
+				ImGui::PopID();
+			}
+
+			// Finalize the tree node
+			ImGui::TreePop();
+		}
 	}
 	ImGui::End();
 }
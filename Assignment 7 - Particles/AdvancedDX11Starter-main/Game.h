@@ -7,7 +7,14 @@
 #include "SimpleShader.h"
 #include "Lights.h"
 #include "Sky.h"
+#include "Random.h"
 #include "Emitter.h"
+#include "Renderer.h"
+#include "NullRenderer.h"
+#include "JobSystem.h"
+#include "ParticleBudget.h"
+#include "ParticleBatch.h"
+#include "EmitterPool.h"
 
 #include <DirectXMath.h>
 #include <wrl/client.h>
@@ -28,12 +35,41 @@ public:
 	void Update(float deltaTime, float totalTime);
 	void Draw(float deltaTime, float totalTime);
 
+	// Runs the game loop without a GPU backend and reports timings
+	HRESULT RunHeadless(int frameCount);
+
+	// CPU only particle benchmarks, without a window or GPU
+	HRESULT RunSimulationBenchmark();
+	HRESULT RunSortBenchmark();
+	HRESULT RunNeighborBenchmark();
+
+	// Emitter benchmarks and checks, drawn with a null renderer
+	// like RunHeadless()
+	HRESULT RunEmitterScalingBenchmark();
+	HRESULT RunEmitterBoundsTest();
+	HRESULT RunParticleBatchingBenchmark();
+	HRESULT RunParticleBudgetStressTest();
+	HRESULT RunEmitterPoolStressTest();
+
+	// Checks the shader reflection cache's file format, without
+	// a window or GPU
+	HRESULT RunReflectionCacheTest();
+
 private:
 
+	// Issues all per-frame rendering work
+	std::shared_ptr<IRenderer> renderer;
+	bool headless;
+	std::shared_ptr<NullRenderer> InitHeadless();
+	HRESULT FinishHeadless(std::shared_ptr<NullRenderer> nullRenderer, bool passed);
+
 	// Our scene
 	std::vector<std::shared_ptr<GameEntity>> entities;
 	std::shared_ptr<Camera> camera;
 
+	// General purpose random numbers (point light placement)
+	PCG32 random;
+
 	// Lights
 	std::vector<Light> lights;
 	int lightCount;
@@ -67,8 +103,47 @@ private:
 	bool showUIDemoWindow;
 
 	std::vector<std::shared_ptr<Emitter>> emitterList;
+	int emittersDrawn;
+
+	// One-shot bursts, recycled through a pool, and every
+	// emitter (regular and burst) updated this frame
+	std::shared_ptr<EmitterPool> burstPool;
+	std::shared_ptr<Material> burstMaterial;
+	PCG32 burstRandom;
+	float burstsPerSecond;
+	float timeSinceBurst;
+	std::vector<std::shared_ptr<Emitter>> frameEmitters;
+	void SpawnBursts(float deltaTime, float totalTime);
+	void GatherFrameEmitters();
+	void StressTestEmitterPool(int burstsPerSecond, int frameCount);
+
+	// Emitters sharing a material can be drawn together
+	std::shared_ptr<ParticleBatcher> particleBatcher;
+	bool batchParticles;
+	void BenchmarkParticleBatching(int emitterCount, int frameCount);
+	bool CheckEmitterBounds(int frameCount);
+
+	// Emitters are updated in parallel, with big emitters split
+	// into chunks of particles for the simulation step
+	struct EmitterChunk
+	{
+		Emitter* EmitterPtr;
+		int Start;
+		int End;
+	};
+	static const int ParticlesPerChunk = 4096;
+	JobSystem jobs;
+	int jobThreadCount;
+	std::vector<EmitterChunk> emitterChunks;
+	void UpdateEmitters(std::vector<std::shared_ptr<Emitter>>& emitters, float deltaTime, float totalTime);
+	void BenchmarkEmitterScaling(int emitterCount, int frameCount);
+
+	// Caps the live particles across every emitter
+	ParticleBudget particleBudget;
+	void StressTestParticleBudget(int emitterCount, int frameCount);
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> particleDepthState;
 	Microsoft::WRL::ComPtr<ID3D11BlendState> particleBlendState;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> particleAlphaBlendState;
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> particleRasterState;
 };
 
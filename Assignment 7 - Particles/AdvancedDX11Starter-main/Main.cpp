@@ -1,5 +1,7 @@
 
 #include <Windows.h>
+#include <stdlib.h>
+#include <string.h>
 #include "Game.h"
 
 // --------------------------------------------------------
@@ -22,6 +24,19 @@ int WINAPI WinMain(
 	// the app handle we got from WinMain
 	Game dxGame(hInstance);
 
+	// "-reflectioncache" checks the shader reflection cache's file
+	// format, and never needs a window or a GPU
+	if (strstr(lpCmdLine, "-reflectioncache"))
+		return dxGame.RunReflectionCacheTest();
+
+	// CPU only particle benchmarks, which don't need one either
+	if (strstr(lpCmdLine, "-simbenchmark"))
+		return dxGame.RunSimulationBenchmark();
+	if (strstr(lpCmdLine, "-sortbenchmark"))
+		return dxGame.RunSortBenchmark();
+	if (strstr(lpCmdLine, "-neighborbenchmark"))
+		return dxGame.RunNeighborBenchmark();
+
 	// Result variable for function calls below
 	HRESULT hr = S_OK;
 
@@ -35,6 +50,28 @@ int WINAPI WinMain(
 	hr = dxGame.InitDirect3D();
 	if (FAILED(hr)) return hr;
 
+	// "-headless [frames]" runs the game loop without presenting
+	// anything, and prints CPU timings and renderer stats instead
+	const char* headlessArg = strstr(lpCmdLine, "-headless");
+	if (headlessArg)
+	{
+		int frames = atoi(headlessArg + strlen("-headless"));
+		return dxGame.RunHeadless(frames > 0 ? frames : 1000);
+	}
+
+	// Emitter benchmarks and checks, which load the scene's assets
+	// like "-headless" but never present anything either
+	if (strstr(lpCmdLine, "-emitterscaling"))
+		return dxGame.RunEmitterScalingBenchmark();
+	if (strstr(lpCmdLine, "-emitterbounds"))
+		return dxGame.RunEmitterBoundsTest();
+	if (strstr(lpCmdLine, "-particlebatching"))
+		return dxGame.RunParticleBatchingBenchmark();
+	if (strstr(lpCmdLine, "-particlebudget"))
+		return dxGame.RunParticleBudgetStressTest();
+	if (strstr(lpCmdLine, "-emitterpool"))
+		return dxGame.RunEmitterPoolStressTest();
+
 	// Begin the message and game loop, and then return
 	// whatever we get back once the game loop is over
 	return dxGame.Run();
@@ -341,16 +341,14 @@ void Mesh::CalculateTangents(Vertex* verts, size_t numVerts, unsigned int* indic
 // Binds the mesh buffers and issues a draw call.  Note that
 // this method assumes you're drawing the entire mesh.
 // 
-// context - D3D context for issuing rendering calls
+// renderer - Renderer for issuing rendering calls
 // --------------------------------------------------------
-void Mesh::SetBuffersAndDraw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+void Mesh::SetBuffersAndDraw(std::shared_ptr<IRenderer> renderer)
 {
 	// Set buffers in the input assembler
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	context->IASetVertexBuffers(0, 1, vb.GetAddressOf(), &stride, &offset);
-	context->IASetIndexBuffer(ib.Get(), DXGI_FORMAT_R32_UINT, 0);
+	renderer->SetVertexBuffer(vb.Get(), sizeof(Vertex));
+	renderer->SetIndexBuffer(ib.Get());
 
 	// Draw this mesh
-	context->DrawIndexed(this->numIndices, 0, 0);
+	renderer->DrawIndexed(this->numIndices, 0, 0);
 }
@@ -2,9 +2,11 @@
 
 #include <d3d11.h>
 #include <wrl/client.h>
+#include <memory>
 #include <string>
 
 #include "Vertex.h"
+#include "Renderer.h"
 
 
 class Mesh
@@ -20,7 +22,7 @@ public:
 	unsigned int GetIndexCount();
 
 	// Basic mesh drawing
-	void SetBuffersAndDraw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	void SetBuffersAndDraw(std::shared_ptr<IRenderer> renderer);
 
 private:
 	// D3D buffers
@@ -0,0 +1,228 @@
+#include "NullRenderer.h"
+
+#include <string.h>
+
+NullRenderer::NullRenderer(bool noOverwriteAcrossFrames) :
+	indexBuffer(0),
+	vertexShader(0),
+	pixelShader(0),
+	renderTarget(0),
+	noOverwriteAcrossFrames(noOverwriteAcrossFrames),
+	errorCount(0)
+{
+}
+
+void NullRenderer::DescribeBuffer(ID3D11Buffer* buffer, unsigned int byteWidth, bool dynamic)
+{
+	if (!buffer)
+	{
+		Error("DescribeBuffer() - Buffer is null");
+		return;
+	}
+
+	BufferInfo& info = buffers[buffer];
+	info.ByteWidth = byteWidth;
+	info.Dynamic = dynamic;
+	info.DiscardFrame = -1;
+	info.Shadow.clear();
+}
+
+// --------------------------------------------------------
+// Checks each range against what we know about the buffer,
+// then copies the data into the buffer's shadow storage.
+// The whole call counts as a single map, which fails if any
+// range is rejected.
+// --------------------------------------------------------
+bool NullRenderer::WriteBufferRanges(ID3D11Buffer* buffer, RenderMapType mapType, const RenderBufferRange* ranges, unsigned int rangeCount)
+{
+	if (!buffer || (rangeCount > 0 && !ranges))
+	{
+		Error("WriteBuffer() - Buffer or ranges are null");
+		frameStats.FailedMaps++;
+		return false;
+	}
+
+	// Zero-sized writes are legal, but wasteful
+	frameStats.BufferWrites++;
+
+	auto it = buffers.find(buffer);
+	if (it == buffers.end())
+	{
+		// Unknown buffer - we can't validate, but can still copy
+		BufferInfo& info = buffers[buffer];
+		for (unsigned int i = 0; i < rangeCount; i++)
+			if (ranges[i].ByteOffset + ranges[i].Size > info.ByteWidth)
+				info.ByteWidth = ranges[i].ByteOffset + ranges[i].Size;
+		info.Dynamic = true;
+		info.DiscardFrame = (long long)frameCount;
+		it = buffers.find(buffer);
+	}
+
+	BufferInfo& info = it->second;
+	if (!info.Dynamic)
+		Error("WriteBuffer() - Mapping a buffer that isn't dynamic");
+
+	// A no-overwrite map is only valid once the buffer has been
+	// discarded, and unless the device can keep writing into a
+	// buffer the GPU is reading, only within the same frame
+	if (mapType == RenderMapType::WriteDiscard)
+		info.DiscardFrame = (long long)frameCount;
+	else if (info.DiscardFrame < 0)
+		Error("WriteBuffer() - No-overwrite write before the buffer was ever discarded");
+	else if (!noOverwriteAcrossFrames && info.DiscardFrame != (long long)frameCount)
+		Error("WriteBuffer() - No-overwrite write on a buffer that wasn't discarded this frame");
+
+	if (info.Shadow.size() < info.ByteWidth)
+		info.Shadow.resize(info.ByteWidth);
+
+	bool written = true;
+	for (unsigned int i = 0; i < rangeCount; i++)
+	{
+		const RenderBufferRange& range = ranges[i];
+		if (!range.Data)
+		{
+			Error("WriteBuffer() - Range data is null");
+			written = false;
+			continue;
+		}
+		if ((unsigned long long)range.ByteOffset + range.Size > info.ByteWidth)
+		{
+			Error("WriteBuffer() - Write of " + std::to_string(range.Size) + " bytes at offset " + std::to_string(range.ByteOffset) +
+				" overruns buffer of " + std::to_string(info.ByteWidth) + " bytes");
+			written = false;
+			continue;
+		}
+
+		frameStats.BufferBytesWritten += range.Size;
+		if (range.Size > 0)
+			memcpy(info.Shadow.data() + range.ByteOffset, range.Data, range.Size);
+	}
+
+	if (!written)
+		frameStats.FailedMaps++;
+	return written;
+}
+
+void NullRenderer::UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size)
+{
+	if (!buffer || !data)
+		Error("UpdateConstantBuffer() - Buffer or data is null");
+	if (size % 16 != 0)
+		Error("UpdateConstantBuffer() - Size " + std::to_string(size) + " isn't a multiple of 16 bytes");
+
+	frameStats.ConstantBufferUpdates++;
+	frameStats.ConstantBufferBytes += size;
+}
+
+void NullRenderer::SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride)
+{
+	if (buffer && stride == 0)
+		Error("SetVertexBuffer() - Stride is zero");
+	frameStats.Bindings++;
+}
+
+void NullRenderer::SetIndexBuffer(ID3D11Buffer* buffer)
+{
+	indexBuffer = buffer;
+	frameStats.Bindings++;
+}
+
+void NullRenderer::SetVertexShader(ID3D11VertexShader* shader, ID3D11InputLayout* /*inputLayout*/)
+{
+	vertexShader = shader;
+	frameStats.Bindings++;
+}
+
+void NullRenderer::SetPixelShader(ID3D11PixelShader* shader)
+{
+	pixelShader = shader;
+	frameStats.Bindings++;
+}
+
+void NullRenderer::SetConstantBuffer(RenderShaderStage /*stage*/, unsigned int slot, ID3D11Buffer* /*buffer*/)
+{
+	if (slot >= 14) // D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT
+		Error("SetConstantBuffer() - Slot " + std::to_string(slot) + " is out of range");
+	frameStats.Bindings++;
+}
+
+void NullRenderer::SetShaderResource(RenderShaderStage /*stage*/, unsigned int slot, ID3D11ShaderResourceView* /*srv*/)
+{
+	if (slot >= 128) // D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT
+		Error("SetShaderResource() - Slot " + std::to_string(slot) + " is out of range");
+	frameStats.Bindings++;
+}
+
+void NullRenderer::SetSampler(RenderShaderStage /*stage*/, unsigned int slot, ID3D11SamplerState* /*sampler*/)
+{
+	if (slot >= 16) // D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT
+		Error("SetSampler() - Slot " + std::to_string(slot) + " is out of range");
+	frameStats.Bindings++;
+}
+
+void NullRenderer::SetRasterizerState(ID3D11RasterizerState* /*state*/) { frameStats.Bindings++; }
+void NullRenderer::SetDepthStencilState(ID3D11DepthStencilState* /*state*/) { frameStats.Bindings++; }
+void NullRenderer::SetBlendState(ID3D11BlendState* /*state*/) { frameStats.Bindings++; }
+
+void NullRenderer::SetRenderTarget(ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* /*dsv*/)
+{
+	renderTarget = rtv;
+	frameStats.Bindings++;
+}
+
+void NullRenderer::ClearRenderTarget(ID3D11RenderTargetView* rtv, const float /*color*/[4])
+{
+	if (!rtv)
+		Error("ClearRenderTarget() - Render target is null");
+	frameStats.Clears++;
+}
+
+void NullRenderer::ClearDepth(ID3D11DepthStencilView* dsv, float depth)
+{
+	if (!dsv)
+		Error("ClearDepth() - Depth buffer is null");
+	if (depth < 0.0f || depth > 1.0f)
+		Error("ClearDepth() - Depth value is outside [0, 1]");
+	frameStats.Clears++;
+}
+
+void NullRenderer::Draw(unsigned int vertexCount, unsigned int /*startVertex*/)
+{
+	ValidateDraw("Draw()");
+	frameStats.DrawCalls++;
+	frameStats.VerticesDrawn += vertexCount;
+}
+
+void NullRenderer::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int /*baseVertex*/)
+{
+	ValidateDraw("DrawIndexed()");
+	if (!indexBuffer)
+		Error("DrawIndexed() - No index buffer is bound");
+	else
+	{
+		// Make sure we don't read past the end of the index buffer
+		auto it = buffers.find(indexBuffer);
+		if (it != buffers.end() && ((unsigned long long)startIndex + indexCount) * sizeof(unsigned int) > it->second.ByteWidth)
+			Error("DrawIndexed() - Drawing " + std::to_string(indexCount) + " indices overruns the index buffer");
+	}
+
+	frameStats.DrawCalls++;
+	frameStats.IndicesDrawn += indexCount;
+}
+
+void NullRenderer::ValidateDraw(const char* call)
+{
+	if (!vertexShader)
+		Error(std::string(call) + " - No vertex shader is bound");
+	if (!pixelShader)
+		Error(std::string(call) + " - No pixel shader is bound");
+	if (!renderTarget)
+		Error(std::string(call) + " - No render target is bound");
+}
+
+void NullRenderer::Error(const std::string& message)
+{
+	errorCount++;
+	if (errors.size() < MaxStoredErrors)
+		errors.push_back(message);
+}
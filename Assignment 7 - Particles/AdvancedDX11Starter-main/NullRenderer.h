@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Renderer.h"
+
+// --------------------------------------------------------
+// A renderer that never touches the GPU.
+//
+// Every command is validated against the current state and
+// counted, and buffer writes are copied into CPU-side
+// shadow storage so upload costs still show up when
+// profiling.  It has no Direct3D dependency at all, so it
+// builds and runs anywhere.
+// --------------------------------------------------------
+class NullRenderer : public IRenderer
+{
+public:
+	NullRenderer(bool noOverwriteAcrossFrames = false);
+
+	void DescribeBuffer(ID3D11Buffer* buffer, unsigned int byteWidth, bool dynamic);
+
+	// Pretends to be a device with or without the 11.1 feature
+	bool CanNoOverwriteAcrossFrames() { return noOverwriteAcrossFrames; }
+
+	bool WriteBufferRanges(ID3D11Buffer* buffer, RenderMapType mapType, const RenderBufferRange* ranges, unsigned int rangeCount);
+	void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size);
+
+	void SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride);
+	void SetIndexBuffer(ID3D11Buffer* buffer);
+
+	void SetVertexShader(ID3D11VertexShader* shader, ID3D11InputLayout* inputLayout);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetConstantBuffer(RenderShaderStage stage, unsigned int slot, ID3D11Buffer* buffer);
+	void SetShaderResource(RenderShaderStage stage, unsigned int slot, ID3D11ShaderResourceView* srv);
+	void SetSampler(RenderShaderStage stage, unsigned int slot, ID3D11SamplerState* sampler);
+
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetDepthStencilState(ID3D11DepthStencilState* state);
+	void SetBlendState(ID3D11BlendState* state);
+
+	void SetRenderTarget(ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv);
+	void ClearRenderTarget(ID3D11RenderTargetView* rtv, const float color[4]);
+	void ClearDepth(ID3D11DepthStencilView* dsv, float depth);
+
+	void Draw(unsigned int vertexCount, unsigned int startVertex);
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+
+	// Validation results
+	unsigned int GetErrorCount() { return errorCount; }
+	const std::vector<std::string>& GetErrors() { return errors; }
+
+	// Only the first few messages are kept, but all errors are counted
+	static const unsigned int MaxStoredErrors = 32;
+
+private:
+	struct BufferInfo
+	{
+		unsigned int ByteWidth = 0;
+		bool Dynamic = false;
+		long long DiscardFrame = -1;
+		std::vector<unsigned char> Shadow;
+	};
+
+	std::unordered_map<ID3D11Buffer*, BufferInfo> buffers;
+
+	ID3D11Buffer* indexBuffer;
+	ID3D11VertexShader* vertexShader;
+	ID3D11PixelShader* pixelShader;
+	ID3D11RenderTargetView* renderTarget;
+	bool noOverwriteAcrossFrames;
+
+	unsigned int errorCount;
+	std::vector<std::string> errors;
+
+	void Error(const std::string& message);
+	void ValidateDraw(const char* call);
+};
@@ -0,0 +1,115 @@
+#include "ParticleArena.h"
+#include "Emitter.h"
+
+#include <string.h>
+
+// --------------------------------------------------------
+// Creates the arena, with at least reservedParticles of
+// storage allocated up front
+// --------------------------------------------------------
+ParticleArena::ParticleArena(int reservedParticles, int blockParticles) :
+	blockParticles(blockParticles)
+{
+	if (reservedParticles > 0)
+		AddBlock(reservedParticles > blockParticles ? reservedParticles : blockParticles);
+}
+
+ParticleArena::~ParticleArena()
+{
+	for (Block& block : blocks)
+		delete[] block.Memory;
+}
+
+int ParticleArena::GetCapacityClass(int particleCount)
+{
+	int capacity = MinCapacity;
+	while (capacity < particleCount && capacity < MaxCapacity)
+		capacity *= 2;
+	return capacity;
+}
+
+int ParticleArena::GetClassIndex(int capacity)
+{
+	int index = 0;
+	while (index < ClassCount - 1 && (MinCapacity << index) < capacity)
+		index++;
+	return index;
+}
+
+// --------------------------------------------------------
+// Returns zeroed storage for a whole capacity class, from
+// the free list if possible, otherwise from the end of the
+// newest block (adding a block if it doesn't fit)
+// --------------------------------------------------------
+Particle* ParticleArena::Allocate(int capacity)
+{
+	if (capacity > MaxCapacity)
+		return 0;
+
+	int classIndex = GetClassIndex(capacity);
+	Particle* particles = 0;
+	stats.Allocations++;
+
+	if (!freeLists[classIndex].empty())
+	{
+		particles = freeLists[classIndex].back();
+		freeLists[classIndex].pop_back();
+		stats.Reuses++;
+	}
+	else
+	{
+		if (blocks.empty() || blocks.back().Capacity - blocks.back().Used < capacity)
+		{
+			// Whatever is left of the old block isn't lost
+			if (!blocks.empty())
+				FreeBlockTail(blocks.back());
+			AddBlock(capacity > blockParticles ? capacity : blockParticles);
+		}
+
+		Block& block = blocks.back();
+		particles = block.Memory + block.Used;
+		block.Used += capacity;
+	}
+
+	stats.UsedBytes += sizeof(Particle) * capacity;
+	memset(particles, 0, sizeof(Particle) * capacity);
+	return particles;
+}
+
+void ParticleArena::Free(Particle* particles, int capacity)
+{
+	if (!particles)
+		return;
+
+	freeLists[GetClassIndex(capacity)].push_back(particles);
+	stats.UsedBytes -= sizeof(Particle) * capacity;
+}
+
+void ParticleArena::AddBlock(int capacity)
+{
+	Block block;
+	block.Memory = new Particle[capacity];
+	block.Capacity = capacity;
+	block.Used = 0;
+	blocks.push_back(block);
+
+	stats.HeapAllocations++;
+	stats.ReservedBytes += sizeof(Particle) * capacity;
+}
+
+// --------------------------------------------------------
+// Splits the unused end of a block into the largest classes
+// that fit, and puts them on their free lists
+// --------------------------------------------------------
+void ParticleArena::FreeBlockTail(Block& block)
+{
+	for (int c = ClassCount - 1; c >= 0; c--)
+	{
+		int capacity = MinCapacity << c;
+		while (block.Capacity - block.Used >= capacity)
+		{
+			freeLists[c].push_back(block.Memory + block.Used);
+			block.Used += capacity;
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+struct Particle;
+
+// --------------------------------------------------------
+// Hands out particle storage from a few large blocks, rather
+// than a new array per emitter.
+//
+// Requests are rounded up to a capacity class (a power of two)
+// and freed storage goes on that class's free list, so short
+// lived emitters keep reusing the same memory.  Only a new
+// block ever touches the heap.
+// --------------------------------------------------------
+class ParticleArena
+{
+public:
+	ParticleArena(int reservedParticles, int blockParticles = 65536);
+	~ParticleArena();
+
+	static const int MinCapacity = 64;
+	static const int ClassCount = 20;
+	static const int MaxCapacity = MinCapacity << (ClassCount - 1);
+
+	// Rounds a particle count up to its capacity class.  Counts
+	// above MaxCapacity have no class, so callers must keep
+	// their counts in range (both of these clamp to the top)
+	static int GetCapacityClass(int particleCount);
+	static int GetClassIndex(int capacity);
+
+	// Capacity must be a class size (see GetCapacityClass),
+	// anything bigger gets null back
+	Particle* Allocate(int capacity);
+	void Free(Particle* particles, int capacity);
+
+	struct Stats
+	{
+		long long HeapAllocations = 0;
+		long long Allocations = 0;
+		long long Reuses = 0;
+		unsigned long long ReservedBytes = 0;
+		unsigned long long UsedBytes = 0;
+	};
+	const Stats& GetStats() { return stats; }
+
+private:
+	struct Block
+	{
+		Particle* Memory;
+		int Capacity;
+		int Used;
+	};
+	std::vector<Block> blocks;
+	std::vector<Particle*> freeLists[ClassCount];
+	int blockParticles;
+	Stats stats;
+
+	void AddBlock(int capacity);
+	void FreeBlockTail(Block& block);
+};
@@ -0,0 +1,150 @@
+#include "ParticleBatch.h"
+
+#include <algorithm>
+
+
+ParticleBatcher::ParticleBatcher(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	std::shared_ptr<IRenderer> renderer,
+	std::shared_ptr<SimpleVertexShader> batchVS)
+	:
+	device(device),
+	renderer(renderer),
+	batchVS(batchVS),
+	particleCapacity(0),
+	emitterCapacity(0)
+{
+	quadIndices = QuadIndexBuffer::GetShared(device, renderer);
+}
+
+// --------------------------------------------------------
+// Makes a dynamic structured buffer (and its view) for count
+// elements, replacing whatever was there before
+// --------------------------------------------------------
+void ParticleBatcher::CreateStructuredBuffer(
+	unsigned int stride,
+	int count,
+	Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	buffer.Reset();
+	srv.Reset();
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = stride;
+	desc.ByteWidth = stride * count;
+	device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+	renderer->DescribeBuffer(buffer.Get(), desc.ByteWidth, true);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = count;
+	device->CreateShaderResourceView(buffer.Get(), &srvDesc, srv.GetAddressOf());
+}
+
+// --------------------------------------------------------
+// Draws every emitter that's visible and not paused
+//  - Batchable emitters are sorted by material, and all of
+//    their data is uploaded with one write per buffer
+//  - Each material then gets one draw call
+//
+// Alpha blended emitters are skipped, and the rest blend
+// additively, so the order they're drawn in doesn't change
+// the result.
+// --------------------------------------------------------
+int ParticleBatcher::Draw(const std::vector<std::shared_ptr<Emitter>>& emitters, std::shared_ptr<Camera> camera, float currentTime)
+{
+	int drawn = 0;
+
+	// Anything that can't be batched draws itself as usual
+	candidates.clear();
+	for (auto& e : emitters)
+	{
+		if (e->alphaBlend)
+			continue;
+
+		if (!e->CanBatch())
+		{
+			if (e->Draw(camera, currentTime))
+				drawn++;
+			continue;
+		}
+
+		if (e->IsPaused() || !e->IsVisible(camera) || e->GetLivingCount() == 0)
+			continue;
+
+		candidates.push_back({ e->GetMaterial().get(), e.get() });
+	}
+
+	// Group the rest by material, keeping their original order otherwise
+	std::stable_sort(candidates.begin(), candidates.end(), [](const BatchCandidate& a, const BatchCandidate& b)
+		{ return a.BatchMaterial < b.BatchMaterial; });
+
+	int particleCount = 0;
+	for (BatchCandidate& c : candidates)
+		particleCount += c.EmitterPtr->GetLivingCount();
+
+	batches.clear();
+	particles.resize(particleCount);
+	emitterParams.resize(candidates.size());
+	int written = 0;
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		BatchCandidate& c = candidates[i];
+		if (batches.empty() || batches.back().BatchMaterial != c.BatchMaterial)
+			batches.push_back({ c.BatchMaterial, written, 0 });
+
+		emitterParams[i] = c.EmitterPtr->GetBatchParameters();
+		int count = c.EmitterPtr->CopyBatchParticles(particles.data() + written, (unsigned int)i);
+		written += count;
+		batches.back().ParticleCount += count;
+	}
+
+	if (batches.empty())
+		return drawn;
+
+	// Grow the buffers with some room to spare
+	if (particleCount > particleCapacity)
+	{
+		particleCapacity = std::max(particleCount, particleCapacity * 2);
+		CreateStructuredBuffer(sizeof(BatchedParticle), particleCapacity, particleBuffer, particleSRV);
+	}
+	if ((int)emitterParams.size() > emitterCapacity)
+	{
+		emitterCapacity = std::max((int)emitterParams.size(), emitterCapacity * 2);
+		CreateStructuredBuffer(sizeof(BatchedEmitter), emitterCapacity, emitterBuffer, emitterSRV);
+	}
+	quadIndices->Reserve(particleCount);
+
+	renderer->WriteBuffer(particleBuffer.Get(), RenderMapType::WriteDiscard, 0, particles.data(), sizeof(BatchedParticle) * particleCount);
+	renderer->WriteBuffer(emitterBuffer.Get(), RenderMapType::WriteDiscard, 0, emitterParams.data(), sizeof(BatchedEmitter) * (unsigned int)emitterParams.size());
+
+	renderer->SetVertexBuffer(0, 0);
+	renderer->SetIndexBuffer(quadIndices->GetBuffer());
+
+	for (Batch& batch : batches)
+	{
+		// Material handles the pixel shader and its resources,
+		// then the batch shader replaces its vertex shader
+		batch.BatchMaterial->PrepareMaterial(&identity, camera);
+
+		batchVS->SetShader();
+		batchVS->SetMatrix4x4("view", camera->GetView());
+		batchVS->SetMatrix4x4("projection", camera->GetProjection());
+		batchVS->SetFloat("currentTime", currentTime);
+		batchVS->SetInt("particleOffset", batch.FirstParticle);
+		batchVS->CopyAllBufferData();
+		batchVS->SetShaderResourceView("ParticleData", particleSRV);
+		batchVS->SetShaderResourceView("EmitterData", emitterSRV);
+
+		renderer->DrawIndexed(batch.ParticleCount * 6, 0, 0);
+	}
+
+	return drawn + (int)candidates.size();
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <vector>
+#include "Camera.h"
+#include "Emitter.h"
+#include "QuadIndexBuffer.h"
+#include "Renderer.h"
+#include "SimpleShader.h"
+#include "Transform.h"
+
+// --------------------------------------------------------
+// Draws many emitters with as few draw calls as possible.
+//
+// Each frame, the living particles of every emitter that can
+// be batched are copied into one big structured buffer, with
+// each emitter's parameters (colors, sizes, acceleration) in
+// a second one.  Emitters are grouped by material, and each
+// group is drawn with a single call.  Emitters that can't be
+// batched (simulated or sorted ones) draw themselves.
+//
+// Only additive emitters are drawn, since batching changes the
+// order they're drawn in.  Alpha blended ones are skipped and
+// left for the caller to draw with its own blend state.
+// --------------------------------------------------------
+class ParticleBatcher
+{
+public:
+	ParticleBatcher(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		std::shared_ptr<IRenderer> renderer,
+		std::shared_ptr<SimpleVertexShader> batchVS);
+
+	// Returns how many additive emitters were drawn (batched or not)
+	int Draw(const std::vector<std::shared_ptr<Emitter>>& emitters, std::shared_ptr<Camera> camera, float currentTime);
+
+	// Results of the last Draw()
+	int GetBatchCount() { return (int)batches.size(); }
+	int GetBatchedEmitterCount() { return (int)emitterParams.size(); }
+	int GetBatchedParticleCount() { return (int)particles.size(); }
+
+private:
+	struct Batch
+	{
+		Material* BatchMaterial;
+		int FirstParticle;
+		int ParticleCount;
+	};
+
+	struct BatchCandidate
+	{
+		Material* BatchMaterial;
+		Emitter* EmitterPtr;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	std::shared_ptr<IRenderer> renderer;
+	std::shared_ptr<SimpleVertexShader> batchVS;
+	std::shared_ptr<QuadIndexBuffer> quadIndices;
+
+	// Particles are already in world space
+	Transform identity;
+
+	std::vector<BatchCandidate> candidates;
+	std::vector<Batch> batches;
+	std::vector<BatchedParticle> particles;
+	std::vector<BatchedEmitter> emitterParams;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> particleBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> particleSRV;
+	int particleCapacity;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> emitterBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> emitterSRV;
+	int emitterCapacity;
+
+	void CreateStructuredBuffer(
+		unsigned int stride,
+		int count,
+		Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+};
@@ -0,0 +1,81 @@
+cbuffer externalData : register(b0)
+{
+    matrix view;
+    matrix projection;
+
+    float currentTime;
+
+    // Where this batch's particles start in ParticleData
+    int particleOffset;
+};
+
+// Particles from many emitters, each pointing at
+// its emitter's parameters in EmitterData
+struct BatchedParticle
+{
+    float EmitTime;
+    float3 StartPosition;
+    float3 StartVelocity;
+    uint EmitterIndex;
+    float Lifetime;
+};
+
+struct BatchedEmitter
+{
+    float4 StartColor;
+    float4 EndColor;
+    float3 Acceleration;
+    float StartSize;
+    float EndSize;
+    float3 Padding;
+};
+
+StructuredBuffer<BatchedParticle> ParticleData : register(t0);
+StructuredBuffer<BatchedEmitter> EmitterData : register(t1);
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD;
+    float4 colorTint : COLOR;
+};
+
+VertexToPixel main(uint id : SV_VertexID)
+{
+    VertexToPixel output;
+
+    uint particleID = particleOffset + id / 4;
+    uint cornerID = id % 4;
+
+    BatchedParticle p = ParticleData.Load(particleID);
+    BatchedEmitter e = EmitterData.Load(p.EmitterIndex);
+
+    float age = currentTime - p.EmitTime;
+    float agePercent = age / p.Lifetime;
+
+    float3 pos = e.Acceleration * age * age / 2.0f + p.StartVelocity * age + p.StartPosition;
+    float size = age < p.Lifetime ? lerp(e.StartSize, e.EndSize, agePercent) : 0.0f;
+
+    float2 offsets[4];
+    offsets[0] = float2(-1.0f, +1.0f); // TL
+    offsets[1] = float2(+1.0f, +1.0f); // TR
+    offsets[2] = float2(+1.0f, -1.0f); // BR
+    offsets[3] = float2(-1.0f, -1.0f); // BL
+
+    // Billboarding, at the same size as ParticleVS
+    pos += float3(view._11, view._12, view._13) * offsets[cornerID].x * size;
+    pos += float3(view._21, view._22, view._23) * offsets[cornerID].y * size;
+
+    matrix viewProj = mul(projection, view);
+    output.position = mul(viewProj, float4(pos, 1.0f));
+
+    float2 uvs[4];
+    uvs[0] = float2(0, 0);
+    uvs[1] = float2(1, 0);
+    uvs[2] = float2(1, 1);
+    uvs[3] = float2(0, 1);
+    output.uv = uvs[cornerID];
+    output.colorTint = lerp(e.StartColor, e.EndColor, agePercent);
+
+    return output;
+}
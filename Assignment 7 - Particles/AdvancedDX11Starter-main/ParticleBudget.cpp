@@ -0,0 +1,149 @@
+#include "ParticleBudget.h"
+
+#include <algorithm>
+#include <math.h>
+
+using namespace DirectX;
+
+
+ParticleBudget::ParticleBudget() :
+	MaxLiveParticles(100000),
+	MaxLiveMemory(64ull * 1024 * 1024),
+	PauseOffscreen(true),
+	FullDetailDistance(30.0f),
+	MinLifetimeScale(0.5f),
+	FullCoverage(0.25f),
+	MinImportance(0.05f),
+	RecoveryRate(2.0f)
+{
+	stats = {};
+}
+
+// --------------------------------------------------------
+// Decides how much of the budget each emitter gets this
+// frame and hands the results to the emitters
+// --------------------------------------------------------
+void ParticleBudget::Update(const std::vector<std::shared_ptr<Emitter>>& emitters, std::shared_ptr<Camera> camera, float dt)
+{
+	stats = {};
+	stats.EmitterCount = (int)emitters.size();
+	records.resize(emitters.size());
+
+	// The live cap is whichever limit is hit first, with every
+	// particle costing as much as a simulated, sorted one
+	unsigned long long bytesPerParticle = Emitter::GetBytesPerParticle();
+	unsigned long long memoryCap = MaxLiveMemory / bytesPerParticle;
+	stats.ParticleCap = (int)std::min((unsigned long long)std::max(MaxLiveParticles, 0), memoryCap);
+
+	XMFLOAT3 camPos = camera->GetTransform()->GetPosition();
+	float tanHalfFov = tanf(camera->GetFieldOfView() * 0.5f);
+
+	// Visibility, screen coverage and demand for each emitter
+	fillOrder.clear();
+	for (size_t i = 0; i < emitters.size(); i++)
+	{
+		Emitter* emitter = emitters[i].get();
+		EmitterRecord& rec = records[i];
+
+		XMFLOAT3 boundsMin, boundsMax;
+		emitter->GetBounds(boundsMin, boundsMax);
+		rec.Visible = camera->IsBoxVisible(boundsMin, boundsMax);
+
+		// A sphere around the bounds for distance and coverage
+		XMFLOAT3 center(
+			(boundsMin.x + boundsMax.x) * 0.5f,
+			(boundsMin.y + boundsMax.y) * 0.5f,
+			(boundsMin.z + boundsMax.z) * 0.5f);
+		float ex = boundsMax.x - center.x;
+		float ey = boundsMax.y - center.y;
+		float ez = boundsMax.z - center.z;
+		float radius = sqrtf(ex * ex + ey * ey + ez * ez);
+
+		// Coverage is the sphere's radius as a fraction of half the screen
+		float dx = center.x - camPos.x;
+		float dy = center.y - camPos.y;
+		float dz = center.z - camPos.z;
+		rec.Distance = sqrtf(dx * dx + dy * dy + dz * dz);
+		rec.Coverage = rec.Distance <= radius ? 1.0f : std::min(radius / (rec.Distance * tanHalfFov), 1.0f);
+
+		// Distant emitters keep their particles around for less time
+		rec.LifetimeScale = 1.0f;
+		if (rec.Distance > FullDetailDistance)
+			rec.LifetimeScale = std::max(FullDetailDistance / rec.Distance, MinLifetimeScale);
+
+		float importance = std::max(std::min(rec.Coverage / FullCoverage, 1.0f), MinImportance);
+		rec.Weight = std::max(emitter->priority, 0.0f) * importance;
+		rec.Demand = emitter->GetParticleDemand(rec.LifetimeScale);
+		rec.Allocation = 0.0f;
+
+		bool paused = PauseOffscreen && !rec.Visible;
+		if (!paused && rec.Demand > 0.0f)
+		{
+			fillOrder.push_back((int)i);
+			stats.TotalDemand += rec.Demand;
+		}
+	}
+
+	// Water fill: hand out the budget in proportion to weight, starting
+	// with the emitters whose demand is smallest relative to their weight
+	// so anything they don't use rolls over to the hungrier ones
+	if (stats.TotalDemand <= stats.ParticleCap)
+	{
+		for (int i : fillOrder)
+			records[i].Allocation = records[i].Demand;
+	}
+	else
+	{
+		std::sort(fillOrder.begin(), fillOrder.end(), [&](int a, int b)
+			{
+				// demand/weight, cross multiplied so zero weights sort last
+				return records[a].Demand * records[b].Weight < records[b].Demand * records[a].Weight;
+			});
+
+		float remaining = (float)stats.ParticleCap;
+		float remainingWeight = 0.0f;
+		for (int i : fillOrder)
+			remainingWeight += records[i].Weight;
+
+		for (int i : fillOrder)
+		{
+			EmitterRecord& rec = records[i];
+			float share = remainingWeight > 0.0f ? remaining * rec.Weight / remainingWeight : 0.0f;
+			rec.Allocation = std::min(rec.Demand, share);
+			remaining -= rec.Allocation;
+			remainingWeight -= rec.Weight;
+		}
+	}
+
+	// Turn allocations into spawn rates.  Cuts happen right away so
+	// the cap holds, but recovery is gradual to avoid popping.
+	float recovery = 1.0f - expf(-RecoveryRate * dt);
+	for (size_t i = 0; i < emitters.size(); i++)
+	{
+		Emitter* emitter = emitters[i].get();
+		EmitterRecord& rec = records[i];
+		bool paused = PauseOffscreen && !rec.Visible;
+
+		float target = rec.Demand > 0.0f ? rec.Allocation / rec.Demand : 1.0f;
+		float current = emitter->GetBudgetRateScale();
+		rec.RateScale = paused ? current :
+			target < current ? target : current + (target - current) * recovery;
+
+		emitter->SetBudget(rec.RateScale, rec.LifetimeScale, paused);
+		rec.Living = emitter->GetLivingCount();
+
+		// Telemetry
+		stats.TotalAllocation += rec.Allocation;
+		stats.LiveParticles += rec.Living;
+		stats.LiveMemory += rec.Living * (emitter->GetMemoryUsage() / std::max(emitter->GetMaxParticles(), 1));
+		stats.ReservedMemory += emitter->GetMemoryUsage();
+		if (rec.Visible) stats.VisibleCount++;
+		if (paused) stats.PausedCount++;
+		if (!paused && rec.RateScale < 0.999f) stats.ThrottledCount++;
+		if (!paused)
+		{
+			int bucket = std::min((int)(rec.RateScale * HistogramBuckets), HistogramBuckets - 1);
+			stats.RateScaleHistogram[std::max(bucket, 0)]++;
+		}
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "Camera.h"
+#include "Emitter.h"
+
+// --------------------------------------------------------
+// Shares a fixed number of live particles between emitters.
+//
+// Every frame each emitter's demand (particles alive at its
+// full spawn rate) is weighed by priority and how much of the
+// screen it covers.  If the total demand fits the budget,
+// everyone gets what they want.  Otherwise the budget is
+// "water filled": emitters get shares in proportion to their
+// weight, and any share an emitter doesn't need is passed on
+// to the rest.  The result becomes a spawn rate scale.
+//
+// Independently, distant emitters get shorter lifetimes, and
+// emitters outside the view frustum are paused entirely (their
+// time keeps running, so they catch up when seen again).
+// --------------------------------------------------------
+class ParticleBudget
+{
+public:
+	ParticleBudget();
+
+	// Limits - the smaller of the two wins
+	int MaxLiveParticles;
+	unsigned long long MaxLiveMemory;
+
+	// Throttling behavior
+	bool PauseOffscreen;
+	float FullDetailDistance;	// Lifetimes are shortened beyond this
+	float MinLifetimeScale;		// ...but never by more than this
+	float FullCoverage;			// Screen coverage (fraction of the half height) given full weight
+	float MinImportance;		// Weight floor for tiny, distant emitters
+	float RecoveryRate;			// How quickly throttled emitters ramp back up (per second)
+
+	void Update(const std::vector<std::shared_ptr<Emitter>>& emitters, std::shared_ptr<Camera> camera, float dt);
+
+	// Telemetry for the most recent update
+	struct EmitterRecord
+	{
+		float Distance;
+		float Coverage;
+		float Weight;
+		float Demand;
+		float Allocation;
+		float RateScale;
+		float LifetimeScale;
+		bool Visible;
+		int Living;
+	};
+
+	static const int HistogramBuckets = 10;
+	struct Stats
+	{
+		int EmitterCount;
+		int VisibleCount;
+		int PausedCount;
+		int ThrottledCount;
+		int LiveParticles;
+		int ParticleCap;
+		float TotalDemand;
+		float TotalAllocation;
+		unsigned long long LiveMemory;
+		unsigned long long ReservedMemory;
+		int RateScaleHistogram[HistogramBuckets];	// Unpaused emitters by rate scale, in 10% steps
+	};
+
+	const Stats& GetStats() { return stats; }
+	const std::vector<EmitterRecord>& GetRecords() { return records; }
+
+private:
+	Stats stats;
+	std::vector<EmitterRecord> records;
+	std::vector<int> fillOrder;
+};
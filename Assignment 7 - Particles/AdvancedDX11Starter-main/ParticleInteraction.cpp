@@ -0,0 +1,340 @@
+#include "ParticleInteraction.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+#include "Random.h"
+
+namespace
+{
+	const float Pi = 3.14159265f;
+}
+
+
+void ParticleInteraction::Apply(
+	const float* x, const float* y, const float* z,
+	float* vx, float* vy, float* vz,
+	int count,
+	const ParticleInteractionSettings& settings,
+	float dt,
+	JobSystem* jobs)
+{
+	if (settings.Mode == ParticleInteractionMode::None || count == 0 || settings.Radius <= 0.0f)
+	{
+		averageNeighbors = 0.0f;
+		return;
+	}
+
+	grid.Build(x, y, z, count, settings.Radius, jobs);
+
+	// Velocities in grid order, so neighbors read them from
+	// (mostly) the same cache lines as their positions.  New
+	// ones go in separate arrays, since neighbors in other
+	// blocks may still be reading the old ones.
+	if (sortedVX.size() < (size_t)count)
+	{
+		sortedVX.resize(count);
+		sortedVY.resize(count);
+		sortedVZ.resize(count);
+		newVX.resize(count);
+		newVY.resize(count);
+		newVZ.resize(count);
+		density.resize(count);
+	}
+
+	const unsigned int* order = grid.GetOrder();
+	for (int i = 0; i < count; i++)
+	{
+		sortedVX[i] = vx[order[i]];
+		sortedVY[i] = vy[order[i]];
+		sortedVZ[i] = vz[order[i]];
+	}
+
+	int blockCount = (count + BlockSize - 1) / BlockSize;
+	blockNeighbors.assign(blockCount, 0);
+	auto runBlocks = [&](const std::function<void(int, int)>& kernel)
+	{
+		auto block = [&](int b) { kernel(b * BlockSize, std::min(count, (b + 1) * BlockSize)); };
+		if (jobs && blockCount > 1)
+			jobs->ParallelFor(blockCount, block);
+		else
+			for (int b = 0; b < blockCount; b++) block(b);
+	};
+
+	if (settings.Mode == ParticleInteractionMode::Boids)
+	{
+		runBlocks([&](int start, int end) { ApplyBoids(start, end, settings, dt); });
+	}
+	else
+	{
+		runBlocks([&](int start, int end) { ComputeDensity(start, end, settings); });
+		runBlocks([&](int start, int end) { ApplyFluid(start, end, settings, dt); });
+	}
+
+	// Results were worked out in grid order - put them back
+	for (int i = 0; i < count; i++)
+	{
+		vx[order[i]] = newVX[i];
+		vy[order[i]] = newVY[i];
+		vz[order[i]] = newVZ[i];
+	}
+
+	long long neighbors = 0;
+	for (long long n : blockNeighbors)
+		neighbors += n;
+	averageNeighbors = (float)((double)neighbors / count);
+}
+
+// --------------------------------------------------------
+// Flocking for sorted particles [start, end)
+//  - Separation pushes away from each neighbor, more strongly
+//    the closer it is
+//  - Alignment steers towards the neighbors' average velocity
+//  - Cohesion steers towards the neighbors' average position
+// --------------------------------------------------------
+void ParticleInteraction::ApplyBoids(int start, int end, const ParticleInteractionSettings& settings, float dt)
+{
+	long long neighbors = 0;
+	float radius = settings.Radius;
+	float minDistSq = radius * radius * 0.0001f;
+	SpatialHashGrid::NeighborCells cells;
+
+	for (int i = start; i < end; i++)
+	{
+		float px = grid.SortedX[i];
+		float py = grid.SortedY[i];
+		float pz = grid.SortedZ[i];
+
+		float sepX = 0, sepY = 0, sepZ = 0;
+		float sumVX = 0, sumVY = 0, sumVZ = 0;
+		float sumPX = 0, sumPY = 0, sumPZ = 0;
+		int count = 0;
+
+		grid.ForEachNeighbor(px, py, pz, radius, cells, [&](int j, float distSq)
+			{
+				count++;
+				if (j == i)
+					return;
+
+				float ox = px - grid.SortedX[j];
+				float oy = py - grid.SortedY[j];
+				float oz = pz - grid.SortedZ[j];
+				float weight = 1.0f / std::max(distSq, minDistSq);
+				sepX += ox * weight;
+				sepY += oy * weight;
+				sepZ += oz * weight;
+
+				sumVX += sortedVX[j];
+				sumVY += sortedVY[j];
+				sumVZ += sortedVZ[j];
+				sumPX += grid.SortedX[j];
+				sumPY += grid.SortedY[j];
+				sumPZ += grid.SortedZ[j];
+			});
+		neighbors += count;
+
+		float vx = sortedVX[i];
+		float vy = sortedVY[i];
+		float vz = sortedVZ[i];
+
+		int others = count - 1;
+		if (others > 0)
+		{
+			float inv = 1.0f / others;
+			float ax = settings.Separation * sepX +
+				settings.Alignment * (sumVX * inv - vx) +
+				settings.Cohesion * (sumPX * inv - px);
+			float ay = settings.Separation * sepY +
+				settings.Alignment * (sumVY * inv - vy) +
+				settings.Cohesion * (sumPY * inv - py);
+			float az = settings.Separation * sepZ +
+				settings.Alignment * (sumVZ * inv - vz) +
+				settings.Cohesion * (sumPZ * inv - pz);
+
+			vx += ax * dt;
+			vy += ay * dt;
+			vz += az * dt;
+
+			float speedSq = vx * vx + vy * vy + vz * vz;
+			if (speedSq > settings.MaxSpeed * settings.MaxSpeed)
+			{
+				float scale = settings.MaxSpeed / sqrtf(speedSq);
+				vx *= scale;
+				vy *= scale;
+				vz *= scale;
+			}
+		}
+
+		newVX[i] = vx;
+		newVY[i] = vy;
+		newVZ[i] = vz;
+	}
+
+	blockNeighbors[start / BlockSize] = neighbors;
+}
+
+// --------------------------------------------------------
+// SPH density for sorted particles [start, end), using the
+// poly6 kernel: W(r) = 315 / (64 pi h^9) * (h^2 - r^2)^3
+// --------------------------------------------------------
+void ParticleInteraction::ComputeDensity(int start, int end, const ParticleInteractionSettings& settings)
+{
+	long long neighbors = 0;
+	float h = settings.Radius;
+	float hSq = h * h;
+	float poly6 = settings.ParticleMass * 315.0f / (64.0f * Pi * powf(h, 9.0f));
+	SpatialHashGrid::NeighborCells cells;
+
+	for (int i = start; i < end; i++)
+	{
+		float sum = 0.0f;
+		int count = 0;
+		grid.ForEachNeighbor(grid.SortedX[i], grid.SortedY[i], grid.SortedZ[i], h, cells, [&](int j, float distSq)
+			{
+				float d = hSq - distSq;
+				sum += d * d * d;
+				count++;
+			});
+
+		density[i] = sum * poly6;
+		neighbors += count;
+	}
+
+	blockNeighbors[start / BlockSize] = neighbors;
+}
+
+// --------------------------------------------------------
+// SPH pressure and viscosity for sorted particles [start, end)
+//  - Pressure is Stiffness * (density - RestDensity), clamped
+//    at zero so particles push apart but never clump together,
+//    using the gradient of the spiky kernel:
+//      -45 / (pi h^6) * (h - r)^2 along the direction apart
+//  - Viscosity uses the laplacian of the viscosity kernel:
+//      45 / (pi h^6) * (h - r)
+// --------------------------------------------------------
+void ParticleInteraction::ApplyFluid(int start, int end, const ParticleInteractionSettings& settings, float dt)
+{
+	float h = settings.Radius;
+	float mass = settings.ParticleMass;
+	float spiky = 45.0f / (Pi * powf(h, 6.0f));
+	float minDist = h * 0.001f;
+	SpatialHashGrid::NeighborCells cells;
+
+	for (int i = start; i < end; i++)
+	{
+		float px = grid.SortedX[i];
+		float py = grid.SortedY[i];
+		float pz = grid.SortedZ[i];
+		float vx = sortedVX[i];
+		float vy = sortedVY[i];
+		float vz = sortedVZ[i];
+
+		float densityI = density[i];
+		float pressureI = std::max(settings.Stiffness * (densityI - settings.RestDensity), 0.0f);
+
+		float fx = 0, fy = 0, fz = 0;
+		grid.ForEachNeighbor(px, py, pz, h, cells, [&](int j, float distSq)
+			{
+				if (j == i)
+					return;
+
+				float dist = std::max(sqrtf(distSq), minDist);
+				float densityJ = density[j];
+				float pressureJ = std::max(settings.Stiffness * (densityJ - settings.RestDensity), 0.0f);
+				float falloff = h - dist;
+
+				// Pressure pushes along the line between the particles
+				float push = mass * (pressureI + pressureJ) / (2.0f * densityJ) * spiky * falloff * falloff / dist;
+				fx += (px - grid.SortedX[j]) * push;
+				fy += (py - grid.SortedY[j]) * push;
+				fz += (pz - grid.SortedZ[j]) * push;
+
+				// Viscosity pulls velocities together
+				float drag = settings.Viscosity * mass / densityJ * spiky * falloff;
+				fx += (sortedVX[j] - vx) * drag;
+				fy += (sortedVY[j] - vy) * drag;
+				fz += (sortedVZ[j] - vz) * drag;
+			});
+
+		// Force per unit density is the acceleration
+		float inv = dt / densityI;
+		newVX[i] = vx + fx * inv;
+		newVY[i] = vy + fy * inv;
+		newVZ[i] = vz + fz * inv;
+	}
+}
+
+// --------------------------------------------------------
+// Runs whole interaction steps (grid, forces and a simple
+// integration) on count particles in a box, for each mode,
+// on one thread and then across the job system.  Matching
+// checksums show the thread count didn't change the result.
+// --------------------------------------------------------
+void ParticleInteraction::Benchmark(int count, int iterations, JobSystem* jobs)
+{
+	// About 30 neighbors per particle, at unit radius
+	float halfSize = 0.5f * powf(count / 7.2f, 1.0f / 3.0f);
+
+	ParticleInteractionSettings settings;
+	settings.Radius = 1.0f;
+
+	const char* modeNames[] = { "Boids", "Fluid" };
+	ParticleInteractionMode modes[] = { ParticleInteractionMode::Boids, ParticleInteractionMode::Fluid };
+
+	printf("Particle interaction benchmark: %d particles, %d iterations\n", count, iterations);
+	for (int m = 0; m < 2; m++)
+	{
+		settings.Mode = modes[m];
+		for (int pass = 0; pass < 2; pass++)
+		{
+			JobSystem* passJobs = pass == 0 ? 0 : jobs;
+
+			// Same starting state for every run
+			PCG32 random;
+			random.Seed(39, 2);
+			std::vector<float> x(count), y(count), z(count);
+			std::vector<float> vx(count), vy(count), vz(count);
+			for (int i = 0; i < count; i++)
+			{
+				x[i] = random.Range(-halfSize, halfSize);
+				y[i] = random.Range(-halfSize, halfSize);
+				z[i] = random.Range(-halfSize, halfSize);
+				vx[i] = random.Range(-1.0f, 1.0f);
+				vy[i] = random.Range(-1.0f, 1.0f);
+				vz[i] = random.Range(-1.0f, 1.0f);
+			}
+
+			ParticleInteraction interaction;
+			const float dt = 1.0f / 60.0f;
+			double neighbors = 0;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int it = 0; it < iterations; it++)
+			{
+				interaction.Apply(x.data(), y.data(), z.data(), vx.data(), vy.data(), vz.data(), count, settings, dt, passJobs);
+				for (int i = 0; i < count; i++)
+				{
+					x[i] += vx[i] * dt;
+					y[i] += vy[i] * dt;
+					z[i] += vz[i] * dt;
+				}
+				neighbors += interaction.GetAverageNeighbors();
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+
+			double checksum = 0;
+			for (int i = 0; i < count; i++)
+				checksum += x[i] + y[i] + z[i];
+
+			double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+			printf("  %-6s %2u thread(s): %8.3f ms/step, %5.1f neighbors, checksum %.4f\n",
+				modeNames[m],
+				passJobs ? passJobs->GetThreadCount() : 1,
+				ms,
+				neighbors / iterations,
+				checksum);
+		}
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include "JobSystem.h"
+#include "ParticleSimulation.h"
+#include "SpatialHash.h"
+
+// --------------------------------------------------------
+// Particle-particle forces, found with a spatial hash grid.
+//
+// Boids steer each particle away from neighbors that are too
+// close, towards their average velocity and towards their
+// center.  Fluid particles use SPH (Muller et al. 2003): a
+// density pass, then pressure and viscosity forces with the
+// poly6, spiky and viscosity smoothing kernels.
+//
+// Work is done in grid order in blocks spread across the job
+// system.  Every particle only reads shared data and writes
+// its own results, and neighbors are always visited in the
+// same order, so results don't depend on the thread count.
+// --------------------------------------------------------
+class ParticleInteraction
+{
+public:
+	// Adds neighbor forces to the velocities of count particles,
+	// stored as separate arrays.  Positions are left alone.
+	void Apply(
+		const float* x, const float* y, const float* z,
+		float* vx, float* vy, float* vz,
+		int count,
+		const ParticleInteractionSettings& settings,
+		float dt,
+		JobSystem* jobs = 0);
+
+	// Average number of neighbors (including itself) per particle
+	// in the last Apply()
+	float GetAverageNeighbors() { return averageNeighbors; }
+
+	// Times whole interaction steps, including rebuilding the grid
+	static void Benchmark(int count, int iterations, JobSystem* jobs);
+
+private:
+	static const int BlockSize = 1024;
+
+	SpatialHashGrid grid;
+	std::vector<float> sortedVX, sortedVY, sortedVZ;
+	std::vector<float> newVX, newVY, newVZ;
+	std::vector<float> density;
+	std::vector<long long> blockNeighbors;
+	float averageNeighbors = 0.0f;
+
+	void ApplyBoids(int start, int end, const ParticleInteractionSettings& settings, float dt);
+	void ComputeDensity(int start, int end, const ParticleInteractionSettings& settings);
+	void ApplyFluid(int start, int end, const ParticleInteractionSettings& settings, float dt);
+};
@@ -0,0 +1,58 @@
+
+cbuffer externalData : register(b0)
+{
+    matrix view;
+    matrix projection;
+};
+
+// Particles simulated on the CPU - position, size and color
+// are already final, so this only needs to billboard them
+struct SimulatedParticle
+{
+    float3 Position;
+    float Size;
+    float4 Color;
+};
+
+StructuredBuffer<SimulatedParticle> ParticleData : register(t0);
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD;
+    float4 colorTint : COLOR;
+};
+
+VertexToPixel main(uint id : SV_VertexID)
+{
+    VertexToPixel output;
+
+    uint particleID = id / 4;
+    uint cornerID = id % 4;
+
+    SimulatedParticle p = ParticleData.Load(particleID);
+
+    float2 offsets[4];
+    offsets[0] = float2(-1.0f, +1.0f); // TL
+    offsets[1] = float2(+1.0f, +1.0f); // TR
+    offsets[2] = float2(+1.0f, -1.0f); // BR
+    offsets[3] = float2(-1.0f, -1.0f); // BL
+
+	// Billboarding, scaled by the simulated size
+    float3 pos = p.Position;
+    pos += float3(view._11, view._12, view._13) * offsets[cornerID].x * p.Size;
+    pos += float3(view._21, view._22, view._23) * offsets[cornerID].y * p.Size;
+
+    matrix viewProj = mul(projection, view);
+    output.position = mul(viewProj, float4(pos, 1.0f));
+
+    float2 uvs[4];
+    uvs[0] = float2(0, 0);
+    uvs[1] = float2(1, 0);
+    uvs[2] = float2(1, 1);
+    uvs[3] = float2(0, 1);
+    output.uv = uvs[cornerID];
+    output.colorTint = p.Color;
+
+    return output;
+}
@@ -0,0 +1,280 @@
+#include "ParticleSimulation.h"
+
+#include <chrono>
+#include <float.h>
+#include <stdio.h>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Helpers for loading and storing four particles' worth
+// of a single attribute at once
+// --------------------------------------------------------
+namespace
+{
+	inline XMVECTOR Load4(const std::vector<float>& v, int i) { return XMLoadFloat4((const XMFLOAT4*)&v[i]); }
+	inline void Store4(std::vector<float>& v, int i, FXMVECTOR value) { XMStoreFloat4((XMFLOAT4*)&v[i], value); }
+
+	// Widens a range to whole groups of four
+	inline int GroupStart(int start) { return start & ~3; }
+	inline int GroupEnd(int end, int capacity) { int e = (end + 3) & ~3; return e > capacity ? capacity : e; }
+}
+
+
+void ParticleSoA::Resize(int particleCount)
+{
+	capacity = (particleCount + 3) & ~3;
+
+	std::vector<float>* arrays[] = {
+		&PositionX, &PositionY, &PositionZ,
+		&VelocityX, &VelocityY, &VelocityZ,
+		&Age, &Lifetime, &Size, &SizeScale,
+		&ColorR, &ColorG, &ColorB, &ColorA };
+
+	for (std::vector<float>* a : arrays)
+		a->assign(capacity, 0.0f);
+}
+
+void ParticleSoA::Spawn(int index, XMFLOAT3 position, XMFLOAT3 velocity, float lifetime, float sizeScale)
+{
+	PositionX[index] = position.x;
+	PositionY[index] = position.y;
+	PositionZ[index] = position.z;
+	VelocityX[index] = velocity.x;
+	VelocityY[index] = velocity.y;
+	VelocityZ[index] = velocity.z;
+	Age[index] = 0.0f;
+	Lifetime[index] = lifetime;
+	SizeScale[index] = sizeScale;
+}
+
+// --------------------------------------------------------
+// velocity += acceleration * dt
+// --------------------------------------------------------
+void ParticleSoA::ApplyAcceleration(int start, int end, XMFLOAT3 acceleration, float dt)
+{
+	XMVECTOR ax = XMVectorReplicate(acceleration.x * dt);
+	XMVECTOR ay = XMVectorReplicate(acceleration.y * dt);
+	XMVECTOR az = XMVectorReplicate(acceleration.z * dt);
+
+	for (int i = GroupStart(start); i < GroupEnd(end, capacity); i += 4)
+	{
+		Store4(VelocityX, i, XMVectorAdd(Load4(VelocityX, i), ax));
+		Store4(VelocityY, i, XMVectorAdd(Load4(VelocityY, i), ay));
+		Store4(VelocityZ, i, XMVectorAdd(Load4(VelocityZ, i), az));
+	}
+}
+
+// --------------------------------------------------------
+// Scales velocity down by the drag amount for this step
+// --------------------------------------------------------
+void ParticleSoA::ApplyDrag(int start, int end, float drag, float dt)
+{
+	float keep = 1.0f - drag * dt;
+	if (keep < 0.0f) keep = 0.0f;
+	XMVECTOR scale = XMVectorReplicate(keep);
+
+	for (int i = GroupStart(start); i < GroupEnd(end, capacity); i += 4)
+	{
+		Store4(VelocityX, i, XMVectorMultiply(Load4(VelocityX, i), scale));
+		Store4(VelocityY, i, XMVectorMultiply(Load4(VelocityY, i), scale));
+		Store4(VelocityZ, i, XMVectorMultiply(Load4(VelocityZ, i), scale));
+	}
+}
+
+// --------------------------------------------------------
+// Pushes particles along a divergence-free flow field.
+//
+// The field is the curl of the vector potential
+//   psi = (f(y) + g(z), f(z) + g(x), f(x) + g(y))
+// with f(u) = sin(s*u + phase) and g(u) = cos(k*s*u + phase),
+// which works out to
+//   curl = (g'(y) - f'(z), g'(z) - f'(x), g'(x) - f'(y))
+// Being a curl, the flow swirls without bunching up.
+// --------------------------------------------------------
+void ParticleSoA::ApplyCurlNoise(int start, int end, float strength, float scale, float phase, float dt)
+{
+	const float k = 2.3f; // Second octave frequency multiplier
+	XMVECTOR s = XMVectorReplicate(scale);
+	XMVECTOR ks = XMVectorReplicate(k * scale);
+	XMVECTOR p = XMVectorReplicate(phase);
+	XMVECTOR fScale = XMVectorReplicate(scale * strength * dt);		// f'(u) =  s * cos(s*u + phase)
+	XMVECTOR gScale = XMVectorReplicate(-k * scale * strength * dt);	// g'(u) = -k*s * sin(k*s*u + phase)
+
+	for (int i = GroupStart(start); i < GroupEnd(end, capacity); i += 4)
+	{
+		XMVECTOR x = Load4(PositionX, i);
+		XMVECTOR y = Load4(PositionY, i);
+		XMVECTOR z = Load4(PositionZ, i);
+
+		// f'(x, y, z)
+		XMVECTOR sinF, fx, fy, fz;
+		XMVectorSinCos(&sinF, &fx, XMVectorMultiplyAdd(x, s, p));
+		XMVectorSinCos(&sinF, &fy, XMVectorMultiplyAdd(y, s, p));
+		XMVectorSinCos(&sinF, &fz, XMVectorMultiplyAdd(z, s, p));
+
+		// g'(x, y, z)
+		XMVECTOR cosG, gx, gy, gz;
+		XMVectorSinCos(&gx, &cosG, XMVectorMultiplyAdd(x, ks, p));
+		XMVectorSinCos(&gy, &cosG, XMVectorMultiplyAdd(y, ks, p));
+		XMVectorSinCos(&gz, &cosG, XMVectorMultiplyAdd(z, ks, p));
+
+		XMVECTOR vx = XMVectorMultiplyAdd(gy, gScale, Load4(VelocityX, i));
+		XMVECTOR vy = XMVectorMultiplyAdd(gz, gScale, Load4(VelocityY, i));
+		XMVECTOR vz = XMVectorMultiplyAdd(gx, gScale, Load4(VelocityZ, i));
+		Store4(VelocityX, i, XMVectorNegativeMultiplySubtract(fz, fScale, vx));
+		Store4(VelocityY, i, XMVectorNegativeMultiplySubtract(fx, fScale, vy));
+		Store4(VelocityZ, i, XMVectorNegativeMultiplySubtract(fy, fScale, vz));
+	}
+}
+
+// --------------------------------------------------------
+// Accelerates particles towards a point, falling off with
+// the square of the distance (softened so particles passing
+// right through the point don't explode)
+// --------------------------------------------------------
+void ParticleSoA::ApplyAttractor(int start, int end, const ParticleAttractor& attractor, float dt)
+{
+	const float softening = 0.25f;
+	XMVECTOR ax = XMVectorReplicate(attractor.Position.x);
+	XMVECTOR ay = XMVectorReplicate(attractor.Position.y);
+	XMVECTOR az = XMVectorReplicate(attractor.Position.z);
+	XMVECTOR soft = XMVectorReplicate(softening);
+	XMVECTOR strength = XMVectorReplicate(attractor.Strength * dt);
+
+	for (int i = GroupStart(start); i < GroupEnd(end, capacity); i += 4)
+	{
+		XMVECTOR dx = XMVectorSubtract(ax, Load4(PositionX, i));
+		XMVECTOR dy = XMVectorSubtract(ay, Load4(PositionY, i));
+		XMVECTOR dz = XMVectorSubtract(az, Load4(PositionZ, i));
+
+		// strength / (d^2 + soft) along the normalized direction
+		XMVECTOR distSq = XMVectorMultiplyAdd(dx, dx, XMVectorMultiplyAdd(dy, dy, XMVectorMultiplyAdd(dz, dz, soft)));
+		XMVECTOR invDist = XMVectorReciprocalSqrtEst(distSq);
+		XMVECTOR amount = XMVectorMultiply(strength, XMVectorMultiply(invDist, XMVectorMultiply(invDist, invDist)));
+
+		Store4(VelocityX, i, XMVectorMultiplyAdd(dx, amount, Load4(VelocityX, i)));
+		Store4(VelocityY, i, XMVectorMultiplyAdd(dy, amount, Load4(VelocityY, i)));
+		Store4(VelocityZ, i, XMVectorMultiplyAdd(dz, amount, Load4(VelocityZ, i)));
+	}
+}
+
+// --------------------------------------------------------
+// position += velocity * dt, age += dt
+// --------------------------------------------------------
+void ParticleSoA::Integrate(int start, int end, float dt)
+{
+	XMVECTOR step = XMVectorReplicate(dt);
+
+	for (int i = GroupStart(start); i < GroupEnd(end, capacity); i += 4)
+	{
+		Store4(PositionX, i, XMVectorMultiplyAdd(Load4(VelocityX, i), step, Load4(PositionX, i)));
+		Store4(PositionY, i, XMVectorMultiplyAdd(Load4(VelocityY, i), step, Load4(PositionY, i)));
+		Store4(PositionZ, i, XMVectorMultiplyAdd(Load4(VelocityZ, i), step, Load4(PositionZ, i)));
+		Store4(Age, i, XMVectorAdd(Load4(Age, i), step));
+	}
+}
+
+// --------------------------------------------------------
+// Interpolates size and color over each particle's life
+// --------------------------------------------------------
+void ParticleSoA::UpdateAppearance(
+	int start, int end,
+	float startSize, float endSize,
+	XMFLOAT4 startColor, XMFLOAT4 endColor)
+{
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR one = XMVectorSplatOne();
+
+	// Start values and deltas for each attribute
+	XMVECTOR s0 = XMVectorReplicate(startSize), sd = XMVectorReplicate(endSize - startSize);
+	XMVECTOR r0 = XMVectorReplicate(startColor.x), rd = XMVectorReplicate(endColor.x - startColor.x);
+	XMVECTOR g0 = XMVectorReplicate(startColor.y), gd = XMVectorReplicate(endColor.y - startColor.y);
+	XMVECTOR b0 = XMVectorReplicate(startColor.z), bd = XMVectorReplicate(endColor.z - startColor.z);
+	XMVECTOR a0 = XMVectorReplicate(startColor.w), ad = XMVectorReplicate(endColor.w - startColor.w);
+
+	for (int i = GroupStart(start); i < GroupEnd(end, capacity); i += 4)
+	{
+		// Expired particles (still waiting behind older ones) shrink to nothing
+		XMVECTOR age = Load4(Age, i);
+		XMVECTOR lifetime = Load4(Lifetime, i);
+		XMVECTOR t = XMVectorClamp(XMVectorDivide(age, XMVectorMax(lifetime, XMVectorReplicate(FLT_MIN))), zero, one);
+		XMVECTOR size = XMVectorMultiply(XMVectorMultiplyAdd(t, sd, s0), Load4(SizeScale, i));
+		Store4(Size, i, XMVectorSelect(size, zero, XMVectorGreaterOrEqual(age, lifetime)));
+		Store4(ColorR, i, XMVectorMultiplyAdd(t, rd, r0));
+		Store4(ColorG, i, XMVectorMultiplyAdd(t, gd, g0));
+		Store4(ColorB, i, XMVectorMultiplyAdd(t, bd, b0));
+		Store4(ColorA, i, XMVectorMultiplyAdd(t, ad, a0));
+	}
+}
+
+void ParticleSoA::Simulate(int start, int end, XMFLOAT3 acceleration, const ParticleForces& forces, float time, float dt)
+{
+	ApplyAcceleration(start, end, acceleration, dt);
+
+	if (forces.CurlStrength != 0.0f)
+		ApplyCurlNoise(start, end, forces.CurlStrength, forces.CurlScale, time * forces.CurlSpeed, dt);
+
+	for (const ParticleAttractor& a : forces.Attractors)
+		ApplyAttractor(start, end, a, dt);
+
+	if (forces.Drag > 0.0f)
+		ApplyDrag(start, end, forces.Drag, dt);
+
+	Integrate(start, end, dt);
+}
+
+// --------------------------------------------------------
+// Copies particles [start, end) into the GPU layout.  Unlike
+// the kernels, this is exact - it doesn't widen the range.
+// --------------------------------------------------------
+void ParticleSoA::Pack(int start, int end, SimulatedParticle* output)
+{
+	for (int i = start; i < end; i++, output++)
+	{
+		output->Position = XMFLOAT3(PositionX[i], PositionY[i], PositionZ[i]);
+		output->Size = Size[i];
+		output->Color = XMFLOAT4(ColorR[i], ColorG[i], ColorB[i], ColorA[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Times each kernel over a large set of particles and prints
+// the throughput in millions of particles per second
+// --------------------------------------------------------
+void ParticleSoA::Benchmark(int particleCount, int iterations)
+{
+	ParticleSoA soa;
+	soa.Resize(particleCount);
+	for (int i = 0; i < particleCount; i++)
+		soa.Spawn(i, XMFLOAT3((float)(i % 100), (float)(i % 37), (float)(i % 11)), XMFLOAT3(0, 1, 0), 5.0f);
+
+	std::vector<SimulatedParticle> packed(particleCount);
+	ParticleAttractor attractor = { XMFLOAT3(0, 5, 0), 10.0f };
+	ParticleForces forces;
+	forces.Drag = 0.5f;
+	forces.CurlStrength = 1.0f;
+	forces.Attractors.push_back(attractor);
+
+	const float dt = 1.0f / 60.0f;
+	auto time = [&](const char* name, auto kernel)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < iterations; i++)
+			kernel();
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		printf("  %-12s %8.1f M particles/sec\n", name, (double)particleCount * iterations / seconds / 1000000.0);
+	};
+
+	printf("Particle simulation benchmark: %d particles, %d iterations\n", particleCount, iterations);
+	time("Gravity", [&]() { soa.ApplyAcceleration(0, particleCount, XMFLOAT3(0, -9.8f, 0), dt); });
+	time("Drag", [&]() { soa.ApplyDrag(0, particleCount, forces.Drag, dt); });
+	time("Curl Noise", [&]() { soa.ApplyCurlNoise(0, particleCount, forces.CurlStrength, forces.CurlScale, 0.0f, dt); });
+	time("Attractor", [&]() { soa.ApplyAttractor(0, particleCount, attractor, dt); });
+	time("Integrate", [&]() { soa.Integrate(0, particleCount, dt); });
+	time("Appearance", [&]() { soa.UpdateAppearance(0, particleCount, 1.0f, 4.0f, XMFLOAT4(1, 1, 1, 1), XMFLOAT4(0, 0, 0, 0)); });
+	time("Pack", [&]() { soa.Pack(0, particleCount, packed.data()); });
+	time("All Forces", [&]() { soa.Simulate(0, particleCount, XMFLOAT3(0, -9.8f, 0), forces, 0.0f, dt); });
+}
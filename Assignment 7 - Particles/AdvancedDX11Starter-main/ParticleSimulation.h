@@ -0,0 +1,118 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+// --------------------------------------------------------
+// A point that pulls particles towards it (or pushes them
+// away, with a negative strength)
+// --------------------------------------------------------
+struct ParticleAttractor
+{
+	DirectX::XMFLOAT3 Position;
+	float Strength;
+};
+
+// --------------------------------------------------------
+// How simulated particles react to their neighbors - see
+// ParticleInteraction for the details of each mode
+// --------------------------------------------------------
+enum class ParticleInteractionMode
+{
+	None,
+	Boids,	// Flocking: separation, alignment and cohesion
+	Fluid	// Smoothed particle hydrodynamics: pressure and viscosity
+};
+
+struct ParticleInteractionSettings
+{
+	ParticleInteractionMode Mode = ParticleInteractionMode::None;
+	float Radius = 1.0f;			// Particles closer than this interact
+
+	// Boids
+	float Separation = 1.0f;		// Push away from close neighbors
+	float Alignment = 1.0f;			// Match neighbors' velocity
+	float Cohesion = 0.5f;			// Pull towards neighbors' center
+	float MaxSpeed = 5.0f;
+
+	// Fluid
+	float ParticleMass = 1.0f;
+	float RestDensity = 5.0f;		// Density the pressure pushes towards
+	float Stiffness = 2.0f;			// Pressure per unit of extra density
+	float Viscosity = 0.5f;			// Smooths out velocity differences
+};
+
+// --------------------------------------------------------
+// Forces applied to simulated particles, on top of the
+// emitter's constant acceleration (gravity)
+// --------------------------------------------------------
+struct ParticleForces
+{
+	float Drag = 0.0f;				// Fraction of velocity lost per second
+	float CurlStrength = 0.0f;		// Strength of the curl noise flow field
+	float CurlScale = 0.5f;			// Spatial frequency of the curl noise
+	float CurlSpeed = 0.5f;			// How quickly the curl noise animates
+	std::vector<ParticleAttractor> Attractors;
+	ParticleInteractionSettings Interaction;
+};
+
+// --------------------------------------------------------
+// Particle data as it's uploaded to the GPU for simulated
+// particles - must match ParticleSimVS.hlsl
+// --------------------------------------------------------
+struct SimulatedParticle
+{
+	DirectX::XMFLOAT3 Position;
+	float Size;
+	DirectX::XMFLOAT4 Color;
+};
+
+// --------------------------------------------------------
+// Structure-of-arrays particle state.
+//
+// Every array is padded to a multiple of four so the kernels
+// below can always work on whole SIMD groups.  Kernels take
+// [start, end) ranges, which they widen to whole groups;
+// the extra particles are dead ones that will be reset when
+// they're spawned again, so updating them is harmless.
+// --------------------------------------------------------
+class ParticleSoA
+{
+public:
+	void Resize(int particleCount);
+	int GetCapacity() { return capacity; }
+
+	// Resets a single particle's state
+	void Spawn(int index, DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 velocity, float lifetime, float sizeScale = 1.0f);
+
+	// Simulation kernels
+	void ApplyAcceleration(int start, int end, DirectX::XMFLOAT3 acceleration, float dt);
+	void ApplyDrag(int start, int end, float drag, float dt);
+	void ApplyCurlNoise(int start, int end, float strength, float scale, float phase, float dt);
+	void ApplyAttractor(int start, int end, const ParticleAttractor& attractor, float dt);
+	void Integrate(int start, int end, float dt);
+	void UpdateAppearance(
+		int start, int end,
+		float startSize, float endSize,
+		DirectX::XMFLOAT4 startColor, DirectX::XMFLOAT4 endColor);
+
+	// Runs all of the above for one time step
+	void Simulate(int start, int end, DirectX::XMFLOAT3 acceleration, const ParticleForces& forces, float time, float dt);
+
+	// Copies particles out in the GPU layout
+	void Pack(int start, int end, SimulatedParticle* output);
+
+	// Prints how many particles per second each kernel handles
+	static void Benchmark(int particleCount, int iterations);
+
+	std::vector<float> PositionX, PositionY, PositionZ;
+	std::vector<float> VelocityX, VelocityY, VelocityZ;
+	std::vector<float> Age;
+	std::vector<float> Lifetime;
+	std::vector<float> Size;
+	std::vector<float> SizeScale;	// Random per particle, set when spawned
+	std::vector<float> ColorR, ColorG, ColorB, ColorA;
+
+private:
+	int capacity = 0;
+};
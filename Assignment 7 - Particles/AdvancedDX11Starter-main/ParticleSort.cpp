@@ -0,0 +1,210 @@
+#include "ParticleSort.h"
+
+#include <chrono>
+#include <stdio.h>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Builds one key per particle from its view depth.
+//
+// Flipping the sign bit of a positive float (or all bits of
+// a negative one) gives an integer that sorts the same way
+// as the float.  Inverting that puts the largest depth first.
+// --------------------------------------------------------
+void ParticleSorter::ComputeDepthKeys(
+	const float* x, const float* y, const float* z,
+	int count,
+	XMFLOAT3 cameraPosition,
+	XMFLOAT3 cameraForward,
+	unsigned int* keys)
+{
+	// depth = dot(p - camera, forward) = dot(p, forward) - dot(camera, forward)
+	XMVECTOR fx = XMVectorReplicate(cameraForward.x);
+	XMVECTOR fy = XMVectorReplicate(cameraForward.y);
+	XMVECTOR fz = XMVectorReplicate(cameraForward.z);
+	XMVECTOR offset = XMVectorReplicate(-(
+		cameraPosition.x * cameraForward.x +
+		cameraPosition.y * cameraForward.y +
+		cameraPosition.z * cameraForward.z));
+
+	XMVECTOR positiveFlip = XMVectorReplicateInt(0x7FFFFFFF);
+	XMVECTOR negativeFlip = XMVectorZero();
+	XMVECTOR zero = XMVectorZero();
+
+	// Keys are written four at a time, so the tail goes
+	// through a small buffer instead of past the end
+	for (int i = 0; i < count; i += 4)
+	{
+		XMVECTOR depth = XMVectorMultiplyAdd(XMLoadFloat4((const XMFLOAT4*)&x[i]), fx, offset);
+		depth = XMVectorMultiplyAdd(XMLoadFloat4((const XMFLOAT4*)&y[i]), fy, depth);
+		depth = XMVectorMultiplyAdd(XMLoadFloat4((const XMFLOAT4*)&z[i]), fz, depth);
+
+		XMVECTOR flip = XMVectorSelect(positiveFlip, negativeFlip, XMVectorLess(depth, zero));
+		XMVECTOR key = XMVectorXorInt(depth, flip);
+
+		if (i + 4 <= count)
+		{
+			XMStoreInt4((uint32_t*)&keys[i], key);
+		}
+		else
+		{
+			unsigned int tail[4];
+			XMStoreInt4((uint32_t*)tail, key);
+			for (int t = 0; i + t < count; t++)
+				keys[i + t] = tail[t];
+		}
+	}
+}
+
+// --------------------------------------------------------
+// LSD radix sort of the keys, carrying indices along
+// --------------------------------------------------------
+const std::vector<unsigned int>& ParticleSorter::Sort(const unsigned int* keys, int count, JobSystem* jobs)
+{
+	if ((int)keysA.size() < count)
+	{
+		keysA.resize(count);
+		keysB.resize(count);
+		indicesA.resize(count);
+		indicesB.resize(count);
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		keysA[i] = keys[i];
+		indicesA[i] = i;
+	}
+
+	// One chunk per thread for big sorts, otherwise just one
+	int chunkCount = 1;
+	if (jobs && count >= ParallelThreshold)
+		chunkCount = (int)jobs->GetThreadCount();
+	int chunkSize = (count + chunkCount - 1) / chunkCount;
+	histograms.resize(RadixSize * chunkCount);
+
+	unsigned int* srcKeys = keysA.data();
+	unsigned int* dstKeys = keysB.data();
+	unsigned int* srcIndices = indicesA.data();
+	unsigned int* dstIndices = indicesB.data();
+
+	auto runChunks = [&](const std::function<void(int)>& job)
+	{
+		if (chunkCount > 1)
+			jobs->ParallelFor(chunkCount, job);
+		else
+			job(0);
+	};
+
+	for (int shift = 0; shift < 32; shift += RadixBits)
+	{
+		// Count each digit within each chunk
+		runChunks([&](int c)
+			{
+				unsigned int* histogram = &histograms[c * RadixSize];
+				for (int d = 0; d < RadixSize; d++)
+					histogram[d] = 0;
+
+				int end = (c + 1) * chunkSize < count ? (c + 1) * chunkSize : count;
+				for (int i = c * chunkSize; i < end; i++)
+					histogram[(srcKeys[i] >> shift) & (RadixSize - 1)]++;
+			});
+
+		// Turn counts into starting offsets - digit first, then
+		// chunk, which keeps equal keys in their original order
+		unsigned int offset = 0;
+		bool singleDigit = false;
+		for (int d = 0; d < RadixSize; d++)
+		{
+			unsigned int digitTotal = 0;
+			for (int c = 0; c < chunkCount; c++)
+			{
+				unsigned int n = histograms[c * RadixSize + d];
+				histograms[c * RadixSize + d] = offset;
+				offset += n;
+				digitTotal += n;
+			}
+
+			// Every key has the same digit, so this pass changes nothing
+			if (digitTotal == (unsigned int)count)
+				singleDigit = true;
+		}
+		if (singleDigit)
+			continue;
+
+		// Scatter each chunk into its slots
+		runChunks([&](int c)
+			{
+				unsigned int* offsets = &histograms[c * RadixSize];
+				int end = (c + 1) * chunkSize < count ? (c + 1) * chunkSize : count;
+				for (int i = c * chunkSize; i < end; i++)
+				{
+					unsigned int dst = offsets[(srcKeys[i] >> shift) & (RadixSize - 1)]++;
+					dstKeys[dst] = srcKeys[i];
+					dstIndices[dst] = srcIndices[i];
+				}
+			});
+
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcIndices, dstIndices);
+	}
+
+	// Make sure the results end up in the A arrays
+	if (srcIndices != indicesA.data())
+	{
+		keysA.swap(keysB);
+		indicesA.swap(indicesB);
+	}
+
+	// Only the first count entries are meaningful
+	return indicesA;
+}
+
+// --------------------------------------------------------
+// Sorts a large random cloud of particles and prints the
+// time taken for keys, a single threaded sort and a sort
+// spread across the job system
+// --------------------------------------------------------
+void ParticleSorter::Benchmark(int count, JobSystem* jobs)
+{
+	int padded = (count + 3) & ~3;
+	std::vector<float> x(padded), y(padded), z(padded);
+	unsigned int seed = 12345;
+	for (int i = 0; i < padded; i++)
+	{
+		// Simple LCG is plenty for test data
+		seed = seed * 1664525u + 1013904223u; x[i] = (seed >> 8) / 16777216.0f * 200.0f - 100.0f;
+		seed = seed * 1664525u + 1013904223u; y[i] = (seed >> 8) / 16777216.0f * 200.0f - 100.0f;
+		seed = seed * 1664525u + 1013904223u; z[i] = (seed >> 8) / 16777216.0f * 200.0f - 100.0f;
+	}
+
+	std::vector<unsigned int> keys(count);
+	ParticleSorter sorter;
+	XMFLOAT3 cameraPos(0, 0, -150);
+	XMFLOAT3 cameraForward(0, 0, 1);
+
+	auto now = []() { return std::chrono::high_resolution_clock::now(); };
+	auto ms = [](std::chrono::high_resolution_clock::time_point a, std::chrono::high_resolution_clock::time_point b)
+	{
+		return std::chrono::duration<double, std::milli>(b - a).count();
+	};
+
+	auto t0 = now();
+	ComputeDepthKeys(x.data(), y.data(), z.data(), count, cameraPos, cameraForward, keys.data());
+	auto t1 = now();
+	sorter.Sort(keys.data(), count);
+	auto t2 = now();
+	const std::vector<unsigned int>& order = sorter.Sort(keys.data(), count, jobs);
+	auto t3 = now();
+
+	// Depths should never increase along the sorted order
+	bool sorted = true;
+	for (int i = 1; i < count && sorted; i++)
+		sorted = z[order[i - 1]] - cameraPos.z >= z[order[i]] - cameraPos.z;
+
+	printf("Particle sort benchmark: %d particles\n", count);
+	printf("  Depth keys:        %8.3f ms\n", ms(t0, t1));
+	printf("  Radix sort (1):    %8.3f ms\n", ms(t1, t2));
+	printf("  Radix sort (%2u):   %8.3f ms\n", jobs ? jobs->GetThreadCount() : 1, ms(t2, t3));
+	printf("  Back to front:     %s\n", sorted ? "yes" : "NO");
+}
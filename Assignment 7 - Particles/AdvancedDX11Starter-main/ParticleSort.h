@@ -0,0 +1,47 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "JobSystem.h"
+
+// --------------------------------------------------------
+// Sorts particles back to front for alpha blending.
+//
+// Depth keys are 32-bit integers that order the same way as
+// the (negated) view depth, so a plain LSD radix sort - four
+// 8-bit passes - puts the farthest particle first.  Large
+// sorts split each pass into chunks across the job system;
+// every chunk scatters into its own precomputed slice, so the
+// result is stable and identical on any number of threads.
+// --------------------------------------------------------
+class ParticleSorter
+{
+public:
+	// Below this many keys, sorting isn't worth spreading out
+	static const int ParallelThreshold = 65536;
+
+	// Turns view depth into keys (ascending key = back to front)
+	// for count particles whose positions are stored as separate
+	// x, y and z arrays, each padded to a multiple of four
+	static void ComputeDepthKeys(
+		const float* x, const float* y, const float* z,
+		int count,
+		DirectX::XMFLOAT3 cameraPosition,
+		DirectX::XMFLOAT3 cameraForward,
+		unsigned int* keys);
+
+	// Sorts keys[0 .. count) and returns the order as indices
+	// into that array.  Both stay valid until the next Sort().
+	const std::vector<unsigned int>& Sort(const unsigned int* keys, int count, JobSystem* jobs = 0);
+
+	// Times key generation and sorting at a given size
+	static void Benchmark(int count, JobSystem* jobs);
+
+private:
+	static const int RadixBits = 8;
+	static const int RadixSize = 1 << RadixBits;
+
+	std::vector<unsigned int> keysA, keysB;
+	std::vector<unsigned int> indicesA, indicesB;
+	std::vector<unsigned int> histograms;	// RadixSize counts per chunk
+};
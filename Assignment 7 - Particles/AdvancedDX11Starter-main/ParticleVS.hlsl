@@ -11,7 +11,10 @@ cbuffer externalData : register(b0)
 
     float startSize;
     float endSize;
-    float lifetime;
+
+    // Where the oldest living particle sits in the ring buffer
+    int ringStart;
+    int ringSize;
 };
 
 struct Particle
@@ -19,6 +22,7 @@ struct Particle
     float EmitTime;
     float3 StartPosition;
     float3 StartVelocity;
+    float Lifetime;
 };
 
 StructuredBuffer<Particle> ParticleData : register(t0);
@@ -34,18 +38,19 @@ VertexToPixel main(uint id : SV_VertexID)
 {
     VertexToPixel output;
 
-    uint particleID = id / 4; 
+    uint particleID = (ringStart + id / 4) % ringSize;
     uint cornerID = id % 4; 
 
     Particle p = ParticleData.Load(particleID);
 
     float age = currentTime - p.EmitTime;
-    float agePercent = age / lifetime;
+    float agePercent = age / p.Lifetime;
 
     float3 pos = acceleration * age * age / 2.0f + p.StartVelocity * age + p.StartPosition;
 
-	// Size interpolation
-    float size = lerp(startSize, endSize, agePercent);
+	// Size interpolation - particles that have expired behind an
+	// older, longer lived one collapse to nothing until they're removed
+    float size = age < p.Lifetime ? lerp(startSize, endSize, agePercent) : 0.0f;
 
 
     float2 offsets[4];
@@ -55,9 +60,9 @@ VertexToPixel main(uint id : SV_VertexID)
     offsets[3] = float2(-1.0f, -1.0f); // BL
 
 
-	// Billboarding!
-    pos += float3(view._11, view._12, view._13) * offsets[cornerID].x;
-    pos += float3(view._21, view._22, view._23) * offsets[cornerID].y;
+	// Billboarding, scaled the same way as simulated particles
+    pos += float3(view._11, view._12, view._13) * offsets[cornerID].x * size;
+    pos += float3(view._21, view._22, view._23) * offsets[cornerID].y * size;
 
     matrix viewProj = mul(projection, view);
     output.position = mul(viewProj, float4(pos, 1.0f));
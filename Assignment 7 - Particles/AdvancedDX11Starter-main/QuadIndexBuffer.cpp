@@ -0,0 +1,67 @@
+#include "QuadIndexBuffer.h"
+
+#include <vector>
+
+
+QuadIndexBuffer::QuadIndexBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<IRenderer> renderer) :
+	device(device),
+	renderer(renderer),
+	quadCount(0)
+{
+}
+
+std::shared_ptr<QuadIndexBuffer> QuadIndexBuffer::GetShared(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<IRenderer> renderer)
+{
+	// Only a weak reference is kept here, so the buffer is released
+	// along with the last thing using it (and never outlives the device)
+	static std::weak_ptr<QuadIndexBuffer> shared;
+
+	std::shared_ptr<QuadIndexBuffer> result = shared.lock();
+	if (!result || result->device != device || result->renderer != renderer)
+	{
+		result = std::make_shared<QuadIndexBuffer>(device, renderer);
+		shared = result;
+	}
+	return result;
+}
+
+// --------------------------------------------------------
+// Makes sure there are indices for at least quadCount quads.
+// Growing leaves some extra room, so a series of slightly
+// bigger requests doesn't recreate the buffer every time.
+// --------------------------------------------------------
+void QuadIndexBuffer::Reserve(int quadCount)
+{
+	if (quadCount <= this->quadCount)
+		return;
+
+	int newCount = this->quadCount + this->quadCount / 2;
+	if (newCount < quadCount)
+		newCount = quadCount;
+
+	std::vector<unsigned int> indices(newCount * 6);
+	for (int q = 0; q < newCount; q++)
+	{
+		unsigned int v = q * 4;
+		indices[q * 6 + 0] = v;
+		indices[q * 6 + 1] = v + 1;
+		indices[q * 6 + 2] = v + 2;
+		indices[q * 6 + 3] = v;
+		indices[q * 6 + 4] = v + 2;
+		indices[q * 6 + 5] = v + 3;
+	}
+
+	D3D11_SUBRESOURCE_DATA indexData = {};
+	indexData.pSysMem = indices.data();
+
+	D3D11_BUFFER_DESC ibDesc = {};
+	ibDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	ibDesc.CPUAccessFlags = 0;
+	ibDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	ibDesc.ByteWidth = sizeof(unsigned int) * newCount * 6;
+
+	buffer.Reset();
+	device->CreateBuffer(&ibDesc, &indexData, buffer.GetAddressOf());
+	renderer->DescribeBuffer(buffer.Get(), ibDesc.ByteWidth, false);
+	this->quadCount = newCount;
+}
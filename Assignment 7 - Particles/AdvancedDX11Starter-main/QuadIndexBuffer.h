@@ -0,0 +1,36 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include "Renderer.h"
+
+// --------------------------------------------------------
+// A static index buffer of quads - (0, 1, 2, 0, 2, 3), then
+// the same for vertices 4-7 and so on - shared by every
+// particle draw, instead of each emitter having its own.
+//
+// It grows to fit the largest request, which replaces the
+// buffer, so fetch it with GetBuffer() when drawing rather
+// than holding on to it.
+// --------------------------------------------------------
+class QuadIndexBuffer
+{
+public:
+	QuadIndexBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<IRenderer> renderer);
+
+	// The buffer shared by everything using this device, which
+	// lives as long as something is holding on to it
+	static std::shared_ptr<QuadIndexBuffer> GetShared(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<IRenderer> renderer);
+
+	void Reserve(int quadCount);
+	ID3D11Buffer* GetBuffer() { return buffer.Get(); }
+	int GetQuadCount() { return quadCount; }
+	unsigned long long GetMemoryUsage() { return (unsigned long long)quadCount * 6 * sizeof(unsigned int); }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	std::shared_ptr<IRenderer> renderer;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	int quadCount;
+};
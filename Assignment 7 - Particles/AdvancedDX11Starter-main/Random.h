@@ -0,0 +1,248 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RANDOM_USE_SSE2
+#endif
+
+// --------------------------------------------------------
+// Small, fast random number generators with no global state.
+//
+// Each generator is an independent object, so every system
+// (or emitter, or thread) can own one and get the same
+// sequence from the same seed every time it runs.
+//
+//  - PCG32:           Good quality, for one number at a time
+//  - Xoshiro128Plus4: Four xoshiro128+ streams side by side,
+//                     for filling arrays four values at a time
+// --------------------------------------------------------
+
+
+// --------------------------------------------------------
+// SplitMix64 - used to turn a single seed into well mixed
+// starting states for the generators below
+// --------------------------------------------------------
+inline uint64_t SplitMix64(uint64_t& state)
+{
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+
+// --------------------------------------------------------
+// PCG32 (XSH-RR variant) - 64 bits of state, 32 bit output.
+// Different stream values give unrelated sequences even from
+// the same seed.
+// --------------------------------------------------------
+class PCG32
+{
+public:
+	PCG32(uint64_t seed = 0x853C49E6748FEA9BULL, uint64_t stream = 0xDA3E39CB94B95BDBULL) { Seed(seed, stream); }
+
+	void Seed(uint64_t seed, uint64_t stream = 0xDA3E39CB94B95BDBULL)
+	{
+		state = 0;
+		increment = (stream << 1) | 1;
+		Next();
+		state += seed;
+		Next();
+	}
+
+	uint32_t Next()
+	{
+		uint64_t old = state;
+		state = old * 6364136223846793005ULL + increment;
+		uint32_t xorShifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+		uint32_t rot = (uint32_t)(old >> 59);
+		return (xorShifted >> rot) | (xorShifted << ((32 - rot) & 31));
+	}
+
+	// Uniform float in [0, 1), from the top 24 bits
+	float NextFloat() { return (Next() >> 8) * (1.0f / 16777216.0f); }
+
+	// Uniform float in [min, max)
+	float Range(float min, float max) { return NextFloat() * (max - min) + min; }
+
+	// Uniform integer in [0, bound), without modulo bias
+	uint32_t Range(uint32_t bound)
+	{
+		uint64_t m = (uint64_t)Next() * bound;
+		uint32_t low = (uint32_t)m;
+		if (low < bound)
+		{
+			uint32_t threshold = (0u - bound) % bound;
+			while (low < threshold)
+			{
+				m = (uint64_t)Next() * bound;
+				low = (uint32_t)m;
+			}
+		}
+		return (uint32_t)(m >> 32);
+	}
+
+private:
+	uint64_t state;
+	uint64_t increment;
+};
+
+
+// --------------------------------------------------------
+// Four xoshiro128+ generators, one per SIMD lane.  Each call
+// produces four new values at once.  The low bits of
+// xoshiro128+ are weak, so only the top 24 are used for floats.
+// --------------------------------------------------------
+class Xoshiro128Plus4
+{
+public:
+	Xoshiro128Plus4(uint64_t seed = 1) { Seed(seed); }
+
+	void Seed(uint64_t seed)
+	{
+		uint64_t mix = seed;
+		for (int lane = 0; lane < 4; lane++)
+		{
+			uint64_t a = SplitMix64(mix);
+			uint64_t b = SplitMix64(mix);
+			s[0][lane] = (uint32_t)a;
+			s[1][lane] = (uint32_t)(a >> 32);
+			s[2][lane] = (uint32_t)b;
+			s[3][lane] = (uint32_t)(b >> 32);
+
+			// An all zero state would only ever produce zeros
+			if ((s[0][lane] | s[1][lane] | s[2][lane] | s[3][lane]) == 0)
+				s[0][lane] = 1;
+		}
+	}
+
+	// Four uniform floats in [0, 1)
+	DirectX::XMVECTOR NextFloat4()
+	{
+#ifdef RANDOM_USE_SSE2
+		__m128i s0 = _mm_loadu_si128((const __m128i*)s[0]);
+		__m128i s1 = _mm_loadu_si128((const __m128i*)s[1]);
+		__m128i s2 = _mm_loadu_si128((const __m128i*)s[2]);
+		__m128i s3 = _mm_loadu_si128((const __m128i*)s[3]);
+
+		__m128i result = _mm_add_epi32(s0, s3);
+		__m128i t = _mm_slli_epi32(s1, 9);
+		s2 = _mm_xor_si128(s2, s0);
+		s3 = _mm_xor_si128(s3, s1);
+		s1 = _mm_xor_si128(s1, s2);
+		s0 = _mm_xor_si128(s0, s3);
+		s2 = _mm_xor_si128(s2, t);
+		s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+		_mm_storeu_si128((__m128i*)s[0], s0);
+		_mm_storeu_si128((__m128i*)s[1], s1);
+		_mm_storeu_si128((__m128i*)s[2], s2);
+		_mm_storeu_si128((__m128i*)s[3], s3);
+
+		__m128 f = _mm_cvtepi32_ps(_mm_srli_epi32(result, 8));
+		return _mm_mul_ps(f, _mm_set1_ps(1.0f / 16777216.0f));
+#else
+		float f[4];
+		for (int lane = 0; lane < 4; lane++)
+		{
+			uint32_t result = s[0][lane] + s[3][lane];
+			uint32_t t = s[1][lane] << 9;
+			s[2][lane] ^= s[0][lane];
+			s[3][lane] ^= s[1][lane];
+			s[1][lane] ^= s[2][lane];
+			s[0][lane] ^= s[3][lane];
+			s[2][lane] ^= t;
+			s[3][lane] = (s[3][lane] << 11) | (s[3][lane] >> 21);
+			f[lane] = (result >> 8) * (1.0f / 16777216.0f);
+		}
+		return DirectX::XMVectorSet(f[0], f[1], f[2], f[3]);
+#endif
+	}
+
+	// Four uniform floats in [min, max)
+	DirectX::XMVECTOR Range4(float min, float max)
+	{
+		return DirectX::XMVectorMultiplyAdd(NextFloat4(), DirectX::XMVectorReplicate(max - min), DirectX::XMVectorReplicate(min));
+	}
+
+	// --------------------------------------------------------
+	// Batched helpers - each one works four outputs at a time
+	// and generates whole groups, so results only depend on the
+	// seed and the counts requested (not on how they're split)
+	// --------------------------------------------------------
+
+	// Uniform floats in [min, max)
+	void FillUniform(float* output, int count, float min, float max)
+	{
+		for (int i = 0; i < count; i += 4)
+		{
+			float values[4];
+			DirectX::XMStoreFloat4((DirectX::XMFLOAT4*)values, Range4(min, max));
+			for (int j = 0; j < 4 && i + j < count; j++)
+				output[i + j] = values[j];
+		}
+	}
+
+	// Points uniformly distributed in an axis aligned box
+	void FillBox(DirectX::XMFLOAT3* output, int count, DirectX::XMFLOAT3 center, DirectX::XMFLOAT3 halfExtents)
+	{
+		for (int i = 0; i < count; i += 4)
+		{
+			DirectX::XMVECTOR x = Range4(center.x - halfExtents.x, center.x + halfExtents.x);
+			DirectX::XMVECTOR y = Range4(center.y - halfExtents.y, center.y + halfExtents.y);
+			DirectX::XMVECTOR z = Range4(center.z - halfExtents.z, center.z + halfExtents.z);
+			Store(output + i, count - i, x, y, z);
+		}
+	}
+
+	// Points uniformly distributed inside a sphere
+	void FillSphere(DirectX::XMFLOAT3* output, int count, DirectX::XMFLOAT3 center, float radius)
+	{
+		using namespace DirectX;
+		for (int i = 0; i < count; i += 4)
+		{
+			XMVECTOR x, y, z;
+			UnitVector4(x, y, z);
+
+			// Cube root keeps the density even all the way out
+			XMVECTOR r = XMVectorMultiply(XMVectorPow(NextFloat4(), XMVectorReplicate(1.0f / 3.0f)), XMVectorReplicate(radius));
+			x = XMVectorMultiplyAdd(x, r, XMVectorReplicate(center.x));
+			y = XMVectorMultiplyAdd(y, r, XMVectorReplicate(center.y));
+			z = XMVectorMultiplyAdd(z, r, XMVectorReplicate(center.z));
+			Store(output + i, count - i, x, y, z);
+		}
+	}
+
+private:
+	uint32_t s[4][4];	// [state word][lane]
+
+	// Four unit vectors: z uniform in [-1, 1], angle uniform around it
+	void UnitVector4(DirectX::XMVECTOR& x, DirectX::XMVECTOR& y, DirectX::XMVECTOR& z)
+	{
+		using namespace DirectX;
+		z = Range4(-1.0f, 1.0f);
+		XMVECTOR angle = XMVectorMultiply(NextFloat4(), XMVectorReplicate(XM_2PI));
+		XMVECTOR r = XMVectorSqrt(XMVectorMax(XMVectorZero(), XMVectorNegativeMultiplySubtract(z, z, XMVectorSplatOne())));
+		XMVECTOR sinA, cosA;
+		XMVectorSinCos(&sinA, &cosA, angle);
+		x = XMVectorMultiply(r, cosA);
+		y = XMVectorMultiply(r, sinA);
+	}
+
+	// Writes up to four points from separate x, y and z vectors
+	static void Store(DirectX::XMFLOAT3* output, int remaining, DirectX::FXMVECTOR x, DirectX::FXMVECTOR y, DirectX::FXMVECTOR z)
+	{
+		DirectX::XMFLOAT4 xs, ys, zs;
+		DirectX::XMStoreFloat4(&xs, x);
+		DirectX::XMStoreFloat4(&ys, y);
+		DirectX::XMStoreFloat4(&zs, z);
+		const float* px = &xs.x;
+		const float* py = &ys.x;
+		const float* pz = &zs.x;
+		for (int j = 0; j < 4 && j < remaining; j++)
+			output[j] = DirectX::XMFLOAT3(px[j], py[j], pz[j]);
+	}
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+// --------------------------------------------------------
+// Direct3D objects are only ever passed through the renderer
+// as opaque pointers, so these forward declarations are all
+// a backend needs.  Backends that never touch the GPU (like
+// NullRenderer) don't include the Direct3D headers at all.
+// --------------------------------------------------------
+struct ID3D11Buffer;
+struct ID3D11ShaderResourceView;
+struct ID3D11SamplerState;
+struct ID3D11VertexShader;
+struct ID3D11PixelShader;
+struct ID3D11InputLayout;
+struct ID3D11RasterizerState;
+struct ID3D11DepthStencilState;
+struct ID3D11BlendState;
+struct ID3D11RenderTargetView;
+struct ID3D11DepthStencilView;
+
+enum class RenderMapType
+{
+	WriteDiscard,
+	WriteNoOverwrite
+};
+
+// --------------------------------------------------------
+// One piece of a buffer write - several of these can go
+// into a single map, so a wrapped ring only needs one
+// --------------------------------------------------------
+struct RenderBufferRange
+{
+	unsigned int ByteOffset;
+	const void* Data;
+	unsigned int Size;
+};
+
+enum class RenderShaderStage
+{
+	Vertex,
+	Pixel
+};
+
+// --------------------------------------------------------
+// Counts of the work submitted to a renderer
+// --------------------------------------------------------
+struct RenderStats
+{
+	unsigned long long DrawCalls = 0;
+	unsigned long long IndicesDrawn = 0;
+	unsigned long long VerticesDrawn = 0;
+	unsigned long long BufferWrites = 0;
+	unsigned long long BufferBytesWritten = 0;
+	unsigned long long FailedMaps = 0;
+	unsigned long long ConstantBufferUpdates = 0;
+	unsigned long long ConstantBufferBytes = 0;
+	unsigned long long Bindings = 0;
+	unsigned long long Clears = 0;
+
+	void Add(const RenderStats& other)
+	{
+		DrawCalls += other.DrawCalls;
+		IndicesDrawn += other.IndicesDrawn;
+		VerticesDrawn += other.VerticesDrawn;
+		BufferWrites += other.BufferWrites;
+		BufferBytesWritten += other.BufferBytesWritten;
+		FailedMaps += other.FailedMaps;
+		ConstantBufferUpdates += other.ConstantBufferUpdates;
+		ConstantBufferBytes += other.ConstantBufferBytes;
+		Bindings += other.Bindings;
+		Clears += other.Clears;
+	}
+};
+
+// --------------------------------------------------------
+// The small set of per-frame commands the engine issues.
+//
+// Resource creation stays on the device; everything that
+// happens each frame (uploads, bindings, draws) goes through
+// here so it can be swapped for a null or recording backend.
+// --------------------------------------------------------
+class IRenderer
+{
+public:
+	virtual ~IRenderer() {}
+
+	// Frame boundaries - stats are gathered per frame
+	void BeginFrame() { frameStats = RenderStats(); }
+	void EndFrame() { totalStats.Add(frameStats); frameCount++; }
+	const RenderStats& GetFrameStats() { return frameStats; }
+	const RenderStats& GetTotalStats() { return totalStats; }
+	unsigned long long GetFrameCount() { return frameCount; }
+
+	// Lets a backend validate writes and draws against buffer sizes
+	virtual void DescribeBuffer(ID3D11Buffer* /*buffer*/, unsigned int /*byteWidth*/, bool /*dynamic*/) {}
+
+	// Whether NO_OVERWRITE can follow a DISCARD from an earlier frame
+	// on a buffer the shaders read (MapNoOverwriteOnDynamicBufferSRV).
+	// Without it, every frame's first map of such a buffer must discard.
+	virtual bool CanNoOverwriteAcrossFrames() = 0;
+
+	// Buffer uploads - every range is copied under the same map.
+	// These return false (and count a failed map) if nothing could
+	// be written, in which case the buffer's contents are unknown.
+	virtual bool WriteBufferRanges(ID3D11Buffer* buffer, RenderMapType mapType, const RenderBufferRange* ranges, unsigned int rangeCount) = 0;
+	bool WriteBuffer(ID3D11Buffer* buffer, RenderMapType mapType, unsigned int byteOffset, const void* data, unsigned int size)
+	{
+		RenderBufferRange range = { byteOffset, data, size };
+		return WriteBufferRanges(buffer, mapType, &range, 1);
+	}
+	virtual void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size) = 0;
+
+	// Input assembler (index buffers are always 32-bit)
+	virtual void SetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride) = 0;
+	virtual void SetIndexBuffer(ID3D11Buffer* buffer) = 0;
+
+	// Shaders and their resources
+	virtual void SetVertexShader(ID3D11VertexShader* shader, ID3D11InputLayout* inputLayout) = 0;
+	virtual void SetPixelShader(ID3D11PixelShader* shader) = 0;
+	virtual void SetConstantBuffer(RenderShaderStage stage, unsigned int slot, ID3D11Buffer* buffer) = 0;
+	virtual void SetShaderResource(RenderShaderStage stage, unsigned int slot, ID3D11ShaderResourceView* srv) = 0;
+	virtual void SetSampler(RenderShaderStage stage, unsigned int slot, ID3D11SamplerState* sampler) = 0;
+
+	// Render states (null restores the defaults)
+	virtual void SetRasterizerState(ID3D11RasterizerState* state) = 0;
+	virtual void SetDepthStencilState(ID3D11DepthStencilState* state) = 0;
+	virtual void SetBlendState(ID3D11BlendState* state) = 0;
+
+	// Output merger
+	virtual void SetRenderTarget(ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv) = 0;
+	virtual void ClearRenderTarget(ID3D11RenderTargetView* rtv, const float color[4]) = 0;
+	virtual void ClearDepth(ID3D11DepthStencilView* dsv, float depth) = 0;
+
+	// Drawing
+	virtual void Draw(unsigned int vertexCount, unsigned int startVertex) = 0;
+	virtual void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) = 0;
+
+protected:
+	RenderStats frameStats;
+	RenderStats totalStats;
+	unsigned long long frameCount = 0;
+};
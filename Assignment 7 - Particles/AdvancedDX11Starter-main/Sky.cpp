@@ -104,11 +104,11 @@ Sky::~Sky()
 {
 }
 
-void Sky::Draw(std::shared_ptr<Camera> camera)
+void Sky::Draw(std::shared_ptr<IRenderer> renderer, std::shared_ptr<Camera> camera)
 {
 	// Change to the sky-specific rasterizer state
-	context->RSSetState(skyRasterState.Get());
-	context->OMSetDepthStencilState(skyDepthState.Get(), 0);
+	renderer->SetRasterizerState(skyRasterState.Get());
+	renderer->SetDepthStencilState(skyDepthState.Get());
 
 	// Set the sky shaders
 	skyVS->SetShader();
@@ -124,11 +124,11 @@ void Sky::Draw(std::shared_ptr<Camera> camera)
 	skyPS->SetSamplerState("samplerOptions", samplerOptions);
 
 	// Set mesh buffers and draw
-	skyMesh->SetBuffersAndDraw(context);
+	skyMesh->SetBuffersAndDraw(renderer);
 
 	// Reset my rasterizer state to the default
-	context->RSSetState(0); // Null (or 0) puts back the defaults
-	context->OMSetDepthStencilState(0, 0);
+	renderer->SetRasterizerState(0); // Null (or 0) puts back the defaults
+	renderer->SetDepthStencilState(0);
 }
 
 void Sky::InitRenderStates()
@@ -65,7 +65,7 @@ public:
 
 	~Sky();
 
-	void Draw(std::shared_ptr<Camera> camera);
+	void Draw(std::shared_ptr<IRenderer> renderer, std::shared_ptr<Camera> camera);
 
 private:
 
@@ -0,0 +1,167 @@
+#include "SpatialHash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include "Random.h"
+
+
+// --------------------------------------------------------
+// Rebuilds the grid around count particles
+//  - Each particle's key is the bucket its cell hashes to
+//  - Sorting by key groups each bucket's particles together
+//  - One pass over the sorted keys finds where buckets start
+// --------------------------------------------------------
+void SpatialHashGrid::Build(const float* x, const float* y, const float* z, int count, float cellSize, JobSystem* jobs)
+{
+	this->count = count;
+	this->cellSize = cellSize;
+	inverseCellSize = 1.0f / cellSize;
+
+	// At least twice as many buckets as particles keeps them short
+	unsigned int bucketCount = 64;
+	while (bucketCount < (unsigned int)count * 2)
+		bucketCount *= 2;
+	bucketMask = bucketCount - 1;
+
+	if (keys.size() < (size_t)count)
+	{
+		keys.resize(count);
+		order.resize(count);
+		SortedX.resize(count);
+		SortedY.resize(count);
+		SortedZ.resize(count);
+	}
+
+	// Hash in chunks, across threads for big grids
+	const int chunkSize = 16384;
+	int chunkCount = (count + chunkSize - 1) / chunkSize;
+	auto hashChunk = [&](int c)
+	{
+		int end = std::min(count, (c + 1) * chunkSize);
+		for (int i = c * chunkSize; i < end; i++)
+			keys[i] = HashCell(CellCoord(x[i]), CellCoord(y[i]), CellCoord(z[i]));
+	};
+	if (jobs && count >= ParallelThreshold)
+		jobs->ParallelFor(chunkCount, hashChunk);
+	else
+		for (int c = 0; c < chunkCount; c++) hashChunk(c);
+
+	// Sorting is stable, so particles keep their relative order within
+	// a bucket and the same input always gives the same grid
+	const std::vector<unsigned int>& sorted = sorter.Sort(keys.data(), count, jobs);
+
+	bucketStart.assign(bucketCount, 0);
+	bucketEnd.assign(bucketCount, 0);
+
+	auto copyChunk = [&](int c)
+	{
+		int end = std::min(count, (c + 1) * chunkSize);
+		for (int i = c * chunkSize; i < end; i++)
+		{
+			unsigned int p = sorted[i];
+			order[i] = p;
+			SortedX[i] = x[p];
+			SortedY[i] = y[p];
+			SortedZ[i] = z[p];
+		}
+	};
+	if (jobs && count >= ParallelThreshold)
+		jobs->ParallelFor(chunkCount, copyChunk);
+	else
+		for (int c = 0; c < chunkCount; c++) copyChunk(c);
+
+	for (int i = 0; i < count; i++)
+	{
+		unsigned int bucket = keys[order[i]];
+		if (i == 0 || bucket != keys[order[i - 1]])
+			bucketStart[bucket] = i;
+		bucketEnd[bucket] = i + 1;
+	}
+}
+
+// --------------------------------------------------------
+// Finds the non-empty buckets in the 3x3x3 cells around a
+// point, unless the last search was for the same cell.
+// Neighboring cells can hash to the same bucket, which must
+// only be searched once.
+// --------------------------------------------------------
+void SpatialHashGrid::FindNeighborCells(float px, float py, float pz, NeighborCells& cells) const
+{
+	int cx = CellCoord(px);
+	int cy = CellCoord(py);
+	int cz = CellCoord(pz);
+	if (cells.Count >= 0 && cells.CellX == cx && cells.CellY == cy && cells.CellZ == cz)
+		return;
+
+	cells.CellX = cx;
+	cells.CellY = cy;
+	cells.CellZ = cz;
+	cells.Count = 0;
+	if (count == 0)
+		return;
+
+	for (int dz = -1; dz <= 1; dz++)
+	{
+		for (int dy = -1; dy <= 1; dy++)
+		{
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				unsigned int bucket = HashCell(cx + dx, cy + dy, cz + dz);
+				int start = bucketStart[bucket];
+				int end = bucketEnd[bucket];
+				if (start == end)
+					continue;
+
+				// Buckets are identified by where they start
+				bool seen = false;
+				for (int c = 0; c < cells.Count && !seen; c++)
+					seen = cells.Start[c] == start;
+				if (seen)
+					continue;
+
+				cells.Start[cells.Count] = start;
+				cells.End[cells.Count] = end;
+				cells.Count++;
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Times grid rebuilds for count particles scattered through
+// a box, on one thread and then across the job system
+// --------------------------------------------------------
+void SpatialHashGrid::Benchmark(int count, JobSystem* jobs)
+{
+	PCG32 random;
+	random.Seed(39, 1);
+
+	// About 30 particles within one cell size of each other
+	float halfSize = 0.5f * powf(count / 7.2f, 1.0f / 3.0f);
+	std::vector<float> x(count), y(count), z(count);
+	for (int i = 0; i < count; i++)
+	{
+		x[i] = random.Range(-halfSize, halfSize);
+		y[i] = random.Range(-halfSize, halfSize);
+		z[i] = random.Range(-halfSize, halfSize);
+	}
+
+	printf("Spatial hash build: %d particles\n", count);
+
+	const int iterations = 20;
+	SpatialHashGrid grid;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		JobSystem* passJobs = pass == 0 ? 0 : jobs;
+		grid.Build(x.data(), y.data(), z.data(), count, 1.0f, passJobs);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < iterations; i++)
+			grid.Build(x.data(), y.data(), z.data(), count, 1.0f, passJobs);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+		printf("  %2u thread(s): %8.3f ms per build\n", passJobs ? passJobs->GetThreadCount() : 1, ms);
+	}
+}
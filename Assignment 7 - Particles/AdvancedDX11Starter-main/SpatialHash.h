@@ -0,0 +1,126 @@
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include "JobSystem.h"
+#include "ParticleSort.h"
+
+// --------------------------------------------------------
+// A uniform grid over particle positions, stored as a hash
+// table of buckets so it covers particles anywhere at all.
+//
+// Each rebuild hashes every particle's cell to a bucket and
+// counting sorts the particles by bucket (ParticleSorter's
+// radix sort, which is parallel and stable).  Positions are
+// copied out in that order, so the particles in a bucket sit
+// next to each other in memory.
+//
+// Cells are as big as the query radius, so a fixed-radius
+// query only has to look in the 3x3x3 cells around a point.
+// Unrelated cells can share a bucket, which just means a few
+// extra particles get rejected by the distance test.
+// --------------------------------------------------------
+class SpatialHashGrid
+{
+public:
+	// Below this many particles, keys are hashed on one thread
+	static const int ParallelThreshold = 65536;
+
+	void Build(const float* x, const float* y, const float* z, int count, float cellSize, JobSystem* jobs = 0);
+
+	// The ranges of sorted particles in the buckets around a cell.
+	// Particles sharing a cell sit next to each other in grid order,
+	// so a query can reuse the last one's ranges when it's in the
+	// same cell.  Start with Count = -1.
+	struct NeighborCells
+	{
+		int CellX, CellY, CellZ;
+		int Count = -1;
+		int Start[27];
+		int End[27];
+	};
+	void FindNeighborCells(float px, float py, float pz, NeighborCells& cells) const;
+
+	// Calls visit(sortedIndex, distanceSquared) for each particle
+	// within radius (no bigger than the cell size) of the point,
+	// in the same order every time
+	template<typename Visitor>
+	void ForEachNeighbor(float px, float py, float pz, float radius, NeighborCells& cells, Visitor visit) const;
+
+	template<typename Visitor>
+	void ForEachNeighbor(float px, float py, float pz, float radius, Visitor visit) const
+	{
+		NeighborCells cells;
+		ForEachNeighbor(px, py, pz, radius, cells, visit);
+	}
+
+	int GetCount() const { return count; }
+	float GetCellSize() const { return cellSize; }
+	int GetBucketCount() const { return (int)bucketStart.size(); }
+
+	// Sorted position i belongs to particle GetOrder()[i]
+	const unsigned int* GetOrder() const { return order.data(); }
+	std::vector<float> SortedX, SortedY, SortedZ;
+
+	// Times rebuilding the grid
+	static void Benchmark(int count, JobSystem* jobs);
+
+private:
+	int count = 0;
+	float cellSize = 1.0f;
+	float inverseCellSize = 1.0f;
+	unsigned int bucketMask = 0;
+
+	ParticleSorter sorter;
+	std::vector<unsigned int> keys;
+	std::vector<unsigned int> order;
+	std::vector<int> bucketStart;
+	std::vector<int> bucketEnd;
+
+	// Converting NaN or anything outside int's range is undefined,
+	// so coordinates are clamped first (with room left for the
+	// neighboring cells).  Everything out there, and NaN, shares
+	// the edge cells - those particles are broken anyway.
+	static const int MaxCellCoord = 1 << 30;
+	int CellCoord(float v) const
+	{
+		float c = floorf(v * inverseCellSize);
+		if (!(c >= -(float)MaxCellCoord))
+			return -MaxCellCoord;
+		if (c > (float)MaxCellCoord)
+			return MaxCellCoord;
+		return (int)c;
+	}
+	unsigned int HashCell(int cx, int cy, int cz) const
+	{
+		// Large odd multipliers spread neighboring cells out, and
+		// mixing the high bits back down keeps them apart once the
+		// hash is masked to a power of two
+		unsigned int h = (unsigned int)cx * 0x8DA6B343u + (unsigned int)cy * 0xD8163841u + (unsigned int)cz * 0xCB1AB31Fu;
+		h ^= h >> 16;
+		h *= 0x85EBCA6Bu;
+		h ^= h >> 13;
+		return h & bucketMask;
+	}
+};
+
+template<typename Visitor>
+void SpatialHashGrid::ForEachNeighbor(float px, float py, float pz, float radius, NeighborCells& cells, Visitor visit) const
+{
+	FindNeighborCells(px, py, pz, cells);
+
+	float radiusSq = radius * radius;
+	for (int c = 0; c < cells.Count; c++)
+	{
+		int end = cells.End[c];
+		for (int i = cells.Start[c]; i < end; i++)
+		{
+			float ox = SortedX[i] - px;
+			float oy = SortedY[i] - py;
+			float oz = SortedZ[i] - pz;
+			float distSq = ox * ox + oy * oy + oz * oz;
+			if (distSq < radiusSq)
+				visit(i, distSq);
+		}
+	}
+}
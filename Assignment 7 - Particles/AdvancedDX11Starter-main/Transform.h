@@ -32,6 +32,10 @@ public:
 	DirectX::XMFLOAT3 GetPitchYawRoll();
 	DirectX::XMFLOAT3 GetScale();
 
+	// Incremented every time the transform changes, so other
+	// objects can tell if their cached data is out of date
+	unsigned int GetVersion();
+
 	// Local direction vector getters
 	DirectX::XMFLOAT3 GetUp();
 	DirectX::XMFLOAT3 GetRight();
@@ -46,6 +50,7 @@ private:
 	DirectX::XMFLOAT3 position;
 	DirectX::XMFLOAT3 pitchYawRoll;
 	DirectX::XMFLOAT3 scale;
+	unsigned int version;
 
 	// Local orientation vectors
 	bool vectorsDirty;
@@ -1,6 +1,12 @@
+#include "GBuffer.hlsli"
+
 cbuffer externalData : register(b0)
 {
-    float2 pixelSize; // (1.0/windowWidth, 1.0/windowHeight)
+    matrix invProjMatrix; // Inverse of projection matrix
+    int2 direction; // (1,0) for the horizontal pass, (0,1) for the vertical
+    int blurRadius; // Taps each way from the center
+    float depthSharpness; // How quickly depth differences stop the blur
+    float normalPower; // How quickly normal differences stop the blur
 }
 
 struct VertexToPixel
@@ -10,20 +16,60 @@ struct VertexToPixel
 };
 
 Texture2D SSAO : register(t0);
-SamplerState ClampSampler : register(s0);
+Texture2D Normals : register(t1); // Octahedral (see GBuffer.hlsli)
+Texture2D Depths : register(t2);
+
+
+float LinearDepth(float depth)
+{
+    float4 viewPos = mul(invProjMatrix, float4(0, 0, depth, 1));
+    return viewPos.z / viewPos.w;
+}
 
+float3 UnitNormal(int2 pixel)
+{
+    return DecodeNormal(Normals.Load(int3(pixel, 0)).xy);
+}
 
+// One direction of a separable bilateral blur: a gaussian, with each tap's
+// weight scaled down by how far its depth and normal are from the center's,
+// so occlusion doesn't bleed across edges
 float4 main(VertexToPixel input) : SV_TARGET
 {
-    float ao = 0;
-    for (float x = -1.5f; x <= 1.5f; x++) // -1.5, -0.5, 0.5, 1.5
+    int2 pixel = int2(input.position.xy);
+    float depth = Depths.Load(int3(pixel, 0)).r;
+    if (depth == 1.0f)
+        return float4(1, 1, 1, 1);
+
+    float z = LinearDepth(depth);
+    float3 normal = UnitNormal(pixel);
+
+    uint width, height;
+    SSAO.GetDimensions(width, height);
+    int2 maxPixel = int2(width, height) - 1;
+
+    // Gaussian falloff, reaching about 13% at the radius
+    float sigma = (blurRadius + 1) * 0.5f;
+
+    float ao = 0.0f;
+    float totalWeight = 0.0f;
+    for (int i = -blurRadius; i <= blurRadius; i++)
     {
-        for (float y = -1.5f; y <= 1.5f; y++)
-        {
-            ao += SSAO.Sample(ClampSampler, float2(x, y) * pixelSize + input.uv).r;
-        }
+        int2 tap = clamp(pixel + direction * i, int2(0, 0), maxPixel);
+        float difference = abs(LinearDepth(Depths.Load(int3(tap, 0)).r) - z) / z;
+
+        // pow(0, 0) is NaN on the GPU, so a power of zero skips it
+        float normalWeight = normalPower > 0.0f ? pow(saturate(dot(UnitNormal(tap), normal)), normalPower) : 1.0f;
+        float weight =
+            exp(-(float)(i * i) / (2.0f * sigma * sigma)) *
+            exp(-difference * depthSharpness) *
+            normalWeight;
+
+        ao += SSAO.Load(int3(tap, 0)).r * weight;
+        totalWeight += weight;
     }
-// Average results and return
-    ao /= 16.0f; // 4x4 blur is 16 samples
+
+    // The center always has some weight, unless its normal is missing
+    ao = totalWeight > 0.0f ? ao / totalWeight : SSAO.Load(int3(pixel, 0)).r;
     return float4(ao.rrr, 1);
-}
\ No newline at end of file
+}
@@ -0,0 +1,106 @@
+#include "D3D11FrameGraphDevice.h"
+
+D3D11FrameGraphDevice::D3D11FrameGraphDevice(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context) :
+	device(device),
+	context(context),
+	pool(this)
+{
+}
+
+// --------------------------------------------------------
+// Grabs a matching render target from the pool for one of
+// the frame graph's physical textures
+// --------------------------------------------------------
+void D3D11FrameGraphDevice::CreateTexture(unsigned int physicalIndex, const FrameGraphTextureDesc& desc)
+{
+	if (physicalIndex >= physicalToPool.size())
+		physicalToPool.resize(physicalIndex + 1);
+
+	RenderTargetKey key;
+	key.Width = desc.Width;
+	key.Height = desc.Height;
+	key.Format = desc.Format;
+	key.Usage = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	physicalToPool[physicalIndex] = pool.Acquire(key, desc.BytesPerPixel);
+}
+
+void D3D11FrameGraphDevice::ClearTexture(unsigned int physicalIndex, const float color[4])
+{
+	RenderTarget* rt = GetRenderTarget(physicalIndex);
+	if (rt && rt->RTV)
+		context->ClearRenderTargetView(rt->RTV.Get(), color);
+}
+
+// --------------------------------------------------------
+// Hands the graph's textures back to the pool.  They stay
+// alive until the pool evicts them.
+// --------------------------------------------------------
+void D3D11FrameGraphDevice::ReleaseTextures()
+{
+	for (unsigned int id : physicalToPool)
+		pool.Release(id);
+	physicalToPool.clear();
+}
+
+// --------------------------------------------------------
+// Creates a render target texture and its two views
+// --------------------------------------------------------
+void D3D11FrameGraphDevice::CreateRenderTarget(unsigned int id, const RenderTargetKey& key)
+{
+	if (id >= renderTargets.size())
+		renderTargets.resize(id + 1);
+
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = key.Width;
+	texDesc.Height = key.Height;
+	texDesc.ArraySize = 1;
+	texDesc.BindFlags = key.Usage;
+	texDesc.Format = (DXGI_FORMAT)key.Format;
+	texDesc.MipLevels = 1; // Usually no mip chain needed for render targets
+	texDesc.MiscFlags = 0;
+	texDesc.SampleDesc.Count = 1; // Can't be zero
+	texDesc.SampleDesc.Quality = 0;
+
+	RenderTarget& rt = renderTargets[id];
+	device->CreateTexture2D(&texDesc, 0, rt.Texture.GetAddressOf());
+
+	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D; // This points to a Texture2D
+	rtvDesc.Texture2D.MipSlice = 0; // Which mip are we rendering into?
+	rtvDesc.Format = texDesc.Format; // Same format as texture
+	device->CreateRenderTargetView(rt.Texture.Get(), &rtvDesc, rt.RTV.GetAddressOf());
+	device->CreateShaderResourceView(rt.Texture.Get(), 0, rt.SRV.GetAddressOf());
+}
+
+void D3D11FrameGraphDevice::DestroyRenderTarget(unsigned int id)
+{
+	if (id < renderTargets.size())
+		renderTargets[id] = RenderTarget();
+}
+
+Microsoft::WRL::ComPtr<ID3D11RenderTargetView> D3D11FrameGraphDevice::GetRTV(int physicalIndex)
+{
+	RenderTarget* rt = GetRenderTarget(physicalIndex);
+	if (!rt)
+		return 0;
+	return rt->RTV;
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> D3D11FrameGraphDevice::GetSRV(int physicalIndex)
+{
+	RenderTarget* rt = GetRenderTarget(physicalIndex);
+	if (!rt)
+		return 0;
+	return rt->SRV;
+}
+
+D3D11FrameGraphDevice::RenderTarget* D3D11FrameGraphDevice::GetRenderTarget(int physicalIndex)
+{
+	if (physicalIndex < 0 || physicalIndex >= (int)physicalToPool.size())
+		return 0;
+
+	unsigned int id = physicalToPool[physicalIndex];
+	return id < renderTargets.size() ? &renderTargets[id] : 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+
+#include "FrameGraph.h"
+#include "RenderTargetPool.h"
+
+// --------------------------------------------------------
+// Backs a frame graph with real Direct3D 11 textures.
+//
+// Each texture gets both a render target view and a shader
+// resource view, since every frame graph resource is written
+// by one pass and sampled by another.  Textures come from a
+// render target pool, so recompiling the graph (on resize,
+// for instance) reuses textures whenever the sizes match.
+// --------------------------------------------------------
+class D3D11FrameGraphDevice : public IFrameGraphDevice, public IRenderTargetAllocator
+{
+public:
+	D3D11FrameGraphDevice(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// IFrameGraphDevice
+	void CreateTexture(unsigned int physicalIndex, const FrameGraphTextureDesc& desc);
+	void ClearTexture(unsigned int physicalIndex, const float color[4]);
+	void ReleaseTextures();
+
+	// IRenderTargetAllocator
+	void CreateRenderTarget(unsigned int id, const RenderTargetKey& key);
+	void DestroyRenderTarget(unsigned int id);
+
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> GetRTV(int physicalIndex);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV(int physicalIndex);
+	RenderTargetPool& GetPool() { return pool; }
+
+private:
+	struct RenderTarget
+	{
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> Texture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> RTV;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	// Indexed by pool id
+	std::vector<RenderTarget> renderTargets;
+
+	// Pool id for each of the graph's physical textures
+	std::vector<unsigned int> physicalToPool;
+
+	// Declared last so it's destroyed first, while
+	// the render targets it destroys still exist
+	RenderTargetPool pool;
+
+	RenderTarget* GetRenderTarget(int physicalIndex);
+};
@@ -43,6 +43,7 @@ DXCore::DXCore(
 	titleBarText(titleBarText),
 	windowWidth(windowWidth),
 	windowHeight(windowHeight),
+	resizeDebouncer(windowWidth, windowHeight),
 	vsync(vsync),
 	isFullscreen(false),
 	deviceSupportsTearing(false),
@@ -263,9 +264,9 @@ HRESULT DXCore::InitDirect3D()
 		depthStencilDesc.Height					= windowHeight;
 		depthStencilDesc.MipLevels				= 1;
 		depthStencilDesc.ArraySize				= 1;
-		depthStencilDesc.Format					= DXGI_FORMAT_D24_UNORM_S8_UINT;
+		depthStencilDesc.Format					= DXGI_FORMAT_R32_TYPELESS;
 		depthStencilDesc.Usage					= D3D11_USAGE_DEFAULT;
-		depthStencilDesc.BindFlags				= D3D11_BIND_DEPTH_STENCIL;
+		depthStencilDesc.BindFlags				= D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 		depthStencilDesc.CPUAccessFlags			= 0;
 		depthStencilDesc.MiscFlags				= 0;
 		depthStencilDesc.SampleDesc.Count		= 1;
@@ -276,10 +277,20 @@ HRESULT DXCore::InitDirect3D()
 		device->CreateTexture2D(&depthStencilDesc, 0, depthBufferTexture.GetAddressOf());
 
 		// As long as the depth buffer texture was created successfully, 
-		// create the associated Depth Stencil View so we can use it for rendering
+		// create the associated Depth Stencil View so we can use it for rendering,
+		// and a Shader Resource View so later passes can read the depths
 		if (depthBufferTexture != 0)
 		{
-			device->CreateDepthStencilView(depthBufferTexture.Get(), 0,	depthBufferDSV.GetAddressOf());
+			D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+			dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+			dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+			device->CreateDepthStencilView(depthBufferTexture.Get(), &dsvDesc, depthBufferDSV.GetAddressOf());
+
+			D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+			srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+			srvDesc.Texture2D.MipLevels = 1;
+			device->CreateShaderResourceView(depthBufferTexture.Get(), &srvDesc, depthBufferSRV.GetAddressOf());
 		}
 	}
 
@@ -322,6 +333,7 @@ void DXCore::OnResize()
 		// the back buffer before the resize operation
 		backBufferRTV.Reset();
 		depthBufferDSV.Reset();
+		depthBufferSRV.Reset();
 
 		// Resize the underlying swap chain buffers,
 		// which essentially destroys and recreates them
@@ -354,9 +366,9 @@ void DXCore::OnResize()
 		depthStencilDesc.Height = windowHeight;
 		depthStencilDesc.MipLevels = 1;
 		depthStencilDesc.ArraySize = 1;
-		depthStencilDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		depthStencilDesc.Format = DXGI_FORMAT_R32_TYPELESS;
 		depthStencilDesc.Usage = D3D11_USAGE_DEFAULT;
-		depthStencilDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+		depthStencilDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 		depthStencilDesc.CPUAccessFlags = 0;
 		depthStencilDesc.MiscFlags = 0;
 		depthStencilDesc.SampleDesc.Count = 1;
@@ -367,10 +379,20 @@ void DXCore::OnResize()
 		device->CreateTexture2D(&depthStencilDesc, 0, depthBufferTexture.GetAddressOf());
 
 		// As long as the depth buffer texture was created successfully, 
-		// create the associated Depth Stencil View so we can use it for rendering
+		// create the associated Depth Stencil View so we can use it for rendering,
+		// and a Shader Resource View so later passes can read the depths
 		if (depthBufferTexture != 0)
 		{
-			device->CreateDepthStencilView(depthBufferTexture.Get(), 0,	depthBufferDSV.GetAddressOf());
+			D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+			dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+			dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+			device->CreateDepthStencilView(depthBufferTexture.Get(), &dsvDesc, depthBufferDSV.GetAddressOf());
+
+			D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+			srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+			srvDesc.Texture2D.MipLevels = 1;
+			device->CreateShaderResourceView(depthBufferTexture.Get(), &srvDesc, depthBufferSRV.GetAddressOf());
 		}
 	}
 
@@ -434,6 +456,15 @@ HRESULT DXCore::Run()
 			// Update the input manager
 			Input::GetInstance().Update();
 
+			// Resize our required buffers once the
+			// window size has stopped changing
+			if (resizeDebouncer.Update())
+			{
+				windowWidth = resizeDebouncer.GetWidth();
+				windowHeight = resizeDebouncer.GetHeight();
+				OnResize();
+			}
+
 			// The game loop
 			Update(deltaTime, totalTime);
 			Draw(deltaTime, totalTime);
@@ -609,14 +640,20 @@ LRESULT DXCore::ProcessMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 		if (wParam == SIZE_MINIMIZED)
 			return 0;
 		
-		// Save the new client area dimensions.
-		windowWidth = LOWORD(lParam);
-		windowHeight = HIWORD(lParam);
-
-		// If DX is initialized, resize 
-		// our required buffers
-		if (device) 
-			OnResize();
+		// Before DX is initialized, just save the new client
+		// area dimensions.  After that, the buffers keep their
+		// size (and are stretched to fit) until the window has
+		// settled, and are then resized once (see Run())
+		if (!device)
+		{
+			windowWidth = LOWORD(lParam);
+			windowHeight = HIWORD(lParam);
+			resizeDebouncer.SetSize(windowWidth, windowHeight);
+		}
+		else
+		{
+			resizeDebouncer.Request(LOWORD(lParam), HIWORD(lParam));
+		}
 
 		return 0;
 
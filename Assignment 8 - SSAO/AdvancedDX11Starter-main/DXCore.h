@@ -5,6 +5,8 @@
 #include <string>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 
+#include "ResizeDebouncer.h"
+
 // We can include the correct library files here
 // instead of in Visual Studio settings if we want
 #pragma comment(lib, "d3d11.lib")
@@ -52,9 +54,12 @@ protected:
 	std::wstring	titleBarText;	// Custom text in window's title bar
 	bool			titleBarStats;	// Show extra stats in title bar?
 
-	// Size of the window's client area
+	// Size of the window's client area, as far as rendering is
+	// concerned.  New sizes only apply (calling OnResize()) once
+	// the window has stopped changing size for a few frames.
 	unsigned int windowWidth;
 	unsigned int windowHeight;
+	ResizeDebouncer resizeDebouncer;
 
 	// Does our window currently have focus?
 	// Helpful if we want to pause while not the active window
@@ -74,6 +79,7 @@ protected:
 
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV;
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthBufferSRV; // (32 bit float depths)
 
 	// Helper function for allocating a console window
 	void CreateConsoleWindow(int bufferLines, int bufferColumns, int windowLines, int windowColumns);
@@ -0,0 +1,52 @@
+cbuffer externalData : register(b0)
+{
+    int downsampleFactor; // How many full resolution pixels per side
+    int2 fullSize; // (windowWidth, windowHeight)
+}
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD;
+};
+
+struct PS_Output
+{
+    float4 normal : SV_TARGET0;
+    float depth : SV_TARGET1;
+};
+
+Texture2D Normals : register(t0); // Octahedral, copied as they are
+Texture2D Depths : register(t1);
+
+
+// Each low resolution pixel takes the depth and normal of one pixel in its block:
+// the nearest on one checkerboard color and the farthest on the other, so both
+// sides of a depth edge are kept (averaging would invent depths in between)
+PS_Output main(VertexToPixel input)
+{
+    int2 lowPixel = int2(input.position.xy);
+    int2 start = lowPixel * downsampleFactor;
+    int2 end = min(start + downsampleFactor, fullSize);
+    bool useMax = ((lowPixel.x + lowPixel.y) & 1) != 0;
+
+    int2 chosen = start;
+    float chosenDepth = Depths.Load(int3(start, 0)).r;
+    for (int y = start.y; y < end.y; y++)
+    {
+        for (int x = start.x; x < end.x; x++)
+        {
+            float depth = Depths.Load(int3(x, y, 0)).r;
+            if (useMax ? depth > chosenDepth : depth < chosenDepth)
+            {
+                chosenDepth = depth;
+                chosen = int2(x, y);
+            }
+        }
+    }
+
+    PS_Output output;
+    output.normal = Normals.Load(int3(chosen, 0));
+    output.depth = chosenDepth;
+    return output;
+}
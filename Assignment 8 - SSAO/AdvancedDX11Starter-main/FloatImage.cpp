@@ -0,0 +1,64 @@
+#include "FloatImage.h"
+
+#include <fstream>
+
+void FloatImage::Resize(int width, int height, int channels)
+{
+	Width = width;
+	Height = height;
+	Channels = channels;
+	Pixels.resize((size_t)width * height * channels);
+}
+
+// --------------------------------------------------------
+// Reads a PFM file - "PF" (3 channels) or "Pf" (1 channel),
+// the size, then a scale whose sign gives the byte order,
+// then the rows from the bottom up
+// --------------------------------------------------------
+bool FloatImage::LoadPFM(const std::string& file)
+{
+	std::ifstream in(file, std::ios::binary);
+	if (!in)
+		return false;
+
+	std::string type;
+	int width = 0;
+	int height = 0;
+	float scale = 0.0f;
+	in >> type >> width >> height >> scale;
+	in.get(); // Single whitespace before the data
+
+	// Only little-endian files (negative scale) are supported
+	if (!in || (type != "PF" && type != "Pf") || width <= 0 || height <= 0 || scale >= 0.0f)
+		return false;
+
+	Resize(width, height, type == "PF" ? 3 : 1);
+	for (int y = Height - 1; y >= 0 && in; y--)
+		in.read((char*)Row(y), sizeof(float) * Channels * Width);
+	return (bool)in;
+}
+
+// --------------------------------------------------------
+// Writes a PFM file.  Anything past the third channel is
+// dropped, and two channel images are padded to three.
+// --------------------------------------------------------
+bool FloatImage::SavePFM(const std::string& file) const
+{
+	std::ofstream out(file, std::ios::binary);
+	if (!out)
+		return false;
+
+	int outChannels = Channels == 1 ? 1 : 3;
+	out << (outChannels == 3 ? "PF" : "Pf") << "\n" << Width << " " << Height << "\n-1.0\n";
+
+	std::vector<float> row((size_t)Width * outChannels);
+	for (int y = Height - 1; y >= 0 && out; y--)
+	{
+		const float* source = Row(y);
+		for (int x = 0; x < Width; x++)
+			for (int c = 0; c < outChannels; c++)
+				row[x * outChannels + c] = c < Channels ? source[x * Channels + c] : 0.0f;
+		out.write((const char*)row.data(), sizeof(float) * row.size());
+	}
+	return (bool)out;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// A floating point image, stored top row first with its
+// channels interleaved.  Saved and loaded as PFM files (1 or
+// 3 channels), which most image tools can open.
+// --------------------------------------------------------
+struct FloatImage
+{
+	int Width = 0;
+	int Height = 0;
+	int Channels = 0;
+	std::vector<float> Pixels;
+
+	void Resize(int width, int height, int channels);
+	float* Row(int y) { return Pixels.data() + (size_t)y * Width * Channels; }
+	const float* Row(int y) const { return Pixels.data() + (size_t)y * Width * Channels; }
+
+	bool LoadPFM(const std::string& file);
+	bool SavePFM(const std::string& file) const;
+};
@@ -0,0 +1,274 @@
+#include "FrameGraph.h"
+
+#include <algorithm>
+
+
+FrameGraph::FrameGraph() :
+	device(0),
+	unaliasedMemory(0),
+	aliasedMemory(0)
+{
+}
+
+FrameGraph::~FrameGraph()
+{
+	if (device)
+		device->ReleaseTextures();
+}
+
+// --------------------------------------------------------
+// Clears out all passes and resources, and releases any
+// physical textures created by the previous compile
+// --------------------------------------------------------
+void FrameGraph::Reset()
+{
+	if (device)
+		device->ReleaseTextures();
+	device = 0;
+
+	resources.clear();
+	passes.clear();
+	physicalTextures.clear();
+	unaliasedMemory = 0;
+	aliasedMemory = 0;
+}
+
+// --------------------------------------------------------
+// Declares a transient texture owned by the graph
+// --------------------------------------------------------
+FrameGraph::ResourceHandle FrameGraph::CreateTexture(std::string name, const FrameGraphTextureDesc& desc)
+{
+	Resource res;
+	res.Name = name;
+	res.Desc = desc;
+	resources.push_back(res);
+	return (ResourceHandle)resources.size() - 1;
+}
+
+// --------------------------------------------------------
+// Declares a texture that lives outside of the graph (like
+// the back buffer).  Writing to one of these is considered
+// an output of the graph, so those passes are never culled.
+// --------------------------------------------------------
+FrameGraph::ResourceHandle FrameGraph::ImportTexture(std::string name)
+{
+	Resource res;
+	res.Name = name;
+	res.Imported = true;
+	resources.push_back(res);
+	return (ResourceHandle)resources.size() - 1;
+}
+
+// --------------------------------------------------------
+// Adds a pass to the graph.  Passes run in the order they
+// are added.
+//
+// reads          - Resources sampled by this pass
+// writes         - Resources rendered to by this pass
+// execute        - Does the actual work of the pass
+// hasSideEffects - Keep this pass even if nothing reads its results
+// --------------------------------------------------------
+void FrameGraph::AddPass(
+	std::string name,
+	std::vector<ResourceHandle> reads,
+	std::vector<ResourceHandle> writes,
+	std::function<void()> execute,
+	bool hasSideEffects)
+{
+	Pass pass;
+	pass.Name = name;
+	pass.Reads = reads;
+	pass.Writes = writes;
+	pass.Execute = execute;
+	pass.HasSideEffects = hasSideEffects;
+	passes.push_back(pass);
+}
+
+// --------------------------------------------------------
+// Culls unused passes, works out resource lifetimes, assigns
+// physical textures and creates them on the device
+//
+// device        - Creates the textures, or null to skip creation
+// allowAliasing - Can transients share physical textures?
+// --------------------------------------------------------
+void FrameGraph::Compile(IFrameGraphDevice* device, bool allowAliasing)
+{
+	// Release whatever the last compile made
+	if (this->device)
+		this->device->ReleaseTextures();
+	this->device = device;
+
+	CullPasses();
+	ComputeLifetimes();
+	AssignPhysicalTextures(allowAliasing);
+
+	// Create the textures that actually back the resources
+	if (device)
+	{
+		for (unsigned int i = 0; i < physicalTextures.size(); i++)
+			device->CreateTexture(i, physicalTextures[i]);
+	}
+}
+
+// --------------------------------------------------------
+// Runs each remaining pass in order, clearing resources
+// right before they're first written
+// --------------------------------------------------------
+void FrameGraph::Execute()
+{
+	for (Pass& pass : passes)
+	{
+		if (pass.Culled)
+			continue;
+
+		if (device)
+		{
+			for (ResourceHandle r : pass.Clears)
+				device->ClearTexture(resources[r].PhysicalIndex, resources[r].Desc.ClearColor);
+		}
+
+		if (pass.Execute)
+			pass.Execute();
+	}
+}
+
+int FrameGraph::GetPhysicalIndex(ResourceHandle resource)
+{
+	if (resource < 0 || resource >= (ResourceHandle)resources.size())
+		return -1;
+	return resources[resource].PhysicalIndex;
+}
+
+const std::string& FrameGraph::GetResourceName(ResourceHandle resource)
+{
+	return resources[resource].Name;
+}
+
+unsigned int FrameGraph::GetCulledPassCount()
+{
+	unsigned int count = 0;
+	for (Pass& pass : passes)
+		if (pass.Culled) count++;
+	return count;
+}
+
+// --------------------------------------------------------
+// Walks the passes backwards from the outputs, keeping only
+// the ones whose results are eventually used
+// --------------------------------------------------------
+void FrameGraph::CullPasses()
+{
+	std::vector<bool> needed(resources.size(), false);
+	for (size_t r = 0; r < resources.size(); r++)
+		needed[r] = resources[r].Imported;
+
+	for (int p = (int)passes.size() - 1; p >= 0; p--)
+	{
+		Pass& pass = passes[p];
+
+		// Is anything this pass writes needed later on?
+		bool keep = pass.HasSideEffects;
+		for (ResourceHandle w : pass.Writes)
+			keep = keep || needed[w];
+
+		pass.Culled = !keep;
+		if (pass.Culled)
+			continue;
+
+		// Everything this pass reads is now needed, too
+		for (ResourceHandle r : pass.Reads)
+			needed[r] = true;
+	}
+}
+
+// --------------------------------------------------------
+// Finds the first and last pass that touch each resource,
+// and which resources need to be cleared by which pass
+// --------------------------------------------------------
+void FrameGraph::ComputeLifetimes()
+{
+	for (Resource& res : resources)
+	{
+		res.FirstPass = -1;
+		res.LastPass = -1;
+		res.PhysicalIndex = -1;
+	}
+
+	for (int p = 0; p < (int)passes.size(); p++)
+	{
+		Pass& pass = passes[p];
+		pass.Clears.clear();
+		if (pass.Culled)
+			continue;
+
+		// Writes first, so a pass that clears a resource
+		// is recorded as that resource's first use
+		for (ResourceHandle w : pass.Writes)
+		{
+			Resource& res = resources[w];
+			if (res.FirstPass == -1 && !res.Imported && res.Desc.ClearOnFirstWrite)
+				pass.Clears.push_back(w);
+			if (res.FirstPass == -1) res.FirstPass = p;
+			res.LastPass = p;
+		}
+
+		for (ResourceHandle r : pass.Reads)
+		{
+			Resource& res = resources[r];
+			if (res.FirstPass == -1) res.FirstPass = p;
+			res.LastPass = p;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Gives each used transient a physical texture, reusing one
+// whose previous owner is finished with it when possible
+// --------------------------------------------------------
+void FrameGraph::AssignPhysicalTextures(bool allowAliasing)
+{
+	physicalTextures.clear();
+	unaliasedMemory = 0;
+	aliasedMemory = 0;
+
+	// Handle resources in the order they come to life
+	std::vector<ResourceHandle> order;
+	for (size_t r = 0; r < resources.size(); r++)
+		if (!resources[r].Imported && resources[r].FirstPass != -1)
+			order.push_back((ResourceHandle)r);
+
+	std::stable_sort(order.begin(), order.end(), [&](ResourceHandle a, ResourceHandle b)
+		{ return resources[a].FirstPass < resources[b].FirstPass; });
+
+	// The last pass that uses each physical texture so far
+	std::vector<int> physicalLastPass;
+
+	for (ResourceHandle r : order)
+	{
+		Resource& res = resources[r];
+		unaliasedMemory += res.Desc.GetSizeInBytes();
+
+		// Look for a compatible texture that's already free
+		int physical = -1;
+		for (size_t i = 0; allowAliasing && i < physicalTextures.size(); i++)
+		{
+			if (physicalLastPass[i] < res.FirstPass && physicalTextures[i].IsCompatibleWith(res.Desc))
+			{
+				physical = (int)i;
+				break;
+			}
+		}
+
+		// None available, so make a new one
+		if (physical == -1)
+		{
+			physicalTextures.push_back(res.Desc);
+			physicalLastPass.push_back(-1);
+			physical = (int)physicalTextures.size() - 1;
+			aliasedMemory += res.Desc.GetSizeInBytes();
+		}
+
+		res.PhysicalIndex = physical;
+		physicalLastPass[physical] = res.LastPass;
+	}
+}
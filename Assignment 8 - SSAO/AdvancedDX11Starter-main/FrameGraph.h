@@ -0,0 +1,129 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Describes a 2D render target used by the frame graph.
+//
+// Format is the raw DXGI_FORMAT value, stored as a plain
+// integer so the graph itself has no Direct3D dependency.
+// --------------------------------------------------------
+struct FrameGraphTextureDesc
+{
+	unsigned int Width = 0;
+	unsigned int Height = 0;
+	unsigned int Format = 0;
+	unsigned int BytesPerPixel = 4;
+
+	// Should the graph clear this target before its first write?
+	bool ClearOnFirstWrite = false;
+	float ClearColor[4] = { 0, 0, 0, 0 };
+
+	unsigned long long GetSizeInBytes() const { return (unsigned long long)Width * Height * BytesPerPixel; }
+	bool IsCompatibleWith(const FrameGraphTextureDesc& other) const
+	{
+		return Width == other.Width && Height == other.Height && Format == other.Format;
+	}
+};
+
+// --------------------------------------------------------
+// Creates and clears the physical textures that back the
+// graph's resources.  The graph only deals in indices, so
+// a null/recording device can stand in for Direct3D.
+// --------------------------------------------------------
+class IFrameGraphDevice
+{
+public:
+	virtual ~IFrameGraphDevice() {}
+
+	virtual void CreateTexture(unsigned int physicalIndex, const FrameGraphTextureDesc& desc) = 0;
+	virtual void ClearTexture(unsigned int physicalIndex, const float color[4]) = 0;
+	virtual void ReleaseTextures() = 0;
+};
+
+// --------------------------------------------------------
+// A small declarative frame graph.
+//
+// Passes declare which resources they read and write, and the
+// graph works out everything else when compiled:
+//  - Passes that don't contribute to an output are culled
+//  - Each transient resource gets a lifetime (first to last use)
+//  - Transients whose lifetimes don't overlap share a single
+//    physical texture, as long as their descriptions match
+//  - Clears are inserted before a resource's first write
+// --------------------------------------------------------
+class FrameGraph
+{
+public:
+	typedef int ResourceHandle;
+	static const ResourceHandle InvalidResource = -1;
+
+	FrameGraph();
+	~FrameGraph();
+
+	// Graph building - call Reset() before declaring a new graph
+	void Reset();
+	ResourceHandle CreateTexture(std::string name, const FrameGraphTextureDesc& desc);
+	ResourceHandle ImportTexture(std::string name);
+	void AddPass(
+		std::string name,
+		std::vector<ResourceHandle> reads,
+		std::vector<ResourceHandle> writes,
+		std::function<void()> execute,
+		bool hasSideEffects = false);
+
+	// Compiles the graph and (optionally) creates physical textures
+	// - The device must outlive the graph, which releases its textures
+	void Compile(IFrameGraphDevice* device, bool allowAliasing = true);
+	void Execute();
+
+	// Resource details
+	int GetPhysicalIndex(ResourceHandle resource);
+	const std::string& GetResourceName(ResourceHandle resource);
+	size_t GetResourceCount() { return resources.size(); }
+
+	// Compilation results
+	unsigned int GetPassCount() { return (unsigned int)passes.size(); }
+	unsigned int GetCulledPassCount();
+	const std::string& GetPassName(unsigned int pass) { return passes[pass].Name; }
+	bool IsPassCulled(unsigned int pass) { return passes[pass].Culled; }
+	unsigned int GetPhysicalTextureCount() { return (unsigned int)physicalTextures.size(); }
+	unsigned long long GetUnaliasedMemory() { return unaliasedMemory; }
+	unsigned long long GetAliasedMemory() { return aliasedMemory; }
+
+private:
+	struct Resource
+	{
+		std::string Name;
+		FrameGraphTextureDesc Desc;
+		bool Imported = false;
+		int FirstPass = -1;
+		int LastPass = -1;
+		int PhysicalIndex = -1;
+	};
+
+	struct Pass
+	{
+		std::string Name;
+		std::vector<ResourceHandle> Reads;
+		std::vector<ResourceHandle> Writes;
+		std::vector<ResourceHandle> Clears;
+		std::function<void()> Execute;
+		bool HasSideEffects = false;
+		bool Culled = false;
+	};
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<FrameGraphTextureDesc> physicalTextures;
+
+	IFrameGraphDevice* device;
+	unsigned long long unaliasedMemory;
+	unsigned long long aliasedMemory;
+
+	void CullPasses();
+	void ComputeLifetimes();
+	void AssignPhysicalTextures(bool allowAliasing);
+};
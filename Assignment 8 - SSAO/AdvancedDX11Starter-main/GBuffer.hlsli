@@ -0,0 +1,33 @@
+// Include guard
+#ifndef _GBUFFER_HLSL
+#define _GBUFFER_HLSL
+
+// Octahedral normals (Cigolle et al. 2014): a unit vector is projected onto
+// an octahedron, whose lower half is folded over the upper one, leaving a
+// square.  Two 16 bit channels keep the precision spread evenly over the
+// sphere.  NormalEncoding.h has the CPU versions of these.
+
+// Folds the lower hemisphere over the diagonals
+float2 OctahedralWrap(float2 v)
+{
+    return (1.0f - abs(v.yx)) * (v.xy >= 0.0f ? 1.0f : -1.0f);
+}
+
+// Unit world space normal to two 0-1 values (for UNORM targets)
+float2 EncodeNormal(float3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0f ? n.xy : OctahedralWrap(n.xy);
+    return n.xy * 0.5f + 0.5f;
+}
+
+float3 DecodeNormal(float2 encoded)
+{
+    float2 f = encoded * 2.0f - 1.0f;
+    float3 n = float3(f.x, f.y, 1.0f - abs(f.x) - abs(f.y));
+    float t = saturate(-n.z);
+    n.xy += n.xy >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+#endif
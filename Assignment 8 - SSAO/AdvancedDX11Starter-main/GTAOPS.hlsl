@@ -0,0 +1,137 @@
+#include "GBuffer.hlsli"
+
+cbuffer externalData : register(b0)
+{
+    matrix viewMatrix; // Camera view matrix
+    matrix projectionMatrix; // Camera projection matrix
+    matrix invProjMatrix; // Inverse of projection matrix
+
+    float ssaoRadius; // View space distance to look for horizons within
+    int sliceCount; // Directions around each pixel (each searched both ways)
+    int stepsPerSide; // Depth samples each way along a direction
+
+    // Per frame jitter for temporal accumulation (identity when it's off)
+    float2 randomRotation; // (cos, sin) to rotate the random vectors by
+    int2 noiseOffset; // Shifts the random texture, in pixels
+    int noiseSize; // Width and height of the random texture (4 or 64)
+}
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD;
+};
+
+Texture2D Normals : register(t0); // Octahedral (see GBuffer.hlsli)
+Texture2D Depths : register(t1);
+Texture2D Random : register(t2); // (rotations in xy, step offsets in w)
+
+static const float PI = 3.14159265f;
+static const float HALF_PI = 1.57079633f;
+
+
+float3 ViewSpaceFromDepth(float depth, float2 uv)
+{
+    // Back to NDCs
+    uv.y = 1.0f - uv.y; // Invert Y due to UV <--> NDC diff
+    uv = uv * 2.0f - 1.0f;
+    float4 screenPos = float4(uv, depth, 1.0f);
+    // Back to view space
+    float4 viewPos = mul(invProjMatrix, screenPos);
+    return viewPos.xyz / viewPos.w;
+}
+
+// Ground truth ambient occlusion (Jimenez et al.): each slice is a plane
+// through the view vector, searched both ways for the highest horizon.
+// The cosine weighted visibility between the two horizons is integrated
+// exactly, so a few directions give a smooth result where the hemisphere
+// kernel needs many samples.
+float4 main(VertexToPixel input) : SV_TARGET
+{
+    // Early out for sky box
+    int2 pixel = int2(input.position.xy);
+    float pixelDepth = Depths.Load(int3(pixel, 0)).r;
+    if (pixelDepth == 1.0f)
+        return float4(1, 1, 1, 1);
+
+    float2 size;
+    Depths.GetDimensions(size.x, size.y);
+    float3 position = ViewSpaceFromDepth(pixelDepth, (pixel + 0.5f) / size);
+    float3 viewDir = normalize(-position);
+    float3 normal = DecodeNormal(Normals.Load(int3(pixel, 0)).xy);
+    normal = normalize(mul((float3x3) viewMatrix, normal));
+
+    // The random vector turns the slices and offsets the steps along them
+    int2 noisePixel = (pixel + noiseOffset) % noiseSize;
+    float4 random = Random.Load(int3(noisePixel, 0));
+    random.xy = float2(
+        random.x * randomRotation.x - random.y * randomRotation.y,
+        random.x * randomRotation.y + random.y * randomRotation.x);
+    float stepNoise = random.w;
+
+    // How far the radius reaches across the screen
+    float radiusPixels = ssaoRadius * projectionMatrix[0][0] * 0.5f * size.x / position.z;
+
+    float visibility = 0.0f;
+    for (int s = 0; s < sliceCount; s++)
+    {
+        // Slice direction on screen (y down) and in view space (y up)
+        float sliceAngle = s * PI / sliceCount;
+        float sliceCos = cos(sliceAngle);
+        float sliceSin = sin(sliceAngle);
+        float2 direction = float2(random.x * sliceCos - random.y * sliceSin, random.x * sliceSin + random.y * sliceCos);
+        float3 directionView = float3(direction.x, -direction.y, 0.0f);
+
+        // The normal, projected into the slice, as an angle from the view vector
+        float3 orthoDirection = directionView - dot(directionView, viewDir) * viewDir;
+        float3 axis = normalize(cross(orthoDirection, viewDir));
+        float3 projectedNormal = normal - axis * dot(normal, axis);
+        float projectedLength = max(length(projectedNormal), 1e-6f);
+        float cosNormal = saturate(dot(projectedNormal, viewDir) / projectedLength);
+        float n = sign(dot(orthoDirection, projectedNormal)) * acos(cosNormal);
+
+        // Start at the tangent plane and look for anything higher,
+        // fading out occluders past the radius
+        float lowCos0 = cos(n + HALF_PI);
+        float lowCos1 = cos(n - HALF_PI);
+        float horizonCos0 = lowCos0;
+        float horizonCos1 = lowCos1;
+        for (int j = 0; j < stepsPerSide; j++)
+        {
+            float t = (j + stepNoise) / stepsPerSide;
+            float2 offset = direction * (1.0f + t * t * max(radiusPixels - 1.0f, 0.0f));
+
+            for (int side = 0; side < 2; side++)
+            {
+                int2 tap = int2(floor(pixel + 0.5f + (side == 0 ? offset : -offset)));
+                if (any(tap < 0) || any(tap >= int2(size)))
+                    continue;
+
+                float3 samplePos = ViewSpaceFromDepth(Depths.Load(int3(tap, 0)).r, (tap + 0.5f) / size);
+                float3 delta = samplePos - position;
+                float distance = length(delta);
+                float sampleCos = dot(delta, viewDir) / max(distance, 1e-6f);
+                float falloff = saturate((ssaoRadius - distance) / (0.4f * ssaoRadius));
+                if (side == 0)
+                    horizonCos0 = max(horizonCos0, lerp(lowCos0, sampleCos, falloff));
+                else
+                    horizonCos1 = max(horizonCos1, lerp(lowCos1, sampleCos, falloff));
+            }
+        }
+
+        // Horizon angles, kept within the hemisphere around the normal
+        float h0 = -acos(clamp(horizonCos1, -1.0f, 1.0f));
+        float h1 = acos(clamp(horizonCos0, -1.0f, 1.0f));
+        h0 = n + clamp(h0 - n, -HALF_PI, HALF_PI);
+        h1 = n + clamp(h1 - n, -HALF_PI, HALF_PI);
+
+        // Cosine weighted visibility between them
+        float sinN = sin(n);
+        float arc0 = (cosNormal + 2.0f * h0 * sinN - cos(2.0f * h0 - n)) / 4.0f;
+        float arc1 = (cosNormal + 2.0f * h1 * sinN - cos(2.0f * h1 - n)) / 4.0f;
+        visibility += projectedLength * (arc0 + arc1);
+    }
+
+    float ao = saturate(visibility / sliceCount);
+    return float4(ao.rrr, 1);
+}
@@ -1,11 +1,13 @@
 
-#include <stdlib.h>     // For seeding random and rand()
+#include <stdlib.h>
 #include <time.h>       // For grabbing time (to seed random)
+#include <chrono>
 
 #include "Game.h"
 #include "Vertex.h"
 #include "Input.h"
 #include "Helpers.h"
+#include "NormalEncoding.h"
 
 #include "WICTextureLoader.h"
 #include "ImGui/imgui.h"
@@ -20,13 +22,14 @@
 // For the DirectX Math library
 using namespace DirectX;
 
-// Helper macro for getting a float between min and max
-#define RandomRange(min, max) (float)rand() / RAND_MAX * (max - min) + min
-
 // Helper macros for making texture and shader loading code more succinct
 #define LoadTexture(file, srv) CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(file).c_str(), 0, srv.GetAddressOf())
 #define LoadShader(type, file) std::make_shared<type>(device.Get(), context.Get(), FixPath(file).c_str())
 
+// The G-buffer before octahedral normals: RGBA8 colors, normals and
+// ambient, an R32 depth target, and a separate D24S8 depth buffer
+#define GBUFFER_BYTES_PER_PIXEL_BEFORE 20
+
 
 // --------------------------------------------------------
 // Constructor
@@ -50,15 +53,69 @@ Game::Game(HINSTANCE hInstance)
 	showUIDemoWindow(false),
 	showPointLights(false)
 {
+	clusterIndexCapacity = 0;
+	lightClusterTime = 0.0;
+	lightTreeCapacity = 0;
+	lightTreeSamples = 0;
+	lightTreeBuiltCount = -1;
+	lightTreeFrame = 0;
+	lightTreeBuildTime = 0.0;
+	lightTreeRefitTime = 0.0;
 	ssaoSamples = 64;
 	ssaoRadius = 1.0f;
+	ssaoKernel = SSAO_KERNEL_HALTON;
+	ssaoNoise = SSAO_NOISE_BLUE;
+	ssaoNoiseSize = 0;
+	ssaoNoiseBakeTime = 0.0;
+	ssaoAlgorithm = SSAO_ALGORITHM_HEMISPHERE;
+	ssaoGTAOSlices = 2;
+	ssaoGTAOSteps = 4;
+	ssaoHiZ = true;
+	hiZOcclusionCulling = false;
+	hiZRT = FrameGraph::InvalidResource;
+	hiZWidth = 0;
+	hiZHeight = 0;
+	hiZReadbackMip = 0;
+	hiZReadbackPending = false;
+	occludedEntityCount = 0;
+	ssaoResolutionScale = 1;
+	ssaoWidth = 0;
+	ssaoHeight = 0;
+	ssaoUpsampleSharpness = 20.0f;
+	ssaoBlurRadius = 4;
+	ssaoBlurDepthSharpness = 20.0f;
+	ssaoBlurNormalPower = 8.0f;
+	ssaoTemporal = false;
+	ssaoHistoryWeight = 0.9f;
+	ssaoDisocclusionThreshold = 0.05f;
+	ssaoHistoryReadRT = FrameGraph::InvalidResource;
+	ssaoHistoryWriteRT = FrameGraph::InvalidResource;
+	ssaoHistoryIndex = 0;
+	ssaoHistoryValid = false;
+	ssaoHistoryWidth = 0;
+	ssaoHistoryHeight = 0;
+	ssaoFrame = 0;
+	ssaoCameraGeneration = 0;
+	frameGraphAliasing = true;
+	frameGraphResizePending = false;
+	gBufferBytesPerPixel = 0;
+	ssaoCapturePending = false;
+	ssaoCaptureValid = false;
+	ssaoReferenceTime = 0.0;
+	ssaoReferenceScale = 1;
+	ssaoFullResolutionTime = 0.0;
+	ssaoReferenceTemporal = false;
 	// Seed random
-	srand((unsigned int)time(0));
+	random.Seed((unsigned long long)time(0));
 
 #if defined(DEBUG) || defined(_DEBUG)
 	// Do we want a console window?  Probably only in debug mode
 	CreateConsoleWindow(500, 120, 32, 120);
 	printf("Console window created successfully.  Feel free to printf() here.\n");
+
+	// Print how long each shader takes to load (and whether
+	// its reflection data came from the cache)
+	ISimpleShader::ReportLoadTimes = true;
 #endif
 
 }
@@ -106,6 +163,17 @@ void Game::Init()
 	lightCount = 1;
 	GenerateLights();
 
+	// Buffers for the light clusters (the index list starts big
+	// enough for a few lights in every cluster)
+	CreateStructuredBuffer(sizeof(Light), MAX_LIGHTS, lightBuffer, lightBufferSRV);
+	CreateStructuredBuffer(sizeof(XMUINT2), LIGHT_CLUSTER_COUNT, clusterRangeBuffer, clusterRangeSRV);
+	clusterIndexCapacity = LIGHT_CLUSTER_COUNT * 16;
+	CreateStructuredBuffer(sizeof(uint32_t), clusterIndexCapacity, clusterIndexBuffer, clusterIndexSRV);
+
+	// The light tree has at most two nodes per light
+	lightTreeCapacity = 2 * MAX_LIGHTS;
+	CreateStructuredBuffer(sizeof(LightBVHNode), lightTreeCapacity, lightTreeBuffer, lightTreeSRV);
+
 	// Set initial graphics API state
 	//  - These settings persist until we change them
 	{
@@ -136,134 +204,12 @@ void Game::Init()
 	device->CreateSamplerState(&clampDesc, clampSamplerOptions.GetAddressOf());
 
 
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> rtTexture;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> sceneColorsTexture;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> ambientTexture;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> ssaoTexture;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> ssaoBlurTexture;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> depthTexture;
-
-	D3D11_TEXTURE2D_DESC texDesc = {};
-	texDesc.Width = windowWidth;
-	texDesc.Height = windowHeight;
-	texDesc.ArraySize = 1;
-	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE; // Need both!
-	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Might occasionally use other formats
-	texDesc.MipLevels = 1; // Usually no mip chain needed for render targets
-	texDesc.MiscFlags = 0;
-	texDesc.SampleDesc.Count = 1; // Can't be zero
-	texDesc.SampleDesc.Quality = 0;
-	device->CreateTexture2D(&texDesc, 0, rtTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-	device->CreateTexture2D(&texDesc, 0, sceneColorsTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-	device->CreateTexture2D(&texDesc, 0, ambientTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-	device->CreateTexture2D(&texDesc, 0, ssaoTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-	device->CreateTexture2D(&texDesc, 0, ssaoBlurTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-	// device->CreateTexture2D(&texDesc, 0, depthTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-
-	//texDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	D3D11_TEXTURE2D_DESC depthDesc = {};
-	depthDesc.Width = windowWidth;
-	depthDesc.Height = windowHeight;
-	depthDesc.ArraySize = 1;
-	depthDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE; // Need both!
-	depthDesc.Format = DXGI_FORMAT_R32_FLOAT; // Might occasionally use other formats
-	depthDesc.MipLevels = 1; // Usually no mip chain needed for render targets
-	depthDesc.MiscFlags = 0;
-	depthDesc.SampleDesc.Count = 1; // Can't be zero
-	depthDesc.SampleDesc.Quality = 0;
-	device->CreateTexture2D(&depthDesc, 0, depthTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-
-	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
-	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D; // This points to a Texture2D
-	rtvDesc.Texture2D.MipSlice = 0; // Which mip are we rendering into?
-	rtvDesc.Format = texDesc.Format; // Same format as texture
-
-	device->CreateRenderTargetView(rtTexture.Get(), &rtvDesc, sceneNormalsRTV.GetAddressOf());
-	device->CreateShaderResourceView(rtTexture.Get(), 0, sceneNormalsSRV.GetAddressOf());
-
-	device->CreateRenderTargetView(sceneColorsTexture.Get(), &rtvDesc, sceneColorsRTV.GetAddressOf());
-	device->CreateShaderResourceView(sceneColorsTexture.Get(), 0, sceneColorsSRV.GetAddressOf());
-
-	device->CreateRenderTargetView(ambientTexture.Get(), &rtvDesc, sceneAmbientRTV.GetAddressOf());
-	device->CreateShaderResourceView(ambientTexture.Get(), 0, sceneAmbientSRV.GetAddressOf());
-
-	device->CreateRenderTargetView(ssaoTexture.Get(), &rtvDesc, ssaoRTV.GetAddressOf());
-	device->CreateShaderResourceView(ssaoTexture.Get(), 0, ssaoSRV.GetAddressOf());
-
-	device->CreateRenderTargetView(ssaoBlurTexture.Get(), &rtvDesc, blurRTV.GetAddressOf());
-	device->CreateShaderResourceView(ssaoBlurTexture.Get(), 0, blurSRV.GetAddressOf());
-
-	D3D11_RENDER_TARGET_VIEW_DESC rtvDepthDesc = {};
-	rtvDepthDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D; // This points to a Texture2D
-	rtvDepthDesc.Texture2D.MipSlice = 0; // Which mip are we rendering into?
-	rtvDepthDesc.Format = depthDesc.Format; // Same format as texture
-
-	device->CreateRenderTargetView(depthTexture.Get(), &rtvDepthDesc, depthRTV.GetAddressOf());
-	device->CreateShaderResourceView(depthTexture.Get(), 0, depthSRV.GetAddressOf());
-
-
-	// Random SSAO Texture
-	const int textureSize = 4;
-	const int totalPixels = textureSize * textureSize;
-
-	XMFLOAT4 randomPixels[totalPixels] = {};
-	for (int i = 0; i < totalPixels; i++)
-	{
-		XMVECTOR randomVec = XMVectorSet(RandomRange(-1, 1), RandomRange(-1, 1), 0, 0);
-		XMStoreFloat4(&randomPixels[i], XMVector3Normalize(randomVec));
-	}
-
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> ssaoTex;
-	D3D11_TEXTURE2D_DESC tDesc = {};
-	tDesc.Width = textureSize;
-	tDesc.Height = textureSize;
-	tDesc.ArraySize = 1;
-	tDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-	tDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-	tDesc.MipLevels = 1;
-	tDesc.SampleDesc.Count = 1;
-
-	D3D11_SUBRESOURCE_DATA data = {};
-	data.pSysMem = randomPixels;
-	data.SysMemPitch = sizeof(float) * 4 * textureSize;
-
-	device->CreateTexture2D(&tDesc, &data, ssaoTex.GetAddressOf());
-
-	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Format = tDesc.Format;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
-	device->CreateShaderResourceView(ssaoTex.Get(), &srvDesc, randomTexSRV.GetAddressOf());
-	
-
-	// Want to save above texture and srv to game.h probably
-
-
-	// Set up the array of ssao offset vectors (count must match shader!)
-	for (int i = 0; i < 64; i++)
-	{
-		// Offsets should be in hemisphere ([-1,1], [-1,1], [0,1])
-		// Note: Must be stored as float4s due to cbuffer data packing!
-		ssaoOffsets[i] = XMFLOAT4(
-			(float)rand() / RAND_MAX * 2 - 1, // -1 to 1
-			(float)rand() / RAND_MAX * 2 - 1, // -1 to 1
-			(float)rand() / RAND_MAX, // 0 to 1
-			0);
-		XMVECTOR offset = XMVector3Normalize(XMLoadFloat4(&ssaoOffsets[i]));
-		// Scale over the array, such that more of the values are
-		// closer to the minimum than the maximum (see image -->)
-		float scale = (float)i / 64;
-		XMVECTOR acceleratedScale = XMVectorLerp(
-			XMVectorSet(0.1f, 0.1f, 0.1f, 1),
-			XMVectorSet(1, 1, 1, 1),
-			scale * scale);
-		XMStoreFloat4(&ssaoOffsets[i], offset * acceleratedScale);
-	}
-
+	// Render targets are created by the frame graph
+	frameGraphDevice = std::make_shared<D3D11FrameGraphDevice>(device, context);
+	BuildFrameGraph();
 
+	// SSAO kernel and random vectors
+	CreateSSAOSamples();
 }
 
 
@@ -284,8 +230,13 @@ void Game::LoadAssetsAndCreateEntities()
 
 	fullscreenVS = LoadShader(SimpleVertexShader, L"FullscreenVS.cso");
 	ssaoPS = LoadShader(SimplePixelShader, L"SSAOPS.cso");
+	gtaoPS = LoadShader(SimplePixelShader, L"GTAOPS.cso");
 	blurPS = LoadShader(SimplePixelShader, L"BlurSSAOPS.cso");
 	combinePS = LoadShader(SimplePixelShader, L"CombineSSAOPS.cso");
+	downsamplePS = LoadShader(SimplePixelShader, L"DownsampleSSAOPS.cso");
+	upsamplePS = LoadShader(SimplePixelShader, L"UpsampleSSAOPS.cso");
+	temporalPS = LoadShader(SimplePixelShader, L"TemporalSSAOPS.cso");
+	hiZPS = LoadShader(SimplePixelShader, L"HiZPS.cso");
 
 	std::shared_ptr<SimplePixelShader> specConvPS = LoadShader(SimplePixelShader, L"SpecularConvolution.cso");
 	std::shared_ptr<SimplePixelShader> brdfPS = LoadShader(SimplePixelShader, L"BrdfLookUpTablePS.cso");
@@ -581,12 +532,15 @@ void Game::LoadAssetsAndCreateEntities()
 
 // --------------------------------------------------------
 // Generates the lights in the scene: 3 directional lights
-// and many random point lights.
+// and many random point lights.  Past the first 128 (all the
+// scene had before light clustering), they're smaller and
+// spread further out, and some are spot lights.
 // --------------------------------------------------------
 void Game::GenerateLights()
 {
-	// Reset
+	// Reset (new lights get a new light tree, not a refit)
 	lights.clear();
+	lightTreeBuiltCount = -1;
 
 	// Setup directional lights
 	Light dir1 = {};
@@ -613,19 +567,142 @@ void Game::GenerateLights()
 	lights.push_back(dir3);
 
 	// Create the rest of the lights
-	while (lights.size() < MAX_LIGHTS)
+	const size_t originalLightCount = 128;
+	while (lights.size() < originalLightCount)
 	{
 		Light point = {};
 		point.Type = LIGHT_TYPE_POINT;
-		point.Position = XMFLOAT3(RandomRange(-10.0f, 10.0f), RandomRange(-5.0f, 5.0f), RandomRange(-10.0f, 10.0f));
-		point.Color = XMFLOAT3(RandomRange(0, 1), RandomRange(0, 1), RandomRange(0, 1));
-		point.Range = RandomRange(5.0f, 10.0f);
-		point.Intensity = RandomRange(0.1f, 0.5f);
+		point.Position = XMFLOAT3(random.Range(-10.0f, 10.0f), random.Range(-5.0f, 5.0f), random.Range(-10.0f, 10.0f));
+		point.Color = XMFLOAT3(random.Range(0.0f, 1.0f), random.Range(0.0f, 1.0f), random.Range(0.0f, 1.0f));
+		point.Range = random.Range(5.0f, 10.0f);
+		point.Intensity = random.Range(0.1f, 0.5f);
 
 		// Add to the list
 		lights.push_back(point);
 	}
 
+	while (lights.size() < MAX_LIGHTS)
+	{
+		Light light = {};
+		light.Type = random.NextFloat() < 0.25f ? LIGHT_TYPE_SPOT : LIGHT_TYPE_POINT;
+		light.Position = XMFLOAT3(random.Range(-30.0f, 30.0f), random.Range(-5.0f, 5.0f), random.Range(-30.0f, 30.0f));
+		light.Color = XMFLOAT3(random.Range(0.0f, 1.0f), random.Range(0.0f, 1.0f), random.Range(0.0f, 1.0f));
+		light.Range = random.Range(1.0f, 4.0f);
+		light.Intensity = random.Range(0.5f, 1.0f);
+
+		// Spot lights mostly point down
+		if (light.Type == LIGHT_TYPE_SPOT)
+		{
+			XMFLOAT3 direction(random.Range(-0.5f, 0.5f), -1.0f, random.Range(-0.5f, 0.5f));
+			XMStoreFloat3(&light.Direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+			light.SpotFalloff = random.Range(4.0f, 32.0f);
+		}
+
+		lights.push_back(light);
+	}
+}
+
+// --------------------------------------------------------
+// A dynamic structured buffer, rewritten each frame
+// --------------------------------------------------------
+void Game::CreateStructuredBuffer(unsigned int elementSize, unsigned int count, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = elementSize * count;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = elementSize;
+
+	buffer.Reset();
+	srv.Reset();
+	device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = count;
+	device->CreateShaderResourceView(buffer.Get(), &srvDesc, srv.GetAddressOf());
+}
+
+// --------------------------------------------------------
+// Assigns this frame's lights to clusters (see LightClusters)
+// on the job system and uploads the lights and their lists
+// --------------------------------------------------------
+void Game::UpdateLightClusters()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	lightClusters.Build(lights.data(), lightCount, camera->GetView(), camera->GetProjection(), camera->GetNearClip(), camera->GetFarClip(), &jobs);
+	lightClusterTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	// Lights can change in the UI, so they're all sent every frame
+	const std::vector<uint32_t>& indices = lightClusters.GetLightIndices();
+	if (indices.size() > clusterIndexCapacity)
+	{
+		clusterIndexCapacity = max((unsigned int)indices.size(), clusterIndexCapacity * 2);
+		CreateStructuredBuffer(sizeof(uint32_t), clusterIndexCapacity, clusterIndexBuffer, clusterIndexSRV);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (lightCount > 0 && SUCCEEDED(context->Map(lightBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		memcpy(mapped.pData, lights.data(), sizeof(Light) * lightCount);
+		context->Unmap(lightBuffer.Get(), 0);
+	}
+	if (SUCCEEDED(context->Map(clusterRangeBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		memcpy(mapped.pData, lightClusters.GetClusterRanges().data(), sizeof(XMUINT2) * LIGHT_CLUSTER_COUNT);
+		context->Unmap(clusterRangeBuffer.Get(), 0);
+	}
+	if (!indices.empty() && SUCCEEDED(context->Map(clusterIndexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		memcpy(mapped.pData, indices.data(), sizeof(uint32_t) * indices.size());
+		context->Unmap(clusterIndexBuffer.Get(), 0);
+	}
+}
+
+// --------------------------------------------------------
+// Rebuilds or refits the light BVH (see LightBVH) and uploads
+// its nodes, when the shaders are picking lights from it
+// --------------------------------------------------------
+void Game::UpdateLightTree()
+{
+	if (lightTreeSamples <= 0)
+	{
+		lightTreeBuiltCount = -1;
+		return;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (lightCount != lightTreeBuiltCount)
+	{
+		lightTree.Build(lights.data(), lightCount);
+		lightTreeBuildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		lightTreeBuiltCount = lightCount;
+	}
+	else
+	{
+		// Lights can change in the UI, so the bounds are refit every frame
+		lightTree.Refit(lights.data(), lightCount);
+		lightTreeRefitTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	lightTreeFrame++;
+
+	const std::vector<LightBVHNode>& nodes = lightTree.GetNodes();
+	if (nodes.size() > lightTreeCapacity)
+	{
+		lightTreeCapacity = max((unsigned int)nodes.size(), lightTreeCapacity * 2);
+		CreateStructuredBuffer(sizeof(LightBVHNode), lightTreeCapacity, lightTreeBuffer, lightTreeSRV);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (!nodes.empty() && SUCCEEDED(context->Map(lightTreeBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		memcpy(mapped.pData, nodes.data(), sizeof(LightBVHNode) * nodes.size());
+		context->Unmap(lightTreeBuffer.Get(), 0);
+	}
 }
 
 
@@ -639,96 +716,8 @@ void Game::OnResize()
 	// Handle base-level DX resize stuff
 	DXCore::OnResize();
 
-	// Need to resize the render targets
-	sceneNormalsRTV.Reset();
-	sceneNormalsSRV.Reset();
-	sceneColorsRTV.Reset();
-	sceneColorsSRV.Reset();
-	sceneAmbientRTV.Reset();
-	sceneAmbientSRV.Reset();
-
-	ssaoRTV.Reset();
-	ssaoSRV.Reset();
-	blurRTV.Reset();
-	blurSRV.Reset();
-
-	depthRTV.Reset();
-	depthSRV.Reset();
-
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> rtTexture;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> sceneColorsTexture;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> ambientTexture;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> ssaoTexture;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> ssaoBlurTexture;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> depthTexture;
-
-	D3D11_TEXTURE2D_DESC texDesc = {};
-	texDesc.Width = windowWidth;
-	texDesc.Height = windowHeight;
-	texDesc.ArraySize = 1;
-	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE; // Need both!
-	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Might occasionally use other formats
-	texDesc.MipLevels = 1; // Usually no mip chain needed for render targets
-	texDesc.MiscFlags = 0;
-	texDesc.SampleDesc.Count = 1; // Can't be zero
-	device->CreateTexture2D(&texDesc, 0, rtTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-	device->CreateTexture2D(&texDesc, 0, sceneColorsTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-	device->CreateTexture2D(&texDesc, 0, ambientTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-	device->CreateTexture2D(&texDesc, 0, ssaoTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-	device->CreateTexture2D(&texDesc, 0, ssaoBlurTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-	//device->CreateTexture2D(&texDesc, 0, depthTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-
-	D3D11_TEXTURE2D_DESC depthDesc = {};
-	depthDesc.Width = windowWidth;
-	depthDesc.Height = windowHeight;
-	depthDesc.ArraySize = 1;
-	depthDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE; // Need both!
-	depthDesc.Format = DXGI_FORMAT_R32_FLOAT; // Might occasionally use other formats
-	depthDesc.MipLevels = 1; // Usually no mip chain needed for render targets
-	depthDesc.MiscFlags = 0;
-	depthDesc.SampleDesc.Count = 1; // Can't be zero
-	depthDesc.SampleDesc.Quality = 0;
-	device->CreateTexture2D(&depthDesc, 0, depthTexture.GetAddressOf()); // ComPtr<ID3D11Texture2D> rtTexture
-
-	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
-	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D; // This points to a Texture2D
-	rtvDesc.Texture2D.MipSlice = 0; // Which mip are we rendering into?
-	rtvDesc.Format = texDesc.Format; // Same format as texture
-	device->CreateRenderTargetView(rtTexture.Get(), &rtvDesc, sceneNormalsRTV.GetAddressOf());
-	device->CreateRenderTargetView(sceneColorsTexture.Get(), &rtvDesc, sceneColorsRTV.GetAddressOf());
-
-	D3D11_RENDER_TARGET_VIEW_DESC rtvDepthDesc = {};
-	rtvDepthDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D; // This points to a Texture2D
-	rtvDepthDesc.Texture2D.MipSlice = 0; // Which mip are we rendering into?
-	rtvDepthDesc.Format = depthDesc.Format; // Same format as texture
-
-	device->CreateRenderTargetView(depthTexture.Get(), &rtvDepthDesc, depthRTV.GetAddressOf());
-	device->CreateShaderResourceView(depthTexture.Get(), 0, depthSRV.GetAddressOf());
-
-	device->CreateShaderResourceView(
-		rtTexture.Get(), // Texture resource itself
-		0, // Null description = default SRV options
-		sceneNormalsSRV.GetAddressOf()); // ComPtr<ID3D11ShaderResourceView>
-
-	device->CreateShaderResourceView(
-		sceneColorsTexture.Get(), // Texture resource itself
-		0, // Null description = default SRV options
-		sceneColorsSRV.GetAddressOf()); // ComPtr<ID3D11ShaderResourceView>
-
-
-	device->CreateRenderTargetView(ambientTexture.Get(), &rtvDesc, sceneAmbientRTV.GetAddressOf());
-	device->CreateShaderResourceView(ambientTexture.Get(), 0, sceneAmbientSRV.GetAddressOf());
-
-	device->CreateRenderTargetView(ssaoTexture.Get(), &rtvDesc, ssaoRTV.GetAddressOf());
-	device->CreateShaderResourceView(ssaoTexture.Get(), 0, ssaoSRV.GetAddressOf());
-
-	device->CreateRenderTargetView(ssaoBlurTexture.Get(), &rtvDesc, blurRTV.GetAddressOf());
-	device->CreateShaderResourceView(ssaoBlurTexture.Get(), 0, blurSRV.GetAddressOf());
-
-
-
-	
-
+	// Render targets are resized at the start of the next frame
+	frameGraphResizePending = true;
 
 	// Update our projection matrix to match the new aspect ratio
 	if (camera)
@@ -740,6 +729,22 @@ void Game::OnResize()
 // --------------------------------------------------------
 void Game::Update(float deltaTime, float totalTime)
 {
+	// Rebuild the render targets if the window size has changed
+	// since the last frame.  This happens before the UI is built,
+	// so it never shows views of textures from the old graph.
+	if (frameGraphResizePending)
+	{
+		BuildFrameGraph();
+		frameGraphResizePending = false;
+	}
+
+	// Same goes for SSAO captures, which rebuild the graph twice
+	if (ssaoCapturePending)
+	{
+		CaptureSSAOReference();
+		ssaoCapturePending = false;
+	}
+
 	// Set up the new frame for the UI, then build
 	// this frame's interface.  Note that the building
 	// of the UI could happen at any point during update.
@@ -767,42 +772,748 @@ void Game::Draw(float deltaTime, float totalTime)
 		// Clear the back buffer (erases what's on the screen)
 		const float bgColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f }; // Black
 		context->ClearRenderTargetView(backBufferRTV.Get(), bgColor);
-		context->ClearRenderTargetView(sceneColorsRTV.Get(), bgColor);
-		context->ClearRenderTargetView(sceneNormalsRTV.Get(), bgColor);
-		context->ClearRenderTargetView(sceneAmbientRTV.Get(), bgColor);
-		context->ClearRenderTargetView(depthRTV.Get(), bgColor);
 		// Clear the depth buffer (resets per-pixel occlusion information)
 		context->ClearDepthStencilView(depthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+	}
+
+	// Run the G-buffer and SSAO passes, skipping whatever
+	// was hidden last frame
+	UpdateOcclusionCulling();
+	UpdateLightClusters();
+	UpdateLightTree();
+	frameGraph.Execute();
+	EndSSAOFrame();
+
+	ID3D11ShaderResourceView* nullSRVs[128] = {};
+	context->PSSetShaderResources(0, 128, nullSRVs);
+	
+
+
+	// Frame END
+	// - These should happen exactly ONCE PER FRAME
+	// - At the very end of the frame (after drawing *everything*)
+	{
+		// Draw the UI after everything else
+		ImGui::Render();
+		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+
+		// Present the back buffer to the user
+		//  - Puts the results of what we've drawn onto the window
+		//  - Without this, the user never sees anything
+		bool vsyncNecessary = vsync || !deviceSupportsTearing || isFullscreen;
+		swapChain->Present(
+			vsyncNecessary ? 1 : 0,
+			vsyncNecessary ? 0 : DXGI_PRESENT_ALLOW_TEARING);
+
+		// Must re-bind buffers after presenting, as they become unbound
+		context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
+
+		// Let the pool evict render targets that are no longer used
+		frameGraphDevice->GetPool().EndFrame();
+
+		
+
+	}
+}
+
+
+// The SSAO graph stores raw DXGI formats (see SSAOFrameGraph.h)
+static_assert(SSAO_GRAPH_FORMAT_RGBA8_UNORM == DXGI_FORMAT_R8G8B8A8_UNORM, "SSAO graph formats must match DXGI");
+static_assert(SSAO_GRAPH_FORMAT_RG16_UNORM == DXGI_FORMAT_R16G16_UNORM, "SSAO graph formats must match DXGI");
+static_assert(SSAO_GRAPH_FORMAT_R32_FLOAT == DXGI_FORMAT_R32_FLOAT, "SSAO graph formats must match DXGI");
+
+// --------------------------------------------------------
+// Declares the G-buffer and SSAO passes and compiles the
+// frame graph, which (re)creates all of the render targets
+// at the current window size
+// --------------------------------------------------------
+void Game::BuildFrameGraph()
+{
+	frameGraph.Reset();
+
+	// SSAO runs at 1/scale of the window, rounded up
+	ssaoWidth = (windowWidth + ssaoResolutionScale - 1) / ssaoResolutionScale;
+	ssaoHeight = (windowHeight + ssaoResolutionScale - 1) / ssaoResolutionScale;
+
+	// Temporal history is kept only while it's in use, and starts
+	// over whenever the SSAO size changes
+	if (ssaoTemporal)
+	{
+		if (ssaoHistoryWidth != ssaoWidth || ssaoHistoryHeight != ssaoHeight)
+			CreateSSAOHistory();
+	}
+	else
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			ssaoHistoryTextures[i].Reset();
+			ssaoHistoryRTVs[i].Reset();
+			ssaoHistorySRVs[i].Reset();
+		}
+		ssaoHistoryWidth = 0;
+		ssaoHistoryHeight = 0;
+		ssaoHistoryValid = false;
+	}
+
+	// The Hi-Z pyramid is also only kept while it's in use, and
+	// always covers the full window
+	bool hiZ = ssaoHiZ || hiZOcclusionCulling;
+	if (hiZ)
+	{
+		if (hiZWidth != windowWidth || hiZHeight != windowHeight)
+			CreateHiZ();
+	}
+	else
+	{
+		hiZTexture.Reset();
+		hiZSRV.Reset();
+		hiZMipRTVs.clear();
+		hiZMipSRVs.clear();
+		hiZReadbackTexture.Reset();
+		hiZWidth = 0;
+		hiZHeight = 0;
+		hiZReadbackPending = false;
+	}
+
+	// The graph itself is declared without Direct3D (see SSAOFrameGraph.h)
+	SSAOFrameGraphSettings settings;
+	settings.Width = windowWidth;
+	settings.Height = windowHeight;
+	settings.ResolutionScale = ssaoResolutionScale;
+	settings.Temporal = ssaoTemporal;
+	settings.HiZ = hiZ;
+
+	SSAOFrameGraphPasses passes;
+	passes.GBuffer = [this]() { RenderGBuffer(); };
+	passes.HiZ = [this]() { RenderHiZ(); };
+	passes.Downsample = [this]() { RenderSSAODownsample(); };
+	passes.SSAO = [this]() { RenderSSAO(); };
+	passes.Temporal = [this]() { RenderSSAOTemporal(); };
+	passes.BlurX = [this]() { RenderSSAOBlur(true); };
+	passes.BlurY = [this]() { RenderSSAOBlur(false); };
+	passes.Upsample = [this]() { RenderSSAOUpsample(); };
+	passes.Combine = [this]() { RenderSSAOCombine(); };
+
+	SSAOFrameGraphResources resources;
+	DeclareSSAOFrameGraph(frameGraph, settings, passes, resources);
+	sceneColorsRT = resources.SceneColors;
+	sceneNormalsRT = resources.SceneNormals;
+	sceneAmbientRT = resources.SceneAmbient;
+	depthRT = resources.Depth;
+	ssaoRT = resources.SSAO;
+	blurTempRT = resources.BlurTemp;
+	blurRT = resources.Blur;
+	backBufferRT = resources.BackBuffer;
+	ssaoNormalsRT = resources.SSAONormals;
+	ssaoDepthsRT = resources.SSAODepths;
+	ssaoUpsampledRT = resources.SSAOUpsampled;
+	ssaoResultRT = resources.SSAOResult;
+	ssaoHistoryReadRT = resources.HistoryRead;
+	ssaoHistoryWriteRT = resources.HistoryWrite;
+	hiZRT = resources.HiZ;
+	gBufferBytesPerPixel = resources.GBufferBytesPerPixel;
+
+	frameGraph.Compile(frameGraphDevice.get(), frameGraphAliasing);
+
+#if defined(DEBUG) || defined(_DEBUG)
+	printf("G-buffer: %u bytes per pixel (was %u with 8 bit normals, a depth target and D24S8)\n",
+		gBufferBytesPerPixel, GBUFFER_BYTES_PER_PIXEL_BEFORE);
+	printf("Frame graph: %u passes (%u culled), %u physical targets, %.2f MB -> %.2f MB\n",
+		frameGraph.GetPassCount(),
+		frameGraph.GetCulledPassCount(),
+		frameGraph.GetPhysicalTextureCount(),
+		frameGraph.GetUnaliasedMemory() / (1024.0 * 1024.0),
+		frameGraph.GetAliasedMemory() / (1024.0 * 1024.0));
+
+	RenderTargetPool& pool = frameGraphDevice->GetPool();
+	printf("Render target pool: %u targets, %.2f MB, %.0f%% hit rate\n",
+		pool.GetTargetCount(),
+		pool.GetMemory() / (1024.0 * 1024.0),
+		pool.GetHitRate() * 100.0f);
+#endif
+}
+
+// --------------------------------------------------------
+// Views of a graph resource.  The SSAO history is imported,
+// so its views come from whichever texture is current.  The
+// Hi-Z pyramid is imported too (its render target is mip 0),
+// as is the depth buffer, which is only ever read this way.
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D11RenderTargetView> Game::GetRTV(FrameGraph::ResourceHandle resource)
+{
+	if (resource != FrameGraph::InvalidResource && resource == ssaoHistoryWriteRT)
+		return ssaoHistoryRTVs[ssaoHistoryIndex];
+	if (resource != FrameGraph::InvalidResource && resource == hiZRT && !hiZMipRTVs.empty())
+		return hiZMipRTVs[0];
+	return frameGraphDevice->GetRTV(frameGraph.GetPhysicalIndex(resource));
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Game::GetSRV(FrameGraph::ResourceHandle resource)
+{
+	if (resource != FrameGraph::InvalidResource && resource == ssaoHistoryWriteRT)
+		return ssaoHistorySRVs[ssaoHistoryIndex];
+	if (resource != FrameGraph::InvalidResource && resource == ssaoHistoryReadRT)
+		return ssaoHistorySRVs[1 - ssaoHistoryIndex];
+	if (resource != FrameGraph::InvalidResource && resource == hiZRT)
+		return hiZSRV;
+	if (resource != FrameGraph::InvalidResource && resource == depthRT)
+		return depthBufferSRV;
+	return frameGraphDevice->GetSRV(frameGraph.GetPhysicalIndex(resource));
+}
+
+// --------------------------------------------------------
+// Builds the kernel offsets and the random vector texture.
+// Blue noise is baked on the job system, which only takes a
+// moment, so it's done here rather than loaded from a file.
+// --------------------------------------------------------
+void Game::CreateSSAOSamples()
+{
+	// Set up the array of ssao offset vectors (count must match shader!)
+	GenerateSSAOKernel(ssaoKernel, ssaoOffsets, ARRAYSIZE(ssaoOffsets), random);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ssaoNoiseSize = GenerateSSAONoise(ssaoNoise, ssaoRandomVectors, random, &jobs);
+	ssaoNoiseBakeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> ssaoTex;
+	D3D11_TEXTURE2D_DESC tDesc = {};
+	tDesc.Width = ssaoNoiseSize;
+	tDesc.Height = ssaoNoiseSize;
+	tDesc.ArraySize = 1;
+	tDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	tDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	tDesc.MipLevels = 1;
+	tDesc.SampleDesc.Count = 1;
+
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = ssaoRandomVectors.data();
+	data.SysMemPitch = sizeof(float) * 4 * ssaoNoiseSize;
+
+	device->CreateTexture2D(&tDesc, &data, ssaoTex.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Format = tDesc.Format;
+	srvDesc.Texture2D.MipLevels = 1;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+
+	randomTexSRV.Reset();
+	device->CreateShaderResourceView(ssaoTex.Get(), &srvDesc, randomTexSRV.GetAddressOf());
+
+	// The accumulated history was made with the old samples
+	ssaoHistoryValid = false;
+}
+
+// --------------------------------------------------------
+// (Re)creates both SSAO history textures at the SSAO size.
+// Full float, so the depths are exact enough to compare and
+// the CPU reference can match the accumulation closely.
+// --------------------------------------------------------
+void Game::CreateSSAOHistory()
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = ssaoWidth;
+	desc.Height = ssaoHeight;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	for (int i = 0; i < 2; i++)
+	{
+		ssaoHistoryTextures[i].Reset();
+		ssaoHistoryRTVs[i].Reset();
+		ssaoHistorySRVs[i].Reset();
+		device->CreateTexture2D(&desc, 0, ssaoHistoryTextures[i].GetAddressOf());
+		device->CreateRenderTargetView(ssaoHistoryTextures[i].Get(), 0, ssaoHistoryRTVs[i].GetAddressOf());
+		device->CreateShaderResourceView(ssaoHistoryTextures[i].Get(), 0, ssaoHistorySRVs[i].GetAddressOf());
+	}
+
+	ssaoHistoryWidth = ssaoWidth;
+	ssaoHistoryHeight = ssaoHeight;
+	ssaoHistoryValid = false;
+}
+
+// --------------------------------------------------------
+// This frame's rotation, noise shift and kernel subset, or
+// none at all without temporal accumulation
+// --------------------------------------------------------
+SSAOFrameJitter Game::GetSSAOJitter()
+{
+	return ssaoTemporal ? SSAOFrameJitter::ForFrame(ssaoFrame, ssaoSamples, ssaoNoiseSize) : SSAOFrameJitter();
+}
+
+// --------------------------------------------------------
+// Called once the frame graph has run: this frame's history
+// becomes next frame's, and the camera remembers where it was
+// --------------------------------------------------------
+void Game::EndSSAOFrame()
+{
+	if (ssaoTemporal)
+	{
+		ssaoHistoryIndex = 1 - ssaoHistoryIndex;
+		ssaoHistoryValid = true;
+	}
+	ssaoFrame++;
+	camera->EndFrame();
+}
+
+// --------------------------------------------------------
+// (Re)creates the Hi-Z pyramid at the window size, with views
+// of each mip for building it one mip at a time, and the
+// staging texture occlusion culling reads it back through
+// --------------------------------------------------------
+void Game::CreateHiZ()
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = windowWidth;
+	desc.Height = windowHeight;
+	desc.MipLevels = HiZPyramid::MipCount(windowWidth, windowHeight);
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	hiZTexture.Reset();
+	hiZSRV.Reset();
+	device->CreateTexture2D(&desc, 0, hiZTexture.GetAddressOf());
+	device->CreateShaderResourceView(hiZTexture.Get(), 0, hiZSRV.GetAddressOf());
+
+	hiZMipRTVs.clear();
+	hiZMipSRVs.clear();
+	hiZMipRTVs.resize(desc.MipLevels);
+	hiZMipSRVs.resize(desc.MipLevels);
+	for (unsigned int mip = 0; mip < desc.MipLevels; mip++)
+	{
+		D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+		rtvDesc.Format = desc.Format;
+		rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+		rtvDesc.Texture2D.MipSlice = mip;
+		device->CreateRenderTargetView(hiZTexture.Get(), &rtvDesc, hiZMipRTVs[mip].GetAddressOf());
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = desc.Format;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = mip;
+		srvDesc.Texture2D.MipLevels = 1;
+		device->CreateShaderResourceView(hiZTexture.Get(), &srvDesc, hiZMipSRVs[mip].GetAddressOf());
+	}
+
+	// Culling reads back the first mip no wider than 256
+	hiZReadbackMip = 0;
+	while (hiZReadbackMip < (int)desc.MipLevels - 1 && (windowWidth >> hiZReadbackMip) > 256)
+		hiZReadbackMip++;
+
+	D3D11_TEXTURE2D_DESC readbackDesc = desc;
+	readbackDesc.Width = max(windowWidth >> hiZReadbackMip, 1u);
+	readbackDesc.Height = max(windowHeight >> hiZReadbackMip, 1u);
+	readbackDesc.MipLevels = 1;
+	readbackDesc.Usage = D3D11_USAGE_STAGING;
+	readbackDesc.BindFlags = 0;
+	readbackDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	hiZReadbackTexture.Reset();
+	device->CreateTexture2D(&readbackDesc, 0, hiZReadbackTexture.GetAddressOf());
+
+	hiZWidth = windowWidth;
+	hiZHeight = windowHeight;
+	hiZReadbackPending = false;
+}
+
+// --------------------------------------------------------
+// Picks up last frame's pyramid once the GPU has finished
+// with it (without waiting), then tests each entity's bounds
+// against it as seen from last frame's camera.  Anything newly
+// uncovered is drawn a frame late.
+// --------------------------------------------------------
+void Game::UpdateOcclusionCulling()
+{
+	entityOccluded.assign(entities.size(), false);
+	occludedEntityCount = 0;
+	if (!hiZOcclusionCulling)
+		return;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (hiZReadbackPending && SUCCEEDED(context->Map(hiZReadbackTexture.Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped)))
+	{
+		D3D11_TEXTURE2D_DESC desc = {};
+		hiZReadbackTexture->GetDesc(&desc);
+
+		FloatImage mip;
+		mip.Resize(desc.Width, desc.Height, 2);
+		for (int y = 0; y < mip.Height; y++)
+			memcpy(mip.Row(y), (const unsigned char*)mapped.pData + (size_t)y * mapped.RowPitch, sizeof(float) * 2 * mip.Width);
+		context->Unmap(hiZReadbackTexture.Get(), 0);
+
+		hiZCulling.Build(mip, &jobs);
+		hiZCullingViewProj = hiZReadbackViewProj;
+		hiZReadbackPending = false;
+	}
+	if (hiZCulling.GetMipCount() == 0)
+		return;
 
-		ID3D11RenderTargetView* renderTargets[4] = {};
-		renderTargets[0] = sceneColorsRTV.Get();
-		renderTargets[1] = sceneNormalsRTV.Get();
-		renderTargets[2] = sceneAmbientRTV.Get();
-		renderTargets[3] = depthRTV.Get();
-		context->OMSetRenderTargets(4, renderTargets, depthBufferDSV.Get());
+	// Each texel read back covers 2^mip pixels, but the last ones
+	// cover a little more, so bounds are grown by a texel to stay
+	// on the safe side
+	for (size_t i = 0; i < entities.size(); i++)
+	{
+		XMFLOAT3 boundsMin, boundsMax;
+		entities[i]->GetWorldBounds(boundsMin, boundsMax);
+		entityOccluded[i] = hiZCulling.IsBoxOccluded(boundsMin, boundsMax, hiZCullingViewProj, 1.0f);
+		occludedEntityCount += entityOccluded[i] ? 1 : 0;
+	}
+}
+
+// --------------------------------------------------------
+// Matches the viewport to the size of the targets about to
+// be rendered, since the SSAO passes may be smaller than
+// the window
+// --------------------------------------------------------
+void Game::SetViewport(unsigned int width, unsigned int height)
+{
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)width;
+	viewport.Height = (float)height;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	context->RSSetViewports(1, &viewport);
+}
+
+// --------------------------------------------------------
+// Renders a frame, reads the SSAO pass inputs and results back
+// and saves them to the SSAOReference folder (for use with
+// "-ssaoreference <folder>"), then runs the CPU reference on
+// them right away and records how far off the GPU is
+// --------------------------------------------------------
+void Game::CaptureSSAOReference()
+{
+	// Aliased targets may be overwritten by later passes, so
+	// render this frame with every target kept separate
+	bool aliasing = frameGraphAliasing;
+	frameGraphAliasing = false;
+	BuildFrameGraph();
+
+	context->ClearDepthStencilView(depthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+	frameGraph.Execute();
+	ID3D11ShaderResourceView* nullSRVs[128] = {};
+	context->PSSetShaderResources(0, 128, nullSRVs);
+
+	// Everything the frame used, before the history swaps
+	SSAOReferenceSettings settings;
+	settings.View = camera->GetView();
+	settings.Projection = camera->GetProjection();
+	memcpy(settings.Offsets, ssaoOffsets, sizeof(ssaoOffsets));
+	settings.RandomVectors = ssaoRandomVectors;
+	settings.NoiseSize = ssaoNoiseSize;
+	settings.Radius = ssaoRadius;
+	settings.Samples = ssaoSamples;
+	settings.Algorithm = ssaoAlgorithm;
+	settings.GTAOSlices = ssaoGTAOSlices;
+	settings.GTAOSteps = ssaoGTAOSteps;
+	settings.UseHiZ = ssaoHiZ;
+	settings.ResolutionScale = ssaoResolutionScale;
+	settings.UpsampleSharpness = ssaoUpsampleSharpness;
+	settings.BlurRadius = ssaoBlurRadius;
+	settings.BlurDepthSharpness = ssaoBlurDepthSharpness;
+	settings.BlurNormalPower = ssaoBlurNormalPower;
+	settings.Jitter = GetSSAOJitter();
+	settings.PreviousViewProjection = camera->GetPreviousViewProjection();
+	settings.HistoryValid = ssaoHistoryValid;
+	settings.HistoryWeight = ssaoHistoryWeight;
+	settings.DisocclusionThreshold = ssaoDisocclusionThreshold;
+
+	FloatImage encodedNormals, normals, depths, colors, ambient, gpuSSAO, gpuBlur, gpuUpsampled, gpuPreviousHistory, gpuHistory;
+	bool temporal = ssaoTemporal;
+	bool valid =
+		ReadRenderTarget(sceneNormalsRT, 2, encodedNormals) &&
+		ReadRenderTarget(depthRT, 1, depths) &&
+		ReadRenderTarget(sceneColorsRT, 3, colors) &&
+		ReadRenderTarget(sceneAmbientRT, 3, ambient) &&
+		ReadRenderTarget(ssaoRT, 1, gpuSSAO) &&
+		ReadRenderTarget(blurRT, 1, gpuBlur) &&
+		(ssaoResolutionScale == 1 || ReadRenderTarget(ssaoUpsampledRT, 1, gpuUpsampled)) &&
+		(!temporal || (ReadRenderTarget(ssaoHistoryReadRT, 3, gpuPreviousHistory) && ReadRenderTarget(ssaoHistoryWriteRT, 3, gpuHistory)));
+	EndSSAOFrame();
+
+	frameGraphAliasing = aliasing;
+	BuildFrameGraph();
+
+	ssaoCaptureValid = false;
+	if (!valid)
+	{
+		printf("SSAO reference: couldn't read back the render targets\n");
+		return;
+	}
+
+	// Captures keep the plain 0-1 normals, so they're easy to look at
+	DecodeNormalImage(encodedNormals, normals);
+
+	CreateDirectoryW(FixPath(L"SSAOReference").c_str(), 0);
+	std::string folder = WideToNarrow(FixPath(L"SSAOReference/"));
+	settings.Save(folder + "settings.txt");
+	normals.SavePFM(folder + "normals.pfm");
+	depths.SavePFM(folder + "depths.pfm");
+	colors.SavePFM(folder + "colors.pfm");
+	ambient.SavePFM(folder + "ambient.pfm");
+	gpuSSAO.SavePFM(folder + "gpu_ssao.pfm");
+	gpuBlur.SavePFM(folder + "gpu_blur.pfm");
+	if (ssaoResolutionScale > 1)
+		gpuUpsampled.SavePFM(folder + "gpu_upsampled.pfm");
+
+	// The history files are only there for temporal captures
+	std::string previousHistoryFile = folder + "gpu_history_prev.pfm";
+	std::string historyFile = folder + "gpu_history.pfm";
+	DeleteFileA(previousHistoryFile.c_str());
+	DeleteFileA(historyFile.c_str());
+	if (temporal)
+	{
+		gpuPreviousHistory.SavePFM(previousHistoryFile);
+		gpuHistory.SavePFM(historyFile);
 	}
 
+	// The GPU writes 8 bit targets, so allow for that rounding
+	FloatImage cpuSSAO, cpuBlur, cpuAO, cpuHistory;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ssaoReference.Run(normals, depths, settings, cpuSSAO, cpuBlur, cpuAO, &jobs,
+		temporal ? &gpuPreviousHistory : 0, temporal ? &cpuHistory : 0);
+	ssaoReferenceTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	ssaoReferenceScale = ssaoResolutionScale;
+	ssaoReferenceTemporal = temporal;
+	ssaoReferenceError = SSAOReference::Compare(cpuSSAO, gpuSSAO, 2.0f / 255.0f);
+	ssaoBlurReferenceError = SSAOReference::Compare(cpuBlur, gpuBlur, 2.0f / 255.0f);
+	if (temporal)
+		ssaoTemporalReferenceError = SSAOReference::Compare(cpuHistory, gpuHistory, 2.0f / 255.0f);
+	if (ssaoResolutionScale > 1)
+	{
+		ssaoUpsampleReferenceError = SSAOReference::Compare(cpuAO, gpuUpsampled, 2.0f / 255.0f);
+
+		// What the lower resolution gives up, compared to full resolution
+		FloatImage fullSSAO, fullBlur, fullAO;
+		settings.ResolutionScale = 1;
+		start = std::chrono::steady_clock::now();
+		ssaoReference.Run(normals, depths, settings, fullSSAO, fullBlur, fullAO, &jobs);
+		ssaoFullResolutionTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		ssaoFullResolutionError = SSAOReference::Compare(cpuAO, fullAO, 2.0f / 255.0f);
+	}
+	ssaoCaptureValid = true;
+
+	printf("SSAO reference: saved to %s, CPU took %.2f ms, max error %.4f (SSAO) %.4f (blur)\n",
+		folder.c_str(), ssaoReferenceTime, ssaoReferenceError.MaxError, ssaoBlurReferenceError.MaxError);
+}
+
+// --------------------------------------------------------
+// Copies a render target into a float image, through a
+// staging texture the CPU can read
+//
+// target   - The frame graph resource to read
+// channels - How many of the target's channels to keep
+// image    - Resized and filled with the target's contents
+// --------------------------------------------------------
+bool Game::ReadRenderTarget(FrameGraph::ResourceHandle target, int channels, FloatImage& image)
+{
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv = GetSRV(target);
+	if (!srv)
+		return false;
+
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	srv->GetResource(resource.GetAddressOf());
+	if (FAILED(resource.As(&texture)))
+		return false;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	texture->GetDesc(&desc);
+	// The depth buffer is typeless, but its bits are 32 bit floats
+	bool singleFloat = desc.Format == DXGI_FORMAT_R32_FLOAT || desc.Format == DXGI_FORMAT_R32_TYPELESS;
+	if (desc.Format != DXGI_FORMAT_R8G8B8A8_UNORM && desc.Format != DXGI_FORMAT_R16G16_UNORM &&
+		desc.Format != DXGI_FORMAT_R32G32B32A32_FLOAT && !singleFloat)
+		return false;
+
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.MiscFlags = 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staging;
+	if (FAILED(device->CreateTexture2D(&desc, 0, staging.GetAddressOf())))
+		return false;
+	context->CopyResource(staging.Get(), texture.Get());
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &mapped)))
+		return false;
+
+	image.Resize(desc.Width, desc.Height, channels);
+	for (int y = 0; y < image.Height; y++)
+	{
+		const unsigned char* source = (const unsigned char*)mapped.pData + (size_t)y * mapped.RowPitch;
+		float* dest = image.Row(y);
+		for (int x = 0; x < image.Width; x++)
+		{
+			for (int c = 0; c < channels; c++)
+			{
+				if (singleFloat)
+					dest[x * channels + c] = c == 0 ? ((const float*)source)[x] : 0.0f;
+				else if (desc.Format == DXGI_FORMAT_R32G32B32A32_FLOAT)
+					dest[x * channels + c] = ((const float*)source)[x * 4 + c];
+				else if (desc.Format == DXGI_FORMAT_R16G16_UNORM)
+					dest[x * channels + c] = c < 2 ? ((const unsigned short*)source)[x * 2 + c] / 65535.0f : 0.0f;
+				else
+					dest[x * channels + c] = source[x * 4 + c] / 255.0f;
+			}
+		}
+	}
+
+	context->Unmap(staging.Get(), 0);
+	return true;
+}
+
+// --------------------------------------------------------
+// Loads a capture saved by CaptureSSAOReference() and runs
+// it through the CPU reference on more and more threads.
+// Nothing is created besides a console, so this works on
+// machines without a GPU.
+// --------------------------------------------------------
+HRESULT Game::RunSSAOReference(const char* folder)
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	// Debug builds already have a console
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	return SSAOReference::RunFolder(folder, 5) ? S_OK : E_FAIL;
+}
+
+// --------------------------------------------------------
+// Runs SSAOReference::RunTests() in a console
+// --------------------------------------------------------
+HRESULT Game::RunSSAOTests()
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	return SSAOReference::RunTests() ? S_OK : E_FAIL;
+}
 
-	// Draw all of the entities
-	for (auto& ge : entities)
+// --------------------------------------------------------
+// Runs LightClusters::Benchmark() - like the SSAO reference,
+// this only needs a console
+// --------------------------------------------------------
+HRESULT Game::RunLightClusterBenchmark()
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	// Debug builds already have a console
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	return LightClusters::Benchmark(10) ? S_OK : E_FAIL;
+}
+
+// --------------------------------------------------------
+// Runs LightBVH::Benchmark(), also in a console
+// --------------------------------------------------------
+HRESULT Game::RunLightBVHBenchmark()
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	return LightBVH::Benchmark(10) ? S_OK : E_FAIL;
+}
+
+// --------------------------------------------------------
+// Runs ShaderReflectionCache::Test() in a console
+// --------------------------------------------------------
+HRESULT Game::RunReflectionCacheTest()
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	// Debug builds already have a console
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	return ShaderReflectionCache::Test() ? S_OK : E_FAIL;
+}
+
+// --------------------------------------------------------
+// Runs TestSSAOFrameGraph() in a console
+// --------------------------------------------------------
+HRESULT Game::RunFrameGraphTest()
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	return TestSSAOFrameGraph() ? S_OK : E_FAIL;
+}
+
+// --------------------------------------------------------
+// Runs RenderTargetPool::Test() in a console
+// --------------------------------------------------------
+HRESULT Game::RunRenderTargetPoolTest()
+{
+#if !defined(DEBUG) && !defined(_DEBUG)
+	CreateConsoleWindow(500, 120, 32, 120);
+#endif
+
+	return RenderTargetPool::Test() ? S_OK : E_FAIL;
+}
+
+// --------------------------------------------------------
+// Draws the scene into the G-buffer targets
+// --------------------------------------------------------
+void Game::RenderGBuffer()
+{
+	// Depths go straight to the depth buffer, which Draw() cleared
+	ID3D11RenderTargetView* renderTargets[3] = {};
+	renderTargets[0] = GetRTV(sceneColorsRT).Get();
+	renderTargets[1] = GetRTV(sceneNormalsRT).Get();
+	renderTargets[2] = GetRTV(sceneAmbientRT).Get();
+	context->OMSetRenderTargets(3, renderTargets, depthBufferDSV.Get());
+
+	// Where the shaders find their light clusters
+	const XMFLOAT4X4& view = camera->GetView();
+	XMFLOAT4 clusterDepthPlane(view._13, view._23, view._33, view._43);
+	XMFLOAT2 clusterScreenScale((float)LIGHT_CLUSTERS_X / windowWidth, (float)LIGHT_CLUSTERS_Y / windowHeight);
+
+	// Draw all of the entities that weren't hidden last frame
+	for (size_t i = 0; i < entities.size(); i++)
 	{
+		if (i < entityOccluded.size() && entityOccluded[i])
+			continue;
+		std::shared_ptr<GameEntity> ge = entities[i];
+
 		// Set the "per frame" data
 		// Note that this should literally be set once PER FRAME, before
 		// the draw loop, but we're currently setting it per entity since 
 		// we are just using whichever shader the current entity has.  
 		// Inefficient!!!
 		std::shared_ptr<SimplePixelShader> ps = ge->GetMaterial()->GetPixelShader();
-		ps->SetData("lights", (void*)(&lights[0]), sizeof(Light) * lightCount);
-		ps->SetInt("lightCount", lightCount);
 		ps->SetFloat3("cameraPosition", camera->GetTransform()->GetPosition());
 		ps->CopyBufferData("perFrame");
+		ps->SetFloat4("clusterDepthPlane", clusterDepthPlane);
+		ps->SetFloat2("clusterScreenScale", clusterScreenScale);
+		ps->SetFloat("clusterDepthScale", lightClusters.GetDepthScale());
+		ps->SetFloat("clusterDepthBias", lightClusters.GetDepthBias());
+		ps->SetInt("globalLightCount", lightClusters.GetGlobalLightCount());
+		ps->CopyBufferData("lightClusters");
+		ps->SetShaderResourceView("Lights", lightBufferSRV);
+		ps->SetShaderResourceView("ClusterRanges", clusterRangeSRV);
+		ps->SetShaderResourceView("ClusterLightIndices", clusterIndexSRV);
+		ps->SetInt("lightTreeNodeCount", lightTreeSamples > 0 ? (int)lightTree.GetNodes().size() : 0);
+		ps->SetInt("lightTreeSamples", lightTreeSamples);
+		ps->SetInt("lightTreeFrame", (int)lightTreeFrame);
+		ps->CopyBufferData("lightTree");
+		ps->SetShaderResourceView("LightTree", lightTreeSRV);
 		ps->SetInt("specIBLTotalMipLevels", sky->GetTotalSpecularIBLMipLevels());
 		ps->SetShaderResourceView("IrradianceIBLMap", sky->GetIrradianceMap());
 		ps->SetShaderResourceView("SpecularIBLMap", sky->GetSpecularMap());
 		ps->SetShaderResourceView("BrdfLookUpMap", sky->GetBRDFLookUpTexture());
 		ps->SetSamplerState("BasicSampler", samplerOptions);
 		ps->SetSamplerState("ClampSampler", clampSamplerOptions);
-		
 
 		// Draw the entity
 		ge->Draw(context, camera);
@@ -815,108 +1526,241 @@ void Game::Draw(float deltaTime, float totalTime)
 	// Draw the sky
 	sky->Draw(camera);
 
-	
-	/*context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+	// Unbind the G-buffer and depth buffer so they can be sampled
+	for (int i = 0; i < 3; i++)
+		renderTargets[i] = 0;
+	context->OMSetRenderTargets(3, renderTargets, 0);
+}
 
+// --------------------------------------------------------
+// Builds the Hi-Z pyramid from the depths, one mip at a time
+// (each from the one before it), and queues a copy of a small
+// mip for occlusion culling to read next frame
+// --------------------------------------------------------
+void Game::RenderHiZ()
+{
 	fullscreenVS->SetShader();
-	simpleTexturePS->SetShader();
-	simpleTexturePS->SetShaderResourceView("Pixels", sceneColorsSRV);
-
-	context->Draw(3, 0);*/
-
+	hiZPS->SetShader();
 
-
-
-	// SSAO POST PROCESSING
+	ID3D11ShaderResourceView* nullSRV = 0;
+	for (size_t mip = 0; mip < hiZMipRTVs.size(); mip++)
 	{
-		const int numTargets = 4;
-		ID3D11RenderTargetView* renderTargets[4] = {};
-		context->OMSetRenderTargets(4, renderTargets, 0);
-
-		fullscreenVS->SetShader();
-
-		context->OMSetRenderTargets(1, ssaoRTV.GetAddressOf(), 0);
-
-		// SSAO RESULTS
-		ssaoPS->SetShader();
-		
-		XMFLOAT4X4 invView, invProj, view = camera->GetView(), proj = camera->GetProjection();
-		XMStoreFloat4x4(&invView, XMMatrixInverse(0, XMLoadFloat4x4(&view)));
-		XMStoreFloat4x4(&invProj, XMMatrixInverse(0, XMLoadFloat4x4(&proj)));
-		ssaoPS->SetMatrix4x4("invViewMatrix", invView);
-		ssaoPS->SetMatrix4x4("invProjMatrix", invProj);
-		ssaoPS->SetMatrix4x4("viewMatrix", view);
-		ssaoPS->SetMatrix4x4("projectionMatrix", proj);
-		ssaoPS->SetData("offsets", ssaoOffsets, sizeof(XMFLOAT4) * ARRAYSIZE(ssaoOffsets));
-		ssaoPS->SetFloat("ssaoRadius", ssaoRadius);
-		ssaoPS->SetInt("ssaoSamples", ssaoSamples);
-		ssaoPS->SetFloat2("randomTextureScreenScale", XMFLOAT2(windowWidth / 4.0f, windowHeight / 4.0f));
-		ssaoPS->CopyAllBufferData();
-
-		ssaoPS->SetShaderResourceView("Normals", sceneNormalsSRV);
-		ssaoPS->SetShaderResourceView("Depths", depthSRV);
-		ssaoPS->SetShaderResourceView("Random", randomTexSRV);
-		ssaoPS->SetSamplerState("BasicSampler", samplerOptions);
-		ssaoPS->SetSamplerState("ClampSampler", clampSamplerOptions);
+		context->OMSetRenderTargets(1, hiZMipRTVs[mip].GetAddressOf(), 0);
+		SetViewport(max(hiZWidth >> mip, 1u), max(hiZHeight >> mip, 1u));
 
+		hiZPS->SetInt("fromDepth", mip == 0 ? 1 : 0);
+		hiZPS->CopyAllBufferData();
+		hiZPS->SetShaderResourceView("Source", mip == 0 ? GetSRV(depthRT) : hiZMipSRVs[mip - 1]);
 		context->Draw(3, 0);
 
+		// This mip is the next one's source
+		context->PSSetShaderResources(0, 1, &nullSRV);
+	}
 
-		renderTargets[0] = blurRTV.Get();
-		context->OMSetRenderTargets(1, renderTargets, 0);
-		blurPS->SetShader();
-		blurPS->SetShaderResourceView("SSAO", ssaoSRV);
-		blurPS->SetSamplerState("ClampSampler", clampSamplerOptions);
-		blurPS->SetFloat2("pixelSize", XMFLOAT2(1.0f / windowWidth, 1.0f / windowHeight));
-		blurPS->CopyAllBufferData();
-		context->Draw(3, 0);
+	if (hiZOcclusionCulling && hiZReadbackTexture)
+	{
+		context->CopySubresourceRegion(hiZReadbackTexture.Get(), 0, 0, 0, 0, hiZTexture.Get(), hiZReadbackMip, 0);
+		hiZReadbackViewProj = camera->GetViewProjection();
+		hiZReadbackPending = true;
+	}
+}
 
-		renderTargets[0] = backBufferRTV.Get();
-		context->OMSetRenderTargets(1, renderTargets, 0);
+// --------------------------------------------------------
+// Calculates ambient occlusion from the normals and depths
+// --------------------------------------------------------
+void Game::RenderSSAO()
+{
+	context->OMSetRenderTargets(1, GetRTV(ssaoRT).GetAddressOf(), 0);
+	SetViewport(ssaoWidth, ssaoHeight);
 
-		combinePS->SetShader();
-		combinePS->SetShaderResourceView("SceneColorsNoAmbient", sceneColorsSRV);
-		combinePS->SetShaderResourceView("Ambient", sceneAmbientSRV);
-		combinePS->SetShaderResourceView("SSAOBlur", blurSRV);
-		combinePS->SetSamplerState("BasicSampler", samplerOptions);
-		combinePS->SetFloat2("pixelSize", XMFLOAT2(1.0f / windowWidth, 1.0f / windowHeight));
-		combinePS->CopyAllBufferData();
-		context->Draw(3, 0);
+	// Both algorithms share the same inputs, and each
+	// shader ignores the other's settings
+	std::shared_ptr<SimplePixelShader> ps = ssaoAlgorithm == SSAO_ALGORITHM_GTAO ? gtaoPS : ssaoPS;
+	fullscreenVS->SetShader();
+	ps->SetShader();
 
+	// Only invert the camera matrices when the camera has changed
+	if (camera->GetGeneration() != ssaoCameraGeneration)
+	{
+		XMStoreFloat4x4(&ssaoInvView, XMMatrixInverse(0, XMLoadFloat4x4(&camera->GetView())));
+		XMStoreFloat4x4(&ssaoInvProj, XMMatrixInverse(0, XMLoadFloat4x4(&camera->GetProjection())));
+		ssaoCameraGeneration = camera->GetGeneration();
+	}
+	ps->SetMatrix4x4("invViewMatrix", ssaoInvView);
+	ps->SetMatrix4x4("invProjMatrix", ssaoInvProj);
+	ps->SetMatrix4x4("viewMatrix", camera->GetView());
+	ps->SetMatrix4x4("projectionMatrix", camera->GetProjection());
+	ps->SetData("offsets", ssaoOffsets, sizeof(XMFLOAT4) * ARRAYSIZE(ssaoOffsets));
+	ps->SetFloat("ssaoRadius", ssaoRadius);
+	ps->SetInt("ssaoSamples", ssaoSamples);
+	ps->SetInt("sliceCount", ssaoGTAOSlices);
+	ps->SetInt("stepsPerSide", ssaoGTAOSteps);
+	ps->SetInt("noiseSize", ssaoNoiseSize);
+
+	// A different rotation and subset of the kernel each frame,
+	// when they're being accumulated
+	SSAOFrameJitter jitter = GetSSAOJitter();
+	XMINT2 noiseOffset(jitter.NoiseOffsetX, jitter.NoiseOffsetY);
+	ps->SetFloat2("randomRotation", XMFLOAT2(jitter.RotationCos, jitter.RotationSin));
+	ps->SetData("noiseOffset", &noiseOffset, sizeof(XMINT2));
+	ps->SetInt("sampleStride", jitter.SampleStride);
+	ps->SetInt("sampleOffset", jitter.SampleOffset);
+
+	// Further samples from coarser mips of the Hi-Z pyramid
+	bool useHiZ = ssaoHiZ && hiZRT != FrameGraph::InvalidResource;
+	ps->SetInt("useHiZ", useHiZ ? 1 : 0);
+	ps->SetInt("hiZMaxMip", (int)hiZMipRTVs.size() - 1);
+	ps->SetFloat2("hiZSize", XMFLOAT2((float)hiZWidth, (float)hiZHeight));
+	ps->CopyAllBufferData();
+
+	ps->SetShaderResourceView("Normals", GetSRV(ssaoNormalsRT));
+	ps->SetShaderResourceView("Depths", GetSRV(ssaoDepthsRT));
+	ps->SetShaderResourceView("Random", randomTexSRV);
+	if (useHiZ)
+		ps->SetShaderResourceView("HiZ", GetSRV(hiZRT));
+	ps->SetSamplerState("BasicSampler", samplerOptions);
+	ps->SetSamplerState("ClampSampler", clampSamplerOptions);
+
+	context->Draw(3, 0);
+
+	// Later passes may render into these (aliased) textures
+	ID3D11ShaderResourceView* nullSRVs[16] = {};
+	context->PSSetShaderResources(0, 16, nullSRVs);
+}
 
+// --------------------------------------------------------
+// Blends this frame's SSAO into the history reprojected from
+// last frame, throwing it out where something new is visible
+// --------------------------------------------------------
+void Game::RenderSSAOTemporal()
+{
+	context->OMSetRenderTargets(1, GetRTV(ssaoHistoryWriteRT).GetAddressOf(), 0);
+	SetViewport(ssaoWidth, ssaoHeight);
 
-		context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+	// This frame's NDC back to world space, then into last frame's clip space
+	XMMATRIX viewProj = XMMatrixMultiply(XMLoadFloat4x4(&camera->GetView()), XMLoadFloat4x4(&camera->GetProjection()));
+	XMFLOAT4X4 currentToPrevious;
+	XMStoreFloat4x4(&currentToPrevious, XMMatrixMultiply(XMMatrixInverse(0, viewProj), XMLoadFloat4x4(&camera->GetPreviousViewProjection())));
 
-		
-	}
+	fullscreenVS->SetShader();
+	temporalPS->SetShader();
+	temporalPS->SetShaderResourceView("SSAO", GetSRV(ssaoRT));
+	temporalPS->SetShaderResourceView("Depths", GetSRV(ssaoDepthsRT));
+	temporalPS->SetShaderResourceView("History", GetSRV(ssaoHistoryReadRT));
+	temporalPS->SetMatrix4x4("currentToPrevious", currentToPrevious);
+	temporalPS->SetMatrix4x4("invProjMatrix", ssaoInvProj);
+	temporalPS->SetFloat("historyWeight", ssaoHistoryWeight);
+	temporalPS->SetFloat("disocclusionThreshold", ssaoDisocclusionThreshold);
+	temporalPS->SetInt("historyValid", ssaoHistoryValid ? 1 : 0);
+	temporalPS->CopyAllBufferData();
+	context->Draw(3, 0);
+
+	ID3D11ShaderResourceView* nullSRVs[16] = {};
+	context->PSSetShaderResources(0, 16, nullSRVs);
+}
 
-	ID3D11ShaderResourceView* nullSRVs[128] = {};
-	context->PSSetShaderResources(0, 128, nullSRVs);
-	
+// --------------------------------------------------------
+// Blurs the raw SSAO results in one direction, guided by the
+// depths and normals so occlusion stays on its own surface
+//
+// horizontal - The first (SSAO -> temp) or second (temp -> blur) pass
+// --------------------------------------------------------
+void Game::RenderSSAOBlur(bool horizontal)
+{
+	context->OMSetRenderTargets(1, GetRTV(horizontal ? blurTempRT : blurRT).GetAddressOf(), 0);
+	SetViewport(ssaoWidth, ssaoHeight);
 
+	fullscreenVS->SetShader();
+	blurPS->SetShader();
+	blurPS->SetShaderResourceView("SSAO", GetSRV(horizontal ? (ssaoTemporal ? ssaoHistoryWriteRT : ssaoRT) : blurTempRT));
+	blurPS->SetShaderResourceView("Normals", GetSRV(ssaoNormalsRT));
+	blurPS->SetShaderResourceView("Depths", GetSRV(ssaoDepthsRT));
+	blurPS->SetMatrix4x4("invProjMatrix", ssaoInvProj);
+	XMINT2 direction(horizontal ? 1 : 0, horizontal ? 0 : 1);
+	blurPS->SetData("direction", &direction, sizeof(XMINT2));
+	blurPS->SetInt("blurRadius", ssaoBlurRadius);
+	blurPS->SetFloat("depthSharpness", ssaoBlurDepthSharpness);
+	blurPS->SetFloat("normalPower", ssaoBlurNormalPower);
+	blurPS->CopyAllBufferData();
+	context->Draw(3, 0);
+
+	ID3D11ShaderResourceView* nullSRVs[16] = {};
+	context->PSSetShaderResources(0, 16, nullSRVs);
+
+	// Back to full size for the rest of the frame
+	if (!horizontal)
+		SetViewport(windowWidth, windowHeight);
+}
 
-	// Frame END
-	// - These should happen exactly ONCE PER FRAME
-	// - At the very end of the frame (after drawing *everything*)
-	{
-		// Draw the UI after everything else
-		ImGui::Render();
-		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+// --------------------------------------------------------
+// Shrinks the normals and depths for lower resolution SSAO
+// --------------------------------------------------------
+void Game::RenderSSAODownsample()
+{
+	ID3D11RenderTargetView* renderTargets[2] = {};
+	renderTargets[0] = GetRTV(ssaoNormalsRT).Get();
+	renderTargets[1] = GetRTV(ssaoDepthsRT).Get();
+	context->OMSetRenderTargets(2, renderTargets, 0);
+	SetViewport(ssaoWidth, ssaoHeight);
 
-		// Present the back buffer to the user
-		//  - Puts the results of what we've drawn onto the window
-		//  - Without this, the user never sees anything
-		bool vsyncNecessary = vsync || !deviceSupportsTearing || isFullscreen;
-		swapChain->Present(
-			vsyncNecessary ? 1 : 0,
-			vsyncNecessary ? 0 : DXGI_PRESENT_ALLOW_TEARING);
+	fullscreenVS->SetShader();
+	downsamplePS->SetShader();
+	downsamplePS->SetShaderResourceView("Normals", GetSRV(sceneNormalsRT));
+	downsamplePS->SetShaderResourceView("Depths", GetSRV(depthRT));
+	downsamplePS->SetInt("downsampleFactor", ssaoResolutionScale);
+	XMINT2 fullSize((int)windowWidth, (int)windowHeight);
+	downsamplePS->SetData("fullSize", &fullSize, sizeof(XMINT2));
+	downsamplePS->CopyAllBufferData();
+	context->Draw(3, 0);
+
+	// Unbind both so they can be sampled
+	renderTargets[0] = renderTargets[1] = 0;
+	context->OMSetRenderTargets(2, renderTargets, 0);
+	ID3D11ShaderResourceView* nullSRVs[16] = {};
+	context->PSSetShaderResources(0, 16, nullSRVs);
+}
 
-		// Must re-bind buffers after presenting, as they become unbound
-		context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
+// --------------------------------------------------------
+// Brings lower resolution SSAO back up to full size, with
+// a bilateral filter guided by the full resolution depths
+// --------------------------------------------------------
+void Game::RenderSSAOUpsample()
+{
+	context->OMSetRenderTargets(1, GetRTV(ssaoUpsampledRT).GetAddressOf(), 0);
+	SetViewport(windowWidth, windowHeight);
 
-		
+	fullscreenVS->SetShader();
+	upsamplePS->SetShader();
+	upsamplePS->SetShaderResourceView("SSAOBlur", GetSRV(blurRT));
+	upsamplePS->SetShaderResourceView("LowDepths", GetSRV(ssaoDepthsRT));
+	upsamplePS->SetShaderResourceView("Depths", GetSRV(depthRT));
+	upsamplePS->SetMatrix4x4("invProjMatrix", ssaoInvProj);
+	upsamplePS->SetFloat2("lowSize", XMFLOAT2((float)ssaoWidth, (float)ssaoHeight));
+	upsamplePS->SetFloat("upsampleSharpness", ssaoUpsampleSharpness);
+	upsamplePS->CopyAllBufferData();
+	context->Draw(3, 0);
+
+	ID3D11ShaderResourceView* nullSRVs[16] = {};
+	context->PSSetShaderResources(0, 16, nullSRVs);
+}
 
-	}
+// --------------------------------------------------------
+// Combines the scene colors, ambient and blurred SSAO
+// into the back buffer
+// --------------------------------------------------------
+void Game::RenderSSAOCombine()
+{
+	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+
+	fullscreenVS->SetShader();
+	combinePS->SetShader();
+	combinePS->SetShaderResourceView("SceneColorsNoAmbient", GetSRV(sceneColorsRT));
+	combinePS->SetShaderResourceView("Ambient", GetSRV(sceneAmbientRT));
+	combinePS->SetShaderResourceView("SSAOBlur", GetSRV(ssaoResultRT));
+	combinePS->SetSamplerState("BasicSampler", samplerOptions);
+	combinePS->SetFloat2("pixelSize", XMFLOAT2(1.0f / windowWidth, 1.0f / windowHeight));
+	combinePS->CopyAllBufferData();
+	context->Draw(3, 0);
 }
 
 
@@ -1105,6 +1949,18 @@ void Game::BuildUI()
 			ImGui::Spacing();
 			ImGui::SliderInt("Light Count", &lightCount, 0, MAX_LIGHTS);
 			ImGui::Checkbox("Show Point Lights", &showPointLights);
+			ImGui::Text("Clusters Built In: %.3f ms", lightClusterTime);
+			ImGui::Text("Light Indices: %d (at most %d in a cluster)", (int)lightClusters.GetLightIndices().size(), lightClusters.GetMaxClusterLights());
+			if (lightClusters.GetOverflowCount() > 0)
+				ImGui::Text("Over %d Lights: %d dropped", MAX_LIGHTS_PER_CLUSTER, lightClusters.GetOverflowCount());
+			ImGui::SliderInt("Light Tree Samples", &lightTreeSamples, 0, 16);
+			if (lightTreeSamples > 0)
+			{
+				ImGui::Text("Tree: %d nodes for %d lights", (int)lightTree.GetNodes().size(), lightTree.GetLightCount());
+				ImGui::Text("Built In: %.3f ms, Refit In: %.3f ms", lightTreeBuildTime, lightTreeRefitTime);
+			}
+			else
+				ImGui::Text("(0 loops over each pixel's cluster)");
 			ImGui::Spacing();
 
 			// Loop and show the details for each entity
@@ -1137,28 +1993,143 @@ void Game::BuildUI()
 			ImGui::TreePop();
 		}
 
+		// === Frame Graph ===
+		if (ImGui::TreeNode("Frame Graph"))
+		{
+			ImGui::Text("Passes: %u (%u culled)", frameGraph.GetPassCount(), frameGraph.GetCulledPassCount());
+			ImGui::Text("Resources: %u", (unsigned int)frameGraph.GetResourceCount());
+			ImGui::Text("Physical Targets: %u", frameGraph.GetPhysicalTextureCount());
+			ImGui::Text("Memory (no aliasing): %.2f MB", frameGraph.GetUnaliasedMemory() / (1024.0f * 1024.0f));
+			ImGui::Text("Memory (aliased): %.2f MB", frameGraph.GetAliasedMemory() / (1024.0f * 1024.0f));
+			ImGui::Text("G-Buffer: %u bytes/pixel (was %u)", gBufferBytesPerPixel, GBUFFER_BYTES_PER_PIXEL_BEFORE);
+
+			RenderTargetPool& pool = frameGraphDevice->GetPool();
+			ImGui::Text("Pool Targets: %u (%u free)", pool.GetTargetCount(), pool.GetFreeTargetCount());
+			ImGui::Text("Pool Memory: %.2f MB (%.2f MB free)", pool.GetMemory() / (1024.0f * 1024.0f), pool.GetFreeMemory() / (1024.0f * 1024.0f));
+			ImGui::Text("Pool Hit Rate: %.0f%% (%u of %u)", pool.GetHitRate() * 100.0f, pool.GetHitCount(), pool.GetAcquireCount());
+			ImGui::Text("Pool Evictions: %u", pool.GetEvictionCount());
+
+			// Recompile when aliasing is toggled - this happens before
+			// the render targets are shown below, so no stale views are drawn
+			if (ImGui::Checkbox("Alias Transient Targets", &frameGraphAliasing))
+				BuildFrameGraph();
+
+			ImGui::TreePop();
+		}
+
 		// === RenderTargets ===
 		if (ImGui::TreeNode("Render Targets"))
 		{
 			ImVec2 size = ImGui::GetItemRectSize();
 			float rtHeight = size.x * ((float)windowHeight / windowWidth);
 
-			ImGui::Image(sceneColorsSRV.Get(), ImVec2(size.x * 2, rtHeight * 2));
-			ImGui::Image(sceneNormalsSRV.Get(), ImVec2(size.x * 2, rtHeight * 2));
-			ImGui::Image(sceneAmbientSRV.Get(), ImVec2(size.x * 2, rtHeight * 2));
-			ImGui::Image(depthSRV.Get(), ImVec2(size.x * 2, rtHeight * 2));
-			ImGui::Image(ssaoSRV.Get(), ImVec2(size.x * 2, rtHeight * 2));
-			ImGui::Image(blurSRV.Get(), ImVec2(size.x * 2, rtHeight * 2));
+			// Note: Aliased targets show whichever resource wrote to them last
+			ImGui::Image(GetSRV(sceneColorsRT).Get(), ImVec2(size.x * 2, rtHeight * 2));
+			ImGui::Image(GetSRV(sceneNormalsRT).Get(), ImVec2(size.x * 2, rtHeight * 2));
+			ImGui::Image(GetSRV(sceneAmbientRT).Get(), ImVec2(size.x * 2, rtHeight * 2));
+			ImGui::Image(GetSRV(depthRT).Get(), ImVec2(size.x * 2, rtHeight * 2));
+			ImGui::Image(GetSRV(ssaoRT).Get(), ImVec2(size.x * 2, rtHeight * 2));
+			ImGui::Image(GetSRV(blurRT).Get(), ImVec2(size.x * 2, rtHeight * 2));
+			if (ssaoResolutionScale > 1)
+				ImGui::Image(GetSRV(ssaoUpsampledRT).Get(), ImVec2(size.x * 2, rtHeight * 2));
+
+			ImGui::TreePop();
+		}
+
+		// === Occlusion Culling ===
+		if (ImGui::TreeNode("Occlusion Culling"))
+		{
+			// Entity bounds against last frame's Hi-Z pyramid, which is
+			// started over when culling is turned back on
+			if (ImGui::Checkbox("Hi-Z Occlusion Culling", &hiZOcclusionCulling))
+			{
+				hiZCulling = HiZPyramid();
+				hiZReadbackPending = false;
+				frameGraphResizePending = true;
+			}
+			ImGui::Text("Occluded Entities: %d of %d", occludedEntityCount, (int)entities.size());
+			if (hiZCulling.GetMipCount() > 0)
+				ImGui::Text("Read Back: %dx%d (mip %d)", hiZCulling.GetWidth(), hiZCulling.GetHeight(), hiZReadbackMip);
 
 			ImGui::TreePop();
 		}
 
 		if (ImGui::TreeNode("SSAO Settings"))
 		{
-			ImGui::SliderInt("SSAO Samples", &ssaoSamples, 1, 64);
+			// GTAO takes slices * steps * 2 depth samples, for comparing
+			// against the hemisphere kernel at the same sample count
+			ImGui::Combo("Algorithm", &ssaoAlgorithm, "Hemisphere\0GTAO\0");
+			if (ssaoAlgorithm == SSAO_ALGORITHM_GTAO)
+			{
+				ImGui::SliderInt("GTAO Slices", &ssaoGTAOSlices, 1, 8);
+				ImGui::SliderInt("GTAO Steps", &ssaoGTAOSteps, 1, 16);
+				ImGui::Text("Depth Samples: %d", ssaoGTAOSlices * ssaoGTAOSteps * 2);
+			}
+			else
+			{
+				ImGui::SliderInt("SSAO Samples", &ssaoSamples, 1, 64);
+
+				// Further samples read coarser mips of the pyramid
+				if (ImGui::Checkbox("Hi-Z Depth Pyramid", &ssaoHiZ))
+					frameGraphResizePending = true;
+			}
 			ImGui::SliderFloat("Radius", &ssaoRadius, 0.0f, 5.0f);
 
+			// Both are rebuilt right away (the texture isn't in the UI)
+			bool kernelChanged = ImGui::Combo("Kernel", &ssaoKernel, "Random\0Halton\0");
+			bool noiseChanged = ImGui::Combo("Random Vectors", &ssaoNoise, "4x4 White Noise\0" "64x64 Blue Noise\0");
+			if (kernelChanged || noiseChanged)
+				CreateSSAOSamples();
+			if (ssaoNoise == SSAO_NOISE_BLUE)
+				ImGui::Text("Blue Noise Baked In: %.1f ms", ssaoNoiseBakeTime);
+
+			// Targets are rebuilt next frame, like on a resize, as
+			// views of the current ones are already in this frame's UI
+			int resolutionIndex = ssaoResolutionScale == 4 ? 2 : ssaoResolutionScale - 1;
+			if (ImGui::Combo("Resolution", &resolutionIndex, "Full\0Half\0Quarter\0"))
+			{
+				ssaoResolutionScale = 1 << resolutionIndex;
+				frameGraphResizePending = true;
+			}
+			if (ssaoResolutionScale > 1)
+				ImGui::SliderFloat("Upsample Sharpness", &ssaoUpsampleSharpness, 0.0f, 100.0f);
+
+			// Two passes of 2 * radius + 1 taps each
+			ImGui::SliderInt("Blur Radius", &ssaoBlurRadius, 0, 8);
+			ImGui::SliderFloat("Blur Depth Sharpness", &ssaoBlurDepthSharpness, 0.0f, 100.0f);
+			ImGui::SliderFloat("Blur Normal Power", &ssaoBlurNormalPower, 0.1f, 32.0f);
 
+			// Fewer samples each frame, accumulated over several frames
+			if (ImGui::Checkbox("Temporal Accumulation", &ssaoTemporal))
+			{
+				if (ssaoTemporal && ssaoSamples > 16)
+					ssaoSamples = 16;
+				ssaoHistoryValid = false;
+				frameGraphResizePending = true;
+			}
+			if (ssaoTemporal)
+			{
+				ImGui::SliderFloat("History Weight", &ssaoHistoryWeight, 0.0f, 0.98f);
+				ImGui::SliderFloat("Disocclusion Threshold", &ssaoDisocclusionThreshold, 0.0f, 0.5f);
+			}
+
+			// Checks the GPU's results against the CPU reference
+			if (ImGui::Button("Capture SSAO Reference"))
+				ssaoCapturePending = true;
+			if (ssaoCaptureValid)
+			{
+				ImGui::Text("CPU Reference: %.2f ms on %u threads", ssaoReferenceTime, jobs.GetThreadCount());
+				ImGui::Text("SSAO Error: %.4f max, %.5f mean, %d pixels", ssaoReferenceError.MaxError, ssaoReferenceError.MeanError, ssaoReferenceError.PixelsOverThreshold);
+				ImGui::Text("Blur Error: %.4f max, %.5f mean, %d pixels", ssaoBlurReferenceError.MaxError, ssaoBlurReferenceError.MeanError, ssaoBlurReferenceError.PixelsOverThreshold);
+				if (ssaoReferenceTemporal)
+					ImGui::Text("Temporal Error: %.4f max, %.5f mean, %d pixels", ssaoTemporalReferenceError.MaxError, ssaoTemporalReferenceError.MeanError, ssaoTemporalReferenceError.PixelsOverThreshold);
+				if (ssaoReferenceScale > 1)
+				{
+					ImGui::Text("Upsample Error: %.4f max, %.5f mean, %d pixels", ssaoUpsampleReferenceError.MaxError, ssaoUpsampleReferenceError.MeanError, ssaoUpsampleReferenceError.PixelsOverThreshold);
+					ImGui::Text("Vs. Full Resolution: %.4f max, %.5f mean, %d pixels", ssaoFullResolutionError.MaxError, ssaoFullResolutionError.MeanError, ssaoFullResolutionError.PixelsOverThreshold);
+					ImGui::Text("Full Resolution CPU: %.2f ms", ssaoFullResolutionTime);
+				}
+			}
 
 			ImGui::TreePop();
 		}
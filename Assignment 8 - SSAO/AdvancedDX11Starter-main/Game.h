@@ -7,6 +7,16 @@
 #include "SimpleShader.h"
 #include "Lights.h"
 #include "Sky.h"
+#include "Random.h"
+#include "FrameGraph.h"
+#include "SSAOFrameGraph.h"
+#include "D3D11FrameGraphDevice.h"
+#include "JobSystem.h"
+#include "SSAOReference.h"
+#include "HiZPyramid.h"
+#include "SSAOSampling.h"
+#include "LightClusters.h"
+#include "LightBVH.h"
 
 #include <DirectXMath.h>
 #include <wrl/client.h>
@@ -27,17 +37,73 @@ public:
 	void Update(float deltaTime, float totalTime);
 	void Draw(float deltaTime, float totalTime);
 
+	// Runs the CPU SSAO reference on a capture folder
+	// and reports the results, without a window or GPU
+	HRESULT RunSSAOReference(const char* folder);
+
+	// Runs the SSAO reference's checks on a generated scene,
+	// for when there's no capture to hand
+	HRESULT RunSSAOTests();
+
+	// Times and checks the light cluster assignment, also
+	// without a window or GPU
+	HRESULT RunLightClusterBenchmark();
+
+	// Checks the light BVH and compares its variance and cost
+	// with uniform light picking, without a window or GPU
+	HRESULT RunLightBVHBenchmark();
+
+	// Checks the shader reflection cache's file format
+	HRESULT RunReflectionCacheTest();
+
+	// Checks the SSAO frame graph's culling, aliasing and memory
+	// against a null device
+	HRESULT RunFrameGraphTest();
+
+	// Checks the render target pool against a mock allocator
+	HRESULT RunRenderTargetPoolTest();
+
 private:
 
 	// Our scene
 	std::vector<std::shared_ptr<GameEntity>> entities;
 	std::shared_ptr<Camera> camera;
 
+	// General purpose random numbers (lights, SSAO samples)
+	PCG32 random;
+
 	// Lights
 	std::vector<Light> lights;
 	int lightCount;
 	bool showPointLights;
 
+	// Clustered light culling - every light goes to the shaders
+	// in a structured buffer, along with each cluster's range in
+	// one list of light indices (which grows as needed)
+	LightClusters lightClusters;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> lightBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lightBufferSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> clusterRangeBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> clusterRangeSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> clusterIndexBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> clusterIndexSRV;
+	unsigned int clusterIndexCapacity;
+	double lightClusterTime;
+
+	// Stochastic light picking - with any samples per pixel, the
+	// PBR shader picks that many point and spot lights from a BVH
+	// instead of looping over its cluster.  The tree is rebuilt
+	// when the light count changes and refit otherwise.
+	LightBVH lightTree;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> lightTreeBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lightTreeSRV;
+	unsigned int lightTreeCapacity;
+	int lightTreeSamples;
+	int lightTreeBuiltCount;
+	unsigned int lightTreeFrame;
+	double lightTreeBuildTime;
+	double lightTreeRefitTime;
+
 	// These will be loaded along with other assets and
 	// saved to these variables for ease of access
 	std::shared_ptr<Mesh> lightMesh;
@@ -48,24 +114,72 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> clampSamplerOptions;
 
-	
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneNormalsRTV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneNormalsSRV;
+	// Frame graph that owns the G-buffer and SSAO render targets
+	std::shared_ptr<D3D11FrameGraphDevice> frameGraphDevice;
+	FrameGraph frameGraph;
+	bool frameGraphAliasing;
 
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneColorsRTV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneColorsSRV;
+	// DXCore only resizes once the window has settled, and the
+	// graph is then rebuilt at the start of the next Update()
+	bool frameGraphResizePending;
 
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneAmbientRTV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneAmbientSRV;
+	FrameGraph::ResourceHandle sceneColorsRT;
+	FrameGraph::ResourceHandle sceneNormalsRT;
+	FrameGraph::ResourceHandle sceneAmbientRT;
+	FrameGraph::ResourceHandle depthRT; // The real depth buffer, imported
 
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> ssaoRTV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoSRV;
+	// Bytes per pixel across the G-buffer targets and depth buffer
+	unsigned int gBufferBytesPerPixel;
+	FrameGraph::ResourceHandle ssaoRT;
+	FrameGraph::ResourceHandle blurTempRT;
+	FrameGraph::ResourceHandle blurRT;
 
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> blurRTV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> blurSRV;
+	// SSAO can run at a lower resolution, on downsampled copies
+	// of the normals and depths, and be upsampled after the blur.
+	// At full resolution these refer to the G-buffer and blur.
+	FrameGraph::ResourceHandle ssaoNormalsRT;
+	FrameGraph::ResourceHandle ssaoDepthsRT;
+	FrameGraph::ResourceHandle ssaoUpsampledRT;
+	FrameGraph::ResourceHandle ssaoResultRT;
+	FrameGraph::ResourceHandle backBufferRT;
 
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> depthRTV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthSRV;
+	// Temporal SSAO history (AO, view space depth, frames accumulated).
+	// These have to last from one frame to the next, so they're made
+	// here and imported into the graph: last frame's is read while
+	// this frame's is written, and they swap at the end of the frame.
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> ssaoHistoryTextures[2];
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> ssaoHistoryRTVs[2];
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoHistorySRVs[2];
+	FrameGraph::ResourceHandle ssaoHistoryReadRT;
+	FrameGraph::ResourceHandle ssaoHistoryWriteRT;
+	int ssaoHistoryIndex;
+	bool ssaoHistoryValid;
+	unsigned int ssaoHistoryWidth;
+	unsigned int ssaoHistoryHeight;
+	unsigned int ssaoFrame;
+
+	// Min/max Hi-Z pyramid of the depths (see HiZPyramid), shared by
+	// SSAO and occlusion culling.  The graph's targets only have one
+	// mip, so this is made here and imported, like the history.
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> hiZTexture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> hiZSRV;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11RenderTargetView>> hiZMipRTVs;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> hiZMipSRVs;
+	FrameGraph::ResourceHandle hiZRT;
+	unsigned int hiZWidth;
+	unsigned int hiZHeight;
+
+	// Occlusion culling tests entity bounds against a CPU copy of
+	// one of the smaller mips, read back a frame late so the GPU
+	// is never waited on
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> hiZReadbackTexture;
+	int hiZReadbackMip;
+	bool hiZReadbackPending;
+	DirectX::XMFLOAT4X4 hiZReadbackViewProj;
+	HiZPyramid hiZCulling;
+	DirectX::XMFLOAT4X4 hiZCullingViewProj;
+	std::vector<bool> entityOccluded;
+	int occludedEntityCount;
 
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> randomTexSRV;
 	
@@ -75,10 +189,40 @@ private:
 	std::shared_ptr<SimplePixelShader> simpleTexturePS;
 
 	std::shared_ptr<SimplePixelShader> ssaoPS;
+	std::shared_ptr<SimplePixelShader> gtaoPS;
 	std::shared_ptr<SimplePixelShader> blurPS;
 	std::shared_ptr<SimplePixelShader> combinePS;
+	std::shared_ptr<SimplePixelShader> downsamplePS;
+	std::shared_ptr<SimplePixelShader> upsamplePS;
+	std::shared_ptr<SimplePixelShader> temporalPS;
+	std::shared_ptr<SimplePixelShader> hiZPS;
 
 	DirectX::XMFLOAT4 ssaoOffsets[64];
+	std::vector<DirectX::XMFLOAT4> ssaoRandomVectors; // ssaoNoiseSize * ssaoNoiseSize
+	int ssaoNoiseSize;
+	double ssaoNoiseBakeTime;
+
+	// Inverse camera matrices for SSAO, recalculated only
+	// when the camera's generation number changes
+	unsigned int ssaoCameraGeneration;
+	DirectX::XMFLOAT4X4 ssaoInvView;
+	DirectX::XMFLOAT4X4 ssaoInvProj;
+
+	// CPU reference for the SSAO passes - a capture is taken at
+	// the start of the next update, before the UI is built
+	JobSystem jobs;
+	SSAOReference ssaoReference;
+	bool ssaoCapturePending;
+	bool ssaoCaptureValid;
+	double ssaoReferenceTime;
+	SSAOReference::Difference ssaoReferenceError;
+	SSAOReference::Difference ssaoBlurReferenceError;
+	int ssaoReferenceScale;
+	SSAOReference::Difference ssaoUpsampleReferenceError;
+	SSAOReference::Difference ssaoFullResolutionError;
+	double ssaoFullResolutionTime;
+	bool ssaoReferenceTemporal;
+	SSAOReference::Difference ssaoTemporalReferenceError;
 
 	// Skybox
 	std::shared_ptr<Sky> sky;
@@ -88,6 +232,41 @@ private:
 	void GenerateLights();
 	void DrawPointLights();
 
+	// Light cluster helpers
+	void CreateStructuredBuffer(unsigned int elementSize, unsigned int count, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+	void UpdateLightClusters();
+	void UpdateLightTree();
+
+	// Frame graph setup and passes
+	void BuildFrameGraph();
+	void RenderGBuffer();
+	void RenderHiZ();
+	void RenderSSAODownsample();
+	void RenderSSAO();
+	void RenderSSAOBlur(bool horizontal);
+	void RenderSSAOTemporal();
+	void RenderSSAOUpsample();
+	void RenderSSAOCombine();
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> GetRTV(FrameGraph::ResourceHandle resource);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV(FrameGraph::ResourceHandle resource);
+	void SetViewport(unsigned int width, unsigned int height);
+
+	// (Re)builds the SSAO kernel and random vector texture
+	void CreateSSAOSamples();
+
+	// Temporal SSAO helpers
+	void CreateSSAOHistory();
+	SSAOFrameJitter GetSSAOJitter();
+	void EndSSAOFrame();
+
+	// Hi-Z pyramid helpers
+	void CreateHiZ();
+	void UpdateOcclusionCulling();
+
+	// SSAO reference capture
+	void CaptureSSAOReference();
+	bool ReadRenderTarget(FrameGraph::ResourceHandle resource, int channels, FloatImage& image);
+
 	// UI functions
 	void UINewFrame(float deltaTime);
 	void BuildUI();
@@ -100,5 +279,37 @@ private:
 
 	int ssaoSamples;
 	float ssaoRadius;
+
+	// SSAO_KERNEL_RANDOM or SSAO_KERNEL_HALTON, and
+	// SSAO_NOISE_WHITE or SSAO_NOISE_BLUE (see SSAOSampling.h)
+	int ssaoKernel;
+	int ssaoNoise;
+
+	// SSAO_ALGORITHM_HEMISPHERE or SSAO_ALGORITHM_GTAO, and
+	// GTAO's slices and steps each way along them
+	int ssaoAlgorithm;
+	int ssaoGTAOSlices;
+	int ssaoGTAOSteps;
+
+	// Should the hemisphere kernel read further samples from
+	// the Hi-Z pyramid?  And should entities be culled with it?
+	bool ssaoHiZ;
+	bool hiZOcclusionCulling;
+
+	// 1, 2 or 4 - SSAO runs at 1/scale of the window size
+	int ssaoResolutionScale;
+	unsigned int ssaoWidth;
+	unsigned int ssaoHeight;
+	float ssaoUpsampleSharpness;
+
+	// Bilateral blur settings
+	int ssaoBlurRadius;
+	float ssaoBlurDepthSharpness;
+	float ssaoBlurNormalPower;
+
+	// Temporal accumulation settings
+	bool ssaoTemporal;
+	float ssaoHistoryWeight;
+	float ssaoDisocclusionThreshold;
 };
 
@@ -1,5 +1,7 @@
 #include "GameEntity.h"
 
+#include <float.h>
+
 using namespace DirectX;
 
 GameEntity::GameEntity(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material) :
@@ -15,6 +17,35 @@ Transform* GameEntity::GetTransform() { return &transform; }
 void GameEntity::SetMesh(std::shared_ptr<Mesh> mesh) { this->mesh = mesh; }
 void GameEntity::SetMaterial(std::shared_ptr<Material> material) { this->material = material; }
 
+// --------------------------------------------------------
+// Transforms each corner of the mesh's bounds and takes the
+// box around them
+// --------------------------------------------------------
+void GameEntity::GetWorldBounds(XMFLOAT3& boundsMin, XMFLOAT3& boundsMax)
+{
+	XMFLOAT4X4 worldMatrix = transform.GetWorldMatrix();
+	XMMATRIX world = XMLoadFloat4x4(&worldMatrix);
+	const XMFLOAT3& meshMin = mesh->GetBoundsMin();
+	const XMFLOAT3& meshMax = mesh->GetBoundsMax();
+
+	XMVECTOR worldMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR worldMax = XMVectorReplicate(-FLT_MAX);
+	for (int corner = 0; corner < 8; corner++)
+	{
+		XMVECTOR point = XMVectorSet(
+			corner & 1 ? meshMax.x : meshMin.x,
+			corner & 2 ? meshMax.y : meshMin.y,
+			corner & 4 ? meshMax.z : meshMin.z,
+			1.0f);
+		point = XMVector3TransformCoord(point, world);
+		worldMin = XMVectorMin(worldMin, point);
+		worldMax = XMVectorMax(worldMax, point);
+	}
+
+	XMStoreFloat3(&boundsMin, worldMin);
+	XMStoreFloat3(&boundsMax, worldMax);
+}
+
 
 void GameEntity::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera)
 {
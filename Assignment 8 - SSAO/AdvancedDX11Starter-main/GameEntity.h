@@ -20,6 +20,9 @@ public:
 	void SetMesh(std::shared_ptr<Mesh> mesh);
 	void SetMaterial(std::shared_ptr<Material> material);
 
+	// World space box around the mesh's bounds
+	void GetWorldBounds(DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax);
+
 	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera);
 
 private:
@@ -0,0 +1,48 @@
+cbuffer externalData : register(b0)
+{
+    int fromDepth; // Is the source the depth buffer (for mip 0)?
+}
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD;
+};
+
+Texture2D Source : register(t0); // The depths, or just the mip above
+
+
+// Builds one mip of the min/max Hi-Z pyramid: the nearest (R) and
+// farthest (G) depth of the texels this one covers in the mip above.
+// HiZPyramid is the CPU version, for testing and occlusion culling.
+float4 main(VertexToPixel input) : SV_TARGET
+{
+    int2 pixel = int2(input.position.xy);
+    if (fromDepth)
+    {
+        float depth = Source.Load(int3(pixel, 0)).r;
+        return float4(depth, depth, 0, 0);
+    }
+
+    // Each texel covers 2x2 of the mip above, and when that has an odd
+    // size the last row and column take in the leftover one as well
+    uint2 dimensions;
+    Source.GetDimensions(dimensions.x, dimensions.y);
+    int2 sourceSize = int2(dimensions);
+    int2 size = max(sourceSize / 2, 1);
+    int2 first = pixel * 2;
+    int2 last = pixel == size - 1 ? sourceSize - 1 : first + 1;
+
+    float nearest = 1.0f;
+    float farthest = 0.0f;
+    for (int y = first.y; y <= last.y; y++)
+    {
+        for (int x = first.x; x <= last.x; x++)
+        {
+            float2 nearFar = Source.Load(int3(x, y, 0)).rg;
+            nearest = min(nearest, nearFar.x);
+            farthest = max(farthest, nearFar.y);
+        }
+    }
+    return float4(nearest, farthest, 0, 0);
+}
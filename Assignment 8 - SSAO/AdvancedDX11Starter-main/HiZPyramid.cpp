@@ -0,0 +1,288 @@
+#include "HiZPyramid.h"
+
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+
+using namespace DirectX;
+
+namespace
+{
+	// Runs job(0) through job(count - 1), across the job
+	// system's threads if there is one
+	void ForEach(int count, JobSystem* jobs, const std::function<void(int)>& job)
+	{
+		if (jobs)
+		{
+			jobs->ParallelFor(count, job);
+			return;
+		}
+
+		for (int i = 0; i < count; i++)
+			job(i);
+	}
+
+	// The mip 0 pixel a UV falls in, kept on screen
+	int PixelFromUV(float uv, int size)
+	{
+		float pixel = fminf(fmaxf(floorf(uv * size), 0.0f), (float)(size - 1));
+		return (int)pixel;
+	}
+}
+
+int HiZPyramid::MipCount(int width, int height)
+{
+	int count = 1;
+	while (width > 1 || height > 1)
+	{
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		count++;
+	}
+	return count;
+}
+
+// --------------------------------------------------------
+// Mip 0 is a copy of the depths, and each mip after that is
+// reduced from the one before it, a row per job
+// --------------------------------------------------------
+void HiZPyramid::Build(const FloatImage& depths, JobSystem* jobs)
+{
+	int count = MipCount(depths.Width, depths.Height);
+	mips.resize(count);
+
+	FloatImage& top = mips[0];
+	top.Resize(depths.Width, depths.Height, 2);
+	bool minMax = depths.Channels >= 2;
+	ForEach(depths.Height, jobs, [&](int y)
+		{
+			const float* source = depths.Row(y);
+			float* dest = top.Row(y);
+			for (int x = 0; x < depths.Width; x++)
+			{
+				const float* texel = source + x * depths.Channels;
+				dest[x * 2 + 0] = texel[0];
+				dest[x * 2 + 1] = minMax ? texel[1] : texel[0];
+			}
+		});
+
+	for (int mip = 1; mip < count; mip++)
+	{
+		const FloatImage& source = mips[mip - 1];
+		FloatImage& dest = mips[mip];
+		dest.Resize(source.Width > 1 ? source.Width / 2 : 1, source.Height > 1 ? source.Height / 2 : 1, 2);
+
+		ForEach(dest.Height, jobs, [&](int y)
+			{
+				// The last row and column take in any leftovers
+				int firstY = y * 2;
+				int lastY = y == dest.Height - 1 ? source.Height - 1 : firstY + 1;
+				float* out = dest.Row(y);
+				for (int x = 0; x < dest.Width; x++)
+				{
+					int firstX = x * 2;
+					int lastX = x == dest.Width - 1 ? source.Width - 1 : firstX + 1;
+
+					float nearest = FLT_MAX;
+					float farthest = -FLT_MAX;
+					for (int sy = firstY; sy <= lastY; sy++)
+					{
+						const float* row = source.Row(sy);
+						for (int sx = firstX; sx <= lastX; sx++)
+						{
+							nearest = fminf(nearest, row[sx * 2 + 0]);
+							farthest = fmaxf(farthest, row[sx * 2 + 1]);
+						}
+					}
+					out[x * 2 + 0] = nearest;
+					out[x * 2 + 1] = farthest;
+				}
+			});
+	}
+}
+
+// --------------------------------------------------------
+// Same as SSAOPS: the highest set bit of the distance, less
+// the offset, so the texels read grow with the distance
+// --------------------------------------------------------
+int HiZPyramid::GetSSAOMip(float distancePixels) const
+{
+	unsigned int distance = (unsigned int)fminf(fmaxf(distancePixels, 1.0f), 65535.0f);
+	int highestBit = 0;
+	while (distance >>= 1)
+		highestBit++;
+
+	int mip = highestBit - HIZ_SSAO_MIP_OFFSET;
+	int lastMip = GetMipCount() - 1;
+	return mip < 0 ? 0 : (mip > lastMip ? lastMip : mip);
+}
+
+// --------------------------------------------------------
+// Mip m's texel t covers mip 0 pixels t * 2^m up to (t + 1) * 2^m,
+// aside from the last one, which covers the rest.  So the first
+// mip where the rectangle's end pixels land in the same or
+// neighboring texels covers it with at most 2x2 reads.
+// --------------------------------------------------------
+float HiZPyramid::GetFarthestDepth(float minU, float minV, float maxU, float maxV) const
+{
+	if (mips.empty())
+		return 1.0f;
+
+	int x0 = PixelFromUV(minU, GetWidth());
+	int y0 = PixelFromUV(minV, GetHeight());
+	int x1 = PixelFromUV(maxU, GetWidth());
+	int y1 = PixelFromUV(maxV, GetHeight());
+
+	int mip = 0;
+	while (mip < GetMipCount() - 1 && ((x1 >> mip) - (x0 >> mip) > 1 || (y1 >> mip) - (y0 >> mip) > 1))
+		mip++;
+
+	const FloatImage& image = mips[mip];
+	int tx0 = (x0 >> mip) < image.Width ? x0 >> mip : image.Width - 1;
+	int ty0 = (y0 >> mip) < image.Height ? y0 >> mip : image.Height - 1;
+	int tx1 = (x1 >> mip) < image.Width ? x1 >> mip : image.Width - 1;
+	int ty1 = (y1 >> mip) < image.Height ? y1 >> mip : image.Height - 1;
+
+	float farthest = -FLT_MAX;
+	for (int y = ty0; y <= ty1; y++)
+		for (int x = tx0; x <= tx1; x++)
+			farthest = fmaxf(farthest, image.Row(y)[x * 2 + 1]);
+	return farthest;
+}
+
+bool HiZPyramid::IsOccluded(float minU, float minV, float maxU, float maxV, float nearestDepth) const
+{
+	// Off screen is for frustum culling to deal with
+	if (mips.empty() || maxU < 0.0f || maxV < 0.0f || minU > 1.0f || minV > 1.0f)
+		return false;
+
+	return nearestDepth > GetFarthestDepth(minU, minV, maxU, maxV);
+}
+
+// --------------------------------------------------------
+// The matrix is used as rows, like the rest of the C++ code
+// --------------------------------------------------------
+bool HiZPyramid::IsBoxOccluded(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, const XMFLOAT4X4& viewProj, float marginTexels) const
+{
+	float minU = FLT_MAX, minV = FLT_MAX, maxU = -FLT_MAX, maxV = -FLT_MAX;
+	float nearestDepth = FLT_MAX;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		float p[3] = {
+			corner & 1 ? boxMax.x : boxMin.x,
+			corner & 2 ? boxMax.y : boxMin.y,
+			corner & 4 ? boxMax.z : boxMin.z };
+
+		float clip[4];
+		for (int c = 0; c < 4; c++)
+			clip[c] = p[0] * viewProj.m[0][c] + p[1] * viewProj.m[1][c] + p[2] * viewProj.m[2][c] + viewProj.m[3][c];
+
+		// Crossing the near plane - can't be bounded on screen
+		if (clip[3] < 0.0001f || clip[2] < 0.0f)
+			return false;
+
+		float u = clip[0] / clip[3] * 0.5f + 0.5f;
+		float v = 0.5f - clip[1] / clip[3] * 0.5f;
+		minU = fminf(minU, u);
+		minV = fminf(minV, v);
+		maxU = fmaxf(maxU, u);
+		maxV = fmaxf(maxV, v);
+		nearestDepth = fminf(nearestDepth, clip[2] / clip[3]);
+	}
+
+	float marginU = GetWidth() > 0 ? marginTexels / GetWidth() : 0.0f;
+	float marginV = GetHeight() > 0 ? marginTexels / GetHeight() : 0.0f;
+	return IsOccluded(minU - marginU, minV - marginV, maxU + marginU, maxV + marginV, nearestDepth);
+}
+
+bool HiZPyramid::Test(const FloatImage& depths, JobSystem* jobs)
+{
+	printf("  Hi-Z pyramid:\n");
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	HiZPyramid pyramid;
+	pyramid.Build(depths, jobs);
+	double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	HiZPyramid single;
+	single.Build(depths, 0);
+
+	// Every texel against the pixels it covers (the last texel of
+	// a row or column covers the rest of it)
+	int width = depths.Width;
+	int height = depths.Height;
+	int wrongTexels = 0;
+	bool deterministic = true;
+	for (int mip = 0; mip < pyramid.GetMipCount(); mip++)
+	{
+		const FloatImage& image = pyramid.GetMip(mip);
+		deterministic = deterministic && image.Pixels == single.GetMip(mip).Pixels;
+		for (int ty = 0; ty < image.Height; ty++)
+		{
+			for (int tx = 0; tx < image.Width; tx++)
+			{
+				int x0 = tx << mip;
+				int y0 = ty << mip;
+				int x1 = tx == image.Width - 1 ? width : (tx + 1) << mip;
+				int y1 = ty == image.Height - 1 ? height : (ty + 1) << mip;
+
+				float nearest = FLT_MAX;
+				float farthest = -FLT_MAX;
+				for (int y = y0; y < y1; y++)
+				{
+					for (int x = x0; x < x1; x++)
+					{
+						float depth = depths.Row(y)[x * depths.Channels];
+						nearest = fminf(nearest, depth);
+						farthest = fmaxf(farthest, depth);
+					}
+				}
+
+				const float* texel = image.Row(ty) + tx * 2;
+				if (texel[0] != nearest || texel[1] != farthest)
+					wrongTexels++;
+			}
+		}
+	}
+
+	// Random rectangles: the pyramid's farthest depth can only be
+	// further than the pixels' (it covers more of the screen)
+	unsigned int seed = 12345;
+	auto next = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) / 16777216.0f; };
+	int wrongRectangles = 0;
+	int occluded = 0;
+	double slack = 0.0;
+	const int rectangles = 2000;
+	for (int i = 0; i < rectangles; i++)
+	{
+		float u = next();
+		float v = next();
+		float size = next() * next() * 0.5f;
+		float minU = u - size * 0.5f, maxU = u + size * 0.5f;
+		float minV = v - size * 0.5f, maxV = v + size * 0.5f;
+
+		float farthest = -FLT_MAX;
+		for (int y = PixelFromUV(minV, height); y <= PixelFromUV(maxV, height); y++)
+			for (int x = PixelFromUV(minU, width); x <= PixelFromUV(maxU, width); x++)
+				farthest = fmaxf(farthest, depths.Row(y)[x * depths.Channels]);
+
+		float conservative = pyramid.GetFarthestDepth(minU, minV, maxU, maxV);
+		if (conservative < farthest)
+			wrongRectangles++;
+		slack += conservative - farthest;
+
+		float nearestDepth = next();
+		bool hidden = pyramid.IsOccluded(minU, minV, maxU, maxV, nearestDepth);
+		if (hidden && nearestDepth <= farthest)
+			wrongRectangles++;
+		occluded += hidden ? 1 : 0;
+	}
+
+	bool passed = wrongTexels == 0 && wrongRectangles == 0 && deterministic;
+	printf("    %d mips built in %.3f ms, %d texel(s) wrong, results on every thread count %s\n",
+		pyramid.GetMipCount(), time, wrongTexels, deterministic ? "match" : "DIFFER");
+	printf("    %d random rectangles: %d occluded, %d not conservative, farthest depth %.5f too far on average - %s\n",
+		rectangles, occluded, wrongRectangles, slack / rectangles, passed ? "ok" : "FAILED");
+	return passed;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "FloatImage.h"
+#include "JobSystem.h"
+
+// How many mips finer than the sample distance (in pixels) SSAO
+// reads the Hi-Z pyramid at - a sample 64 pixels away reads mip 3
+#define HIZ_SSAO_MIP_OFFSET 3
+
+// --------------------------------------------------------
+// A min/max hierarchical Z pyramid, the CPU version of the one
+// HiZPS builds each frame.  Every texel holds the nearest (first
+// channel) and farthest (second channel) post-projection depth
+// of the texels it covers in the mip above.  Mips halve in size
+// like a texture's, and when the mip above has an odd size the
+// last row/column also takes in the leftover one, so each mip
+// still covers the whole screen.
+//
+// SSAO reads it at coarser mips for samples further away, and
+// it can conservatively test screen space bounds for occlusion.
+// --------------------------------------------------------
+class HiZPyramid
+{
+public:
+	// Builds every mip from a single channel depth image, or
+	// from a two channel (nearest, farthest) one - such as a mip
+	// read back from the GPU's pyramid
+	void Build(const FloatImage& depths, JobSystem* jobs);
+
+	int GetMipCount() const { return (int)mips.size(); }
+	const FloatImage& GetMip(int mip) const { return mips[mip]; }
+	int GetWidth() const { return mips.empty() ? 0 : mips[0].Width; }
+	int GetHeight() const { return mips.empty() ? 0 : mips[0].Height; }
+
+	// Mips in a full chain down to 1x1 (same as D3D's)
+	static int MipCount(int width, int height);
+
+	// The mip SSAO reads for a sample this many (mip 0) pixels away
+	int GetSSAOMip(float distancePixels) const;
+
+	// The farthest depth anywhere in a rectangle of UVs, from the
+	// coarsest mip where it covers at most 2x2 texels
+	float GetFarthestDepth(float minU, float minV, float maxU, float maxV) const;
+
+	// Is everything in the rectangle hidden behind what's already
+	// there?  Nothing is culled by the sky (depth 1).
+	bool IsOccluded(float minU, float minV, float maxU, float maxV, float nearestDepth) const;
+
+	// Projects a world space box and tests its screen bounds,
+	// grown by a margin of mip 0 texels on each side.  Boxes that
+	// cross the near plane are never occluded.
+	bool IsBoxOccluded(const DirectX::XMFLOAT3& boxMin, const DirectX::XMFLOAT3& boxMax, const DirectX::XMFLOAT4X4& viewProj, float marginTexels = 0.0f) const;
+
+	// Checks every mip against a brute force min/max of mip 0,
+	// the results on any number of threads, and random occlusion
+	// tests against every pixel they cover.  Returns false if a
+	// check fails.
+	static bool Test(const FloatImage& depths, JobSystem* jobs);
+
+private:
+	std::vector<FloatImage> mips;
+};
@@ -0,0 +1,136 @@
+#include "JobSystem.h"
+
+
+JobSystem::JobSystem(unsigned int threadCount) :
+	stopping(false),
+	currentJob(0),
+	jobCount(0),
+	generation(0),
+	activeWorkers(0),
+	nextIndex(0),
+	remaining(0)
+{
+	SetThreadCount(threadCount);
+}
+
+JobSystem::~JobSystem()
+{
+	StopWorkers();
+}
+
+unsigned int JobSystem::GetHardwareThreadCount()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+// --------------------------------------------------------
+// Restarts the pool with a new number of threads.  The
+// calling thread counts as one, so 1 means no workers.
+// --------------------------------------------------------
+void JobSystem::SetThreadCount(unsigned int threadCount)
+{
+	if (threadCount == 0)
+		threadCount = GetHardwareThreadCount();
+
+	StopWorkers();
+	StartWorkers(threadCount - 1);
+}
+
+void JobSystem::StartWorkers(unsigned int count)
+{
+	stopping = false;
+	for (unsigned int i = 0; i < count; i++)
+		workers.push_back(std::thread(&JobSystem::WorkerLoop, this));
+}
+
+void JobSystem::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+
+	for (std::thread& t : workers)
+		t.join();
+	workers.clear();
+}
+
+// --------------------------------------------------------
+// Publishes a batch of jobs, helps run them, then waits for
+// any worker still finishing its last one
+// --------------------------------------------------------
+void JobSystem::ParallelFor(int count, const std::function<void(int)>& job)
+{
+	if (count <= 0)
+		return;
+
+	// Not worth waking anyone up
+	if (workers.empty() || count == 1)
+	{
+		for (int i = 0; i < count; i++)
+			job(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentJob = &job;
+		jobCount = count;
+		nextIndex = 0;
+		remaining = count;
+		generation++;
+	}
+	workAvailable.notify_all();
+
+	RunJobs();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	workFinished.wait(lock, [this]() { return remaining == 0 && activeWorkers == 0; });
+	currentJob = 0;
+}
+
+void JobSystem::WorkerLoop()
+{
+	unsigned int lastGeneration = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		workAvailable.wait(lock, [&]() { return stopping || generation != lastGeneration; });
+		if (stopping)
+			return;
+
+		// Only join in if there's work left - otherwise the batch
+		// may already be over, and its job could be out of scope
+		lastGeneration = generation;
+		if (nextIndex >= jobCount)
+			continue;
+		activeWorkers++;
+
+		lock.unlock();
+		RunJobs();
+		lock.lock();
+
+		activeWorkers--;
+		if (activeWorkers == 0 && remaining == 0)
+			workFinished.notify_all();
+	}
+}
+
+// --------------------------------------------------------
+// Grabs job indices until there are none left
+// --------------------------------------------------------
+void JobSystem::RunJobs()
+{
+	while (true)
+	{
+		int index = nextIndex.fetch_add(1);
+		if (index >= jobCount)
+			break;
+
+		(*currentJob)(index);
+		remaining.fetch_sub(1);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// A small pool of worker threads for data-parallel work.
+//
+// ParallelFor() hands out job indices one at a time to the
+// workers and the calling thread, and returns once every
+// job has finished - so it doubles as the join point.
+//
+// Jobs must not call ParallelFor() themselves.
+// --------------------------------------------------------
+class JobSystem
+{
+public:
+	// threadCount - Total threads doing work, including the caller
+	//               (0 uses one per hardware thread)
+	JobSystem(unsigned int threadCount = 0);
+	~JobSystem();
+
+	void SetThreadCount(unsigned int threadCount);
+	unsigned int GetThreadCount() { return (unsigned int)workers.size() + 1; }
+	static unsigned int GetHardwareThreadCount();
+
+	// Runs job(0) through job(count - 1) across all threads
+	void ParallelFor(int count, const std::function<void(int)>& job);
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable workFinished;
+	bool stopping;
+
+	// The current batch of jobs
+	const std::function<void(int)>* currentJob;
+	int jobCount;
+	unsigned int generation;
+	unsigned int activeWorkers;
+	std::atomic<int> nextIndex;
+	std::atomic<int> remaining;
+
+	void StartWorkers(unsigned int count);
+	void StopWorkers();
+	void WorkerLoop();
+	void RunJobs();
+};
@@ -0,0 +1,707 @@
+#include "LightBVH.h"
+
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include "LightClusters.h"
+#include "Random.h"
+
+using namespace DirectX;
+
+namespace
+{
+	const float Pi = 3.14159265f;
+	const int SplitBuckets = 12;
+
+	double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	float Dot3(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	float SafeAcos(float cosine)
+	{
+		return acosf(fminf(fmaxf(cosine, -1.0f), 1.0f));
+	}
+
+	// Rotates v by an angle around a unit axis (Rodrigues)
+	XMFLOAT3 Rotate(const XMFLOAT3& v, const XMFLOAT3& axis, float angle)
+	{
+		float c = cosf(angle);
+		float s = sinf(angle);
+		float d = Dot3(axis, v) * (1.0f - c);
+		return XMFLOAT3(
+			v.x * c + (axis.y * v.z - axis.z * v.y) * s + axis.x * d,
+			v.y * c + (axis.z * v.x - axis.x * v.z) * s + axis.y * d,
+			v.z * c + (axis.x * v.y - axis.y * v.x) * s + axis.z * d);
+	}
+
+	// The smallest cone of directions holding two others (a cosine
+	// of -1 is the whole sphere)
+	void UnionCones(const XMFLOAT3& axisA, float cosA, const XMFLOAT3& axisB, float cosB, XMFLOAT3& axis, float& cosine)
+	{
+		axis = axisA;
+		cosine = -1.0f;
+		if (cosA <= -1.0f || cosB <= -1.0f)
+			return;
+
+		float thetaA = SafeAcos(cosA);
+		float thetaB = SafeAcos(cosB);
+		float thetaD = SafeAcos(Dot3(axisA, axisB));
+		if (fminf(thetaD + thetaB, Pi) <= thetaA)
+		{
+			cosine = cosA;
+			return;
+		}
+		if (fminf(thetaD + thetaA, Pi) <= thetaB)
+		{
+			axis = axisB;
+			cosine = cosB;
+			return;
+		}
+
+		// Turn a's axis toward b's, half way across the combined spread
+		float thetaO = (thetaA + thetaD + thetaB) * 0.5f;
+		XMFLOAT3 across(
+			axisA.y * axisB.z - axisA.z * axisB.y,
+			axisA.z * axisB.x - axisA.x * axisB.z,
+			axisA.x * axisB.y - axisA.y * axisB.x);
+		float length = sqrtf(Dot3(across, across));
+		if (thetaO >= Pi || length < 1e-6f)
+			return;
+
+		across = XMFLOAT3(across.x / length, across.y / length, across.z / length);
+		axis = Rotate(axisA, across, thetaO - thetaA);
+		cosine = cosf(thetaO);
+	}
+
+	// Both nodes' lights.  Lights with no power can't be picked,
+	// so only their positions count.
+	LightBVHNode Union(const LightBVHNode& a, const LightBVHNode& b)
+	{
+		LightBVHNode node = {};
+		node.BoundsMin = XMFLOAT3(fminf(a.BoundsMin.x, b.BoundsMin.x), fminf(a.BoundsMin.y, b.BoundsMin.y), fminf(a.BoundsMin.z, b.BoundsMin.z));
+		node.BoundsMax = XMFLOAT3(fmaxf(a.BoundsMax.x, b.BoundsMax.x), fmaxf(a.BoundsMax.y, b.BoundsMax.y), fmaxf(a.BoundsMax.z, b.BoundsMax.z));
+		node.Power = a.Power + b.Power;
+		if (a.Power <= 0.0f || b.Power <= 0.0f)
+		{
+			const LightBVHNode& lit = a.Power > 0.0f ? a : b;
+			node.MaxRange = lit.MaxRange;
+			node.Axis = lit.Axis;
+			node.CosThetaO = lit.CosThetaO;
+			node.CosThetaE = lit.CosThetaE;
+			node.MinSpotFalloff = lit.MinSpotFalloff;
+			return node;
+		}
+
+		node.MaxRange = fmaxf(a.MaxRange, b.MaxRange);
+		UnionCones(a.Axis, a.CosThetaO, b.Axis, b.CosThetaO, node.Axis, node.CosThetaO);
+		node.CosThetaE = fminf(a.CosThetaE, b.CosThetaE);
+		node.MinSpotFalloff = fminf(a.MinSpotFalloff, b.MinSpotFalloff);
+		return node;
+	}
+
+	// The surface area and orientation heuristic's cost for a set
+	// of lights (Conty Estevez and Kulla): power, times the solid
+	// angle their cones reach, times the bounds' surface area.
+	// Splits across a node's thin axes are made to cost more.
+	float SplitCost(const LightBVHNode& lights, const LightBVHNode& parent, int axis)
+	{
+		float thetaO = SafeAcos(lights.CosThetaO);
+		float thetaE = SafeAcos(lights.CosThetaE);
+		float thetaW = fminf(thetaO + thetaE, Pi);
+		float sinO = sinf(thetaO);
+		float solidAngle = 2.0f * Pi * (1.0f - lights.CosThetaO) +
+			Pi / 2.0f * (2.0f * thetaW * sinO - cosf(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinO + lights.CosThetaO);
+
+		XMFLOAT3 size(lights.BoundsMax.x - lights.BoundsMin.x, lights.BoundsMax.y - lights.BoundsMin.y, lights.BoundsMax.z - lights.BoundsMin.z);
+		float area = 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+
+		float parentSize[3] = { parent.BoundsMax.x - parent.BoundsMin.x, parent.BoundsMax.y - parent.BoundsMin.y, parent.BoundsMax.z - parent.BoundsMin.z };
+		float thinness = fmaxf(fmaxf(parentSize[0], parentSize[1]), parentSize[2]) / parentSize[axis];
+		return lights.Power * solidAngle * area * thinness;
+	}
+
+	float Position(const LightBVHNode& leaf, int axis)
+	{
+		return axis == 0 ? leaf.BoundsMin.x : (axis == 1 ? leaf.BoundsMin.y : leaf.BoundsMin.z);
+	}
+
+	// What the shaders get from a light at a point on an upward
+	// facing floor: its diffuse lighting, in luminance
+	float Shade(const Light& light, const XMFLOAT3& point)
+	{
+		XMFLOAT3 toLight(light.Position.x - point.x, light.Position.y - point.y, light.Position.z - point.z);
+		float distanceSq = Dot3(toLight, toLight);
+		float distance = sqrtf(distanceSq);
+		if (distance >= light.Range || distance <= 0.0f)
+			return 0.0f;
+
+		float attenuation = 1.0f - distanceSq / (light.Range * light.Range);
+		attenuation *= attenuation;
+		float diffuse = fmaxf(toLight.y / distance, 0.0f);
+		float penumbra = 1.0f;
+		if (light.Type == LIGHT_TYPE_SPOT)
+			penumbra = powf(fmaxf(-Dot3(toLight, light.Direction) / distance, 0.0f), light.SpotFalloff);
+
+		float luminance = 0.2126f * light.Color.x + 0.7152f * light.Color.y + 0.0722f * light.Color.z;
+		return light.Intensity * luminance * attenuation * diffuse * penumbra;
+	}
+
+	// Lots of small lights over a floor, a quarter of them spot
+	// lights shining down, after one directional light
+	void BenchmarkLights(std::vector<Light>& lights, int count, PCG32& random)
+	{
+		lights.clear();
+		for (int i = 0; i < count; i++)
+		{
+			Light light = {};
+			light.Color = XMFLOAT3(random.Range(0.0f, 1.0f), random.Range(0.0f, 1.0f), random.Range(0.0f, 1.0f));
+			light.Intensity = random.Range(0.1f, 1.0f);
+			if (i == 0)
+			{
+				light.Type = LIGHT_TYPE_DIRECTIONAL;
+				light.Direction = XMFLOAT3(0.0f, -1.0f, 0.0f);
+				lights.push_back(light);
+				continue;
+			}
+
+			light.Type = i % 4 == 0 ? LIGHT_TYPE_SPOT : LIGHT_TYPE_POINT;
+			light.Position = XMFLOAT3(random.Range(-50.0f, 50.0f), random.Range(0.5f, 8.0f), random.Range(-50.0f, 50.0f));
+			light.Range = random.Range(2.0f, 10.0f);
+			if (light.Type == LIGHT_TYPE_SPOT)
+			{
+				XMFLOAT3 direction(random.Range(-0.5f, 0.5f), -1.0f, random.Range(-0.5f, 0.5f));
+				XMStoreFloat3(&light.Direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+				light.SpotFalloff = random.Range(2.0f, 40.0f);
+			}
+			lights.push_back(light);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Point lights shine every way, so their cone is the whole
+// sphere, and each direction is lit across a hemisphere.  A
+// spot light's cone is just its direction, lit out to where
+// the penumbra falls below the cutoff (as in LightClusters).
+// --------------------------------------------------------
+bool LightBVH::LeafFromLight(const Light& light, int index, LightBVHNode& leaf)
+{
+	if (light.Type != LIGHT_TYPE_POINT && light.Type != LIGHT_TYPE_SPOT)
+		return false;
+
+	leaf = {};
+	leaf.BoundsMin = light.Position;
+	leaf.BoundsMax = light.Position;
+	float luminance = 0.2126f * light.Color.x + 0.7152f * light.Color.y + 0.0722f * light.Color.z;
+	leaf.Power = fmaxf(light.Intensity * luminance, 0.0f);
+	leaf.MaxRange = fmaxf(light.Range, 0.0f);
+	leaf.SecondChildOrLight = (uint32_t)index;
+	leaf.IsLeaf = 1;
+
+	float length = sqrtf(Dot3(light.Direction, light.Direction));
+	if (light.Type == LIGHT_TYPE_SPOT && light.SpotFalloff > 0.0f && length > 0.0f)
+	{
+		leaf.Axis = XMFLOAT3(light.Direction.x / length, light.Direction.y / length, light.Direction.z / length);
+		leaf.CosThetaO = 1.0f;
+		leaf.CosThetaE = powf(SPOT_LIGHT_CUTOFF, 1.0f / light.SpotFalloff);
+		leaf.MinSpotFalloff = light.SpotFalloff;
+	}
+	else
+	{
+		leaf.Axis = XMFLOAT3(0.0f, 0.0f, 1.0f);
+		leaf.CosThetaO = -1.0f;
+		leaf.CosThetaE = 0.0f;
+	}
+	return true;
+}
+
+void LightBVH::Build(const Light* lights, int lightCount)
+{
+	nodes.clear();
+	parents.clear();
+	leafOfLight.assign(lightCount, -1);
+
+	std::vector<LightBVHNode> leaves;
+	std::vector<int> lightIndices;
+	for (int i = 0; i < lightCount; i++)
+	{
+		LightBVHNode leaf;
+		if (LeafFromLight(lights[i], i, leaf))
+		{
+			leaves.push_back(leaf);
+			lightIndices.push_back(i);
+		}
+	}
+
+	localLightCount = (int)leaves.size();
+	if (leaves.empty())
+		return;
+
+	nodes.reserve(leaves.size() * 2 - 1);
+	parents.reserve(leaves.size() * 2 - 1);
+	BuildNode(leaves, lightIndices, 0, (int)leaves.size(), UINT32_MAX);
+}
+
+// --------------------------------------------------------
+// Leaves are bucketed by position along each axis, and the
+// split between buckets with the lowest cost wins.  Nodes are
+// stored depth first, so a node's first child follows it.
+// --------------------------------------------------------
+uint32_t LightBVH::BuildNode(std::vector<LightBVHNode>& leaves, std::vector<int>& lightIndices, int start, int end, uint32_t parent)
+{
+	uint32_t index = (uint32_t)nodes.size();
+	nodes.push_back(leaves[start]);
+	parents.push_back(parent);
+	if (end - start == 1)
+	{
+		leafOfLight[lightIndices[start]] = (int)index;
+		return index;
+	}
+
+	LightBVHNode all = leaves[start];
+	for (int i = start + 1; i < end; i++)
+		all = Union(all, leaves[i]);
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestSplit = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float minimum = Position(all, axis);
+		float extent = (axis == 0 ? all.BoundsMax.x : (axis == 1 ? all.BoundsMax.y : all.BoundsMax.z)) - minimum;
+		if (extent <= 0.0f)
+			continue;
+
+		LightBVHNode buckets[SplitBuckets];
+		int counts[SplitBuckets] = {};
+		for (int i = start; i < end; i++)
+		{
+			int b = (int)(SplitBuckets * (Position(leaves[i], axis) - minimum) / extent);
+			b = b < 0 ? 0 : (b >= SplitBuckets ? SplitBuckets - 1 : b);
+			buckets[b] = counts[b] == 0 ? leaves[i] : Union(buckets[b], leaves[i]);
+			counts[b]++;
+		}
+
+		// Costs of everything below and above each split
+		float belowCosts[SplitBuckets - 1];
+		LightBVHNode below = {};
+		int belowCount = 0;
+		for (int split = 0; split < SplitBuckets - 1; split++)
+		{
+			if (counts[split] > 0)
+				below = belowCount == 0 ? buckets[split] : Union(below, buckets[split]);
+			belowCount += counts[split];
+			belowCosts[split] = belowCount > 0 ? SplitCost(below, all, axis) : FLT_MAX;
+		}
+
+		LightBVHNode above = {};
+		int aboveCount = 0;
+		for (int split = SplitBuckets - 2; split >= 0; split--)
+		{
+			if (counts[split + 1] > 0)
+				above = aboveCount == 0 ? buckets[split + 1] : Union(above, buckets[split + 1]);
+			aboveCount += counts[split + 1];
+			if (aboveCount == 0 || belowCosts[split] == FLT_MAX)
+				continue;
+
+			float cost = belowCosts[split] + SplitCost(above, all, axis);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	// Lights all in one place are split in half
+	int middle = (start + end) / 2;
+	if (bestAxis >= 0)
+	{
+		float minimum = Position(all, bestAxis);
+		float extent = (bestAxis == 0 ? all.BoundsMax.x : (bestAxis == 1 ? all.BoundsMax.y : all.BoundsMax.z)) - minimum;
+		int first = start;
+		for (int i = start; i < end; i++)
+		{
+			int b = (int)(SplitBuckets * (Position(leaves[i], bestAxis) - minimum) / extent);
+			b = b < 0 ? 0 : (b >= SplitBuckets ? SplitBuckets - 1 : b);
+			if (b <= bestSplit)
+			{
+				std::swap(leaves[i], leaves[first]);
+				std::swap(lightIndices[i], lightIndices[first]);
+				first++;
+			}
+		}
+		if (first > start && first < end)
+			middle = first;
+	}
+
+	BuildNode(leaves, lightIndices, start, middle, index);
+	uint32_t second = BuildNode(leaves, lightIndices, middle, end, index);
+
+	LightBVHNode node = Union(nodes[index + 1], nodes[second]);
+	node.SecondChildOrLight = second;
+	node.IsLeaf = 0;
+	nodes[index] = node;
+	return index;
+}
+
+// --------------------------------------------------------
+// Children always come after their parents, so going through
+// the nodes backwards updates every child before its parent.
+// A light that's changed type means a new tree.
+// --------------------------------------------------------
+void LightBVH::Refit(const Light* lights, int lightCount)
+{
+	if (lightCount != (int)leafOfLight.size())
+	{
+		Build(lights, lightCount);
+		return;
+	}
+
+	for (int i = 0; i < lightCount; i++)
+	{
+		LightBVHNode leaf;
+		bool local = LeafFromLight(lights[i], i, leaf);
+		if (local != (leafOfLight[i] >= 0))
+		{
+			Build(lights, lightCount);
+			return;
+		}
+		if (local)
+			nodes[leafOfLight[i]] = leaf;
+	}
+
+	for (int n = (int)nodes.size() - 1; n >= 0; n--)
+	{
+		if (nodes[n].IsLeaf)
+			continue;
+
+		uint32_t second = nodes[n].SecondChildOrLight;
+		nodes[n] = Union(nodes[n + 1], nodes[second]);
+		nodes[n].SecondChildOrLight = second;
+		nodes[n].IsLeaf = 0;
+	}
+}
+
+// --------------------------------------------------------
+// Same as LightBVHImportance() in LightBVH.hlsli.  Lights are
+// no closer than the bounds and reach no further than the
+// largest range.  The cone's angle to the point is narrowed by
+// the orientation spread and the angle the bounds take up, and
+// nothing past the emission spread is lit.  The angles are
+// subtracted as sines and cosines, so no trig is needed.
+// --------------------------------------------------------
+float LightBVH::Importance(const LightBVHNode& node, const XMFLOAT3& point)
+{
+	if (node.Power <= 0.0f)
+		return 0.0f;
+
+	XMFLOAT3 outside(
+		fmaxf(fmaxf(node.BoundsMin.x - point.x, 0.0f), point.x - node.BoundsMax.x),
+		fmaxf(fmaxf(node.BoundsMin.y - point.y, 0.0f), point.y - node.BoundsMax.y),
+		fmaxf(fmaxf(node.BoundsMin.z - point.z, 0.0f), point.z - node.BoundsMax.z));
+	float distanceSq = Dot3(outside, outside);
+	float rangeSq = node.MaxRange * node.MaxRange;
+	if (distanceSq >= rangeSq)
+		return 0.0f;
+
+	float attenuation = 1.0f - distanceSq / rangeSq;
+	attenuation *= attenuation;
+
+	// Only spot lights have a cone narrower than the whole sphere
+	float orientation = 1.0f;
+	if (node.CosThetaO > -1.0f)
+	{
+		XMFLOAT3 half((node.BoundsMax.x - node.BoundsMin.x) * 0.5f, (node.BoundsMax.y - node.BoundsMin.y) * 0.5f, (node.BoundsMax.z - node.BoundsMin.z) * 0.5f);
+		XMFLOAT3 toPoint(point.x - node.BoundsMin.x - half.x, point.y - node.BoundsMin.y - half.y, point.z - node.BoundsMin.z - half.z);
+		float centerDistanceSq = Dot3(toPoint, toPoint);
+		float radiusSq = Dot3(half, half);
+		if (centerDistanceSq <= radiusSq)
+			return node.Power * attenuation;
+
+		// Angle to the point, less the orientation spread...
+		float cosW = fminf(fmaxf(Dot3(node.Axis, toPoint) / sqrtf(centerDistanceSq), -1.0f), 1.0f);
+		float sinW = sqrtf(fmaxf(1.0f - cosW * cosW, 0.0f));
+		float sinO = sqrtf(fmaxf(1.0f - node.CosThetaO * node.CosThetaO, 0.0f));
+		float cosX = 1.0f;
+		float sinX = 0.0f;
+		if (cosW < node.CosThetaO)
+		{
+			cosX = cosW * node.CosThetaO + sinW * sinO;
+			sinX = sinW * node.CosThetaO - cosW * sinO;
+		}
+
+		// ...less the angle the bounds take up
+		float sinB = fminf(sqrtf(radiusSq / centerDistanceSq), 1.0f);
+		float cosB = sqrtf(1.0f - sinB * sinB);
+		float cosAngle = 1.0f;
+		if (cosX < cosB)
+			cosAngle = cosX * cosB + sinX * sinB;
+		if (cosAngle <= node.CosThetaE)
+			return 0.0f;
+
+		orientation = powf(cosAngle, node.MinSpotFalloff);
+	}
+
+	return node.Power * attenuation * orientation;
+}
+
+// --------------------------------------------------------
+// Walks down from the root, going either way in proportion
+// to the children's importance, and reuses what's left of the
+// random number at each step
+// --------------------------------------------------------
+bool LightBVH::Sample(const XMFLOAT3& point, float u, int& light, float& probability) const
+{
+	light = -1;
+	probability = 0.0f;
+	if (nodes.empty() || Importance(nodes[0], point) <= 0.0f)
+		return false;
+
+	probability = 1.0f;
+	uint32_t index = 0;
+	while (!nodes[index].IsLeaf)
+	{
+		uint32_t second = nodes[index].SecondChildOrLight;
+		float first = Importance(nodes[index + 1], point);
+		float total = first + Importance(nodes[second], point);
+		if (total <= 0.0f)
+			return false;
+
+		float chance = first / total;
+		if (u < chance)
+		{
+			u = fminf(u / chance, 0.99999994f);
+			probability *= chance;
+			index = index + 1;
+		}
+		else
+		{
+			u = fminf((u - chance) / (1.0f - chance), 0.99999994f);
+			probability *= 1.0f - chance;
+			index = second;
+		}
+	}
+
+	light = (int)nodes[index].SecondChildOrLight;
+	return true;
+}
+
+float LightBVH::Probability(const XMFLOAT3& point, int light) const
+{
+	if (light < 0 || light >= (int)leafOfLight.size() || leafOfLight[light] < 0 || Importance(nodes[0], point) <= 0.0f)
+		return 0.0f;
+
+	float probability = 1.0f;
+	uint32_t index = (uint32_t)leafOfLight[light];
+	while (parents[index] != UINT32_MAX)
+	{
+		uint32_t parent = parents[index];
+		uint32_t second = nodes[parent].SecondChildOrLight;
+		float first = Importance(nodes[parent + 1], point);
+		float total = first + Importance(nodes[second], point);
+		if (total <= 0.0f)
+			return 0.0f;
+
+		probability *= index == second ? 1.0f - first / total : first / total;
+		index = parent;
+	}
+	return probability;
+}
+
+bool LightBVH::Benchmark(int iterations)
+{
+	printf("Light BVH sampling:\n");
+
+	bool passed = true;
+	PCG32 random(4321);
+	std::vector<Light> lights;
+	const int lightCounts[] = { 1024, 16384, 65536 };
+	for (int lightCount : lightCounts)
+	{
+		BenchmarkLights(lights, lightCount, random);
+
+		LightBVH tree;
+		double buildTime = 1e30;
+		for (int i = 0; i < iterations; i++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			tree.Build(&lights[0], lightCount);
+			double time = MillisecondsSince(start);
+			buildTime = time < buildTime ? time : buildTime;
+		}
+
+		int depth = 0;
+		for (size_t n = 0; n < tree.nodes.size(); n++)
+		{
+			int d = 0;
+			for (uint32_t i = (uint32_t)n; tree.parents[i] != UINT32_MAX; i = tree.parents[i])
+				d++;
+			depth = d > depth ? d : depth;
+		}
+
+		// Nudge every light and refit, then check the refitted tree
+		for (int l = 1; l < lightCount; l++)
+		{
+			lights[l].Position.x += random.Range(-1.0f, 1.0f);
+			lights[l].Position.z += random.Range(-1.0f, 1.0f);
+		}
+		double refitTime = 1e30;
+		for (int i = 0; i < iterations; i++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			tree.Refit(&lights[0], lightCount);
+			double time = MillisecondsSince(start);
+			refitTime = time < refitTime ? time : refitTime;
+		}
+
+		printf("  %5d lights: built in %.3f ms (%d nodes, %d deep), refit in %.3f ms\n",
+			lightCount, buildTime, (int)tree.nodes.size(), depth, refitTime);
+
+		// Every light's chance at a point should add up to no more
+		// than one, and anything that lights the point has to be
+		// possible to pick.  The rest of the chance goes to walks that
+		// end where a node's bounds reach the point but its lights don't.
+		const int checkPoints = 32;
+		double worstSum = 0.0;
+		double wasted = 0.0;
+		int reachedPoints = 0;
+		int neverPicked = 0;
+		int wrongSamples = 0;
+		for (int p = 0; p < checkPoints; p++)
+		{
+			XMFLOAT3 point(random.Range(-45.0f, 45.0f), 0.0f, random.Range(-45.0f, 45.0f));
+			double sum = 0.0;
+			bool reached = false;
+			for (int l = 0; l < lightCount; l++)
+			{
+				float probability = tree.Probability(point, l);
+				sum += probability;
+
+				// Skip lights right at the edge of their range or cone
+				const Light& light = lights[l];
+				float lit = Shade(light, point);
+				reached = reached || lit > 0.0f;
+				XMFLOAT3 toLight(light.Position.x - point.x, light.Position.y - point.y, light.Position.z - point.z);
+				float distance = sqrtf(Dot3(toLight, toLight));
+				bool spotEdge = light.Type == LIGHT_TYPE_SPOT &&
+					powf(fmaxf(-Dot3(toLight, light.Direction) / distance, 0.0f), light.SpotFalloff) < SPOT_LIGHT_CUTOFF * 1.01f;
+				if (lit > 0.0f && distance < light.Range * 0.999f && !spotEdge && probability <= 0.0f)
+					neverPicked++;
+			}
+			worstSum = sum > worstSum ? sum : worstSum;
+			if (reached)
+			{
+				wasted += 1.0 - sum;
+				reachedPoints++;
+			}
+
+			// Sample() should agree with Probability()
+			for (int s = 0; s < 8; s++)
+			{
+				int light;
+				float probability;
+				if (tree.Sample(point, random.NextFloat(), light, probability) &&
+					fabsf(probability - tree.Probability(point, light)) > 1e-4f * probability)
+					wrongSamples++;
+			}
+		}
+
+		bool ok = worstSum < 1.0 + 1e-3 && neverPicked == 0 && wrongSamples == 0;
+		passed = passed && ok;
+		printf("    %d points: chances add up to at most %.6f, %.1f%% of picks find no light, %d reaching light(s) never picked, %d sample(s) off - %s\n",
+			checkPoints, worstSum, reachedPoints > 0 ? wasted * 100.0 / reachedPoints : 0.0, neverPicked, wrongSamples, ok ? "ok" : "FAILED");
+
+		// Error against shading with every light, picking a few
+		// lights uniformly or with the tree
+		const int points = 256;
+		const int trials = 64;
+		std::vector<XMFLOAT3> shadePoints;
+		std::vector<double> exact;
+		double exactTime = 0.0;
+		while ((int)shadePoints.size() < points)
+		{
+			XMFLOAT3 point(random.Range(-45.0f, 45.0f), 0.0f, random.Range(-45.0f, 45.0f));
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			double total = 0.0;
+			for (int l = 1; l < lightCount; l++)
+				total += Shade(lights[l], point);
+			exactTime += MillisecondsSince(start);
+			if (total <= 0.0)
+				continue;
+			shadePoints.push_back(point);
+			exact.push_back(total);
+		}
+		printf("    every light: %.1f us per point\n", exactTime * 1000.0 / points);
+
+		const int sampleCounts[] = { 1, 4, 16 };
+		int localLights = lightCount - 1;
+		for (int samples : sampleCounts)
+		{
+			double error[2] = {};
+			double time[2] = {};
+			for (int method = 0; method < 2; method++)
+			{
+				PCG32 picks(99);
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (int p = 0; p < points; p++)
+				{
+					double squaredError = 0.0;
+					for (int t = 0; t < trials; t++)
+					{
+						double estimate = 0.0;
+						for (int s = 0; s < samples; s++)
+						{
+							if (method == 0)
+							{
+								int light = 1 + (int)picks.Range((uint32_t)localLights);
+								estimate += Shade(lights[light], shadePoints[p]) * localLights;
+							}
+							else
+							{
+								int light;
+								float probability;
+								if (tree.Sample(shadePoints[p], picks.NextFloat(), light, probability))
+									estimate += Shade(lights[light], shadePoints[p]) / probability;
+							}
+						}
+						estimate /= samples;
+						squaredError += (estimate - exact[p]) * (estimate - exact[p]);
+					}
+					error[method] += sqrt(squaredError / trials) / exact[p];
+				}
+				time[method] = MillisecondsSince(start) * 1e6 / ((double)points * trials * samples);
+				error[method] /= points;
+			}
+
+			// Variance falls with the sample count, so uniform picking
+			// needs (error ratio)^2 times the samples to match.  Picking
+			// is most of the cost here, but in a shader each sample is
+			// a whole light (and a shadow ray, when ray tracing).
+			double matchingSamples = samples * (error[0] * error[0]) / (error[1] * error[1]);
+			double efficiency = (error[0] * error[0] * time[0]) / (error[1] * error[1] * time[1]);
+			printf("    %2d sample(s): uniform %6.1f%% error (%4.0f ns each), tree %6.1f%% error (%4.0f ns each) - uniform needs %.0f samples to match, %.2fx as efficient per CPU time\n",
+				samples, error[0] * 100.0, time[0], error[1] * 100.0, time[1], matchingSamples, 1.0 / efficiency);
+
+			// Timings vary from run to run, but the tree should
+			// always pick better than uniform at the same count
+			if (error[1] > error[0])
+			{
+				printf("    %2d sample(s): the tree has more error than uniform picking - FAILED\n", samples);
+				passed = false;
+			}
+		}
+	}
+
+	printf("Light BVH %s\n", passed ? "passed" : "FAILED");
+	return passed;
+}
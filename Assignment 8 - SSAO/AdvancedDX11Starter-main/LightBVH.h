@@ -0,0 +1,90 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+#include "Lights.h"
+
+// --------------------------------------------------------
+// One node of the light BVH, laid out for a structured buffer
+// (must match LightBVH.hlsli).  Interior nodes' first child is
+// the next node, so only the second child's index is stored.
+//
+// Bounds hold the lights' positions.  Their ranges are bounded
+// by MaxRange, and the way they face by a cone of directions
+// around Axis (spread CosThetaO) that each emits within
+// CosThetaE of (Conty Estevez and Kulla's orientation bounds).
+// Spot lights' penumbras fall off no faster than MinSpotFalloff.
+// --------------------------------------------------------
+struct LightBVHNode
+{
+	DirectX::XMFLOAT3	BoundsMin;
+	float				Power;				// 16 bytes
+
+	DirectX::XMFLOAT3	BoundsMax;
+	float				MaxRange;			// 32 bytes
+
+	DirectX::XMFLOAT3	Axis;
+	float				CosThetaO;			// 48 bytes
+
+	float				CosThetaE;
+	uint32_t			SecondChildOrLight;	// A light's index, for leaves
+	uint32_t			IsLeaf;
+	float				MinSpotFalloff;		// 64 bytes
+};
+
+// --------------------------------------------------------
+// A bounding volume hierarchy over the point and spot lights,
+// for picking lights at random in proportion to how much they
+// could light a point - a few picks stand in for every light,
+// however many there are (directional lights are left out, as
+// they reach everywhere anyway).
+//
+// Each leaf holds one light.  Nodes are split where the surface
+// area and orientation heuristic is lowest.  When lights move,
+// Refit() updates the bounds without changing the tree.
+//
+// The sampler only reads the nodes, so the same walk works on
+// the CPU, in the pixel shaders and in a ray tracer's hit shader.
+// --------------------------------------------------------
+class LightBVH
+{
+public:
+	void Build(const Light* lights, int lightCount);
+	void Refit(const Light* lights, int lightCount);
+
+	const std::vector<LightBVHNode>& GetNodes() const { return nodes; }
+	int GetLightCount() const { return localLightCount; }
+
+	// How much a node could light a point - an upper bound on its
+	// lights' attenuation and spot cones, times their power.  Zero
+	// only when none of them reach the point.
+	static float Importance(const LightBVHNode& node, const DirectX::XMFLOAT3& point);
+
+	// Picks a light for a point with a random number in [0, 1) and
+	// returns the chance it had of being picked.  Returns false
+	// when no light reaches the point.
+	bool Sample(const DirectX::XMFLOAT3& point, float u, int& light, float& probability) const;
+
+	// The chance Sample() picks a given light for a point
+	float Probability(const DirectX::XMFLOAT3& point, int light) const;
+
+	// Checks the probabilities and refitting, then compares picking
+	// lights with the tree and uniformly: error against shading with
+	// every light, and time, at a few samples per point.  Returns
+	// false if a check fails, or if the tree has more error than
+	// uniform picking.
+	static bool Benchmark(int iterations);
+
+private:
+	std::vector<LightBVHNode> nodes;
+	std::vector<uint32_t> parents;
+	std::vector<int> leafOfLight; // -1 for directional lights
+	int localLightCount = 0;
+
+	// A point or spot light's bounds, as a leaf
+	static bool LeafFromLight(const Light& light, int index, LightBVHNode& leaf);
+
+	// Builds the subtree over part of the leaves and returns its root
+	uint32_t BuildNode(std::vector<LightBVHNode>& leaves, std::vector<int>& lightIndices, int start, int end, uint32_t parent);
+};
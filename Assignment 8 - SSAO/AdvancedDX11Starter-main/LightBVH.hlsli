@@ -0,0 +1,141 @@
+// Include guard
+#ifndef _LIGHT_BVH_HLSL
+#define _LIGHT_BVH_HLSL
+
+#include "Lighting.hlsli"
+
+// Must match LightBVHNode in LightBVH.h
+struct LightBVHNode
+{
+	float3 BoundsMin;
+	float Power;
+	float3 BoundsMax;
+	float MaxRange;
+	float3 Axis;
+	float CosThetaO;
+	float CosThetaE;
+	uint SecondChildOrLight; // A light's index, for leaves
+	uint IsLeaf;
+	float MinSpotFalloff;
+};
+
+// How lights are picked this frame (see LightBVH.h)
+cbuffer lightTree : register(b3)
+{
+	int lightTreeNodeCount; // Zero when there are no point or spot lights
+	int lightTreeSamples; // Picks per pixel, or zero to loop over the cluster instead
+	uint lightTreeFrame; // Changes the random numbers each frame
+};
+
+// The tree's nodes, depth first.  Only this buffer and the cbuffer
+// above are needed to pick a light, so this can be included in a
+// ray tracer's closest hit shader as well as the pixel shaders.
+StructuredBuffer<LightBVHNode> LightTree : register(t10);
+
+// A random number in [0, 1) from a pixel, the frame and which pick
+// this is (a PCG hash)
+float LightTreeRandom(uint2 pixel, uint pick)
+{
+	uint state = (pixel.y * 65536u + pixel.x) ^ (lightTreeFrame * 747796405u) ^ (pick * 2891336453u);
+	state = state * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	word = (word >> 22u) ^ word;
+	return (word >> 8) * (1.0f / 16777216.0f);
+}
+
+// How much a node could light a point - the same bound as
+// LightBVH::Importance()
+float LightBVHImportance(LightBVHNode node, float3 p)
+{
+	if (node.Power <= 0.0f)
+		return 0.0f;
+
+	float3 outside = max(max(node.BoundsMin - p, 0.0f), p - node.BoundsMax);
+	float distanceSq = dot(outside, outside);
+	float rangeSq = node.MaxRange * node.MaxRange;
+	if (distanceSq >= rangeSq)
+		return 0.0f;
+
+	float attenuation = 1.0f - distanceSq / rangeSq;
+	attenuation *= attenuation;
+
+	// Only spot lights have a cone narrower than the whole sphere
+	float orientation = 1.0f;
+	if (node.CosThetaO > -1.0f)
+	{
+		float3 halfSize = (node.BoundsMax - node.BoundsMin) * 0.5f;
+		float3 toPoint = p - node.BoundsMin - halfSize;
+		float centerDistanceSq = dot(toPoint, toPoint);
+		float radiusSq = dot(halfSize, halfSize);
+		if (centerDistanceSq <= radiusSq)
+			return node.Power * attenuation;
+
+		// Angle to the point, less the orientation spread...
+		float cosW = clamp(dot(node.Axis, toPoint) * rsqrt(centerDistanceSq), -1.0f, 1.0f);
+		float sinW = sqrt(max(1.0f - cosW * cosW, 0.0f));
+		float sinO = sqrt(max(1.0f - node.CosThetaO * node.CosThetaO, 0.0f));
+		float cosX = 1.0f;
+		float sinX = 0.0f;
+		if (cosW < node.CosThetaO)
+		{
+			cosX = cosW * node.CosThetaO + sinW * sinO;
+			sinX = sinW * node.CosThetaO - cosW * sinO;
+		}
+
+		// ...less the angle the bounds take up
+		float sinB = min(sqrt(radiusSq / centerDistanceSq), 1.0f);
+		float cosB = sqrt(1.0f - sinB * sinB);
+		float cosAngle = 1.0f;
+		if (cosX < cosB)
+			cosAngle = cosX * cosB + sinX * sinB;
+		if (cosAngle <= node.CosThetaE)
+			return 0.0f;
+
+		orientation = pow(cosAngle, node.MinSpotFalloff);
+	}
+
+	return node.Power * attenuation * orientation;
+}
+
+// Picks a point or spot light for a point with a random number in
+// [0, 1), going down the tree in proportion to the children's
+// importance.  Returns false when no light reaches the point,
+// otherwise the light's index and the chance it had of being picked.
+bool SampleLightBVH(float3 p, float u, out uint lightIndex, out float probability)
+{
+	lightIndex = 0;
+	probability = 0.0f;
+	if (lightTreeNodeCount <= 0 || LightBVHImportance(LightTree[0], p) <= 0.0f)
+		return false;
+
+	probability = 1.0f;
+	uint index = 0;
+	[loop]
+	while (!LightTree[index].IsLeaf)
+	{
+		uint second = LightTree[index].SecondChildOrLight;
+		float first = LightBVHImportance(LightTree[index + 1], p);
+		float total = first + LightBVHImportance(LightTree[second], p);
+		if (total <= 0.0f)
+			return false;
+
+		float chance = first / total;
+		if (u < chance)
+		{
+			u = min(u / chance, 0.99999994f);
+			probability *= chance;
+			index = index + 1;
+		}
+		else
+		{
+			u = min((u - chance) / (1.0f - chance), 0.99999994f);
+			probability *= 1.0f - chance;
+			index = second;
+		}
+	}
+
+	lightIndex = LightTree[index].SecondChildOrLight;
+	return true;
+}
+
+#endif
@@ -0,0 +1,533 @@
+#include "LightClusters.h"
+
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "Random.h"
+
+using namespace DirectX;
+
+namespace
+{
+	double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Four neighboring values of a structure of arrays
+	XMVECTOR Load4(const float* values)
+	{
+		return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(values));
+	}
+
+	// A point (w = 1) or direction (w = 0) times a matrix, as rows
+	XMFLOAT4 Transform(const XMFLOAT4X4& m, float x, float y, float z, float w)
+	{
+		return XMFLOAT4(
+			x * m.m[0][0] + y * m.m[1][0] + z * m.m[2][0] + w * m.m[3][0],
+			x * m.m[0][1] + y * m.m[1][1] + z * m.m[2][1] + w * m.m[3][1],
+			x * m.m[0][2] + y * m.m[1][2] + z * m.m[2][2] + w * m.m[3][2],
+			x * m.m[0][3] + y * m.m[1][3] + z * m.m[2][3] + w * m.m[3][3]);
+	}
+
+	// Where an NDC (x, y) ray reaches a view depth - the ray runs
+	// between the near (z = 0) and far (z = 1) planes, which works
+	// for perspective and orthographic projections alike
+	XMFLOAT3 PointAtDepth(const XMFLOAT4X4& invProj, float ndcX, float ndcY, float depth)
+	{
+		XMFLOAT4 a = Transform(invProj, ndcX, ndcY, 0.0f, 1.0f);
+		XMFLOAT4 b = Transform(invProj, ndcX, ndcY, 1.0f, 1.0f);
+		XMFLOAT3 nearPoint(a.x / a.w, a.y / a.w, a.z / a.w);
+		XMFLOAT3 farPoint(b.x / b.w, b.y / b.w, b.z / b.w);
+		float t = (depth - nearPoint.z) / (farPoint.z - nearPoint.z);
+		return XMFLOAT3(
+			nearPoint.x + (farPoint.x - nearPoint.x) * t,
+			nearPoint.y + (farPoint.y - nearPoint.y) * t,
+			depth);
+	}
+
+	// Random lights for the benchmark, spread through the view with
+	// a quarter of them spot lights, after a few directional lights
+	void BenchmarkLights(std::vector<Light>& lights, int count, PCG32& random)
+	{
+		lights.clear();
+		for (int i = 0; i < count; i++)
+		{
+			Light light = {};
+			light.Color = XMFLOAT3(1, 1, 1);
+			light.Intensity = 1.0f;
+			if (i < 3)
+			{
+				light.Type = LIGHT_TYPE_DIRECTIONAL;
+				light.Direction = XMFLOAT3(random.Range(-1.0f, 1.0f), -1.0f, random.Range(-1.0f, 1.0f));
+				lights.push_back(light);
+				continue;
+			}
+
+			light.Type = i % 4 == 0 ? LIGHT_TYPE_SPOT : LIGHT_TYPE_POINT;
+			light.Position = XMFLOAT3(random.Range(-60.0f, 60.0f), random.Range(-10.0f, 10.0f), random.Range(-10.0f, 110.0f));
+			light.Range = random.Range(1.0f, 6.0f);
+			if (light.Type == LIGHT_TYPE_SPOT)
+			{
+				XMFLOAT3 direction(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f));
+				XMStoreFloat3(&light.Direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+				light.SpotFalloff = random.Range(2.0f, 40.0f);
+			}
+			lights.push_back(light);
+		}
+	}
+}
+
+LightClusters::LightClusters() :
+	cachedNear(0.0f),
+	cachedFar(0.0f),
+	boundsValid(false),
+	depthScale(0.0f),
+	depthBias(0.0f),
+	globalLightCount(0),
+	overflowCount(0),
+	maxClusterLights(0)
+{
+	memset(&cachedProjection, 0, sizeof(cachedProjection));
+	clusterRanges.resize(LIGHT_CLUSTER_COUNT, XMUINT2(0, 0));
+}
+
+// --------------------------------------------------------
+// Depth slices are spaced exponentially, so froxels stay
+// roughly cube shaped from the near plane to the far plane.
+// Each froxel's box holds its tile's corner rays at both of
+// its slice's depths.
+// --------------------------------------------------------
+void LightClusters::BuildFroxelBounds(const XMFLOAT4X4& projection, float nearClip, float farClip)
+{
+	XMFLOAT4X4 invProj;
+	XMStoreFloat4x4(&invProj, XMMatrixInverse(0, XMLoadFloat4x4(&projection)));
+
+	depthScale = LIGHT_CLUSTERS_Z / logf(farClip / nearClip);
+	depthBias = -logf(nearClip) * depthScale;
+
+	sliceNear.resize(LIGHT_CLUSTERS_Z);
+	sliceFar.resize(LIGHT_CLUSTERS_Z);
+	for (int z = 0; z < LIGHT_CLUSTERS_Z; z++)
+	{
+		sliceNear[z] = nearClip * powf(farClip / nearClip, (float)z / LIGHT_CLUSTERS_Z);
+		sliceFar[z] = nearClip * powf(farClip / nearClip, (float)(z + 1) / LIGHT_CLUSTERS_Z);
+	}
+
+	std::vector<float>* arrays[] = { &boundsMinX, &boundsMinY, &boundsMinZ, &boundsMaxX, &boundsMaxY, &boundsMaxZ, &sphereX, &sphereY, &sphereZ, &sphereRadius };
+	for (std::vector<float>* a : arrays)
+		a->resize(LIGHT_CLUSTER_COUNT);
+	columnMinX.assign(LIGHT_CLUSTERS_Z * LIGHT_CLUSTERS_X, FLT_MAX);
+	columnMaxX.assign(LIGHT_CLUSTERS_Z * LIGHT_CLUSTERS_X, -FLT_MAX);
+	rowMinY.assign(LIGHT_CLUSTERS_Z * LIGHT_CLUSTERS_Y, FLT_MAX);
+	rowMaxY.assign(LIGHT_CLUSTERS_Z * LIGHT_CLUSTERS_Y, -FLT_MAX);
+
+	for (int z = 0; z < LIGHT_CLUSTERS_Z; z++)
+	{
+		for (int y = 0; y < LIGHT_CLUSTERS_Y; y++)
+		{
+			for (int x = 0; x < LIGHT_CLUSTERS_X; x++)
+			{
+				// Tile rows run down the screen, NDC y runs up
+				float ndcX[2] = { -1.0f + 2.0f * x / LIGHT_CLUSTERS_X, -1.0f + 2.0f * (x + 1) / LIGHT_CLUSTERS_X };
+				float ndcY[2] = { 1.0f - 2.0f * y / LIGHT_CLUSTERS_Y, 1.0f - 2.0f * (y + 1) / LIGHT_CLUSTERS_Y };
+				float depths[2] = { sliceNear[z], sliceFar[z] };
+
+				XMFLOAT3 boxMin(FLT_MAX, FLT_MAX, FLT_MAX);
+				XMFLOAT3 boxMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+				for (int corner = 0; corner < 8; corner++)
+				{
+					XMFLOAT3 p = PointAtDepth(invProj, ndcX[corner & 1], ndcY[(corner >> 1) & 1], depths[corner >> 2]);
+					boxMin = XMFLOAT3(fminf(boxMin.x, p.x), fminf(boxMin.y, p.y), fminf(boxMin.z, p.z));
+					boxMax = XMFLOAT3(fmaxf(boxMax.x, p.x), fmaxf(boxMax.y, p.y), fmaxf(boxMax.z, p.z));
+				}
+
+				int cluster = (z * LIGHT_CLUSTERS_Y + y) * LIGHT_CLUSTERS_X + x;
+				boundsMinX[cluster] = boxMin.x;
+				boundsMinY[cluster] = boxMin.y;
+				boundsMinZ[cluster] = boxMin.z;
+				boundsMaxX[cluster] = boxMax.x;
+				boundsMaxY[cluster] = boxMax.y;
+				boundsMaxZ[cluster] = boxMax.z;
+
+				XMFLOAT3 half((boxMax.x - boxMin.x) * 0.5f, (boxMax.y - boxMin.y) * 0.5f, (boxMax.z - boxMin.z) * 0.5f);
+				sphereX[cluster] = boxMin.x + half.x;
+				sphereY[cluster] = boxMin.y + half.y;
+				sphereZ[cluster] = boxMin.z + half.z;
+				sphereRadius[cluster] = sqrtf(half.x * half.x + half.y * half.y + half.z * half.z);
+
+				int column = z * LIGHT_CLUSTERS_X + x;
+				int row = z * LIGHT_CLUSTERS_Y + y;
+				columnMinX[column] = fminf(columnMinX[column], boxMin.x);
+				columnMaxX[column] = fmaxf(columnMaxX[column], boxMax.x);
+				rowMinY[row] = fminf(rowMinY[row], boxMin.y);
+				rowMaxY[row] = fmaxf(rowMaxY[row], boxMax.y);
+			}
+		}
+	}
+}
+
+void LightClusters::Build(const Light* lights, int lightCount, const XMFLOAT4X4& view, const XMFLOAT4X4& projection,
+	float nearClip, float farClip, JobSystem* jobs)
+{
+	// Froxels only change with the projection
+	if (!boundsValid || nearClip != cachedNear || farClip != cachedFar ||
+		memcmp(&projection, &cachedProjection, sizeof(XMFLOAT4X4)) != 0)
+	{
+		BuildFroxelBounds(projection, nearClip, farClip);
+		cachedProjection = projection;
+		cachedNear = nearClip;
+		cachedFar = farClip;
+		boundsValid = true;
+	}
+
+	// Lights into view space, with each spot light's cone as the
+	// angle where its penumbra falls to the cutoff.  That's never
+	// wider than 90 degrees, as the shaders saturate the cosine.
+	viewLights.clear();
+	globalLightCount = 0;
+	for (int i = 0; i < lightCount; i++)
+	{
+		const Light& light = lights[i];
+		if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+		{
+			globalLightCount++;
+			continue;
+		}
+		if (light.Type != LIGHT_TYPE_POINT && light.Type != LIGHT_TYPE_SPOT)
+			continue;
+
+		ViewLight viewLight = {};
+		viewLight.Index = i;
+		viewLight.Range = light.Range;
+		XMFLOAT4 position = Transform(view, light.Position.x, light.Position.y, light.Position.z, 1.0f);
+		viewLight.Position = XMFLOAT3(position.x, position.y, position.z);
+
+		XMFLOAT4 direction = Transform(view, light.Direction.x, light.Direction.y, light.Direction.z, 0.0f);
+		float length = sqrtf(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+		viewLight.Spot = light.Type == LIGHT_TYPE_SPOT && light.SpotFalloff > 0.0f && length > 0.0f;
+		if (viewLight.Spot)
+		{
+			viewLight.Direction = XMFLOAT3(direction.x / length, direction.y / length, direction.z / length);
+			viewLight.ConeCos = powf(SPOT_LIGHT_CUTOFF, 1.0f / light.SpotFalloff);
+			viewLight.ConeSin = sqrtf(1.0f - viewLight.ConeCos * viewLight.ConeCos);
+		}
+		viewLights.push_back(viewLight);
+	}
+
+	// Each slice fills its own clusters
+	scratchIndices.resize((size_t)LIGHT_CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+	scratchCounts.assign(LIGHT_CLUSTER_COUNT, 0);
+	sliceOverflows.assign(LIGHT_CLUSTERS_Z, 0);
+	if (jobs)
+		jobs->ParallelFor(LIGHT_CLUSTERS_Z, [&](int slice) { AssignSlice(slice); });
+	else
+		for (int slice = 0; slice < LIGHT_CLUSTERS_Z; slice++)
+			AssignSlice(slice);
+
+	// Pack them together after the directional lights
+	lightIndices.clear();
+	for (int i = 0; i < lightCount; i++)
+		if (lights[i].Type == LIGHT_TYPE_DIRECTIONAL)
+			lightIndices.push_back((uint32_t)i);
+
+	overflowCount = 0;
+	maxClusterLights = 0;
+	for (int z = 0; z < LIGHT_CLUSTERS_Z; z++)
+		overflowCount += sliceOverflows[z];
+	for (int cluster = 0; cluster < LIGHT_CLUSTER_COUNT; cluster++)
+	{
+		int count = scratchCounts[cluster];
+		const uint32_t* first = &scratchIndices[(size_t)cluster * MAX_LIGHTS_PER_CLUSTER];
+		clusterRanges[cluster] = XMUINT2((uint32_t)lightIndices.size(), (uint32_t)count);
+		lightIndices.insert(lightIndices.end(), first, first + count);
+		maxClusterLights = count > maxClusterLights ? count : maxClusterLights;
+	}
+}
+
+// --------------------------------------------------------
+// Every light is checked against the slice's depth range, then
+// the columns and rows it reaches.  The froxels in that rectangle
+// are tested four at a time - a row of 16 tiles is four loads.
+// --------------------------------------------------------
+void LightClusters::AssignSlice(int slice)
+{
+	static_assert(LIGHT_CLUSTERS_X % 4 == 0, "Froxels are tested four to a row at a time");
+
+	XMVECTOR zero = XMVectorZero();
+	int sliceStart = slice * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_X;
+	const float* columnMin = &columnMinX[slice * LIGHT_CLUSTERS_X];
+	const float* columnMax = &columnMaxX[slice * LIGHT_CLUSTERS_X];
+	const float* rowMin = &rowMinY[slice * LIGHT_CLUSTERS_Y];
+	const float* rowMax = &rowMaxY[slice * LIGHT_CLUSTERS_Y];
+
+	for (size_t l = 0; l < viewLights.size(); l++)
+	{
+		const ViewLight& light = viewLights[l];
+		const XMFLOAT3& p = light.Position;
+		float r = light.Range;
+		if (p.z + r < sliceNear[slice] || p.z - r > sliceFar[slice])
+			continue;
+
+		int x0 = 0, x1 = LIGHT_CLUSTERS_X - 1;
+		while (x0 <= x1 && columnMax[x0] < p.x - r) x0++;
+		while (x1 >= x0 && columnMin[x1] > p.x + r) x1--;
+		int y0 = 0, y1 = LIGHT_CLUSTERS_Y - 1;
+		while (y0 <= y1 && rowMin[y0] > p.y + r) y0++;
+		while (y1 >= y0 && rowMax[y1] < p.y - r) y1--;
+		if (x0 > x1 || y0 > y1)
+			continue;
+
+		XMVECTOR cx = XMVectorReplicate(p.x);
+		XMVECTOR cy = XMVectorReplicate(p.y);
+		XMVECTOR cz = XMVectorReplicate(p.z);
+		XMVECTOR radiusSq = XMVectorReplicate(r * r);
+		XMVECTOR dirX = XMVectorReplicate(light.Direction.x);
+		XMVECTOR dirY = XMVectorReplicate(light.Direction.y);
+		XMVECTOR dirZ = XMVectorReplicate(light.Direction.z);
+		XMVECTOR coneCos = XMVectorReplicate(light.ConeCos);
+		XMVECTOR coneSin = XMVectorReplicate(light.ConeSin);
+		XMVECTOR range = XMVectorReplicate(r);
+
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int group = x0 / 4; group <= x1 / 4; group++)
+			{
+				int first = sliceStart + y * LIGHT_CLUSTERS_X + group * 4;
+
+				// Sphere vs box: the squared distance to the nearest point
+				XMVECTOR dx = XMVectorMax(XMVectorMax(XMVectorSubtract(Load4(&boundsMinX[first]), cx), zero), XMVectorSubtract(cx, Load4(&boundsMaxX[first])));
+				XMVECTOR dy = XMVectorMax(XMVectorMax(XMVectorSubtract(Load4(&boundsMinY[first]), cy), zero), XMVectorSubtract(cy, Load4(&boundsMaxY[first])));
+				XMVECTOR dz = XMVectorMax(XMVectorMax(XMVectorSubtract(Load4(&boundsMinZ[first]), cz), zero), XMVectorSubtract(cz, Load4(&boundsMaxZ[first])));
+				XMVECTOR distanceSq = XMVectorAdd(XMVectorAdd(XMVectorMultiply(dx, dx), XMVectorMultiply(dy, dy)), XMVectorMultiply(dz, dz));
+				XMVECTOR touches = XMVectorLessOrEqual(distanceSq, radiusSq);
+
+				// Cone vs the froxel's bounding sphere (Wronski): out if
+				// the sphere is wholly outside the cone's angle, past its
+				// range or behind the light
+				if (light.Spot)
+				{
+					XMVECTOR sphereRadiusV = Load4(&sphereRadius[first]);
+					XMVECTOR vx = XMVectorSubtract(Load4(&sphereX[first]), cx);
+					XMVECTOR vy = XMVectorSubtract(Load4(&sphereY[first]), cy);
+					XMVECTOR vz = XMVectorSubtract(Load4(&sphereZ[first]), cz);
+					XMVECTOR lengthSq = XMVectorAdd(XMVectorAdd(XMVectorMultiply(vx, vx), XMVectorMultiply(vy, vy)), XMVectorMultiply(vz, vz));
+					XMVECTOR along = XMVectorAdd(XMVectorAdd(XMVectorMultiply(vx, dirX), XMVectorMultiply(vy, dirY)), XMVectorMultiply(vz, dirZ));
+					XMVECTOR across = XMVectorSqrt(XMVectorMax(XMVectorSubtract(lengthSq, XMVectorMultiply(along, along)), zero));
+					XMVECTOR closest = XMVectorSubtract(XMVectorMultiply(coneCos, across), XMVectorMultiply(along, coneSin));
+					touches = XMVectorAndInt(touches, XMVectorLessOrEqual(closest, sphereRadiusV));
+					touches = XMVectorAndInt(touches, XMVectorLessOrEqual(along, XMVectorAdd(sphereRadiusV, range)));
+					touches = XMVectorAndInt(touches, XMVectorGreaterOrEqual(along, XMVectorNegate(sphereRadiusV)));
+				}
+
+				uint32_t lanes[4];
+				XMStoreInt4(lanes, touches);
+				for (int lane = 0; lane < 4; lane++)
+				{
+					int x = group * 4 + lane;
+					if (!lanes[lane] || x < x0 || x > x1)
+						continue;
+
+					int cluster = first + lane;
+					int& count = scratchCounts[cluster];
+					if (count == MAX_LIGHTS_PER_CLUSTER)
+					{
+						sliceOverflows[slice]++;
+						continue;
+					}
+					scratchIndices[(size_t)cluster * MAX_LIGHTS_PER_CLUSTER + count++] = (uint32_t)light.Index;
+				}
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// The same tests as AssignSlice(), one froxel at a time and
+// in the same order, so the results match exactly
+// --------------------------------------------------------
+bool LightClusters::LightTouchesFroxel(const ViewLight& light, int cluster) const
+{
+	const XMFLOAT3& p = light.Position;
+	float dx = fmaxf(fmaxf(boundsMinX[cluster] - p.x, 0.0f), p.x - boundsMaxX[cluster]);
+	float dy = fmaxf(fmaxf(boundsMinY[cluster] - p.y, 0.0f), p.y - boundsMaxY[cluster]);
+	float dz = fmaxf(fmaxf(boundsMinZ[cluster] - p.z, 0.0f), p.z - boundsMaxZ[cluster]);
+	if (dx * dx + dy * dy + dz * dz > light.Range * light.Range)
+		return false;
+	if (!light.Spot)
+		return true;
+
+	float radius = sphereRadius[cluster];
+	float vx = sphereX[cluster] - p.x;
+	float vy = sphereY[cluster] - p.y;
+	float vz = sphereZ[cluster] - p.z;
+	float lengthSq = vx * vx + vy * vy + vz * vz;
+	float along = vx * light.Direction.x + vy * light.Direction.y + vz * light.Direction.z;
+	float across = sqrtf(fmaxf(lengthSq - along * along, 0.0f));
+	float closest = light.ConeCos * across - along * light.ConeSin;
+	return closest <= radius && along <= radius + light.Range && along >= -radius;
+}
+
+int LightClusters::GetCluster(const XMFLOAT3& viewPosition) const
+{
+	XMFLOAT4 clip = Transform(cachedProjection, viewPosition.x, viewPosition.y, viewPosition.z, 1.0f);
+	float u = clip.x / clip.w * 0.5f + 0.5f;
+	float v = 0.5f - clip.y / clip.w * 0.5f;
+
+	int x = (int)floorf(u * LIGHT_CLUSTERS_X);
+	int y = (int)floorf(v * LIGHT_CLUSTERS_Y);
+	int z = (int)floorf(logf(viewPosition.z) * depthScale + depthBias);
+	x = x < 0 ? 0 : (x >= LIGHT_CLUSTERS_X ? LIGHT_CLUSTERS_X - 1 : x);
+	y = y < 0 ? 0 : (y >= LIGHT_CLUSTERS_Y ? LIGHT_CLUSTERS_Y - 1 : y);
+	z = z < 0 ? 0 : (z >= LIGHT_CLUSTERS_Z ? LIGHT_CLUSTERS_Z - 1 : z);
+	return (z * LIGHT_CLUSTERS_Y + y) * LIGHT_CLUSTERS_X + x;
+}
+
+bool LightClusters::Benchmark(int iterations)
+{
+	printf("Clustered light culling (%dx%dx%d froxels, up to %d lights each):\n",
+		LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z, MAX_LIGHTS_PER_CLUSTER);
+
+	XMFLOAT3 eye(0.0f, 2.0f, -5.0f);
+	XMFLOAT3 forward(0.3f, -0.1f, 1.0f);
+	XMFLOAT3 up(0.0f, 1.0f, 0.0f);
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMLoadFloat3(&eye), XMLoadFloat3(&forward), XMLoadFloat3(&up)));
+
+	// The camera's defaults, and an orthographic one to be sure
+	// the froxels follow whatever projection they're given
+	const float nearClip = 0.01f;
+	const float farClip = 100.0f;
+	XMFLOAT4X4 projections[2];
+	XMStoreFloat4x4(&projections[0], XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, nearClip, farClip));
+	XMStoreFloat4x4(&projections[1], XMMatrixOrthographicLH(80.0f, 45.0f, nearClip, farClip));
+	const char* projectionNames[2] = { "perspective", "orthographic" };
+
+	bool passed = true;
+	PCG32 random(1234);
+	std::vector<Light> lights;
+	const int lightCounts[] = { 128, 1024, 4096, 16384 };
+	for (int projection = 0; projection < 2; projection++)
+	{
+		for (int lightCount : lightCounts)
+		{
+			// Only the correctness checks for orthographic
+			if (projection == 1 && lightCount != 1024)
+				continue;
+
+			BenchmarkLights(lights, lightCount, random);
+			printf("  %5d lights, %s:\n", lightCount, projectionNames[projection]);
+
+			// Timed on more and more threads, each against one thread
+			LightClusters single;
+			single.Build(&lights[0], lightCount, view, projections[projection], nearClip, farClip, 0);
+			bool deterministic = true;
+			unsigned int maxThreads = JobSystem::GetHardwareThreadCount();
+			for (unsigned int threads = 1; ; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads)
+			{
+				if (projection == 1)
+					break;
+
+				JobSystem threadJobs(threads);
+				LightClusters clusters;
+				double best = 1e30;
+				for (int i = 0; i < iterations; i++)
+				{
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					clusters.Build(&lights[0], lightCount, view, projections[projection], nearClip, farClip, &threadJobs);
+					double time = MillisecondsSince(start);
+					best = time < best ? time : best;
+				}
+
+				deterministic = deterministic && clusters.lightIndices == single.lightIndices;
+				printf("    %2u thread(s): %7.3f ms\n", threads, best);
+				if (threads == maxThreads)
+					break;
+			}
+
+			// Brute force: every light against every froxel
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			int mismatches = 0;
+			for (int cluster = 0; cluster < LIGHT_CLUSTER_COUNT; cluster++)
+			{
+				XMUINT2 range = single.clusterRanges[cluster];
+				unsigned int next = 0;
+				for (size_t l = 0; l < single.viewLights.size(); l++)
+				{
+					if (!single.LightTouchesFroxel(single.viewLights[l], cluster))
+						continue;
+
+					// Lists are in light order, so they can be walked together
+					// (the ones past the limit were dropped)
+					if (next < range.y && single.lightIndices[range.x + next] == (uint32_t)single.viewLights[l].Index)
+						next++;
+					else if (range.y < MAX_LIGHTS_PER_CLUSTER)
+						mismatches++;
+				}
+				mismatches += range.y - next;
+			}
+			double bruteForceTime = MillisecondsSince(start);
+
+			// Random points in the frustum: every light that reaches one
+			// has to be in its cluster
+			XMFLOAT4X4 invView;
+			XMStoreFloat4x4(&invView, XMMatrixInverse(0, XMLoadFloat4x4(&view)));
+			XMFLOAT4X4 invProj;
+			XMStoreFloat4x4(&invProj, XMMatrixInverse(0, XMLoadFloat4x4(&projections[projection])));
+			const int points = 20000;
+			int missed = 0;
+			double listLength = 0.0;
+			for (int i = 0; i < points; i++)
+			{
+				float depth = nearClip * powf(farClip / nearClip, random.NextFloat());
+				XMFLOAT3 viewPosition = PointAtDepth(invProj, random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), depth);
+				XMFLOAT4 world = Transform(invView, viewPosition.x, viewPosition.y, viewPosition.z, 1.0f);
+
+				int cluster = single.GetCluster(viewPosition);
+				XMUINT2 range = single.clusterRanges[cluster];
+				listLength += single.globalLightCount + range.y;
+				if (range.y == MAX_LIGHTS_PER_CLUSTER)
+					continue;
+
+				for (int l = 0; l < lightCount; l++)
+				{
+					const Light& light = lights[l];
+					if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+						continue;
+
+					XMFLOAT3 toPoint(world.x - light.Position.x, world.y - light.Position.y, world.z - light.Position.z);
+					float distance = sqrtf(toPoint.x * toPoint.x + toPoint.y * toPoint.y + toPoint.z * toPoint.z);
+					if (distance >= light.Range)
+						continue;
+					if (light.Type == LIGHT_TYPE_SPOT && distance > 0.0f)
+					{
+						float cosine = (toPoint.x * light.Direction.x + toPoint.y * light.Direction.y + toPoint.z * light.Direction.z) / distance;
+						if (cosine <= 0.0f || powf(cosine, light.SpotFalloff) < SPOT_LIGHT_CUTOFF)
+							continue;
+					}
+
+					bool found = false;
+					for (unsigned int j = 0; j < range.y && !found; j++)
+						found = single.lightIndices[range.x + j] == (uint32_t)l;
+					missed += found ? 0 : 1;
+				}
+			}
+
+			int usedClusters = 0;
+			for (int cluster = 0; cluster < LIGHT_CLUSTER_COUNT; cluster++)
+				usedClusters += single.clusterRanges[cluster].y > 0 ? 1 : 0;
+
+			bool ok = mismatches == 0 && missed == 0 && deterministic;
+			passed = passed && ok;
+			printf("    %d indices, %d of %d clusters used, at most %d lights in one, %d dropped\n",
+				(int)single.lightIndices.size(), usedClusters, LIGHT_CLUSTER_COUNT, single.maxClusterLights, single.overflowCount);
+			printf("    %.1f lights per pixel on average instead of %d\n", listLength / points, lightCount);
+			printf("    brute force (one at a time) %.3f ms: %d difference(s), %d light(s) missed at %d random points, results on every thread count %s - %s\n",
+				bruteForceTime, mismatches, missed, points, deterministic ? "match" : "DIFFER", ok ? "ok" : "FAILED");
+		}
+	}
+
+	return passed;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+#include "JobSystem.h"
+#include "Lights.h"
+
+// The froxel grid - screen tiles across and down, and depth slices
+// (must match LightClusters.hlsli)
+#define LIGHT_CLUSTERS_X	16
+#define LIGHT_CLUSTERS_Y	9
+#define LIGHT_CLUSTERS_Z	24
+#define LIGHT_CLUSTER_COUNT	(LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z)
+
+// Lights past this in one cluster are dropped (and counted)
+#define MAX_LIGHTS_PER_CLUSTER	256
+
+// A spot light's cone ends where its penumbra falls below this -
+// pow(cos, SpotFalloff) never quite reaches zero in the shaders
+#define SPOT_LIGHT_CUTOFF	0.001f
+
+// --------------------------------------------------------
+// Clustered light culling: the view frustum is split into a
+// grid of froxels (screen tiles by exponential depth slices),
+// and each one gets a list of the point and spot lights that
+// can reach it.  The pixel shaders work out their cluster and
+// only loop over its lights, plus the directional lights,
+// which reach everywhere and are listed once up front.
+//
+// Froxel bounds only change with the projection, so they're
+// cached.  Lights are tested against a slice's froxels four at
+// a time (sphere vs box, then cone vs sphere for spot lights),
+// a slice per job.  Each slice only writes its own clusters,
+// and lights are always added in order, so the lists are the
+// same on any number of threads.
+// --------------------------------------------------------
+class LightClusters
+{
+public:
+	LightClusters();
+
+	// Assigns the lights to clusters for this camera.  Matrices are
+	// used as rows, like the rest of the C++ code.
+	void Build(const Light* lights, int lightCount, const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection,
+		float nearClip, float farClip, JobSystem* jobs);
+
+	// Every cluster's lights, one after another (the directional
+	// lights come first and belong to no cluster)
+	const std::vector<uint32_t>& GetLightIndices() const { return lightIndices; }
+
+	// (first index, count) for each cluster, x fastest then y then z
+	const std::vector<DirectX::XMUINT2>& GetClusterRanges() const { return clusterRanges; }
+
+	int GetGlobalLightCount() const { return globalLightCount; }
+	int GetOverflowCount() const { return overflowCount; }
+	int GetMaxClusterLights() const { return maxClusterLights; }
+
+	// A view depth's slice is floor(log(depth) * scale + bias)
+	float GetDepthScale() const { return depthScale; }
+	float GetDepthBias() const { return depthBias; }
+
+	// The cluster a view space position falls in, the same way
+	// LightClusters.hlsli works it out
+	int GetCluster(const DirectX::XMFLOAT3& viewPosition) const;
+
+	// Times the assignment with more and more lights on more and
+	// more threads, and checks it against brute force: every light
+	// against every froxel one at a time, and random points in the
+	// frustum against every light that reaches them.  Returns false
+	// if a check fails.
+	static bool Benchmark(int iterations);
+
+private:
+	// What the froxel bounds were built for
+	DirectX::XMFLOAT4X4 cachedProjection;
+	float cachedNear;
+	float cachedFar;
+	bool boundsValid;
+	float depthScale;
+	float depthBias;
+
+	// View space froxel bounds, structure of arrays by cluster, and
+	// each froxel's bounding sphere for the spot light cone test
+	std::vector<float> boundsMinX, boundsMinY, boundsMinZ;
+	std::vector<float> boundsMaxX, boundsMaxY, boundsMaxZ;
+	std::vector<float> sphereX, sphereY, sphereZ, sphereRadius;
+
+	// Per slice, the x range of each column and y range of each
+	// row, to narrow down which froxels a light could touch
+	std::vector<float> columnMinX, columnMaxX;
+	std::vector<float> rowMinY, rowMaxY;
+	std::vector<float> sliceNear, sliceFar;
+
+	// This frame's lights in view space
+	struct ViewLight
+	{
+		int Index;
+		bool Spot;
+		DirectX::XMFLOAT3 Position;
+		float Range;
+		DirectX::XMFLOAT3 Direction;
+		float ConeCos;
+		float ConeSin;
+	};
+	std::vector<ViewLight> viewLights;
+
+	// Each cluster's lights before they're packed together
+	std::vector<uint32_t> scratchIndices;
+	std::vector<int> scratchCounts;
+	std::vector<int> sliceOverflows;
+
+	std::vector<uint32_t> lightIndices;
+	std::vector<DirectX::XMUINT2> clusterRanges;
+	int globalLightCount;
+	int overflowCount;
+	int maxClusterLights;
+
+	void BuildFroxelBounds(const DirectX::XMFLOAT4X4& projection, float nearClip, float farClip);
+	void AssignSlice(int slice);
+
+	// Does a view space light reach anywhere in a froxel?  One at
+	// a time, for checking the four-wide version.
+	bool LightTouchesFroxel(const ViewLight& light, int cluster) const;
+};
@@ -0,0 +1,47 @@
+// Include guard
+#ifndef _LIGHT_CLUSTERS_HLSL
+#define _LIGHT_CLUSTERS_HLSL
+
+#include "Lighting.hlsli"
+
+// Must match LightClusters.h
+#define LIGHT_CLUSTERS_X	16
+#define LIGHT_CLUSTERS_Y	9
+#define LIGHT_CLUSTERS_Z	24
+
+// Where this frame's clusters are (see LightClusters.h)
+cbuffer lightClusters : register(b2)
+{
+	float4 clusterDepthPlane; // dot with (worldPos, 1) for the view depth
+	float2 clusterScreenScale; // Clusters per pixel on each axis
+	float clusterDepthScale; // A view depth's slice is
+	float clusterDepthBias; //  floor(log(depth) * scale + bias)
+	int globalLightCount; // Directional lights, listed before every cluster
+};
+
+// Every light, and each cluster's (first index, count) into the
+// index list, which starts with the directional lights
+StructuredBuffer<Light> Lights : register(t7);
+StructuredBuffer<uint2> ClusterRanges : register(t8);
+StructuredBuffer<uint> ClusterLightIndices : register(t9);
+
+// The range of this pixel's cluster in the index list
+uint2 ClusterLightRange(float2 pixel, float3 worldPos)
+{
+	float depth = dot(clusterDepthPlane, float4(worldPos, 1.0f));
+	int3 cluster = int3(
+		int2(pixel * clusterScreenScale),
+		int(floor(log(max(depth, 1e-6f)) * clusterDepthScale + clusterDepthBias)));
+	cluster = clamp(cluster, 0, int3(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z) - 1);
+	return ClusterRanges[(cluster.z * LIGHT_CLUSTERS_Y + cluster.y) * LIGHT_CLUSTERS_X + cluster.x];
+}
+
+// The i'th light that reaches this pixel, counting the directional
+// lights first - loop up to globalLightCount + range.y
+Light ClusterLight(uint i, uint2 range)
+{
+	uint index = i < (uint)globalLightCount ? i : range.x + i - globalLightCount;
+	return Lights[ClusterLightIndices[index]];
+}
+
+#endif
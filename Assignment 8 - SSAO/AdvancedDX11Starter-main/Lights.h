@@ -2,9 +2,10 @@
 
 #include <DirectXMath.h>
 
-// This define should match your
-// MAX_LIGHTS definition in your shader(s)
-#define MAX_LIGHTS 128
+// Lights go to the shaders in a structured buffer, and each
+// pixel only loops over its cluster's (see LightClusters.h),
+// so this can be far more than a constant buffer could hold
+#define MAX_LIGHTS 4096
 
 // Light types
 // Must match definitions in shader
@@ -1,5 +1,6 @@
 
 #include <Windows.h>
+#include <string.h>
 #include "Game.h"
 
 // --------------------------------------------------------
@@ -22,6 +23,45 @@ int WINAPI WinMain(
 	// the app handle we got from WinMain
 	Game dxGame(hInstance);
 
+	// The console modes below return E_FAIL, a non-zero exit
+	// code, when a check fails, so they can run unattended
+
+	// "-ssaoreference <folder>" checks a saved SSAO capture against
+	// the CPU reference, and never needs a window or a GPU
+	const char* referenceArg = strstr(lpCmdLine, "-ssaoreference");
+	if (referenceArg)
+	{
+		referenceArg += strlen("-ssaoreference");
+		while (*referenceArg == ' ')
+			referenceArg++;
+		return dxGame.RunSSAOReference(*referenceArg ? referenceArg : "SSAOReference");
+	}
+
+	// "-ssaotests" runs the reference's checks on a generated
+	// scene instead, so they don't need a capture
+	if (strstr(lpCmdLine, "-ssaotests"))
+		return dxGame.RunSSAOTests();
+
+	// "-lightclusters" benchmarks the light cluster assignment
+	if (strstr(lpCmdLine, "-lightclusters"))
+		return dxGame.RunLightClusterBenchmark();
+
+	// "-lightbvh" checks the light BVH against uniform light picking
+	if (strstr(lpCmdLine, "-lightbvh"))
+		return dxGame.RunLightBVHBenchmark();
+
+	// "-reflectioncache" checks the shader reflection cache format
+	if (strstr(lpCmdLine, "-reflectioncache"))
+		return dxGame.RunReflectionCacheTest();
+
+	// "-framegraph" checks the SSAO frame graph on a null device
+	if (strstr(lpCmdLine, "-framegraph"))
+		return dxGame.RunFrameGraphTest();
+
+	// "-rendertargetpool" checks reuse and eviction in the pool
+	if (strstr(lpCmdLine, "-rendertargetpool"))
+		return dxGame.RunRenderTargetPoolTest();
+
 	// Result variable for function calls below
 	HRESULT hr = S_OK;
 
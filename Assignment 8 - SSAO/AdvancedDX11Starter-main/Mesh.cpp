@@ -207,6 +207,8 @@ Mesh::~Mesh() { }
 Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetVertexBuffer() { return vb; }
 Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer() { return ib; }
 unsigned int Mesh::GetIndexCount() { return numIndices; }
+const XMFLOAT3& Mesh::GetBoundsMin() { return boundsMin; }
+const XMFLOAT3& Mesh::GetBoundsMax() { return boundsMax; }
 
 
 // --------------------------------------------------------
@@ -224,6 +226,15 @@ void Mesh::CreateBuffers(Vertex* vertArray, size_t numVerts, unsigned int* index
 	// Calculate the tangents of each vertex first
 	CalculateTangents(vertArray, numVerts, indexArray, numIndices);
 
+	// Bounds for culling
+	boundsMin = numVerts > 0 ? vertArray[0].Position : XMFLOAT3(0, 0, 0);
+	boundsMax = boundsMin;
+	for (size_t i = 1; i < numVerts; i++)
+	{
+		XMStoreFloat3(&boundsMin, XMVectorMin(XMLoadFloat3(&boundsMin), XMLoadFloat3(&vertArray[i].Position)));
+		XMStoreFloat3(&boundsMax, XMVectorMax(XMLoadFloat3(&boundsMax), XMLoadFloat3(&vertArray[i].Position)));
+	}
+
 	// Create the vertex buffer
 	D3D11_BUFFER_DESC vbd = {};
 	vbd.Usage = D3D11_USAGE_IMMUTABLE;
@@ -19,6 +19,10 @@ public:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer();
 	unsigned int GetIndexCount();
 
+	// Object space bounding box of the vertices
+	const DirectX::XMFLOAT3& GetBoundsMin();
+	const DirectX::XMFLOAT3& GetBoundsMax();
+
 	// Basic mesh drawing
 	void SetBuffersAndDraw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
 
@@ -30,6 +34,9 @@ private:
 	// Total indices in this mesh
 	unsigned int numIndices;
 
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+
 	// Helper for creating buffers (in the event we add more constructor overloads)
 	void CreateBuffers(Vertex* vertArray, size_t numVerts, unsigned int* indexArray, size_t numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device);
 	void CalculateTangents(Vertex* verts, size_t numVerts, unsigned int* indices, size_t numIndices);
@@ -0,0 +1,155 @@
+#include "NormalEncoding.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	float SignNotZero(float v)
+	{
+		return v >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	// Same as the shader's UNORM write: round to the nearest step
+	float Quantize(float v, float steps)
+	{
+		return floorf(fminf(fmaxf(v, 0.0f), 1.0f) * steps + 0.5f) / steps;
+	}
+
+	XMFLOAT3 Normalize(const XMFLOAT3& v)
+	{
+		float length = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+		return length > 0.0f ? XMFLOAT3(v.x / length, v.y / length, v.z / length) : v;
+	}
+
+	// The angle between two unit vectors, in degrees (atan2 stays
+	// accurate for tiny angles, where acos doesn't)
+	float AngleDegrees(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		float cx = a.y * b.z - a.z * b.y;
+		float cy = a.z * b.x - a.x * b.z;
+		float cz = a.x * b.y - a.y * b.x;
+		float dot = a.x * b.x + a.y * b.y + a.z * b.z;
+		return atan2f(sqrtf(cx * cx + cy * cy + cz * cz), dot) * 57.2957795f;
+	}
+
+	struct AngleError
+	{
+		float Max = 0.0f;
+		double Total = 0.0;
+	};
+}
+
+XMFLOAT2 EncodeOctahedral(const XMFLOAT3& normal)
+{
+	float sum = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	float x = normal.x / sum;
+	float y = normal.y / sum;
+	if (normal.z < 0.0f)
+	{
+		// Fold the lower hemisphere over the diagonals
+		float foldedX = (1.0f - fabsf(y)) * SignNotZero(x);
+		float foldedY = (1.0f - fabsf(x)) * SignNotZero(y);
+		x = foldedX;
+		y = foldedY;
+	}
+	return XMFLOAT2(x * 0.5f + 0.5f, y * 0.5f + 0.5f);
+}
+
+XMFLOAT3 DecodeOctahedral(const XMFLOAT2& encoded)
+{
+	XMFLOAT3 n(encoded.x * 2.0f - 1.0f, encoded.y * 2.0f - 1.0f, 0.0f);
+	n.z = 1.0f - fabsf(n.x) - fabsf(n.y);
+	float t = fminf(fmaxf(-n.z, 0.0f), 1.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return Normalize(n);
+}
+
+void DecodeNormalImage(const FloatImage& encoded, FloatImage& normals)
+{
+	normals.Resize(encoded.Width, encoded.Height, 3);
+	for (int y = 0; y < encoded.Height; y++)
+	{
+		const float* source = encoded.Row(y);
+		float* dest = normals.Row(y);
+		for (int x = 0; x < encoded.Width; x++)
+		{
+			XMFLOAT3 n = DecodeOctahedral(XMFLOAT2(source[x * encoded.Channels], source[x * encoded.Channels + 1]));
+			dest[x * 3 + 0] = n.x * 0.5f + 0.5f;
+			dest[x * 3 + 1] = n.y * 0.5f + 0.5f;
+			dest[x * 3 + 2] = n.z * 0.5f + 0.5f;
+		}
+	}
+}
+
+bool TestNormalEncoding()
+{
+	printf("  Octahedral normals:\n");
+
+	// The axes, the folds (the equator and the octant edges, above
+	// and below it), then random directions
+	std::vector<XMFLOAT3> directions = {
+		XMFLOAT3(1, 0, 0), XMFLOAT3(-1, 0, 0),
+		XMFLOAT3(0, 1, 0), XMFLOAT3(0, -1, 0),
+		XMFLOAT3(0, 0, 1), XMFLOAT3(0, 0, -1) };
+	for (int i = 0; i < 64; i++)
+	{
+		float angle = i * 6.28318531f / 64;
+		directions.push_back(XMFLOAT3(cosf(angle), sinf(angle), 0.0f));
+		directions.push_back(Normalize(XMFLOAT3(cosf(angle), sinf(angle), -0.001f)));
+		directions.push_back(Normalize(XMFLOAT3(cosf(angle), 0.0f, sinf(angle))));
+		directions.push_back(Normalize(XMFLOAT3(0.0f, cosf(angle), sinf(angle))));
+	}
+
+	unsigned int seed = 12345;
+	auto next = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) / 16777216.0f; };
+	const int randomCount = 100000;
+	for (int i = 0; i < randomCount; i++)
+	{
+		// Uniform on the sphere
+		float z = next() * 2.0f - 1.0f;
+		float angle = next() * 6.28318531f;
+		float r = sqrtf(fmaxf(1.0f - z * z, 0.0f));
+		directions.push_back(XMFLOAT3(r * cosf(angle), r * sinf(angle), z));
+	}
+
+	AngleError exact, octahedral16, rgb8;
+	int outOfRange = 0;
+	for (size_t i = 0; i < directions.size(); i++)
+	{
+		const XMFLOAT3& n = directions[i];
+		XMFLOAT2 encoded = EncodeOctahedral(n);
+		if (encoded.x < 0.0f || encoded.x > 1.0f || encoded.y < 0.0f || encoded.y > 1.0f)
+			outOfRange++;
+
+		XMFLOAT3 decoded = DecodeOctahedral(encoded);
+		XMFLOAT3 quantized = DecodeOctahedral(XMFLOAT2(Quantize(encoded.x, 65535.0f), Quantize(encoded.y, 65535.0f)));
+		XMFLOAT3 old = Normalize(XMFLOAT3(
+			Quantize(n.x * 0.5f + 0.5f, 255.0f) * 2.0f - 1.0f,
+			Quantize(n.y * 0.5f + 0.5f, 255.0f) * 2.0f - 1.0f,
+			Quantize(n.z * 0.5f + 0.5f, 255.0f) * 2.0f - 1.0f));
+
+		AngleError* errors[3] = { &exact, &octahedral16, &rgb8 };
+		XMFLOAT3 results[3] = { decoded, quantized, old };
+		for (int e = 0; e < 3; e++)
+		{
+			float angle = AngleDegrees(n, results[e]);
+			errors[e]->Max = fmaxf(errors[e]->Max, angle);
+			errors[e]->Total += angle;
+		}
+	}
+
+	// Float round trips are exact but for rounding, and 16 bits
+	// should be well under the 8 bit normals' error
+	bool passed = outOfRange == 0 && exact.Max < 0.01f && octahedral16.Max < 0.02f && octahedral16.Max < rgb8.Max;
+	double count = (double)directions.size();
+	printf("    %d directions, %d encoded out of 0-1\n", (int)directions.size(), outOfRange);
+	printf("    Round trip error (degrees):  %.5f max  %.5f mean\n", exact.Max, exact.Total / count);
+	printf("    2x16 bit octahedral (4 B):   %.5f max  %.5f mean\n", octahedral16.Max, octahedral16.Total / count);
+	printf("    3x8 bit RGB, before (4 B):   %.5f max  %.5f mean - %s\n", rgb8.Max, rgb8.Total / count, passed ? "ok" : "FAILED");
+	return passed;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include "FloatImage.h"
+
+// --------------------------------------------------------
+// CPU versions of GBuffer.hlsli's octahedral normal encoding:
+// a unit vector is projected onto an octahedron, the lower half
+// folded over the upper one, and the resulting square stored as
+// two 0-1 values (the G-buffer keeps them as 16 bit UNORMs).
+// --------------------------------------------------------
+DirectX::XMFLOAT2 EncodeOctahedral(const DirectX::XMFLOAT3& normal);
+DirectX::XMFLOAT3 DecodeOctahedral(const DirectX::XMFLOAT2& encoded);
+
+// Turns a two channel image of encoded normals into the three
+// channel, 0-1 (n * 0.5 + 0.5) normals SSAOReference expects
+void DecodeNormalImage(const FloatImage& encoded, FloatImage& normals);
+
+// Round trips random directions, the axes and the octahedron's
+// folds through the encoding, with and without 16 bit rounding,
+// and compares the angular error to the 8 bit RGB normals the
+// G-buffer used before.  Returns false if a check fails.
+bool TestNormalEncoding();
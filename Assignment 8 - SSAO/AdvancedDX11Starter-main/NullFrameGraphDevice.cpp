@@ -0,0 +1,49 @@
+#include "NullFrameGraphDevice.h"
+
+NullFrameGraphDevice::NullFrameGraphDevice() :
+	liveBytes(0),
+	peakBytes(0),
+	errorCount(0)
+{
+}
+
+void NullFrameGraphDevice::CreateTexture(unsigned int physicalIndex, const FrameGraphTextureDesc& desc)
+{
+	if (physicalIndex >= textures.size())
+	{
+		textures.resize(physicalIndex + 1);
+		created.resize(physicalIndex + 1, false);
+	}
+
+	// The graph should never create the same texture twice
+	// without releasing it first
+	if (created[physicalIndex])
+	{
+		errorCount++;
+		liveBytes -= textures[physicalIndex].GetSizeInBytes();
+	}
+
+	textures[physicalIndex] = desc;
+	created[physicalIndex] = true;
+	liveBytes += desc.GetSizeInBytes();
+	if (liveBytes > peakBytes)
+		peakBytes = liveBytes;
+
+	events.push_back("Create " + std::to_string(physicalIndex));
+}
+
+void NullFrameGraphDevice::ClearTexture(unsigned int physicalIndex, const float /*color*/[4])
+{
+	if (physicalIndex >= created.size() || !created[physicalIndex])
+		errorCount++;
+
+	events.push_back("Clear " + std::to_string(physicalIndex));
+}
+
+void NullFrameGraphDevice::ReleaseTextures()
+{
+	textures.clear();
+	created.clear();
+	liveBytes = 0;
+	events.push_back("Release");
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "FrameGraph.h"
+
+// --------------------------------------------------------
+// Stands in for a real device when compiling and running a
+// frame graph without a GPU.
+//
+// Nothing is allocated - the device just keeps track of the
+// textures the graph asked for, how many bytes are alive at
+// once, and every create, clear and release in order, so the
+// graph's decisions can be checked on any platform.
+// --------------------------------------------------------
+class NullFrameGraphDevice : public IFrameGraphDevice
+{
+public:
+	NullFrameGraphDevice();
+
+	// IFrameGraphDevice
+	void CreateTexture(unsigned int physicalIndex, const FrameGraphTextureDesc& desc);
+	void ClearTexture(unsigned int physicalIndex, const float color[4]);
+	void ReleaseTextures();
+
+	// Lets passes add themselves to the event log as they run
+	void Record(const std::string& event) { events.push_back(event); }
+
+	const std::vector<std::string>& GetEvents() { return events; }
+	void ClearEvents() { events.clear(); }
+
+	unsigned int GetTextureCount() { return (unsigned int)textures.size(); }
+	unsigned long long GetLiveBytes() { return liveBytes; }
+	unsigned long long GetPeakBytes() { return peakBytes; }
+
+	// Clears of textures that were never created, and the like
+	unsigned int GetErrorCount() { return errorCount; }
+
+private:
+	std::vector<FrameGraphTextureDesc> textures;
+	std::vector<bool> created;
+	std::vector<std::string> events;
+
+	unsigned long long liveBytes;
+	unsigned long long peakBytes;
+	unsigned int errorCount;
+};
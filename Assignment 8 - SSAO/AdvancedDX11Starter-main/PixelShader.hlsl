@@ -1,8 +1,7 @@
 
 #include "Lighting.hlsli"
-
-// How many lights could we handle?
-#define MAX_LIGHTS 128
+#include "LightClusters.hlsli"
+#include "GBuffer.hlsli"
 
 // Data that can change per material
 cbuffer perMaterial : register(b0)
@@ -18,11 +17,7 @@ cbuffer perMaterial : register(b0)
 // Data that only changes once per frame
 cbuffer perFrame : register(b1)
 {
-	// An array of light data
-	Light lights[MAX_LIGHTS];
-
-	// The amount of lights THIS FRAME
-	int lightCount;
+	// Lights come from this pixel's cluster (see LightClusters.hlsli)
 
 	// Needed for specular (reflection) calculation
 	float3 cameraPosition;
@@ -45,9 +40,8 @@ struct VertexToPixel
 struct PS_Output
 {
     float4 color : SV_TARGET0; // Render target index 0
-    float4 normals : SV_TARGET1; // Index 1
+    float2 normals : SV_TARGET1; // Index 1 - octahedral (depths come from the depth buffer)
     float4 ambientColor : SV_Target2;
-    float depths : SV_TARGET3;
     
     //float4 colorNoAmbient : SV_TARGET0;
     //float4 ambientColor : SV_TARGET1;
@@ -94,22 +88,25 @@ PS_Output main(VertexToPixel input) : SV_TARGET
 	// Total color for this pixel
 	float3 totalColor = float3(0,0,0);
 
-	// Loop through all lights this frame
-	for(int i = 0; i < lightCount; i++)
+	// Loop through the lights that can reach this pixel's cluster
+	uint2 clusterRange = ClusterLightRange(input.screenPosition.xy, input.worldPos);
+	for(uint i = 0; i < globalLightCount + clusterRange.y; i++)
 	{
+		Light light = ClusterLight(i, clusterRange);
+
 		// Which kind of light?
-		switch (lights[i].Type)
+		switch (light.Type)
 		{
 		case LIGHT_TYPE_DIRECTIONAL:
-			totalColor += DirLight(lights[i], input.normal, input.worldPos, cameraPosition, specPower, surfaceColor.rgb);
+			totalColor += DirLight(light, input.normal, input.worldPos, cameraPosition, specPower, surfaceColor.rgb);
 			break;
 
 		case LIGHT_TYPE_POINT:
-			totalColor += PointLight(lights[i], input.normal, input.worldPos, cameraPosition, specPower, surfaceColor.rgb);
+			totalColor += PointLight(light, input.normal, input.worldPos, cameraPosition, specPower, surfaceColor.rgb);
 			break;
 
 		case LIGHT_TYPE_SPOT:
-			totalColor += SpotLight(lights[i], input.normal, input.worldPos, cameraPosition, specPower, surfaceColor.rgb);
+			totalColor += SpotLight(light, input.normal, input.worldPos, cameraPosition, specPower, surfaceColor.rgb);
 			break;
 		}
 	}
@@ -133,9 +130,8 @@ PS_Output main(VertexToPixel input) : SV_TARGET
 	
     PS_Output output;
     output.color = float4(pow(totalColor, 1.0f / 2.2f), 1);
-    output.normals = float4(input.normal * 0.5f + 0.5f, 1);
+    output.normals = EncodeNormal(input.normal);
     output.ambientColor = float4(pow(indirectDiffuse, 1.0f / 2.2f), 1);
-    output.depths = input.screenPosition.z;
     return output;
 	
 	
@@ -1,8 +1,8 @@
 
 #include "Lighting.hlsli"
-
-// How many lights could we handle?
-#define MAX_LIGHTS 128
+#include "LightClusters.hlsli"
+#include "LightBVH.hlsli"
+#include "GBuffer.hlsli"
 
 // Data that can change per material
 cbuffer perMaterial : register(b0)
@@ -18,11 +18,7 @@ cbuffer perMaterial : register(b0)
 // Data that only changes once per frame
 cbuffer perFrame : register(b1)
 {
-	// An array of light data
-	Light lights[MAX_LIGHTS];
-
-	// The amount of lights THIS FRAME
-	int lightCount;
+	// Lights come from this pixel's cluster (see LightClusters.hlsli)
 
 	// Needed for specular (reflection) calculation
 	float3 cameraPosition;
@@ -45,9 +41,8 @@ struct VertexToPixel
 struct PS_Output
 {
     float4 color : SV_TARGET0; // Render target index 0
-    float4 normals : SV_TARGET1; // Index 1
+    float2 normals : SV_TARGET1; // Index 1 - octahedral (depths come from the depth buffer)
     float4 ambientColor : SV_Target2;
-    float depths : SV_Target3;
 };
 
 
@@ -95,26 +90,49 @@ PS_Output main(VertexToPixel input) : SV_TARGET
 	// Total color for this pixel
 	float3 totalColor = float3(0,0,0);
 
-	// Loop through all lights this frame
-	for(int i = 0; i < lightCount; i++)
+	// Loop through the lights that can reach this pixel's cluster, or
+	// just the directional lights when the rest are picked from the tree
+	uint2 clusterRange = ClusterLightRange(input.screenPosition.xy, input.worldPos);
+	uint loopedLights = globalLightCount + (lightTreeSamples > 0 ? 0 : clusterRange.y);
+	for(uint i = 0; i < loopedLights; i++)
 	{
+		Light light = ClusterLight(i, clusterRange);
+
 		// Which kind of light?
-		switch (lights[i].Type)
+		switch (light.Type)
 		{
 		case LIGHT_TYPE_DIRECTIONAL:
-			totalColor += DirLightPBR(lights[i], input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
+			totalColor += DirLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
 			break;
 
 		case LIGHT_TYPE_POINT:
-			totalColor += PointLightPBR(lights[i], input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
+			totalColor += PointLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
 			break;
 
 		case LIGHT_TYPE_SPOT:
-			totalColor += SpotLightPBR(lights[i], input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
+			totalColor += SpotLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
 			break;
 		}
 	}
 
+	// A few point and spot lights picked in proportion to how much they
+	// could light this pixel, each weighted by one over its chance of
+	// being picked - noisy, but the same on average as every light
+	for (int s = 0; s < lightTreeSamples; s++)
+	{
+		uint lightIndex;
+		float probability;
+		float u = LightTreeRandom((uint2)input.screenPosition.xy, s);
+		if (!SampleLightBVH(input.worldPos, u, lightIndex, probability))
+			continue;
+
+		Light light = Lights[lightIndex];
+		float3 lightColor = light.Type == LIGHT_TYPE_SPOT ?
+			SpotLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor) :
+			PointLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
+		totalColor += lightColor / (probability * lightTreeSamples);
+	}
+
 	// Calculate requisite reflection vectors
     float3 viewToCam = normalize(cameraPosition - input.worldPos);
     float3 viewRefl = normalize(reflect(-viewToCam, input.normal));
@@ -141,9 +159,8 @@ PS_Output main(VertexToPixel input) : SV_TARGET
 	
     PS_Output output;
     output.color = float4(pow(totalColor, 1.0f / 2.2f), 1);
-    output.normals = float4(input.normal * 0.5f + 0.5f, 1);
+    output.normals = EncodeNormal(input.normal);
     output.ambientColor = float4(pow(balancedDiff, 1.0f / 2.2f), 1);
-    output.depths = input.screenPosition.z;
     return output;
 	
 	// Gamma correction
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+// --------------------------------------------------------
+// A small, fast random number generator with no global state.
+//
+// Each generator is an independent object, so every system
+// (or thread) can own one and get the same sequence from
+// the same seed every time it runs.
+// --------------------------------------------------------
+
+// --------------------------------------------------------
+// PCG32 (XSH-RR variant) - 64 bits of state, 32 bit output.
+// Different stream values give unrelated sequences even from
+// the same seed.
+// --------------------------------------------------------
+class PCG32
+{
+public:
+	PCG32(uint64_t seed = 0x853C49E6748FEA9BULL, uint64_t stream = 0xDA3E39CB94B95BDBULL) { Seed(seed, stream); }
+
+	void Seed(uint64_t seed, uint64_t stream = 0xDA3E39CB94B95BDBULL)
+	{
+		state = 0;
+		increment = (stream << 1) | 1;
+		Next();
+		state += seed;
+		Next();
+	}
+
+	uint32_t Next()
+	{
+		uint64_t old = state;
+		state = old * 6364136223846793005ULL + increment;
+		uint32_t xorShifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+		uint32_t rot = (uint32_t)(old >> 59);
+		return (xorShifted >> rot) | (xorShifted << ((32 - rot) & 31));
+	}
+
+	// Uniform float in [0, 1), from the top 24 bits
+	float NextFloat() { return (Next() >> 8) * (1.0f / 16777216.0f); }
+
+	// Uniform float in [min, max)
+	float Range(float min, float max) { return NextFloat() * (max - min) + min; }
+
+	// Uniform integer in [0, bound), without modulo bias
+	uint32_t Range(uint32_t bound)
+	{
+		uint64_t m = (uint64_t)Next() * bound;
+		uint32_t low = (uint32_t)m;
+		if (low < bound)
+		{
+			uint32_t threshold = (0u - bound) % bound;
+			while (low < threshold)
+			{
+				m = (uint64_t)Next() * bound;
+				low = (uint32_t)m;
+			}
+		}
+		return (uint32_t)(m >> 32);
+	}
+
+private:
+	uint64_t state;
+	uint64_t increment;
+};
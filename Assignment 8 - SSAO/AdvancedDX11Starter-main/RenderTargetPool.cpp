@@ -0,0 +1,339 @@
+#include "RenderTargetPool.h"
+#include "ResizeDebouncer.h"
+
+#include <stdio.h>
+
+RenderTargetPool::RenderTargetPool(IRenderTargetAllocator* allocator, unsigned int evictAfterFrames) :
+	allocator(allocator),
+	frameNumber(0),
+	evictAfterFrames(evictAfterFrames),
+	acquireCount(0),
+	hitCount(0),
+	evictionCount(0)
+{
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+	Clear();
+}
+
+// --------------------------------------------------------
+// Hands out a render target matching the given key.  A free
+// target with the same key is reused if possible; otherwise
+// a new one is created in the first empty slot.
+// --------------------------------------------------------
+unsigned int RenderTargetPool::Acquire(const RenderTargetKey& key, unsigned int bytesPerPixel)
+{
+	acquireCount++;
+
+	// Look for a free target we can reuse
+	for (unsigned int i = 0; i < entries.size(); i++)
+	{
+		Entry& e = entries[i];
+		if (e.Alive && !e.InUse && e.Key == key)
+		{
+			e.InUse = true;
+			e.LastUsedFrame = frameNumber;
+			hitCount++;
+			return i;
+		}
+	}
+
+	// Nothing to reuse, so find an empty slot
+	unsigned int id = 0;
+	while (id < entries.size() && entries[id].Alive)
+		id++;
+	if (id == entries.size())
+		entries.push_back(Entry());
+
+	Entry& e = entries[id];
+	e.Key = key;
+	e.Bytes = (unsigned long long)key.Width * key.Height * bytesPerPixel;
+	e.LastUsedFrame = frameNumber;
+	e.Alive = true;
+	e.InUse = true;
+
+	allocator->CreateRenderTarget(id, key);
+	return id;
+}
+
+// --------------------------------------------------------
+// Returns a target to the pool.  It stays alive so that it
+// can be handed out again, until it's evicted.
+// --------------------------------------------------------
+void RenderTargetPool::Release(unsigned int id)
+{
+	if (id >= entries.size() || !entries[id].Alive)
+		return;
+
+	entries[id].InUse = false;
+	entries[id].LastUsedFrame = frameNumber;
+}
+
+// --------------------------------------------------------
+// Evicts free targets that haven't been used recently
+// --------------------------------------------------------
+void RenderTargetPool::EndFrame()
+{
+	frameNumber++;
+
+	for (unsigned int i = 0; i < entries.size(); i++)
+	{
+		Entry& e = entries[i];
+		if (e.Alive && !e.InUse && frameNumber - e.LastUsedFrame > evictAfterFrames)
+		{
+			Destroy(i);
+			evictionCount++;
+		}
+	}
+}
+
+void RenderTargetPool::Clear()
+{
+	for (unsigned int i = 0; i < entries.size(); i++)
+		if (entries[i].Alive)
+			Destroy(i);
+	entries.clear();
+}
+
+unsigned int RenderTargetPool::GetTargetCount()
+{
+	unsigned int count = 0;
+	for (Entry& e : entries)
+		if (e.Alive) count++;
+	return count;
+}
+
+unsigned int RenderTargetPool::GetFreeTargetCount()
+{
+	unsigned int count = 0;
+	for (Entry& e : entries)
+		if (e.Alive && !e.InUse) count++;
+	return count;
+}
+
+unsigned long long RenderTargetPool::GetMemory()
+{
+	unsigned long long bytes = 0;
+	for (Entry& e : entries)
+		if (e.Alive) bytes += e.Bytes;
+	return bytes;
+}
+
+unsigned long long RenderTargetPool::GetFreeMemory()
+{
+	unsigned long long bytes = 0;
+	for (Entry& e : entries)
+		if (e.Alive && !e.InUse) bytes += e.Bytes;
+	return bytes;
+}
+
+void RenderTargetPool::Destroy(unsigned int id)
+{
+	allocator->DestroyRenderTarget(id);
+	entries[id].Alive = false;
+	entries[id].InUse = false;
+}
+
+// --------------------------------------------------------
+// Helpers for Test()
+// --------------------------------------------------------
+namespace
+{
+	// Keeps track of which slots hold a target, and complains
+	// about creating over a live one or destroying a dead one
+	class MockRenderTargetAllocator : public IRenderTargetAllocator
+	{
+	public:
+		std::vector<bool> Live;
+		unsigned int Creates = 0;
+		unsigned int Destroys = 0;
+		unsigned int Errors = 0;
+
+		void CreateRenderTarget(unsigned int id, const RenderTargetKey& /*key*/)
+		{
+			if (id >= Live.size())
+				Live.resize(id + 1, false);
+			if (Live[id])
+				Errors++;
+			Live[id] = true;
+			Creates++;
+		}
+
+		void DestroyRenderTarget(unsigned int id)
+		{
+			if (id >= Live.size() || !Live[id])
+				Errors++;
+			else
+				Live[id] = false;
+			Destroys++;
+		}
+
+		unsigned int GetLiveCount()
+		{
+			unsigned int count = 0;
+			for (bool live : Live)
+				if (live) count++;
+			return count;
+		}
+	};
+
+	RenderTargetKey MakeKey(unsigned int width, unsigned int height, unsigned int format = 28, unsigned int usage = 0x28)
+	{
+		RenderTargetKey key;
+		key.Width = width;
+		key.Height = height;
+		key.Format = format;
+		key.Usage = usage;
+		return key;
+	}
+
+	bool Report(const char* name, bool passed)
+	{
+		printf("  %-56s %s\n", name, passed ? "ok" : "FAILED");
+		return passed;
+	}
+}
+
+bool RenderTargetPool::Test()
+{
+	printf("Render target pool:\n");
+	bool passed = true;
+
+	// Released targets come back for the same key, and only the same key
+	{
+		MockRenderTargetAllocator allocator;
+		RenderTargetPool pool(&allocator, 3);
+		unsigned int first = pool.Acquire(MakeKey(1280, 720), 4);
+		pool.Release(first);
+		unsigned int again = pool.Acquire(MakeKey(1280, 720), 4);
+		bool reused = again == first && allocator.Creates == 1 && pool.GetHitCount() == 1;
+
+		pool.Acquire(MakeKey(1281, 720), 4);
+		pool.Acquire(MakeKey(1280, 721), 4);
+		pool.Acquire(MakeKey(1280, 720, 35), 4);
+		pool.Acquire(MakeKey(1280, 720, 28, 0x8), 4);
+		bool distinct = allocator.Creates == 5 && pool.GetHitCount() == 1 && pool.GetTargetCount() == 5;
+		passed = Report("Reuse for the same key, new targets for any other", reused && distinct && allocator.Errors == 0) && passed;
+	}
+
+	// Free targets last exactly evictAfterFrames frames, in-use
+	// targets are never evicted, and freed slots are filled first
+	{
+		MockRenderTargetAllocator allocator;
+		RenderTargetPool pool(&allocator, 3);
+		unsigned int kept = pool.Acquire(MakeKey(64, 64), 4);
+		unsigned int freed = pool.Acquire(MakeKey(128, 128), 4);
+		unsigned int last = pool.Acquire(MakeKey(256, 256), 4);
+		pool.Release(freed);
+
+		bool aliveUntilDue = true;
+		for (int frame = 0; frame < 3; frame++)
+		{
+			pool.EndFrame();
+			aliveUntilDue = aliveUntilDue && pool.GetTargetCount() == 3;
+		}
+		pool.EndFrame();
+		bool evictedWhenDue = pool.GetTargetCount() == 2 && pool.GetEvictionCount() == 1 && !allocator.Live[freed];
+		passed = Report("Free targets evicted after exactly 3 idle frames", aliveUntilDue && evictedWhenDue) && passed;
+
+		for (int frame = 0; frame < 100; frame++)
+			pool.EndFrame();
+		bool inUseKept = pool.GetTargetCount() == 2 && allocator.Live[kept] && allocator.Live[last];
+		passed = Report("Targets in use never evicted", inUseKept) && passed;
+
+		unsigned int recycled = pool.Acquire(MakeKey(512, 512), 4);
+		bool slotReused = recycled == freed && allocator.Live.size() == 3;
+		pool.Release(kept);
+		pool.Release(last);
+		pool.Release(recycled);
+		pool.Clear();
+		bool cleared = allocator.GetLiveCount() == 0 && pool.GetTargetCount() == 0 && pool.GetMemory() == 0;
+		passed = Report("Evicted slots reused first, Clear() destroys everything", slotReused && cleared && allocator.Errors == 0) && passed;
+	}
+
+	// A window drag: Windows sends several resize messages a frame
+	// for the whole drag, and DXCore holds them all back until the
+	// size has settled.  The drag then rebuilds the targets once,
+	// and once idle long enough only the final set is left.
+	{
+		const unsigned int targets = 3;
+		const int dragFrames = 20;
+		const int messagesPerFrame = 5;
+		MockRenderTargetAllocator allocator;
+		RenderTargetPool pool(&allocator);
+		ResizeDebouncer resize(1280, 720);
+		unsigned long long setBytes = 0;
+		unsigned int rebuilds = 0;
+		std::vector<unsigned int> ids;
+		auto rebuild = [&](unsigned int width, unsigned int height)
+		{
+			for (unsigned int id : ids)
+				pool.Release(id);
+			ids.clear();
+			setBytes = 0;
+			for (unsigned int t = 0; t < targets; t++)
+			{
+				ids.push_back(pool.Acquire(MakeKey(width, height, 28 + t), 4));
+				setBytes += (unsigned long long)width * height * 4;
+			}
+		};
+		auto endFrame = [&]()
+		{
+			if (resize.Update())
+			{
+				rebuild(resize.GetWidth(), resize.GetHeight());
+				rebuilds++;
+			}
+			pool.EndFrame();
+		};
+
+		rebuild(resize.GetWidth(), resize.GetHeight());
+		unsigned int width = 0;
+		unsigned int height = 0;
+		for (int frame = 0; frame < dragFrames; frame++)
+		{
+			for (int message = 0; message < messagesPerFrame; message++)
+			{
+				width = 1280 + frame * 16 + message;
+				height = 720 + frame * 8 + message;
+				resize.Request(width, height);
+			}
+			endFrame();
+		}
+		bool heldDuringDrag = rebuilds == 0 && allocator.Creates == targets && resize.GetWidth() == 1280;
+
+		for (unsigned int frame = 0; frame < resize.GetSettleFrames(); frame++)
+			endFrame();
+		bool rebuiltOnce =
+			rebuilds == 1 && !resize.IsPending() &&
+			resize.GetWidth() == width && resize.GetHeight() == height &&
+			allocator.Creates == targets * 2;
+
+		for (unsigned int frame = 0; frame <= pool.GetEvictAfterFrames(); frame++)
+			endFrame();
+		bool settled =
+			pool.GetTargetCount() == targets &&
+			pool.GetEvictionCount() == targets &&
+			pool.GetMemory() == setBytes &&
+			allocator.GetLiveCount() == targets;
+		printf("  %d frame drag, %d resizes a frame: %u rebuild(s), %u targets created, %u evicted once idle\n",
+			dragFrames, messagesPerFrame, rebuilds, allocator.Creates, pool.GetEvictionCount());
+		passed = Report("Drag held until settled, rebuilt once, old set evicted", heldDuringDrag && rebuiltOnce && settled && allocator.Errors == 0) && passed;
+	}
+
+	// Dragging away and back before the size settles changes nothing
+	{
+		ResizeDebouncer resize(1280, 720, 4);
+		resize.Request(1400, 800);
+		resize.Update();
+		resize.Request(1280, 720);
+		bool applied = false;
+		for (int frame = 0; frame < 8; frame++)
+			applied = resize.Update() || applied;
+		passed = Report("Settling back on the old size applies nothing", !applied && !resize.IsPending()) && passed;
+	}
+
+	return passed;
+}
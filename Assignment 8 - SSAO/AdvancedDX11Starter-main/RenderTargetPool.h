@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+
+// --------------------------------------------------------
+// Identifies interchangeable render targets.  Format and
+// Usage are raw DXGI_FORMAT and D3D11_BIND_FLAG values,
+// stored as plain integers to keep the pool API-agnostic.
+// --------------------------------------------------------
+struct RenderTargetKey
+{
+	unsigned int Width = 0;
+	unsigned int Height = 0;
+	unsigned int Format = 0;
+	unsigned int Usage = 0;
+
+	bool operator==(const RenderTargetKey& other) const
+	{
+		return Width == other.Width && Height == other.Height && Format == other.Format && Usage == other.Usage;
+	}
+};
+
+// --------------------------------------------------------
+// Creates and destroys the actual textures for the pool.
+// Textures are referred to by the pool's slot ids, which
+// are small and reused, so they can index a plain array.
+// --------------------------------------------------------
+class IRenderTargetAllocator
+{
+public:
+	virtual ~IRenderTargetAllocator() {}
+
+	virtual void CreateRenderTarget(unsigned int id, const RenderTargetKey& key) = 0;
+	virtual void DestroyRenderTarget(unsigned int id) = 0;
+};
+
+// --------------------------------------------------------
+// Keeps released render targets around so later requests
+// with the same key can reuse them instead of allocating.
+// Targets that sit unused for too many frames are evicted.
+// --------------------------------------------------------
+class RenderTargetPool
+{
+public:
+	RenderTargetPool(IRenderTargetAllocator* allocator, unsigned int evictAfterFrames = 120);
+	~RenderTargetPool();
+
+	// Returns the id of a free target matching the key, creating one if necessary
+	unsigned int Acquire(const RenderTargetKey& key, unsigned int bytesPerPixel);
+	void Release(unsigned int id);
+
+	// Call once per frame - ages and evicts unused targets
+	void EndFrame();
+
+	// Destroys every target, in use or not
+	void Clear();
+
+	// Stats
+	unsigned int GetAcquireCount() { return acquireCount; }
+	unsigned int GetHitCount() { return hitCount; }
+	unsigned int GetEvictionCount() { return evictionCount; }
+	float GetHitRate() { return acquireCount == 0 ? 0.0f : (float)hitCount / acquireCount; }
+	unsigned int GetTargetCount();
+	unsigned int GetFreeTargetCount();
+	unsigned long long GetMemory();
+	unsigned long long GetFreeMemory();
+
+	unsigned int GetEvictAfterFrames() { return evictAfterFrames; }
+	void SetEvictAfterFrames(unsigned int frames) { evictAfterFrames = frames; }
+
+	// Runs the pool against a mock allocator: reuse, slot recycling,
+	// when free and in-use targets are evicted, and a window drag
+	// with several resizes a frame, held back by a ResizeDebouncer
+	// the way DXCore does.  Returns false if a check fails.
+	static bool Test();
+
+private:
+	struct Entry
+	{
+		RenderTargetKey Key;
+		unsigned long long Bytes = 0;
+		unsigned long long LastUsedFrame = 0;
+		bool Alive = false;
+		bool InUse = false;
+	};
+
+	IRenderTargetAllocator* allocator;
+	std::vector<Entry> entries;
+
+	unsigned long long frameNumber;
+	unsigned int evictAfterFrames;
+
+	unsigned int acquireCount;
+	unsigned int hitCount;
+	unsigned int evictionCount;
+
+	void Destroy(unsigned int id);
+};
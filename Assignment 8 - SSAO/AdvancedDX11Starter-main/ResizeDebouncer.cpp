@@ -0,0 +1,48 @@
+#include "ResizeDebouncer.h"
+
+ResizeDebouncer::ResizeDebouncer(unsigned int width, unsigned int height, unsigned int settleFrames) :
+	width(width),
+	height(height),
+	pendingWidth(width),
+	pendingHeight(height),
+	settleFrames(settleFrames),
+	heldFrames(0),
+	pending(false)
+{
+}
+
+// --------------------------------------------------------
+// Starts the wait over whenever the size actually changes
+// --------------------------------------------------------
+void ResizeDebouncer::Request(unsigned int newWidth, unsigned int newHeight)
+{
+	if (pending && newWidth == pendingWidth && newHeight == pendingHeight)
+		return;
+
+	pendingWidth = newWidth;
+	pendingHeight = newHeight;
+	heldFrames = 0;
+	pending = true;
+}
+
+void ResizeDebouncer::SetSize(unsigned int newWidth, unsigned int newHeight)
+{
+	width = pendingWidth = newWidth;
+	height = pendingHeight = newHeight;
+	heldFrames = 0;
+	pending = false;
+}
+
+bool ResizeDebouncer::Update()
+{
+	if (!pending || ++heldFrames < settleFrames)
+		return false;
+
+	pending = false;
+	if (pendingWidth == width && pendingHeight == height)
+		return false;
+
+	width = pendingWidth;
+	height = pendingHeight;
+	return true;
+}
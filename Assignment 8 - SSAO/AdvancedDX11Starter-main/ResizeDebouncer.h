@@ -0,0 +1,44 @@
+#pragma once
+
+// --------------------------------------------------------
+// Holds window resizes back until the size stops changing.
+//
+// Dragging a window edge sends a new size nearly every frame.
+// Rebuilding the swap chain, depth buffer and render targets
+// for each one allocates a full set of targets per frame, so
+// instead the last applied size is kept (and stretched to the
+// window) until the requested size has held for settleFrames
+// frames, and only then applied, once.
+// --------------------------------------------------------
+class ResizeDebouncer
+{
+public:
+	ResizeDebouncer(unsigned int width, unsigned int height, unsigned int settleFrames = 8);
+
+	// Records the window's new size, as often as it changes
+	void Request(unsigned int newWidth, unsigned int newHeight);
+
+	// Makes a size current right away, dropping any request
+	void SetSize(unsigned int newWidth, unsigned int newHeight);
+
+	// Call once per frame.  Returns true on the frame the requested
+	// size should be applied, at which point it becomes the current
+	// size.  Settling back on the current size applies nothing.
+	bool Update();
+
+	// The size that was last applied
+	unsigned int GetWidth() { return width; }
+	unsigned int GetHeight() { return height; }
+
+	bool IsPending() { return pending; }
+	unsigned int GetSettleFrames() { return settleFrames; }
+
+private:
+	unsigned int width;
+	unsigned int height;
+	unsigned int pendingWidth;
+	unsigned int pendingHeight;
+	unsigned int settleFrames;
+	unsigned int heldFrames;
+	bool pending;
+};
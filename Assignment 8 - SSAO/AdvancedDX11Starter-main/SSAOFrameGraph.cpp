@@ -0,0 +1,305 @@
+#include "SSAOFrameGraph.h"
+#include "NullFrameGraphDevice.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+void DeclareSSAOFrameGraph(FrameGraph& graph, const SSAOFrameGraphSettings& settings, const SSAOFrameGraphPasses& passes, SSAOFrameGraphResources& resources)
+{
+	resources = SSAOFrameGraphResources();
+
+	// Every target is window sized and cleared to black
+	FrameGraphTextureDesc colorDesc = {};
+	colorDesc.Width = settings.Width;
+	colorDesc.Height = settings.Height;
+	colorDesc.Format = SSAO_GRAPH_FORMAT_RGBA8_UNORM;
+	colorDesc.BytesPerPixel = 4;
+	colorDesc.ClearOnFirstWrite = true;
+	colorDesc.ClearColor[3] = 1.0f;
+
+	// Octahedral normals only need two channels (see GBuffer.hlsli)
+	FrameGraphTextureDesc normalDesc = colorDesc;
+	normalDesc.Format = SSAO_GRAPH_FORMAT_RG16_UNORM;
+
+	// The SSAO results are fully overwritten, so no clears,
+	// and are smaller when running at a lower resolution
+	int scale = settings.ResolutionScale;
+	resources.SSAOWidth = (settings.Width + scale - 1) / scale;
+	resources.SSAOHeight = (settings.Height + scale - 1) / scale;
+	FrameGraphTextureDesc ssaoDesc = colorDesc;
+	ssaoDesc.ClearOnFirstWrite = false;
+	ssaoDesc.Width = resources.SSAOWidth;
+	ssaoDesc.Height = resources.SSAOHeight;
+
+	resources.SceneColors = graph.CreateTexture("Scene Colors", colorDesc);
+	resources.SceneNormals = graph.CreateTexture("Scene Normals", normalDesc);
+	resources.SceneAmbient = graph.CreateTexture("Scene Ambient", colorDesc);
+	resources.Depth = graph.ImportTexture("Depth Buffer");
+	resources.SSAO = graph.CreateTexture("SSAO", ssaoDesc);
+	resources.BlurTemp = graph.CreateTexture("SSAO Blur Temp", ssaoDesc);
+	resources.Blur = graph.CreateTexture("SSAO Blur", ssaoDesc);
+	resources.BackBuffer = graph.ImportTexture("Back Buffer");
+
+	resources.SSAONormals = resources.SceneNormals;
+	resources.SSAODepths = resources.Depth;
+	resources.SSAOResult = resources.Blur;
+	if (scale > 1)
+	{
+		FrameGraphTextureDesc lowNormalDesc = ssaoDesc;
+		lowNormalDesc.Format = SSAO_GRAPH_FORMAT_RG16_UNORM;
+
+		FrameGraphTextureDesc lowDepthDesc = ssaoDesc;
+		lowDepthDesc.Format = SSAO_GRAPH_FORMAT_R32_FLOAT;
+
+		FrameGraphTextureDesc upsampledDesc = colorDesc;
+		upsampledDesc.ClearOnFirstWrite = false;
+
+		resources.SSAONormals = graph.CreateTexture("SSAO Normals", lowNormalDesc);
+		resources.SSAODepths = graph.CreateTexture("SSAO Depths", lowDepthDesc);
+		resources.SSAOUpsampled = graph.CreateTexture("SSAO Upsampled", upsampledDesc);
+		resources.SSAOResult = resources.SSAOUpsampled;
+	}
+
+	// The temporal history and Hi-Z pyramid last from frame to
+	// frame, so they live outside the graph
+	FrameGraph::ResourceHandle blurSource = resources.SSAO;
+	if (settings.Temporal)
+	{
+		resources.HistoryRead = graph.ImportTexture("SSAO History (Previous)");
+		resources.HistoryWrite = graph.ImportTexture("SSAO History");
+		blurSource = resources.HistoryWrite;
+	}
+	if (settings.HiZ)
+		resources.HiZ = graph.ImportTexture("Hi-Z Pyramid");
+
+	std::vector<FrameGraph::ResourceHandle> ssaoReads = { resources.SSAONormals, resources.SSAODepths };
+	if (settings.HiZ)
+		ssaoReads.push_back(resources.HiZ);
+
+	const SSAOFrameGraphResources& r = resources;
+	graph.AddPass("G-Buffer", {}, { r.SceneColors, r.SceneNormals, r.SceneAmbient, r.Depth }, passes.GBuffer);
+	if (settings.HiZ)
+		graph.AddPass("Hi-Z", { r.Depth }, { r.HiZ }, passes.HiZ);
+	if (scale > 1)
+		graph.AddPass("SSAO Downsample", { r.SceneNormals, r.Depth }, { r.SSAONormals, r.SSAODepths }, passes.Downsample);
+	graph.AddPass("SSAO", ssaoReads, { r.SSAO }, passes.SSAO);
+	if (settings.Temporal)
+		graph.AddPass("SSAO Temporal", { r.SSAO, r.SSAODepths, r.HistoryRead }, { r.HistoryWrite }, passes.Temporal);
+	graph.AddPass("SSAO Blur X", { blurSource, r.SSAONormals, r.SSAODepths }, { r.BlurTemp }, passes.BlurX);
+	graph.AddPass("SSAO Blur Y", { r.BlurTemp, r.SSAONormals, r.SSAODepths }, { r.Blur }, passes.BlurY);
+	if (scale > 1)
+		graph.AddPass("SSAO Upsample", { r.Blur, r.SSAODepths, r.Depth }, { r.SSAOUpsampled }, passes.Upsample);
+	graph.AddPass("SSAO Combine", { r.SceneColors, r.SceneAmbient, r.SSAOResult }, { r.BackBuffer }, passes.Combine);
+
+	// Colors, normals and ambient, plus the 32 bit depth buffer
+	resources.GBufferBytesPerPixel = colorDesc.BytesPerPixel * 2 + normalDesc.BytesPerPixel + 4;
+}
+
+
+// --------------------------------------------------------
+// Helpers for TestSSAOFrameGraph()
+// --------------------------------------------------------
+namespace
+{
+	typedef FrameGraph::ResourceHandle SSAOFrameGraphResources::* ResourceMember;
+
+	struct GraphCase
+	{
+		const char* Name;
+		SSAOFrameGraphSettings Settings;
+
+		// Adds two passes nothing reads, which should be culled
+		bool DebugPasses;
+
+		// Passes that survive culling, in order, and the ones that don't
+		std::vector<std::string> Kept;
+		std::vector<std::string> Culled;
+
+		// Transients that share a texture with aliasing on - every
+		// other pair must have their own
+		std::vector<std::pair<ResourceMember, ResourceMember>> Shared;
+
+		// Used transients, and the peak bytes with and without aliasing
+		unsigned int Transients;
+		unsigned long long UnaliasedBytes;
+		unsigned long long AliasedBytes;
+	};
+
+	bool CheckCase(const GraphCase& test, bool aliasing)
+	{
+		NullFrameGraphDevice device;
+		SSAOFrameGraphPasses passes;
+		auto record = [&device](const char* name) { return [&device, name]() { device.Record(std::string("Pass ") + name); }; };
+		passes.GBuffer = record("G-Buffer");
+		passes.HiZ = record("Hi-Z");
+		passes.Downsample = record("SSAO Downsample");
+		passes.SSAO = record("SSAO");
+		passes.Temporal = record("SSAO Temporal");
+		passes.BlurX = record("SSAO Blur X");
+		passes.BlurY = record("SSAO Blur Y");
+		passes.Upsample = record("SSAO Upsample");
+		passes.Combine = record("SSAO Combine");
+
+		FrameGraph graph;
+		SSAOFrameGraphResources resources;
+		DeclareSSAOFrameGraph(graph, test.Settings, passes, resources);
+
+		FrameGraph::ResourceHandle debugView = FrameGraph::InvalidResource;
+		FrameGraph::ResourceHandle debugBlur = FrameGraph::InvalidResource;
+		if (test.DebugPasses)
+		{
+			FrameGraphTextureDesc debugDesc = {};
+			debugDesc.Width = test.Settings.Width;
+			debugDesc.Height = test.Settings.Height;
+			debugDesc.Format = SSAO_GRAPH_FORMAT_RGBA8_UNORM;
+			debugDesc.ClearOnFirstWrite = true;
+			debugView = graph.CreateTexture("Debug View", debugDesc);
+			debugBlur = graph.CreateTexture("Debug Blur", debugDesc);
+			graph.AddPass("Debug View", { resources.SceneNormals, resources.SSAO }, { debugView }, record("Debug View"));
+			graph.AddPass("Debug Blur", { debugView }, { debugBlur }, record("Debug Blur"));
+		}
+
+		graph.Compile(&device, aliasing);
+
+		// Culling
+		std::vector<std::string> kept, culled;
+		for (unsigned int p = 0; p < graph.GetPassCount(); p++)
+			(graph.IsPassCulled(p) ? culled : kept).push_back(graph.GetPassName(p));
+		bool cullingOK = kept == test.Kept && culled == test.Culled &&
+			graph.GetPhysicalIndex(debugView) == -1 && graph.GetPhysicalIndex(debugBlur) == -1;
+
+		// Aliasing - with it off, every transient gets its own texture
+		std::vector<ResourceMember> transients = {
+			&SSAOFrameGraphResources::SceneColors, &SSAOFrameGraphResources::SceneNormals, &SSAOFrameGraphResources::SceneAmbient,
+			&SSAOFrameGraphResources::SSAO, &SSAOFrameGraphResources::BlurTemp, &SSAOFrameGraphResources::Blur,
+			&SSAOFrameGraphResources::SSAONormals, &SSAOFrameGraphResources::SSAODepths, &SSAOFrameGraphResources::SSAOUpsampled };
+		bool aliasingOK = true;
+		for (size_t a = 0; a < transients.size(); a++)
+		{
+			for (size_t b = a + 1; b < transients.size(); b++)
+			{
+				FrameGraph::ResourceHandle first = resources.*transients[a];
+				FrameGraph::ResourceHandle second = resources.*transients[b];
+				if (first == FrameGraph::InvalidResource || second == FrameGraph::InvalidResource || first == second)
+					continue;
+
+				bool expectShared = false;
+				for (const std::pair<ResourceMember, ResourceMember>& pair : test.Shared)
+				{
+					expectShared = expectShared ||
+						(pair.first == transients[a] && pair.second == transients[b]) ||
+						(pair.first == transients[b] && pair.second == transients[a]);
+				}
+				bool shared = graph.GetPhysicalIndex(first) == graph.GetPhysicalIndex(second);
+				if (shared != (aliasing && expectShared))
+					aliasingOK = false;
+			}
+		}
+
+		// Memory, as the graph works it out and as the device saw it
+		unsigned int expectedTextures = test.Transients - (aliasing ? (unsigned int)test.Shared.size() : 0);
+		unsigned long long expectedPeak = aliasing ? test.AliasedBytes : test.UnaliasedBytes;
+		bool memoryOK =
+			graph.GetPhysicalTextureCount() == expectedTextures &&
+			device.GetTextureCount() == expectedTextures &&
+			graph.GetUnaliasedMemory() == test.UnaliasedBytes &&
+			graph.GetAliasedMemory() == expectedPeak &&
+			device.GetPeakBytes() == expectedPeak;
+
+		// Only the G-buffer targets are cleared, right before the
+		// G-buffer pass, and then the passes run in order
+		device.ClearEvents();
+		graph.Execute();
+		std::vector<std::string> expectedEvents = {
+			"Clear " + std::to_string(graph.GetPhysicalIndex(resources.SceneColors)),
+			"Clear " + std::to_string(graph.GetPhysicalIndex(resources.SceneNormals)),
+			"Clear " + std::to_string(graph.GetPhysicalIndex(resources.SceneAmbient)) };
+		for (const std::string& pass : test.Kept)
+			expectedEvents.push_back("Pass " + pass);
+		bool executeOK = device.GetEvents() == expectedEvents && device.GetErrorCount() == 0;
+
+		bool passed = cullingOK && aliasingOK && memoryOK && executeOK;
+		printf("  %-32s aliasing %-3s: %u of %u passes culled, %u textures, %.2f MB peak (%.2f MB unaliased) - %s%s%s%s%s\n",
+			test.Name, aliasing ? "on" : "off",
+			graph.GetCulledPassCount(), graph.GetPassCount(), graph.GetPhysicalTextureCount(),
+			graph.GetAliasedMemory() / (1024.0 * 1024.0), graph.GetUnaliasedMemory() / (1024.0 * 1024.0),
+			passed ? "ok" : "FAILED",
+			cullingOK ? "" : " (culling)",
+			aliasingOK ? "" : " (aliasing)",
+			memoryOK ? "" : " (memory)",
+			executeOK ? "" : " (clears and order)");
+		return passed;
+	}
+}
+
+bool TestSSAOFrameGraph()
+{
+	printf("SSAO frame graph:\n");
+
+	// An RGBA8 or RG16 target at 1280x720 is 3,686,400 bytes
+	const unsigned long long full = 1280ull * 720 * 4;
+	const unsigned long long half = 640ull * 360 * 4;
+
+	std::vector<GraphCase> cases(3);
+
+	// Full resolution with Hi-Z, plus two debug passes: the SSAO
+	// (passes 2-3) is done before the second blur (4-5) starts
+	GraphCase& fullRes = cases[0];
+	fullRes.Name = "1280x720, Hi-Z, debug passes";
+	fullRes.Settings.Width = 1280;
+	fullRes.Settings.Height = 720;
+	fullRes.Settings.HiZ = true;
+	fullRes.DebugPasses = true;
+	fullRes.Kept = { "G-Buffer", "Hi-Z", "SSAO", "SSAO Blur X", "SSAO Blur Y", "SSAO Combine" };
+	fullRes.Culled = { "Debug View", "Debug Blur" };
+	fullRes.Shared = { { &SSAOFrameGraphResources::SSAO, &SSAOFrameGraphResources::Blur } };
+	fullRes.Transients = 6;
+	fullRes.UnaliasedBytes = 6 * full;
+	fullRes.AliasedBytes = 5 * full;
+
+	// Half resolution and temporal: the temporal pass moves the
+	// first blur along, so it's the one that reuses the SSAO target
+	GraphCase& temporal = cases[1];
+	temporal.Name = "1280x720, 1/2 res, temporal";
+	temporal.Settings.Width = 1280;
+	temporal.Settings.Height = 720;
+	temporal.Settings.ResolutionScale = 2;
+	temporal.Settings.Temporal = true;
+	temporal.DebugPasses = false;
+	temporal.Kept = { "G-Buffer", "SSAO Downsample", "SSAO", "SSAO Temporal", "SSAO Blur X", "SSAO Blur Y", "SSAO Upsample", "SSAO Combine" };
+	temporal.Shared = { { &SSAOFrameGraphResources::SSAO, &SSAOFrameGraphResources::BlurTemp } };
+	temporal.Transients = 9;
+	temporal.UnaliasedBytes = 4 * full + 5 * half;
+	temporal.AliasedBytes = 4 * full + 4 * half;
+
+	// Quarter resolution of an odd size rounds the SSAO size up,
+	// to 321x181
+	GraphCase& quarter = cases[2];
+	quarter.Name = "1283x721, 1/4 res";
+	quarter.Settings.Width = 1283;
+	quarter.Settings.Height = 721;
+	quarter.Settings.ResolutionScale = 4;
+	quarter.DebugPasses = false;
+	quarter.Kept = { "G-Buffer", "SSAO Downsample", "SSAO", "SSAO Blur X", "SSAO Blur Y", "SSAO Upsample", "SSAO Combine" };
+	quarter.Shared = { { &SSAOFrameGraphResources::SSAO, &SSAOFrameGraphResources::Blur } };
+	quarter.Transients = 9;
+	quarter.UnaliasedBytes = 4 * (1283ull * 721 * 4) + 5 * (321ull * 181 * 4);
+	quarter.AliasedBytes = 4 * (1283ull * 721 * 4) + 4 * (321ull * 181 * 4);
+
+	bool passed = true;
+	for (const GraphCase& test : cases)
+	{
+		passed = CheckCase(test, true) && passed;
+		passed = CheckCase(test, false) && passed;
+	}
+
+	// The SSAO size is rounded up, not down
+	FrameGraph graph;
+	SSAOFrameGraphResources resources;
+	DeclareSSAOFrameGraph(graph, quarter.Settings, SSAOFrameGraphPasses(), resources);
+	bool sizeOK = resources.SSAOWidth == 321 && resources.SSAOHeight == 181 && resources.GBufferBytesPerPixel == 16;
+	printf("  1/4 res of 1283x721 is %ux%u, G-buffer %u bytes per pixel - %s\n",
+		resources.SSAOWidth, resources.SSAOHeight, resources.GBufferBytesPerPixel, sizeOK ? "ok" : "FAILED");
+	return passed && sizeOK;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <functional>
+
+#include "FrameGraph.h"
+
+// Raw DXGI_FORMAT values for the graph's targets, so it can be
+// declared without the Direct3D headers
+#define SSAO_GRAPH_FORMAT_RGBA8_UNORM	28	// DXGI_FORMAT_R8G8B8A8_UNORM
+#define SSAO_GRAPH_FORMAT_RG16_UNORM	35	// DXGI_FORMAT_R16G16_UNORM
+#define SSAO_GRAPH_FORMAT_R32_FLOAT		41	// DXGI_FORMAT_R32_FLOAT
+
+// --------------------------------------------------------
+// The options that change the shape of the SSAO graph
+// --------------------------------------------------------
+struct SSAOFrameGraphSettings
+{
+	unsigned int Width = 0;
+	unsigned int Height = 0;
+	int ResolutionScale = 1;	// SSAO runs at 1/scale of the window size
+	bool Temporal = false;		// Accumulate into the imported history
+	bool HiZ = false;			// Build the imported Hi-Z pyramid
+};
+
+// --------------------------------------------------------
+// The work behind each pass.  Passes the settings leave out
+// are never added, so their functions can be empty.
+// --------------------------------------------------------
+struct SSAOFrameGraphPasses
+{
+	std::function<void()> GBuffer;
+	std::function<void()> HiZ;
+	std::function<void()> Downsample;
+	std::function<void()> SSAO;
+	std::function<void()> Temporal;
+	std::function<void()> BlurX;
+	std::function<void()> BlurY;
+	std::function<void()> Upsample;
+	std::function<void()> Combine;
+};
+
+// --------------------------------------------------------
+// Every resource in the graph, or InvalidResource if the
+// settings leave it out.  At full resolution the SSAO normals,
+// depths and result refer to the G-buffer and blur.
+// --------------------------------------------------------
+struct SSAOFrameGraphResources
+{
+	FrameGraph::ResourceHandle SceneColors = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle SceneNormals = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle SceneAmbient = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle Depth = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle SSAO = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle BlurTemp = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle Blur = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle BackBuffer = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle SSAONormals = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle SSAODepths = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle SSAOUpsampled = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle SSAOResult = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle HistoryRead = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle HistoryWrite = FrameGraph::InvalidResource;
+	FrameGraph::ResourceHandle HiZ = FrameGraph::InvalidResource;
+
+	unsigned int SSAOWidth = 0;
+	unsigned int SSAOHeight = 0;
+
+	// Across the G-buffer targets and the 32 bit depth buffer
+	unsigned int GBufferBytesPerPixel = 0;
+};
+
+// Declares the G-buffer, Hi-Z, SSAO, blur and combine passes and
+// their targets on a freshly Reset() graph, ready to Compile()
+void DeclareSSAOFrameGraph(FrameGraph& graph, const SSAOFrameGraphSettings& settings, const SSAOFrameGraphPasses& passes, SSAOFrameGraphResources& resources);
+
+// Declares the SSAO graph in a few configurations, compiles it
+// against a NullFrameGraphDevice with aliasing on and off, and
+// checks the culled passes, which targets share a texture, the
+// clears and the peak render target memory against values worked
+// out by hand.  Returns false if a check fails.
+bool TestSSAOFrameGraph();
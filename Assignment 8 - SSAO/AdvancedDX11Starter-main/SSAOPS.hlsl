@@ -1,3 +1,5 @@
+#include "GBuffer.hlsli"
+
 cbuffer externalData : register(b0)
 {
     matrix viewMatrix; // Camera view matrix
@@ -7,7 +9,18 @@ cbuffer externalData : register(b0)
     float4 offsets[64]; // Random offsets from C++
     float ssaoRadius; // Controllable from C++
     int ssaoSamples; // No more than array size above! Usually just 64
-    float2 randomTextureScreenScale; // (windowWidth/4.0, windowHeight/4.0)
+    int noiseSize; // Width and height of the random texture (4 or 64)
+
+    // Per frame jitter for temporal accumulation (identity when it's off)
+    float2 randomRotation; // (cos, sin) to rotate the random vectors by
+    int2 noiseOffset; // Shifts the random texture, in pixels
+    int sampleStride; // Sample i uses offset i * sampleStride + sampleOffset
+    int sampleOffset;
+
+    // Further samples can come from coarser mips of the Hi-Z pyramid
+    int useHiZ;
+    int hiZMaxMip;
+    float2 hiZSize; // Mip 0's size, in pixels
 }
 
 struct VertexToPixel
@@ -16,13 +29,18 @@ struct VertexToPixel
     float2 uv : TEXCOORD;
 };
 
-Texture2D Normals : register(t0);
+Texture2D Normals : register(t0); // Octahedral (see GBuffer.hlsli)
 Texture2D Depths : register(t1);
-Texture2D Random : register(t2); // (the 4x4 texture of random vectors)
+Texture2D Random : register(t2); // (the tiled texture of random vectors)
+Texture2D HiZ : register(t3); // Nearest and farthest depths (see HiZPS)
 
 SamplerState BasicSampler : register(s0);
 SamplerState ClampSampler : register(s1);
 
+// How many mips finer than the sample distance (in pixels) the Hi-Z
+// pyramid is read at - matches HIZ_SSAO_MIP_OFFSET in HiZPyramid.h
+static const int HIZ_SSAO_MIP_OFFSET = 3;
+
 
 float3 ViewSpaceFromDepth(float depth, float2 uv)
 {
@@ -55,10 +73,13 @@ float4 main(VertexToPixel input) : SV_TARGET
         return float4(1, 1, 1, 1);
     // Get the view space position of this pixel
     float3 pixelPositionViewSpace = ViewSpaceFromDepth(pixelDepth, input.uv);
-    // Sample the 4x4 random texture (assuming it holds already normalized vector3s)
-    float3 randomDir = Random.Sample(BasicSampler, input.uv * randomTextureScreenScale).xyz;
+    // Read the tiled random texture (assuming it holds already normalized vector3's)
+    float3 randomDir = Random.Load(int3((int2(input.position.xy) + noiseOffset) % noiseSize, 0)).xyz;
+    randomDir.xy = float2(
+        randomDir.x * randomRotation.x - randomDir.y * randomRotation.y,
+        randomDir.x * randomRotation.y + randomDir.y * randomRotation.x);
     // Sample normal and convert to view space
-    float3 normal = Normals.Sample(BasicSampler, input.uv).xyz * 2 - 1;
+    float3 normal = DecodeNormal(Normals.Load(int3(input.position.xy, 0)).xy);
     normal = normalize(mul((float3x3) viewMatrix, normal));
     // Calculate TBN matrix
     float3 tangent = normalize(randomDir - normal * dot(randomDir, normal));
@@ -69,11 +90,25 @@ float4 main(VertexToPixel input) : SV_TARGET
     for (int i = 0; i < ssaoSamples; i++)
     {
     // Rotate the offset, scale and apply to position
-        float3 samplePosView = pixelPositionViewSpace + mul(offsets[i].xyz, TBN) * ssaoRadius;
+        float3 samplePosView = pixelPositionViewSpace + mul(offsets[(i * sampleStride + sampleOffset) % 64].xyz, TBN) * ssaoRadius;
     // Get the UV coord of this position
         float2 samplePosScreen = UVFromViewSpacePosition(samplePosView);
     // Sample the this nearby depth and convert to view space
-        float sampleDepth = Depths.SampleLevel(ClampSampler, samplePosScreen.xy, 0).r;
+        float sampleDepth;
+        if (useHiZ)
+        {
+            // Coarser for further samples, which keeps them close together
+            // in the cache.  Halfway between the nearest and farthest depth
+            // is exact on a plane at any mip.
+            float distancePixels = length((samplePosScreen - input.uv) * hiZSize);
+            int mip = int(firstbithigh(uint(clamp(distancePixels, 1.0f, 65535.0f)))) - HIZ_SSAO_MIP_OFFSET;
+            float2 nearFar = HiZ.SampleLevel(ClampSampler, samplePosScreen.xy, clamp(mip, 0, hiZMaxMip)).rg;
+            sampleDepth = (nearFar.x + nearFar.y) * 0.5f;
+        }
+        else
+        {
+            sampleDepth = Depths.SampleLevel(ClampSampler, samplePosScreen.xy, 0).r;
+        }
         float sampleZ = ViewSpaceFromDepth(sampleDepth, samplePosScreen.xy).z;
     // Compare the depths and fade result based on range (so far away objects arent occluded)
         float rangeCheck = smoothstep(0.0f, 1.0f, ssaoRadius / abs(pixelPositionViewSpace.z - sampleZ));
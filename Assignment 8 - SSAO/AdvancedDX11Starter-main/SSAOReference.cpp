@@ -0,0 +1,1812 @@
+#include "SSAOReference.h"
+#include "NormalEncoding.h"
+#include "SSAOSampling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <fstream>
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+
+using namespace DirectX;
+
+namespace
+{
+	// Runs job(0) through job(count - 1), across the job
+	// system's threads if there is one
+	void ForEach(int count, JobSystem* jobs, const std::function<void(int)>& job)
+	{
+		if (jobs)
+		{
+			jobs->ParallelFor(count, job);
+			return;
+		}
+
+		for (int i = 0; i < count; i++)
+			job(i);
+	}
+
+	XMVECTOR LoadLanes(const float lanes[4])
+	{
+		return XMVectorSet(lanes[0], lanes[1], lanes[2], lanes[3]);
+	}
+
+	void StoreLanes(float lanes[4], FXMVECTOR v)
+	{
+		XMFLOAT4 f;
+		XMStoreFloat4(&f, v);
+		lanes[0] = f.x;
+		lanes[1] = f.y;
+		lanes[2] = f.z;
+		lanes[3] = f.w;
+	}
+
+	// HLSL's smoothstep(0, 1, x)
+	XMVECTOR SmoothStep01(FXMVECTOR x)
+	{
+		XMVECTOR t = XMVectorSaturate(x);
+		return XMVectorMultiply(XMVectorMultiply(t, t), XMVectorNegativeMultiplySubtract(XMVectorReplicate(2.0f), t, XMVectorReplicate(3.0f)));
+	}
+
+	// Same as SampleLevel(..., 0) on one channel, with a
+	// linear filter and clamped addressing
+	float SampleBilinear(const FloatImage& image, float u, float v, int channel = 0)
+	{
+		// Way off the edge (or not a number) clamps anyway
+		float x = fminf(fmaxf(u * image.Width - 0.5f, -1.0f), (float)image.Width);
+		float y = fminf(fmaxf(v * image.Height - 0.5f, -1.0f), (float)image.Height);
+		float fx = floorf(x);
+		float fy = floorf(y);
+		float ax = x - fx;
+		float ay = y - fy;
+
+		int x0 = (int)fx;
+		int y0 = (int)fy;
+		int x1 = x0 + 1 < image.Width ? x0 + 1 : image.Width - 1;
+		int y1 = y0 + 1 < image.Height ? y0 + 1 : image.Height - 1;
+		if (x0 < 0) x0 = 0;
+		if (y0 < 0) y0 = 0;
+		if (x0 > image.Width - 1) x0 = image.Width - 1;
+		if (y0 > image.Height - 1) y0 = image.Height - 1;
+
+		int c = image.Channels;
+		const float* row0 = image.Row(y0) + channel;
+		const float* row1 = image.Row(y1) + channel;
+		float top = row0[x0 * c] + (row0[x1 * c] - row0[x0 * c]) * ax;
+		float bottom = row1[x0 * c] + (row1[x1 * c] - row1[x0 * c]) * ax;
+		return top + (bottom - top) * ay;
+	}
+
+	double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	float Dot3(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	XMFLOAT3 Cross3(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	float Saturate(float x)
+	{
+		return fminf(fmaxf(x, 0.0f), 1.0f);
+	}
+}
+
+
+namespace
+{
+	// Reads a label followed by a single value
+	template<typename T>
+	bool ReadValue(std::istream& in, const char* label, T& value)
+	{
+		std::string word;
+		in >> word >> value;
+		return in && word == label;
+	}
+
+	// Reads a label followed by count floats
+	bool ReadFloats(std::istream& in, const char* label, float* values, int count)
+	{
+		std::string word;
+		in >> word;
+		for (int i = 0; i < count && in; i++)
+			in >> values[i];
+		return in && word == label;
+	}
+
+	void WriteFloats(std::ostream& out, const char* label, const float* values, int count)
+	{
+		out << label << "\n";
+		for (int i = 0; i < count; i++)
+			out << values[i] << ((i % 4) == 3 ? "\n" : " ");
+	}
+
+	bool ReadJitter(std::istream& in, SSAOFrameJitter& jitter)
+	{
+		std::string word;
+		in >> word >> jitter.RotationCos >> jitter.RotationSin >> jitter.NoiseOffsetX >> jitter.NoiseOffsetY >> jitter.SampleStride >> jitter.SampleOffset;
+		return in && word == "jitter" && jitter.SampleStride >= 1 && jitter.SampleOffset >= 0 &&
+			jitter.NoiseOffsetX >= 0 && jitter.NoiseOffsetY >= 0;
+	}
+}
+
+// --------------------------------------------------------
+// Each frame turns the random vectors by the golden angle, so
+// the rotations never line up with earlier ones, and shifts
+// the noise pattern by a pixel.  With fewer samples than the
+// kernel has, consecutive frames take interleaved subsets.
+// --------------------------------------------------------
+SSAOFrameJitter SSAOFrameJitter::ForFrame(unsigned int frame, int samples, int noiseSize)
+{
+	// Wrapped so the angle doesn't lose precision over time
+	float angle = (frame % 4096) * 2.39996323f;
+
+	SSAOFrameJitter jitter;
+	jitter.RotationCos = cosf(angle);
+	jitter.RotationSin = sinf(angle);
+	jitter.NoiseOffsetX = frame % noiseSize;
+	jitter.NoiseOffsetY = (frame / noiseSize) % noiseSize;
+	jitter.SampleStride = samples > 0 && samples < 64 ? 64 / samples : 1;
+	jitter.SampleOffset = frame % jitter.SampleStride;
+	return jitter;
+}
+
+bool SSAOReferenceSettings::Load(const std::string& file)
+{
+	std::ifstream in(file);
+	if (!in)
+		return false;
+
+	bool valid =
+		ReadValue(in, "radius", Radius) &&
+		ReadValue(in, "samples", Samples) && Samples >= 0 && Samples <= 64 &&
+		ReadValue(in, "algorithm", Algorithm) &&
+		ReadValue(in, "gtaoslices", GTAOSlices) && GTAOSlices >= 1 &&
+		ReadValue(in, "gtaosteps", GTAOSteps) && GTAOSteps >= 1 &&
+		ReadValue(in, "hiz", UseHiZ) &&
+		ReadValue(in, "scale", ResolutionScale) && ResolutionScale >= 1 &&
+		ReadValue(in, "sharpness", UpsampleSharpness) &&
+		ReadValue(in, "blurradius", BlurRadius) && BlurRadius >= 0 &&
+		ReadValue(in, "blursharpness", BlurDepthSharpness) &&
+		ReadValue(in, "blurnormalpower", BlurNormalPower) && BlurNormalPower >= 0.0f &&
+		ReadJitter(in, Jitter) &&
+		ReadValue(in, "historyvalid", HistoryValid) &&
+		ReadValue(in, "historyweight", HistoryWeight) &&
+		ReadValue(in, "disocclusion", DisocclusionThreshold) &&
+		ReadFloats(in, "view", &View.m[0][0], 16) &&
+		ReadFloats(in, "projection", &Projection.m[0][0], 16) &&
+		ReadFloats(in, "previousviewprojection", &PreviousViewProjection.m[0][0], 16) &&
+		ReadFloats(in, "offsets", &Offsets[0].x, 64 * 4) &&
+		ReadValue(in, "noisesize", NoiseSize) && NoiseSize >= 1 && NoiseSize <= 256;
+	if (!valid)
+		return false;
+
+	RandomVectors.resize(NoiseSize * NoiseSize);
+	return ReadFloats(in, "random", &RandomVectors[0].x, NoiseSize * NoiseSize * 4);
+}
+
+bool SSAOReferenceSettings::Save(const std::string& file) const
+{
+	std::ofstream out(file);
+	if (!out)
+		return false;
+
+	// Nine significant digits round trip a float exactly
+	out.precision(9);
+	out << "radius " << Radius << "\nsamples " << Samples << "\n";
+	out << "algorithm " << Algorithm << "\ngtaoslices " << GTAOSlices << "\ngtaosteps " << GTAOSteps << "\nhiz " << UseHiZ << "\n";
+	out << "scale " << ResolutionScale << "\nsharpness " << UpsampleSharpness << "\n";
+	out << "blurradius " << BlurRadius << "\nblursharpness " << BlurDepthSharpness << "\nblurnormalpower " << BlurNormalPower << "\n";
+	out << "jitter " << Jitter.RotationCos << " " << Jitter.RotationSin << " " << Jitter.NoiseOffsetX << " " << Jitter.NoiseOffsetY << " " << Jitter.SampleStride << " " << Jitter.SampleOffset << "\n";
+	out << "historyvalid " << HistoryValid << "\nhistoryweight " << HistoryWeight << "\ndisocclusion " << DisocclusionThreshold << "\n";
+	WriteFloats(out, "view", &View.m[0][0], 16);
+	WriteFloats(out, "projection", &Projection.m[0][0], 16);
+	WriteFloats(out, "previousviewprojection", &PreviousViewProjection.m[0][0], 16);
+	WriteFloats(out, "offsets", &Offsets[0].x, 64 * 4);
+	out << "noisesize " << NoiseSize << "\n";
+	WriteFloats(out, "random", &RandomVectors[0].x, NoiseSize * NoiseSize * 4);
+	return (bool)out;
+}
+
+
+// --------------------------------------------------------
+// SSAOPS for every pixel.  The matrices are used as rows, like
+// the rest of the C++ code - the shader's mul(matrix, vector)
+// with column-major packing works out to the same thing.
+// --------------------------------------------------------
+void SSAOReference::ComputeSSAO(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& ssao, JobSystem* jobs,
+	const HiZPyramid* hiZ)
+{
+	if (settings.Algorithm == SSAO_ALGORITHM_GTAO)
+	{
+		ComputeGTAO(normals, depths, settings, ssao, jobs);
+		return;
+	}
+
+	int width = depths.Width;
+	int height = depths.Height;
+	ssao.Resize(width, height, 1);
+
+	XMFLOAT4X4 invProj;
+	XMStoreFloat4x4(&invProj, XMMatrixInverse(0, XMLoadFloat4x4(&settings.Projection)));
+	const XMFLOAT4X4& proj = settings.Projection;
+	const XMFLOAT4X4& view = settings.View;
+	int samples = settings.Samples;
+	const SSAOFrameJitter& jitter = settings.Jitter;
+	int noiseSize = settings.NoiseSize;
+	bool useHiZ = settings.UseHiZ && hiZ && hiZ->GetMipCount() > 0;
+
+	int tilesX = (width + TileSize - 1) / TileSize;
+	int tilesY = (height + TileSize - 1) / TileSize;
+	ForEach(tilesX * tilesY, jobs, [&](int tile)
+		{
+			int x0 = (tile % tilesX) * TileSize;
+			int y0 = (tile / tilesX) * TileSize;
+			int x1 = x0 + TileSize < width ? x0 + TileSize : width;
+			int y1 = y0 + TileSize < height ? y0 + TileSize : height;
+
+			// Matrix elements, one per vector
+			XMVECTOR p00 = XMVectorReplicate(proj.m[0][0]), p01 = XMVectorReplicate(proj.m[0][1]), p03 = XMVectorReplicate(proj.m[0][3]);
+			XMVECTOR p10 = XMVectorReplicate(proj.m[1][0]), p11 = XMVectorReplicate(proj.m[1][1]), p13 = XMVectorReplicate(proj.m[1][3]);
+			XMVECTOR p20 = XMVectorReplicate(proj.m[2][0]), p21 = XMVectorReplicate(proj.m[2][1]), p23 = XMVectorReplicate(proj.m[2][3]);
+			XMVECTOR p30 = XMVectorReplicate(proj.m[3][0]), p31 = XMVectorReplicate(proj.m[3][1]), p33 = XMVectorReplicate(proj.m[3][3]);
+			XMVECTOR i02 = XMVectorReplicate(invProj.m[0][2]), i03 = XMVectorReplicate(invProj.m[0][3]);
+			XMVECTOR i12 = XMVectorReplicate(invProj.m[1][2]), i13 = XMVectorReplicate(invProj.m[1][3]);
+			XMVECTOR i22 = XMVectorReplicate(invProj.m[2][2]), i23 = XMVectorReplicate(invProj.m[2][3]);
+			XMVECTOR i32 = XMVectorReplicate(invProj.m[3][2]), i33 = XMVectorReplicate(invProj.m[3][3]);
+
+			XMVECTOR zero = XMVectorZero();
+			XMVECTOR one = XMVectorSplatOne();
+			XMVECTOR two = XMVectorReplicate(2.0f);
+			XMVECTOR half = XMVectorReplicate(0.5f);
+			XMVECTOR radius = XMVectorReplicate(settings.Radius);
+
+			float depthLanes[4], uLanes[4], vLanes[4], pixelULanes[4];
+			float nxLanes[4], nyLanes[4], nzLanes[4];
+			float rxLanes[4], ryLanes[4], rzLanes[4];
+			float aoLanes[4];
+
+			for (int y = y0; y < y1; y++)
+			{
+				const float* depthRow = depths.Row(y);
+				const float* normalRow = normals.Row(y);
+				float v = (y + 0.5f) / height;
+
+				for (int x = x0; x < x1; x += 4)
+				{
+					// Gather four pixels (repeating the last one past the edge)
+					for (int l = 0; l < 4; l++)
+					{
+						int px = x + l < width ? x + l : width - 1;
+						const float* normal = normalRow + px * normals.Channels;
+						const XMFLOAT4& random = settings.RandomVectors[((y + jitter.NoiseOffsetY) % noiseSize) * noiseSize + (px + jitter.NoiseOffsetX) % noiseSize];
+						depthLanes[l] = depthRow[px * depths.Channels];
+						uLanes[l] = (px + 0.5f) / width;
+						pixelULanes[l] = uLanes[l];
+						vLanes[l] = v;
+						nxLanes[l] = normal[0];
+						nyLanes[l] = normal[1];
+						nzLanes[l] = normal[2];
+						rxLanes[l] = random.x * jitter.RotationCos - random.y * jitter.RotationSin;
+						ryLanes[l] = random.x * jitter.RotationSin + random.y * jitter.RotationCos;
+						rzLanes[l] = random.z;
+					}
+					XMVECTOR depth = LoadLanes(depthLanes);
+
+					// View space position (ViewSpaceFromDepth)
+					XMVECTOR ndcX = XMVectorSubtract(XMVectorMultiply(LoadLanes(uLanes), two), one);
+					XMVECTOR ndcY = XMVectorSubtract(XMVectorMultiply(XMVectorSubtract(one, LoadLanes(vLanes)), two), one);
+					XMVECTOR w = XMVectorMultiplyAdd(ndcX, i03, XMVectorMultiplyAdd(ndcY, i13, XMVectorMultiplyAdd(depth, i23, i33)));
+					XMVECTOR posX = XMVectorDivide(XMVectorMultiplyAdd(ndcX, XMVectorReplicate(invProj.m[0][0]), XMVectorMultiplyAdd(ndcY, XMVectorReplicate(invProj.m[1][0]), XMVectorMultiplyAdd(depth, XMVectorReplicate(invProj.m[2][0]), XMVectorReplicate(invProj.m[3][0])))), w);
+					XMVECTOR posY = XMVectorDivide(XMVectorMultiplyAdd(ndcX, XMVectorReplicate(invProj.m[0][1]), XMVectorMultiplyAdd(ndcY, XMVectorReplicate(invProj.m[1][1]), XMVectorMultiplyAdd(depth, XMVectorReplicate(invProj.m[2][1]), XMVectorReplicate(invProj.m[3][1])))), w);
+					XMVECTOR posZ = XMVectorDivide(XMVectorMultiplyAdd(ndcX, i02, XMVectorMultiplyAdd(ndcY, i12, XMVectorMultiplyAdd(depth, i22, i32))), w);
+
+					// View space normal
+					XMVECTOR wnx = XMVectorSubtract(XMVectorMultiply(LoadLanes(nxLanes), two), one);
+					XMVECTOR wny = XMVectorSubtract(XMVectorMultiply(LoadLanes(nyLanes), two), one);
+					XMVECTOR wnz = XMVectorSubtract(XMVectorMultiply(LoadLanes(nzLanes), two), one);
+					XMVECTOR nx = XMVectorMultiplyAdd(wnx, XMVectorReplicate(view.m[0][0]), XMVectorMultiplyAdd(wny, XMVectorReplicate(view.m[1][0]), XMVectorMultiply(wnz, XMVectorReplicate(view.m[2][0]))));
+					XMVECTOR ny = XMVectorMultiplyAdd(wnx, XMVectorReplicate(view.m[0][1]), XMVectorMultiplyAdd(wny, XMVectorReplicate(view.m[1][1]), XMVectorMultiply(wnz, XMVectorReplicate(view.m[2][1]))));
+					XMVECTOR nz = XMVectorMultiplyAdd(wnx, XMVectorReplicate(view.m[0][2]), XMVectorMultiplyAdd(wny, XMVectorReplicate(view.m[1][2]), XMVectorMultiply(wnz, XMVectorReplicate(view.m[2][2]))));
+					XMVECTOR invLength = XMVectorReciprocalSqrt(XMVectorMultiplyAdd(nx, nx, XMVectorMultiplyAdd(ny, ny, XMVectorMultiply(nz, nz))));
+					nx = XMVectorMultiply(nx, invLength);
+					ny = XMVectorMultiply(ny, invLength);
+					nz = XMVectorMultiply(nz, invLength);
+
+					// TBN from the random vector
+					XMVECTOR rx = LoadLanes(rxLanes);
+					XMVECTOR ry = LoadLanes(ryLanes);
+					XMVECTOR rz = LoadLanes(rzLanes);
+					XMVECTOR rDotN = XMVectorMultiplyAdd(rx, nx, XMVectorMultiplyAdd(ry, ny, XMVectorMultiply(rz, nz)));
+					XMVECTOR tx = XMVectorNegativeMultiplySubtract(nx, rDotN, rx);
+					XMVECTOR ty = XMVectorNegativeMultiplySubtract(ny, rDotN, ry);
+					XMVECTOR tz = XMVectorNegativeMultiplySubtract(nz, rDotN, rz);
+					invLength = XMVectorReciprocalSqrt(XMVectorMultiplyAdd(tx, tx, XMVectorMultiplyAdd(ty, ty, XMVectorMultiply(tz, tz))));
+					tx = XMVectorMultiply(tx, invLength);
+					ty = XMVectorMultiply(ty, invLength);
+					tz = XMVectorMultiply(tz, invLength);
+					XMVECTOR bx = XMVectorSubtract(XMVectorMultiply(ty, nz), XMVectorMultiply(tz, ny));
+					XMVECTOR by = XMVectorSubtract(XMVectorMultiply(tz, nx), XMVectorMultiply(tx, nz));
+					XMVECTOR bz = XMVectorSubtract(XMVectorMultiply(tx, ny), XMVectorMultiply(ty, nx));
+
+					XMVECTOR ao = zero;
+					for (int i = 0; i < samples; i++)
+					{
+						// Rotate the offset, scale and apply to position
+						const XMFLOAT4& offset = settings.Offsets[(i * jitter.SampleStride + jitter.SampleOffset) % 64];
+						XMVECTOR ox = XMVectorReplicate(offset.x);
+						XMVECTOR oy = XMVectorReplicate(offset.y);
+						XMVECTOR oz = XMVectorReplicate(offset.z);
+						XMVECTOR sx = XMVectorMultiplyAdd(XMVectorMultiplyAdd(ox, tx, XMVectorMultiplyAdd(oy, bx, XMVectorMultiply(oz, nx))), radius, posX);
+						XMVECTOR sy = XMVectorMultiplyAdd(XMVectorMultiplyAdd(ox, ty, XMVectorMultiplyAdd(oy, by, XMVectorMultiply(oz, ny))), radius, posY);
+						XMVECTOR sz = XMVectorMultiplyAdd(XMVectorMultiplyAdd(ox, tz, XMVectorMultiplyAdd(oy, bz, XMVectorMultiply(oz, nz))), radius, posZ);
+
+						// UV of that position (UVFromViewSpacePosition)
+						XMVECTOR cw = XMVectorMultiplyAdd(sx, p03, XMVectorMultiplyAdd(sy, p13, XMVectorMultiplyAdd(sz, p23, p33)));
+						XMVECTOR cx = XMVectorDivide(XMVectorMultiplyAdd(sx, p00, XMVectorMultiplyAdd(sy, p10, XMVectorMultiplyAdd(sz, p20, p30))), cw);
+						XMVECTOR cy = XMVectorDivide(XMVectorMultiplyAdd(sx, p01, XMVectorMultiplyAdd(sy, p11, XMVectorMultiplyAdd(sz, p21, p31))), cw);
+						XMVECTOR su = XMVectorMultiplyAdd(cx, half, half);
+						XMVECTOR sv = XMVectorSubtract(one, XMVectorMultiplyAdd(cy, half, half));
+
+						// Nearby depth, back in view space (only z is needed)
+						StoreLanes(uLanes, su);
+						StoreLanes(vLanes, sv);
+						for (int l = 0; l < 4; l++)
+						{
+							if (!useHiZ)
+							{
+								depthLanes[l] = SampleBilinear(depths, uLanes[l], vLanes[l]);
+								continue;
+							}
+
+							// Halfway between the nearest and farthest depth,
+							// which is exact on a plane at any mip
+							float dx = (uLanes[l] - pixelULanes[l]) * hiZ->GetWidth();
+							float dy = (vLanes[l] - v) * hiZ->GetHeight();
+							const FloatImage& mip = hiZ->GetMip(hiZ->GetSSAOMip(sqrtf(dx * dx + dy * dy)));
+							depthLanes[l] = (SampleBilinear(mip, uLanes[l], vLanes[l], 0) + SampleBilinear(mip, uLanes[l], vLanes[l], 1)) * 0.5f;
+						}
+						XMVECTOR sampleDepth = LoadLanes(depthLanes);
+						XMVECTOR sampleNdcX = XMVectorSubtract(XMVectorMultiply(su, two), one);
+						XMVECTOR sampleNdcY = XMVectorSubtract(XMVectorMultiply(XMVectorSubtract(one, sv), two), one);
+						XMVECTOR sampleW = XMVectorMultiplyAdd(sampleNdcX, i03, XMVectorMultiplyAdd(sampleNdcY, i13, XMVectorMultiplyAdd(sampleDepth, i23, i33)));
+						XMVECTOR sampleZ = XMVectorDivide(XMVectorMultiplyAdd(sampleNdcX, i02, XMVectorMultiplyAdd(sampleNdcY, i12, XMVectorMultiplyAdd(sampleDepth, i22, i32))), sampleW);
+
+						// Compare the depths and fade result based on range
+						XMVECTOR rangeCheck = SmoothStep01(XMVectorDivide(radius, XMVectorAbs(XMVectorSubtract(posZ, sampleZ))));
+						ao = XMVectorAdd(ao, XMVectorSelect(zero, rangeCheck, XMVectorLess(sampleZ, sz)));
+					}
+
+					// Sky pixels are never occluded
+					ao = XMVectorSubtract(one, XMVectorDivide(ao, XMVectorReplicate((float)samples)));
+					ao = XMVectorSelect(ao, one, XMVectorEqual(depth, one));
+
+					StoreLanes(aoLanes, ao);
+					float* out = ssao.Row(y);
+					for (int l = 0; l < 4 && x + l < x1; l++)
+						out[x + l] = aoLanes[l];
+				}
+			}
+		});
+}
+
+// --------------------------------------------------------
+// GTAOPS for every pixel - see the shader for the details
+// --------------------------------------------------------
+void SSAOReference::ComputeGTAO(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& ssao, JobSystem* jobs)
+{
+	int width = depths.Width;
+	int height = depths.Height;
+	ssao.Resize(width, height, 1);
+
+	XMFLOAT4X4 invProj;
+	XMStoreFloat4x4(&invProj, XMMatrixInverse(0, XMLoadFloat4x4(&settings.Projection)));
+	const XMFLOAT4X4& view = settings.View;
+	const SSAOFrameJitter& jitter = settings.Jitter;
+	int noiseSize = settings.NoiseSize;
+	const float pi = 3.14159265f;
+	const float halfPi = 1.57079633f;
+	int slices = settings.GTAOSlices;
+	int steps = settings.GTAOSteps;
+	float radius = settings.Radius;
+
+	// ViewSpaceFromDepth, for a pixel's center
+	auto viewSpace = [&](int x, int y)
+		{
+			float depth = depths.Row(y)[x * depths.Channels];
+			float ndcX = (x + 0.5f) / width * 2.0f - 1.0f;
+			float ndcY = (1.0f - (y + 0.5f) / height) * 2.0f - 1.0f;
+			float w = ndcX * invProj.m[0][3] + ndcY * invProj.m[1][3] + depth * invProj.m[2][3] + invProj.m[3][3];
+			return XMFLOAT3(
+				(ndcX * invProj.m[0][0] + ndcY * invProj.m[1][0] + depth * invProj.m[2][0] + invProj.m[3][0]) / w,
+				(ndcX * invProj.m[0][1] + ndcY * invProj.m[1][1] + depth * invProj.m[2][1] + invProj.m[3][1]) / w,
+				(ndcX * invProj.m[0][2] + ndcY * invProj.m[1][2] + depth * invProj.m[2][2] + invProj.m[3][2]) / w);
+		};
+
+	int tilesX = (width + TileSize - 1) / TileSize;
+	int tilesY = (height + TileSize - 1) / TileSize;
+	ForEach(tilesX * tilesY, jobs, [&](int tile)
+		{
+			int x0 = (tile % tilesX) * TileSize;
+			int y0 = (tile / tilesX) * TileSize;
+			int x1 = x0 + TileSize < width ? x0 + TileSize : width;
+			int y1 = y0 + TileSize < height ? y0 + TileSize : height;
+
+			for (int y = y0; y < y1; y++)
+			{
+				float* out = ssao.Row(y);
+				for (int x = x0; x < x1; x++)
+				{
+					if (depths.Row(y)[x * depths.Channels] == 1.0f)
+					{
+						out[x] = 1.0f;
+						continue;
+					}
+
+					XMFLOAT3 position = viewSpace(x, y);
+					float invLength = 1.0f / sqrtf(Dot3(position, position));
+					XMFLOAT3 viewDir(-position.x * invLength, -position.y * invLength, -position.z * invLength);
+
+					const float* encoded = normals.Row(y) + x * normals.Channels;
+					float wnx = encoded[0] * 2.0f - 1.0f;
+					float wny = encoded[1] * 2.0f - 1.0f;
+					float wnz = encoded[2] * 2.0f - 1.0f;
+					XMFLOAT3 normal(
+						wnx * view.m[0][0] + wny * view.m[1][0] + wnz * view.m[2][0],
+						wnx * view.m[0][1] + wny * view.m[1][1] + wnz * view.m[2][1],
+						wnx * view.m[0][2] + wny * view.m[1][2] + wnz * view.m[2][2]);
+					invLength = 1.0f / sqrtf(Dot3(normal, normal));
+					normal = XMFLOAT3(normal.x * invLength, normal.y * invLength, normal.z * invLength);
+
+					// Slice rotation and step offset
+					int noiseX = (x + jitter.NoiseOffsetX) % noiseSize;
+					int noiseY = (y + jitter.NoiseOffsetY) % noiseSize;
+					const XMFLOAT4& randomVector = settings.RandomVectors[noiseY * noiseSize + noiseX];
+					float randomX = randomVector.x * jitter.RotationCos - randomVector.y * jitter.RotationSin;
+					float randomY = randomVector.x * jitter.RotationSin + randomVector.y * jitter.RotationCos;
+					float stepNoise = randomVector.w;
+
+					float radiusPixels = radius * settings.Projection.m[0][0] * 0.5f * width / position.z;
+
+					float visibility = 0.0f;
+					for (int s = 0; s < slices; s++)
+					{
+						float sliceAngle = s * pi / slices;
+						float sliceCos = cosf(sliceAngle);
+						float sliceSin = sinf(sliceAngle);
+						float directionX = randomX * sliceCos - randomY * sliceSin;
+						float directionY = randomX * sliceSin + randomY * sliceCos;
+						XMFLOAT3 directionView(directionX, -directionY, 0.0f);
+
+						float directionDotView = Dot3(directionView, viewDir);
+						XMFLOAT3 orthoDirection(
+							directionView.x - directionDotView * viewDir.x,
+							directionView.y - directionDotView * viewDir.y,
+							directionView.z - directionDotView * viewDir.z);
+						XMFLOAT3 axis = Cross3(orthoDirection, viewDir);
+						invLength = 1.0f / sqrtf(Dot3(axis, axis));
+						axis = XMFLOAT3(axis.x * invLength, axis.y * invLength, axis.z * invLength);
+						float normalDotAxis = Dot3(normal, axis);
+						XMFLOAT3 projectedNormal(
+							normal.x - axis.x * normalDotAxis,
+							normal.y - axis.y * normalDotAxis,
+							normal.z - axis.z * normalDotAxis);
+						float projectedLength = fmaxf(sqrtf(Dot3(projectedNormal, projectedNormal)), 1e-6f);
+						float cosNormal = Saturate(Dot3(projectedNormal, viewDir) / projectedLength);
+						float side = Dot3(orthoDirection, projectedNormal);
+						float n = (side > 0.0f ? 1.0f : (side < 0.0f ? -1.0f : 0.0f)) * acosf(cosNormal);
+
+						float lowCos[2] = { cosf(n + halfPi), cosf(n - halfPi) };
+						float horizonCos[2] = { lowCos[0], lowCos[1] };
+						for (int j = 0; j < steps; j++)
+						{
+							float t = (j + stepNoise) / steps;
+							float distancePixels = 1.0f + t * t * fmaxf(radiusPixels - 1.0f, 0.0f);
+							float offsetX = directionX * distancePixels;
+							float offsetY = directionY * distancePixels;
+
+							for (int h = 0; h < 2; h++)
+							{
+								int tapX = (int)floorf(x + 0.5f + (h == 0 ? offsetX : -offsetX));
+								int tapY = (int)floorf(y + 0.5f + (h == 0 ? offsetY : -offsetY));
+								if (tapX < 0 || tapY < 0 || tapX >= width || tapY >= height)
+									continue;
+
+								XMFLOAT3 samplePosition = viewSpace(tapX, tapY);
+								XMFLOAT3 delta(samplePosition.x - position.x, samplePosition.y - position.y, samplePosition.z - position.z);
+								float distance = sqrtf(Dot3(delta, delta));
+								float sampleCos = Dot3(delta, viewDir) / fmaxf(distance, 1e-6f);
+								float falloff = Saturate((radius - distance) / (0.4f * radius));
+								horizonCos[h] = fmaxf(horizonCos[h], lowCos[h] + (sampleCos - lowCos[h]) * falloff);
+							}
+						}
+
+						float h0 = -acosf(fminf(fmaxf(horizonCos[1], -1.0f), 1.0f));
+						float h1 = acosf(fminf(fmaxf(horizonCos[0], -1.0f), 1.0f));
+						h0 = n + fminf(fmaxf(h0 - n, -halfPi), halfPi);
+						h1 = n + fminf(fmaxf(h1 - n, -halfPi), halfPi);
+
+						float sinN = sinf(n);
+						float arc0 = (cosNormal + 2.0f * h0 * sinN - cosf(2.0f * h0 - n)) / 4.0f;
+						float arc1 = (cosNormal + 2.0f * h1 * sinN - cosf(2.0f * h1 - n)) / 4.0f;
+						visibility += projectedLength * (arc0 + arc1);
+					}
+
+					out[x] = Saturate(visibility / slices);
+				}
+			}
+		});
+}
+
+// --------------------------------------------------------
+// BlurSSAOPS - a separable bilateral blur, horizontal then
+// vertical.  Each tap's gaussian weight is scaled down by how
+// far its view space depth and normal are from the center's.
+// --------------------------------------------------------
+void SSAOReference::Blur(const FloatImage& ssao, const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& blurred, JobSystem* jobs)
+{
+	int width = ssao.Width;
+	int height = ssao.Height;
+	blurTemp.Resize(width, height, 1);
+	blurred.Resize(width, height, 1);
+
+	// Every tap needs linear depths and unit normals,
+	// so work them out once up front
+	blurDepths.Resize(width, height, 1);
+	blurNormals.Resize(width, height, 3);
+
+	XMFLOAT4X4 invProj;
+	XMStoreFloat4x4(&invProj, XMMatrixInverse(0, XMLoadFloat4x4(&settings.Projection)));
+
+	int bands = (height + TileSize - 1) / TileSize;
+	ForEach(bands, jobs, [&](int band)
+		{
+			int yEnd = (band + 1) * TileSize < height ? (band + 1) * TileSize : height;
+			for (int y = band * TileSize; y < yEnd; y++)
+			{
+				const float* depthRow = depths.Row(y);
+				const float* normalRow = normals.Row(y);
+				float* linearRow = blurDepths.Row(y);
+				float* unitRow = blurNormals.Row(y);
+				for (int x = 0; x < width; x++)
+				{
+					float depth = depthRow[x * depths.Channels];
+					linearRow[x] = (depth * invProj.m[2][2] + invProj.m[3][2]) / (depth * invProj.m[2][3] + invProj.m[3][3]);
+
+					// Zero length normals stay zero, so they get no weight
+					const float* normal = normalRow + x * normals.Channels;
+					float nx = normal[0] * 2.0f - 1.0f;
+					float ny = normal[1] * 2.0f - 1.0f;
+					float nz = normal[2] * 2.0f - 1.0f;
+					float invLength = 1.0f / sqrtf(fmaxf(nx * nx + ny * ny + nz * nz, 1e-8f));
+					unitRow[x * 3 + 0] = nx * invLength;
+					unitRow[x * 3 + 1] = ny * invLength;
+					unitRow[x * 3 + 2] = nz * invLength;
+				}
+			}
+		});
+
+	BilateralPass(ssao, blurTemp, true, depths, settings, jobs);
+	BilateralPass(blurTemp, blurred, false, depths, settings, jobs);
+}
+
+// --------------------------------------------------------
+// One direction of the bilateral blur, four neighboring
+// pixels at a time
+// --------------------------------------------------------
+void SSAOReference::BilateralPass(const FloatImage& input, FloatImage& output, bool horizontal, const FloatImage& depths, const SSAOReferenceSettings& settings, JobSystem* jobs)
+{
+	int width = input.Width;
+	int height = input.Height;
+	int radius = settings.BlurRadius;
+
+	// Gaussian falloff, reaching about 13% at the radius
+	float sigma = (radius + 1) * 0.5f;
+	std::vector<float> spatialWeights(radius * 2 + 1);
+	for (int i = -radius; i <= radius; i++)
+		spatialWeights[i + radius] = expf(-(float)(i * i) / (2.0f * sigma * sigma));
+
+	int bands = (height + TileSize - 1) / TileSize;
+	ForEach(bands, jobs, [&](int band)
+		{
+			XMVECTOR zero = XMVectorZero();
+			XMVECTOR one = XMVectorSplatOne();
+			XMVECTOR depthScale = XMVectorReplicate(-settings.BlurDepthSharpness * 1.44269504f); // exp(x) = exp2(x * log2(e))
+			XMVECTOR normalPower = XMVectorReplicate(settings.BlurNormalPower);
+
+			float skyLanes[4], zLanes[4], nxLanes[4], nyLanes[4], nzLanes[4], aoLanes[4], weightLanes[4];
+
+			int yEnd = (band + 1) * TileSize < height ? (band + 1) * TileSize : height;
+			for (int y = band * TileSize; y < yEnd; y++)
+			{
+				for (int x = 0; x < width; x += 4)
+				{
+					// The center of each lane (repeating the last one past the edge)
+					for (int l = 0; l < 4; l++)
+					{
+						int px = x + l < width ? x + l : width - 1;
+						const float* normal = blurNormals.Row(y) + px * 3;
+						skyLanes[l] = depths.Row(y)[px * depths.Channels];
+						zLanes[l] = blurDepths.Row(y)[px];
+						nxLanes[l] = normal[0];
+						nyLanes[l] = normal[1];
+						nzLanes[l] = normal[2];
+					}
+					XMVECTOR centerZ = LoadLanes(zLanes);
+					XMVECTOR invCenterZ = XMVectorReciprocal(centerZ);
+					XMVECTOR centerX = LoadLanes(nxLanes);
+					XMVECTOR centerY = LoadLanes(nyLanes);
+					XMVECTOR centerN = LoadLanes(nzLanes);
+					XMVECTOR sky = XMVectorEqual(LoadLanes(skyLanes), one);
+
+					XMVECTOR ao = zero;
+					XMVECTOR totalWeight = zero;
+					for (int i = -radius; i <= radius; i++)
+					{
+						// Gather this tap for each lane, clamped to the edges
+						for (int l = 0; l < 4; l++)
+						{
+							int px = x + l < width ? x + l : width - 1;
+							int tx = px;
+							int ty = y;
+							if (horizontal)
+								tx = px + i < 0 ? 0 : (px + i >= width ? width - 1 : px + i);
+							else
+								ty = y + i < 0 ? 0 : (y + i >= height ? height - 1 : y + i);
+
+							const float* normal = blurNormals.Row(ty) + tx * 3;
+							aoLanes[l] = input.Row(ty)[tx * input.Channels];
+							zLanes[l] = blurDepths.Row(ty)[tx];
+							nxLanes[l] = normal[0];
+							nyLanes[l] = normal[1];
+							nzLanes[l] = normal[2];
+						}
+
+						XMVECTOR difference = XMVectorMultiply(XMVectorAbs(XMVectorSubtract(LoadLanes(zLanes), centerZ)), invCenterZ);
+						XMVECTOR depthWeight = XMVectorExp2(XMVectorMultiply(difference, depthScale));
+						XMVECTOR normalDot = XMVectorMultiplyAdd(LoadLanes(nxLanes), centerX, XMVectorMultiplyAdd(LoadLanes(nyLanes), centerY, XMVectorMultiply(LoadLanes(nzLanes), centerN)));
+						XMVECTOR normalWeight = settings.BlurNormalPower > 0.0f ? XMVectorPow(XMVectorSaturate(normalDot), normalPower) : one;
+						XMVECTOR weight = XMVectorMultiply(XMVectorReplicate(spatialWeights[i + radius]), XMVectorMultiply(depthWeight, normalWeight));
+
+						ao = XMVectorMultiplyAdd(LoadLanes(aoLanes), weight, ao);
+						totalWeight = XMVectorAdd(totalWeight, weight);
+					}
+
+					// The center always has some weight, unless its normal
+					// is missing, in which case it's left as it was
+					StoreLanes(aoLanes, XMVectorSelect(XMVectorDivide(ao, totalWeight), one, sky));
+					StoreLanes(weightLanes, totalWeight);
+					float* out = output.Row(y);
+					for (int l = 0; l < 4 && x + l < width; l++)
+						out[x + l] = weightLanes[l] > 0.0f || skyLanes[l] == 1.0f ? aoLanes[l] : input.Row(y)[(x + l) * input.Channels];
+				}
+			}
+		});
+}
+
+// --------------------------------------------------------
+// The 4x4 box blur BlurSSAOPS used to do: 16 bilinear samples,
+// half way between pixels, from -1.5 to 1.5 pixels away.
+// That's the same as a separable 5 tap filter with weights of
+// 1, 2, 2, 2, 1 (over 8) on each axis, done here in two passes.
+// --------------------------------------------------------
+void SSAOReference::BoxBlur(const FloatImage& ssao, FloatImage& blurred, JobSystem* jobs)
+{
+	int width = ssao.Width;
+	int height = ssao.Height;
+	blurTemp.Resize(width, height, 1);
+	blurred.Resize(width, height, 1);
+
+	XMVECTOR two = XMVectorReplicate(2.0f);
+	XMVECTOR eighth = XMVectorReplicate(0.125f);
+	int bands = (height + TileSize - 1) / TileSize;
+
+	// Horizontal - clamped at the edges, four at a time in between
+	ForEach(bands, jobs, [&](int band)
+		{
+			int yEnd = (band + 1) * TileSize < height ? (band + 1) * TileSize : height;
+			for (int y = band * TileSize; y < yEnd; y++)
+			{
+				const float* in = ssao.Row(y);
+				float* out = blurTemp.Row(y);
+
+				int x = 0;
+				while (x < width)
+				{
+					// Four at a time wherever every tap is in range
+					if (x >= 2 && x + 6 <= width)
+					{
+						XMVECTOR sum = XMVectorAdd(XMLoadFloat4((const XMFLOAT4*)(in + x - 2)), XMLoadFloat4((const XMFLOAT4*)(in + x + 2)));
+						XMVECTOR middle = XMVectorAdd(XMLoadFloat4((const XMFLOAT4*)(in + x - 1)), XMVectorAdd(XMLoadFloat4((const XMFLOAT4*)(in + x)), XMLoadFloat4((const XMFLOAT4*)(in + x + 1))));
+						XMStoreFloat4((XMFLOAT4*)(out + x), XMVectorMultiply(XMVectorMultiplyAdd(middle, two, sum), eighth));
+						x += 4;
+						continue;
+					}
+
+					float sum = 0.0f;
+					for (int k = -2; k <= 2; k++)
+					{
+						int sx = x + k < 0 ? 0 : (x + k >= width ? width - 1 : x + k);
+						sum += in[sx] * (k == -2 || k == 2 ? 1.0f : 2.0f);
+					}
+					out[x] = sum * 0.125f;
+					x++;
+				}
+			}
+		});
+
+	// Vertical - rows are clamped, and every column is independent
+	ForEach(bands, jobs, [&](int band)
+		{
+			int yEnd = (band + 1) * TileSize < height ? (band + 1) * TileSize : height;
+			for (int y = band * TileSize; y < yEnd; y++)
+			{
+				const float* rows[5];
+				for (int k = -2; k <= 2; k++)
+					rows[k + 2] = blurTemp.Row(y + k < 0 ? 0 : (y + k >= height ? height - 1 : y + k));
+				float* out = blurred.Row(y);
+
+				int x = 0;
+				for (; x + 4 <= width; x += 4)
+				{
+					XMVECTOR sum = XMVectorAdd(XMLoadFloat4((const XMFLOAT4*)(rows[0] + x)), XMLoadFloat4((const XMFLOAT4*)(rows[4] + x)));
+					XMVECTOR middle = XMVectorAdd(XMLoadFloat4((const XMFLOAT4*)(rows[1] + x)), XMVectorAdd(XMLoadFloat4((const XMFLOAT4*)(rows[2] + x)), XMLoadFloat4((const XMFLOAT4*)(rows[3] + x))));
+					XMStoreFloat4((XMFLOAT4*)(out + x), XMVectorMultiply(XMVectorMultiplyAdd(middle, two, sum), eighth));
+				}
+				for (; x < width; x++)
+					out[x] = (rows[0][x] + rows[4][x] + (rows[1][x] + rows[2][x] + rows[3][x]) * 2.0f) * 0.125f;
+			}
+		});
+}
+
+// --------------------------------------------------------
+// CombineSSAOPS - ambient * ao + scene colors
+// --------------------------------------------------------
+void SSAOReference::Combine(const FloatImage& colors, const FloatImage& ambient, const FloatImage& ssaoBlur, FloatImage& output, JobSystem* jobs)
+{
+	int width = colors.Width;
+	int height = colors.Height;
+	output.Resize(width, height, 3);
+
+	int bands = (height + TileSize - 1) / TileSize;
+	ForEach(bands, jobs, [&](int band)
+		{
+			int yEnd = (band + 1) * TileSize < height ? (band + 1) * TileSize : height;
+			for (int y = band * TileSize; y < yEnd; y++)
+			{
+				const float* colorRow = colors.Row(y);
+				const float* ambientRow = ambient.Row(y);
+				const float* aoRow = ssaoBlur.Row(y);
+				float* out = output.Row(y);
+				for (int x = 0; x < width; x++)
+				{
+					float ao = aoRow[x * ssaoBlur.Channels];
+					for (int c = 0; c < 3; c++)
+						out[x * 3 + c] = ambientRow[x * ambient.Channels + c] * ao + colorRow[x * colors.Channels + c];
+				}
+			}
+		});
+}
+
+// --------------------------------------------------------
+// DownsampleSSAOPS - each low resolution pixel takes the
+// depth and normal of one pixel in its block: the nearest on
+// one checkerboard color and the farthest on the other, so
+// both edges of a depth discontinuity survive
+// --------------------------------------------------------
+void SSAOReference::Downsample(const FloatImage& normals, const FloatImage& depths, int factor, FloatImage& lowNormals, FloatImage& lowDepths, JobSystem* jobs)
+{
+	int width = (depths.Width + factor - 1) / factor;
+	int height = (depths.Height + factor - 1) / factor;
+	lowNormals.Resize(width, height, normals.Channels);
+	lowDepths.Resize(width, height, 1);
+
+	int bands = (height + TileSize - 1) / TileSize;
+	ForEach(bands, jobs, [&](int band)
+		{
+			int yEnd = (band + 1) * TileSize < height ? (band + 1) * TileSize : height;
+			for (int y = band * TileSize; y < yEnd; y++)
+			{
+				for (int x = 0; x < width; x++)
+				{
+					int startX = x * factor;
+					int startY = y * factor;
+					int endX = startX + factor < depths.Width ? startX + factor : depths.Width;
+					int endY = startY + factor < depths.Height ? startY + factor : depths.Height;
+					bool useMax = ((x + y) & 1) != 0;
+
+					int chosenX = startX;
+					int chosenY = startY;
+					float chosenDepth = depths.Row(startY)[startX * depths.Channels];
+					for (int by = startY; by < endY; by++)
+					{
+						for (int bx = startX; bx < endX; bx++)
+						{
+							float d = depths.Row(by)[bx * depths.Channels];
+							if (useMax ? d > chosenDepth : d < chosenDepth)
+							{
+								chosenDepth = d;
+								chosenX = bx;
+								chosenY = by;
+							}
+						}
+					}
+
+					lowDepths.Row(y)[x] = chosenDepth;
+					const float* normal = normals.Row(chosenY) + chosenX * normals.Channels;
+					float* out = lowNormals.Row(y) + x * normals.Channels;
+					for (int c = 0; c < normals.Channels; c++)
+						out[c] = normal[c];
+				}
+			}
+		});
+}
+
+// --------------------------------------------------------
+// UpsampleSSAOPS - a joint bilateral upsample, which blends
+// the four nearest low resolution results with bilinear
+// weights scaled down by how far their view space depth is
+// from this pixel's.  If every tap is on another surface,
+// the one with the closest depth is used.
+// --------------------------------------------------------
+void SSAOReference::Upsample(const FloatImage& lowAO, const FloatImage& lowDepths, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& ao, JobSystem* jobs)
+{
+	int width = depths.Width;
+	int height = depths.Height;
+	ao.Resize(width, height, 1);
+
+	XMFLOAT4X4 invProj;
+	XMStoreFloat4x4(&invProj, XMMatrixInverse(0, XMLoadFloat4x4(&settings.Projection)));
+	auto linearDepth = [&](float depth)
+		{
+			return (depth * invProj.m[2][2] + invProj.m[3][2]) / (depth * invProj.m[2][3] + invProj.m[3][3]);
+		};
+
+	int bands = (height + TileSize - 1) / TileSize;
+	ForEach(bands, jobs, [&](int band)
+		{
+			int yEnd = (band + 1) * TileSize < height ? (band + 1) * TileSize : height;
+			for (int y = band * TileSize; y < yEnd; y++)
+			{
+				const float* depthRow = depths.Row(y);
+				float* out = ao.Row(y);
+				float lowY = (y + 0.5f) / height * lowAO.Height - 0.5f;
+				float baseY = floorf(lowY);
+				float ty = lowY - baseY;
+
+				for (int x = 0; x < width; x++)
+				{
+					float depth = depthRow[x * depths.Channels];
+					if (depth == 1.0f)
+					{
+						out[x] = 1.0f;
+						continue;
+					}
+					float z = linearDepth(depth);
+
+					float lowX = (x + 0.5f) / width * lowAO.Width - 0.5f;
+					float baseX = floorf(lowX);
+					float tx = lowX - baseX;
+
+					float total = 0.0f;
+					float totalWeight = 0.0f;
+					float closest = FLT_MAX;
+					float closestAO = 1.0f;
+					for (int i = 0; i < 4; i++)
+					{
+						int offsetX = i & 1;
+						int offsetY = i >> 1;
+						int texelX = (int)baseX + offsetX;
+						int texelY = (int)baseY + offsetY;
+						texelX = texelX < 0 ? 0 : (texelX >= lowAO.Width ? lowAO.Width - 1 : texelX);
+						texelY = texelY < 0 ? 0 : (texelY >= lowAO.Height ? lowAO.Height - 1 : texelY);
+
+						float tapAO = lowAO.Row(texelY)[texelX * lowAO.Channels];
+						float difference = fabsf(linearDepth(lowDepths.Row(texelY)[texelX * lowDepths.Channels]) - z) / z;
+						float weight =
+							(offsetX ? tx : 1.0f - tx) *
+							(offsetY ? ty : 1.0f - ty) *
+							expf(-difference * settings.UpsampleSharpness);
+
+						total += tapAO * weight;
+						totalWeight += weight;
+						if (difference < closest)
+						{
+							closest = difference;
+							closestAO = tapAO;
+						}
+					}
+					out[x] = totalWeight > 0.0001f ? total / totalWeight : closestAO;
+				}
+			}
+		});
+}
+
+void SSAOReference::Run(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& ssao, FloatImage& blurred, FloatImage& ao, JobSystem* jobs,
+	const FloatImage* history, FloatImage* newHistory)
+{
+	bool lowResolution = settings.ResolutionScale > 1;
+	if (lowResolution)
+		Downsample(normals, depths, settings.ResolutionScale, lowNormals, lowDepths, jobs);
+	const FloatImage& ssaoNormals = lowResolution ? lowNormals : normals;
+	const FloatImage& ssaoDepths = lowResolution ? lowDepths : depths;
+
+	if (settings.UseHiZ && settings.Algorithm == SSAO_ALGORITHM_HEMISPHERE)
+		hiZ.Build(depths, jobs);
+	ComputeSSAO(ssaoNormals, ssaoDepths, settings, ssao, jobs, &hiZ);
+
+	// The blur works on the accumulated AO, which is the
+	// first channel of the history
+	if (history && newHistory)
+	{
+		TemporalResolve(ssao, ssaoDepths, *history, settings, *newHistory, jobs);
+		Blur(*newHistory, ssaoNormals, ssaoDepths, settings, blurred, jobs);
+	}
+	else
+	{
+		Blur(ssao, ssaoNormals, ssaoDepths, settings, blurred, jobs);
+	}
+
+	if (lowResolution)
+		Upsample(blurred, lowDepths, depths, settings, ao, jobs);
+	else
+		ao = blurred;
+}
+
+XMFLOAT4X4 SSAOReference::CurrentToPrevious(const SSAOReferenceSettings& settings)
+{
+	XMMATRIX viewProj = XMMatrixMultiply(XMLoadFloat4x4(&settings.View), XMLoadFloat4x4(&settings.Projection));
+	XMFLOAT4X4 currentToPrevious;
+	XMStoreFloat4x4(&currentToPrevious, XMMatrixMultiply(XMMatrixInverse(0, viewProj), XMLoadFloat4x4(&settings.PreviousViewProjection)));
+	return currentToPrevious;
+}
+
+// --------------------------------------------------------
+// The same math as TemporalSSAOPS.  u and v are this frame's
+// UVs, and depth its post-projection depth.
+// --------------------------------------------------------
+bool SSAOReference::Reproject(const XMFLOAT4X4& m, float u, float v, float depth, float& previousU, float& previousV, float& previousDepth)
+{
+	float x = u * 2.0f - 1.0f;
+	float y = 1.0f - v * 2.0f;
+	float clipX = x * m.m[0][0] + y * m.m[1][0] + depth * m.m[2][0] + m.m[3][0];
+	float clipY = x * m.m[0][1] + y * m.m[1][1] + depth * m.m[2][1] + m.m[3][1];
+	float clipZ = x * m.m[0][2] + y * m.m[1][2] + depth * m.m[2][2] + m.m[3][2];
+	float clipW = x * m.m[0][3] + y * m.m[1][3] + depth * m.m[2][3] + m.m[3][3];
+	if (clipW <= 0.0f)
+		return false;
+
+	previousU = clipX / clipW * 0.5f + 0.5f;
+	previousV = 0.5f - clipY / clipW * 0.5f;
+	previousDepth = clipZ / clipW;
+	return previousU >= 0.0f && previousU < 1.0f && previousV >= 0.0f && previousV < 1.0f;
+}
+
+// --------------------------------------------------------
+// TemporalSSAOPS for every pixel.  The history holds AO, view
+// space depth and how many frames have been accumulated.
+// History is thrown out if it's off screen, or its depth isn't
+// where this pixel would have been (something else was there).
+// --------------------------------------------------------
+void SSAOReference::TemporalResolve(const FloatImage& ssao, const FloatImage& depths, const FloatImage& history, const SSAOReferenceSettings& settings, FloatImage& output, JobSystem* jobs)
+{
+	int width = ssao.Width;
+	int height = ssao.Height;
+	output.Resize(width, height, 3);
+
+	XMFLOAT4X4 invProj;
+	XMStoreFloat4x4(&invProj, XMMatrixInverse(0, XMLoadFloat4x4(&settings.Projection)));
+	XMFLOAT4X4 currentToPrevious = CurrentToPrevious(settings);
+	auto linearDepth = [&](float depth)
+		{
+			return (depth * invProj.m[2][2] + invProj.m[3][2]) / (depth * invProj.m[2][3] + invProj.m[3][3]);
+		};
+	bool useHistory = settings.HistoryValid && history.Width > 0 && history.Height > 0 && history.Channels >= 3;
+
+	int bands = (height + TileSize - 1) / TileSize;
+	ForEach(bands, jobs, [&](int band)
+		{
+			int yEnd = (band + 1) * TileSize < height ? (band + 1) * TileSize : height;
+			for (int y = band * TileSize; y < yEnd; y++)
+			{
+				const float* aoRow = ssao.Row(y);
+				const float* depthRow = depths.Row(y);
+				float* out = output.Row(y);
+				for (int x = 0; x < width; x++)
+				{
+					float ao = aoRow[x * ssao.Channels];
+					float depth = depthRow[x * depths.Channels];
+					float* result = out + x * 3;
+
+					// Nothing to accumulate for the sky
+					if (depth == 1.0f)
+					{
+						result[0] = 1.0f;
+						result[1] = linearDepth(1.0f);
+						result[2] = 0.0f;
+						continue;
+					}
+
+					result[0] = ao;
+					result[1] = linearDepth(depth);
+					result[2] = 1.0f;
+
+					float previousU, previousV, previousDepth;
+					if (!useHistory || !Reproject(currentToPrevious, (x + 0.5f) / width, (y + 0.5f) / height, depth, previousU, previousV, previousDepth))
+						continue;
+
+					int hx = (int)(previousU * history.Width);
+					int hy = (int)(previousV * history.Height);
+					const float* previous = history.Row(hy) + hx * history.Channels;
+					float expectedZ = linearDepth(previousDepth);
+					if (previous[2] <= 0.0f || fabsf(previous[1] - expectedZ) > settings.DisocclusionThreshold * expectedZ)
+						continue;
+
+					// An even average until the history weight is reached
+					float alpha = fminf(settings.HistoryWeight, previous[2] / (previous[2] + 1.0f));
+					result[0] = ao + (previous[0] - ao) * alpha;
+					result[2] = fminf(previous[2] + 1.0f, 255.0f);
+				}
+			}
+		});
+}
+
+SSAOReference::Difference SSAOReference::Compare(const FloatImage& a, const FloatImage& b, float threshold)
+{
+	Difference diff;
+	if (a.Width != b.Width || a.Height != b.Height || a.Width == 0 || a.Height == 0)
+	{
+		diff.MaxError = diff.MeanError = 1.0f;
+		diff.PixelsOverThreshold = a.Width * a.Height;
+		return diff;
+	}
+
+	double total = 0.0;
+	for (int y = 0; y < a.Height; y++)
+	{
+		const float* rowA = a.Row(y);
+		const float* rowB = b.Row(y);
+		for (int x = 0; x < a.Width; x++)
+		{
+			float error = fabsf(rowA[x * a.Channels] - rowB[x * b.Channels]);
+			total += error;
+			if (error > diff.MaxError) diff.MaxError = error;
+			if (error > threshold) diff.PixelsOverThreshold++;
+		}
+	}
+	diff.MeanError = (float)(total / ((double)a.Width * a.Height));
+	return diff;
+}
+
+// --------------------------------------------------------
+// Loads a capture folder and runs it through the reference:
+//  - settings.txt, normals.pfm and depths.pfm are required
+//  - colors.pfm and ambient.pfm are needed for the combine
+//  - gpu_ssao.pfm, gpu_blur.pfm and gpu_upsampled.pfm (at
+//    lower resolutions) are compared against
+//  - gpu_history_prev.pfm turns on temporal accumulation, and
+//    the result is compared against gpu_history.pfm
+// The best time of several runs is reported for each thread
+// count, and every thread count must match the first exactly.
+// --------------------------------------------------------
+bool SSAOReference::RunFolder(const std::string& folder, int iterations)
+{
+	std::string path = folder;
+	if (!path.empty() && path.back() != '/' && path.back() != '\\')
+		path += '/';
+
+	SSAOReferenceSettings settings;
+	FloatImage normals, depths, colors, ambient;
+	if (!settings.Load(path + "settings.txt") || !normals.LoadPFM(path + "normals.pfm") || !depths.LoadPFM(path + "depths.pfm"))
+	{
+		printf("SSAO reference: couldn't load the capture in %s\n", path.c_str());
+		return false;
+	}
+	if (normals.Width != depths.Width || normals.Height != depths.Height || normals.Channels < 3)
+	{
+		printf("SSAO reference: normals and depths don't match\n");
+		return false;
+	}
+	FloatImage previousHistory;
+	bool temporal = previousHistory.LoadPFM(path + "gpu_history_prev.pfm") && previousHistory.Channels == 3;
+	bool combine =
+		colors.LoadPFM(path + "colors.pfm") &&
+		ambient.LoadPFM(path + "ambient.pfm") &&
+		colors.Width == depths.Width && colors.Height == depths.Height &&
+		ambient.Width == depths.Width && ambient.Height == depths.Height;
+
+	int scale = settings.ResolutionScale;
+	double megapixels = depths.Width * (double)depths.Height / 1000000.0;
+	if (settings.Algorithm == SSAO_ALGORITHM_GTAO)
+		printf("SSAO reference: %dx%d at 1/%d resolution, GTAO with %d slice(s) of %d step(s), radius %.2f%s, best of %d\n",
+			depths.Width, depths.Height, scale, settings.GTAOSlices, settings.GTAOSteps, settings.Radius, temporal ? ", temporal" : "", iterations);
+	else
+		printf("SSAO reference: %dx%d at 1/%d resolution, %d samples, radius %.2f%s, best of %d\n",
+			depths.Width, depths.Height, scale, settings.Samples, settings.Radius, temporal ? ", temporal" : "", iterations);
+
+	SSAOReference reference;
+	FloatImage lowNormals, lowDepths;
+	const FloatImage& ssaoNormals = scale > 1 ? lowNormals : normals;
+	const FloatImage& ssaoDepths = scale > 1 ? lowDepths : depths;
+	FloatImage ssao, history, blurred, upsampled, combined;
+	FloatImage firstSSAO, firstAO;
+	HiZPyramid hiZ;
+	bool deterministic = true;
+
+	unsigned int maxThreads = JobSystem::GetHardwareThreadCount();
+	for (unsigned int threads = 1; ; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads)
+	{
+		JobSystem jobs(threads);
+		double best[6] = { 1e30, 1e30, 1e30, 1e30, 1e30, 1e30 };
+		for (int i = 0; i < iterations; i++)
+		{
+			// Down and upsampling are timed together
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (scale > 1)
+				reference.Downsample(normals, depths, scale, lowNormals, lowDepths, &jobs);
+			double resampleTime = MillisecondsSince(start);
+
+			start = std::chrono::steady_clock::now();
+			if (settings.UseHiZ)
+				hiZ.Build(depths, &jobs);
+			double hiZTime = MillisecondsSince(start);
+
+			start = std::chrono::steady_clock::now();
+			reference.ComputeSSAO(ssaoNormals, ssaoDepths, settings, ssao, &jobs, &hiZ);
+			double ssaoTime = MillisecondsSince(start);
+
+			start = std::chrono::steady_clock::now();
+			if (temporal)
+				reference.TemporalResolve(ssao, ssaoDepths, previousHistory, settings, history, &jobs);
+			double temporalTime = MillisecondsSince(start);
+
+			start = std::chrono::steady_clock::now();
+			reference.Blur(temporal ? history : ssao, ssaoNormals, ssaoDepths, settings, blurred, &jobs);
+			double blurTime = MillisecondsSince(start);
+
+			start = std::chrono::steady_clock::now();
+			if (scale > 1)
+				reference.Upsample(blurred, lowDepths, depths, settings, upsampled, &jobs);
+			else
+				upsampled = blurred;
+			resampleTime += MillisecondsSince(start);
+
+			double combineTime = 0.0;
+			if (combine)
+			{
+				start = std::chrono::steady_clock::now();
+				reference.Combine(colors, ambient, upsampled, combined, &jobs);
+				combineTime = MillisecondsSince(start);
+			}
+
+			if (ssaoTime < best[0]) best[0] = ssaoTime;
+			if (blurTime < best[1]) best[1] = blurTime;
+			if (resampleTime < best[2]) best[2] = resampleTime;
+			if (combineTime < best[3]) best[3] = combineTime;
+			if (temporalTime < best[4]) best[4] = temporalTime;
+			if (hiZTime < best[5]) best[5] = hiZTime;
+		}
+
+		printf("  %2u thread(s): Hi-Z %7.3f ms, SSAO %8.3f ms (%6.1f Mpixels/s), temporal %7.3f ms, blur %7.3f ms, resample %7.3f ms, combine %7.3f ms\n",
+			threads, best[5], best[0], megapixels / (best[0] / 1000.0), best[4], best[1], best[2], best[3]);
+
+		if (threads == 1)
+		{
+			firstSSAO = ssao;
+			firstAO = upsampled;
+		}
+		else if (firstSSAO.Pixels != ssao.Pixels || firstAO.Pixels != upsampled.Pixels)
+		{
+			deterministic = false;
+		}
+
+		if (threads == maxThreads)
+			break;
+	}
+	printf("  Results on every thread count %s\n", deterministic ? "match" : "DIFFER");
+
+	// The GPU writes 8 bit targets, so allow for that rounding
+	const float threshold = 2.0f / 255.0f;
+	FloatImage gpuSSAO, gpuHistory, gpuBlur, gpuUpsampled;
+	if (gpuSSAO.LoadPFM(path + "gpu_ssao.pfm"))
+	{
+		Difference diff = Compare(ssao, gpuSSAO, threshold);
+		printf("  SSAO vs GPU: max error %.4f, mean error %.5f, %d pixel(s) off by more than 2/255\n",
+			diff.MaxError, diff.MeanError, diff.PixelsOverThreshold);
+	}
+	if (temporal && gpuHistory.LoadPFM(path + "gpu_history.pfm"))
+	{
+		Difference diff = Compare(history, gpuHistory, threshold);
+		printf("  Temporal vs GPU: max error %.4f, mean error %.5f, %d pixel(s) off by more than 2/255\n",
+			diff.MaxError, diff.MeanError, diff.PixelsOverThreshold);
+	}
+	if (gpuBlur.LoadPFM(path + "gpu_blur.pfm"))
+	{
+		Difference diff = Compare(blurred, gpuBlur, threshold);
+		printf("  Blur vs GPU: max error %.4f, mean error %.5f, %d pixel(s) off by more than 2/255\n",
+			diff.MaxError, diff.MeanError, diff.PixelsOverThreshold);
+	}
+	if (scale > 1 && gpuUpsampled.LoadPFM(path + "gpu_upsampled.pfm"))
+	{
+		Difference diff = Compare(upsampled, gpuUpsampled, threshold);
+		printf("  Upsample vs GPU: max error %.4f, mean error %.5f, %d pixel(s) off by more than 2/255\n",
+			diff.MaxError, diff.MeanError, diff.PixelsOverThreshold);
+	}
+
+	ssao.SavePFM(path + "cpu_ssao.pfm");
+	if (temporal)
+		history.SavePFM(path + "cpu_history.pfm");
+	blurred.SavePFM(path + "cpu_blur.pfm");
+	if (scale > 1)
+		upsampled.SavePFM(path + "cpu_upsampled.pfm");
+	if (combine)
+		combined.SavePFM(path + "cpu_combined.pfm");
+
+	// How much each lower resolution gives up (and saves)
+	// compared to full resolution SSAO
+	printf("  Resolution scales vs full resolution (%u threads):\n", maxThreads);
+	JobSystem jobs(maxThreads);
+	SSAOReferenceSettings scaled = settings;
+	FloatImage fullAO, scaledAO;
+	double fullTime = 0.0;
+	for (int s = 1; s <= 4; s *= 2)
+	{
+		scaled.ResolutionScale = s;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		reference.Run(normals, depths, scaled, ssao, blurred, s == 1 ? fullAO : scaledAO, &jobs);
+		double time = MillisecondsSince(start);
+
+		if (s == 1)
+		{
+			fullTime = time;
+			printf("    1/1: %8.3f ms\n", time);
+			continue;
+		}
+
+		Difference diff = Compare(scaledAO, fullAO, threshold);
+		printf("    1/%d: %8.3f ms (%.1fx faster), max error %.4f, mean error %.5f, %d pixel(s) off by more than 2/255\n",
+			s, time, fullTime / time, diff.MaxError, diff.MeanError, diff.PixelsOverThreshold);
+	}
+
+	// Reading further samples from coarser mips, against
+	// reading them all from the full size depths
+	if (settings.Algorithm == SSAO_ALGORITHM_HEMISPHERE)
+	{
+		SSAOReferenceSettings full = settings;
+		full.ResolutionScale = 1;
+		full.UseHiZ = false;
+		SSAOReferenceSettings pyramid = full;
+		pyramid.UseHiZ = true;
+
+		FloatImage fullSSAO;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		reference.ComputeSSAO(normals, depths, full, fullSSAO, &jobs);
+		double fullTime = MillisecondsSince(start);
+
+		hiZ.Build(depths, &jobs);
+		start = std::chrono::steady_clock::now();
+		reference.ComputeSSAO(normals, depths, pyramid, ssao, &jobs, &hiZ);
+		double pyramidTime = MillisecondsSince(start);
+
+		Difference diff = Compare(ssao, fullSSAO, threshold);
+		printf("  Hi-Z SSAO vs full size depths: %8.3f ms vs %8.3f ms, max error %.4f, mean error %.5f, %d pixel(s) off by more than 2/255\n",
+			pyramidTime, fullTime, diff.MaxError, diff.MeanError, diff.PixelsOverThreshold);
+	}
+
+	bool hiZPassed = HiZPyramid::Test(depths, &jobs);
+	bool encodingPassed = TestNormalEncoding();
+	BenchmarkBlur(normals, depths, settings, &jobs);
+	BenchmarkKernels(normals, depths, settings, &jobs);
+	BenchmarkAlgorithms(normals, depths, settings, &jobs);
+	bool blueNoisePassed = TestBlueNoise(&jobs);
+	bool temporalPassed = TestTemporal(normals, depths, settings, &jobs);
+	return deterministic && hiZPassed && encodingPassed && blueNoisePassed && temporalPassed;
+}
+
+// --------------------------------------------------------
+// The ideal blur would remove the random vector pattern
+// without smearing occlusion across edges.  SSAO averaged over
+// 16 random vectors at every pixel (every one of a 4x4 texture,
+// or evenly spaced ones from a larger one) has no pattern and
+// no smearing, so each blur is measured against that.
+// --------------------------------------------------------
+void SSAOReference::ComputeIdealSSAO(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& ideal, JobSystem* jobs)
+{
+	SSAOReference reference;
+	FloatImage ssao;
+	ideal.Resize(depths.Width, depths.Height, 1);
+	std::fill(ideal.Pixels.begin(), ideal.Pixels.end(), 0.0f);
+
+	// Shifting the random vectors gives every pixel each one in turn
+	SSAOReferenceSettings shifted = settings;
+	shifted.Algorithm = SSAO_ALGORITHM_HEMISPHERE;
+	shifted.Jitter = SSAOFrameJitter();
+	int count = (int)settings.RandomVectors.size();
+	int shifts = count < 16 ? count : 16;
+	for (int shift = 0; shift < shifts; shift++)
+	{
+		for (int i = 0; i < count; i++)
+			shifted.RandomVectors[i] = settings.RandomVectors[(i + shift * (count / shifts)) % count];
+		reference.ComputeSSAO(normals, depths, shifted, ssao, jobs);
+		for (size_t i = 0; i < ideal.Pixels.size(); i++)
+			ideal.Pixels[i] += ssao.Pixels[i] / shifts;
+	}
+}
+
+void SSAOReference::BenchmarkBlur(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, JobSystem* jobs)
+{
+	int width = depths.Width;
+	int height = depths.Height;
+	SSAOReference reference;
+
+	FloatImage ssao, ideal;
+	ComputeIdealSSAO(normals, depths, settings, ideal, jobs);
+	reference.ComputeSSAO(normals, depths, settings, ssao, jobs);
+
+	// Pixels within the blur radius of a depth edge (a jump of
+	// more than 10% in view space depth between neighbors)
+	XMFLOAT4X4 invProj;
+	XMStoreFloat4x4(&invProj, XMMatrixInverse(0, XMLoadFloat4x4(&settings.Projection)));
+	auto linearDepth = [&](int x, int y)
+		{
+			float depth = depths.Row(y)[x * depths.Channels];
+			return (depth * invProj.m[2][2] + invProj.m[3][2]) / (depth * invProj.m[2][3] + invProj.m[3][3]);
+		};
+	std::vector<bool> edges((size_t)width * height, false);
+	int reach = settings.BlurRadius > 2 ? settings.BlurRadius : 2;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float z = linearDepth(x, y);
+			bool edge =
+				(x + 1 < width && fabsf(linearDepth(x + 1, y) - z) > z * 0.1f) ||
+				(y + 1 < height && fabsf(linearDepth(x, y + 1) - z) > z * 0.1f);
+			if (!edge)
+				continue;
+
+			for (int ey = y - reach; ey <= y + reach; ey++)
+				for (int ex = x - reach; ex <= x + reach; ex++)
+					if (ex >= 0 && ey >= 0 && ex < width && ey < height)
+						edges[(size_t)ey * width + ex] = true;
+		}
+	}
+
+	auto report = [&](const char* name, const FloatImage& blurred, double time, int aoFetches, int totalFetches)
+		{
+			double total = 0.0;
+			double edgeTotal = 0.0;
+			int edgeCount = 0;
+			for (size_t i = 0; i < blurred.Pixels.size(); i++)
+			{
+				double error = fabs(blurred.Pixels[i] - ideal.Pixels[i]);
+				total += error;
+				if (edges[i])
+				{
+					edgeTotal += error;
+					edgeCount++;
+				}
+			}
+			printf("    %-22s %3d AO / %4d total fetches, %8.3f ms, mean error %.5f (%.5f near edges)\n",
+				name, aoFetches, totalFetches, time,
+				total / blurred.Pixels.size(), edgeCount ? edgeTotal / edgeCount : 0.0);
+		};
+
+	int taps = settings.BlurRadius * 2 + 1;
+	printf("  Blurs vs SSAO averaged over every random vector (%.1f%% of pixels near edges):\n",
+		100.0 * std::count(edges.begin(), edges.end(), true) / edges.size());
+
+	FloatImage blurred;
+	report("None", ssao, 0.0, 1, 1);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	reference.BoxBlur(ssao, blurred, jobs);
+	report("4x4 box", blurred, MillisecondsSince(start), 16, 16);
+
+	// A single pass bilateral blur would fetch every
+	// texture once per tap, across the whole square
+	start = std::chrono::steady_clock::now();
+	reference.Blur(ssao, normals, depths, settings, blurred, jobs);
+	double time = MillisecondsSince(start);
+	printf("    (non-separable bilateral, radius %d: %d AO / %d total fetches)\n", settings.BlurRadius, taps * taps, taps * taps * 3);
+	report("Separable bilateral", blurred, time, taps * 2, taps * 2 * 3);
+}
+
+// --------------------------------------------------------
+// Reprojection is checked against transforming each pixel's
+// world space position directly, and rejection against history
+// that's too far away.  Then a still camera accumulates jittered
+// frames, which should end up closer to SSAO averaged over every
+// random vector than a single frame with all 64 samples.
+// --------------------------------------------------------
+bool SSAOReference::TestTemporal(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, JobSystem* jobs)
+{
+	int width = depths.Width;
+	int height = depths.Height;
+	SSAOReference reference;
+	bool passed = true;
+	printf("  Temporal accumulation:\n");
+
+	SSAOReferenceSettings still = settings;
+	still.Jitter = SSAOFrameJitter();
+	still.ResolutionScale = 1;
+	XMMATRIX viewProj = XMMatrixMultiply(XMLoadFloat4x4(&settings.View), XMLoadFloat4x4(&settings.Projection));
+	XMStoreFloat4x4(&still.PreviousViewProjection, viewProj);
+
+	// A still camera puts every pixel right back where it was
+	XMFLOAT4X4 currentToPrevious = CurrentToPrevious(still);
+	int moved = 0;
+	float maxDepthError = 0.0f;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float depth = depths.Row(y)[x * depths.Channels];
+			if (depth == 1.0f)
+				continue;
+
+			float u, v, previousDepth;
+			if (!Reproject(currentToPrevious, (x + 0.5f) / width, (y + 0.5f) / height, depth, u, v, previousDepth) ||
+				(int)(u * width) != x || (int)(v * height) != y)
+				moved++;
+			else
+				maxDepthError = fmaxf(maxDepthError, fabsf(previousDepth - depth));
+		}
+	}
+	bool stillPassed = moved == 0 && maxDepthError < 1e-4f;
+	printf("    Still camera: %d pixel(s) moved, max depth error %g - %s\n", moved, maxDepthError, stillPassed ? "ok" : "FAILED");
+	passed = passed && stillPassed;
+
+	// Moving and turning the camera matches projecting each
+	// pixel's world space position with last frame's camera
+	SSAOReferenceSettings moving = still;
+	XMMATRIX previousView = XMMatrixMultiply(XMLoadFloat4x4(&settings.View), XMMatrixMultiply(XMMatrixRotationY(0.05f), XMMatrixTranslation(0.2f, -0.1f, 0.3f)));
+	XMMATRIX previousViewProj = XMMatrixMultiply(previousView, XMLoadFloat4x4(&settings.Projection));
+	XMStoreFloat4x4(&moving.PreviousViewProjection, previousViewProj);
+	currentToPrevious = CurrentToPrevious(moving);
+	XMMATRIX invViewProj = XMMatrixInverse(0, viewProj);
+	float maxError = 0.0f;
+	int onScreen = 0;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float depth = depths.Row(y)[x * depths.Channels];
+			float u = (x + 0.5f) / width;
+			float v = (y + 0.5f) / height;
+			XMVECTOR world = XMVector3TransformCoord(XMVectorSet(u * 2.0f - 1.0f, 1.0f - v * 2.0f, depth, 1.0f), invViewProj);
+			XMFLOAT3 expected;
+			XMStoreFloat3(&expected, XMVector3TransformCoord(world, previousViewProj));
+
+			float previousU, previousV, previousDepth;
+			if (!Reproject(currentToPrevious, u, v, depth, previousU, previousV, previousDepth))
+				continue;
+			onScreen++;
+			maxError = fmaxf(maxError, fabsf(previousU - (expected.x * 0.5f + 0.5f)));
+			maxError = fmaxf(maxError, fabsf(previousV - (0.5f - expected.y * 0.5f)));
+			maxError = fmaxf(maxError, fabsf(previousDepth - expected.z));
+		}
+	}
+	bool movingPassed = maxError < 1e-3f;
+	printf("    Moving camera: %.1f%% of pixels still on screen, max error %g - %s\n",
+		100.0 * onScreen / ((double)width * height), maxError, movingPassed ? "ok" : "FAILED");
+	passed = passed && movingPassed;
+
+	// History from a surface 20% farther away is thrown out, and
+	// history at the right depth is blended in
+	FloatImage ssao, history, resolved;
+	still.HistoryValid = true;
+	reference.ComputeSSAO(normals, depths, still, ssao, jobs);
+	reference.TemporalResolve(ssao, depths, history, still, resolved, jobs);
+	int rejectErrors = 0;
+	int keepErrors = 0;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		bool occluded = pass == 0;
+		history = resolved;
+		for (int y = 0; y < height; y++)
+		{
+			float* row = history.Row(y);
+			for (int x = 0; x < width; x++)
+			{
+				row[x * 3 + 0] = 0.0f;
+				row[x * 3 + 1] *= occluded ? 1.2f : 1.0f;
+				row[x * 3 + 2] = row[x * 3 + 2] > 0.0f ? 8.0f : 0.0f;
+			}
+		}
+		reference.TemporalResolve(ssao, depths, history, still, resolved, jobs);
+
+		float alpha = fminf(still.HistoryWeight, 8.0f / 9.0f);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				if (depths.Row(y)[x * depths.Channels] == 1.0f)
+					continue;
+
+				float ao = ssao.Row(y)[x];
+				const float* result = resolved.Row(y) + x * 3;
+				if (occluded && (result[2] != 1.0f || result[0] != ao))
+					rejectErrors++;
+				if (!occluded && (result[2] != 9.0f || fabsf(result[0] - ao * (1.0f - alpha)) > 1e-5f))
+					keepErrors++;
+			}
+		}
+	}
+	bool rejectPassed = rejectErrors == 0 && keepErrors == 0;
+	printf("    Disocclusion: %d occluded pixel(s) kept, %d visible pixel(s) thrown out - %s\n",
+		rejectErrors, keepErrors, rejectPassed ? "ok" : "FAILED");
+	passed = passed && rejectPassed;
+
+	// Fewer samples a frame, accumulated over several frames
+	FloatImage ideal;
+	SSAOReferenceSettings full = still;
+	full.Samples = 64;
+	ComputeIdealSSAO(normals, depths, full, ideal, jobs);
+	reference.ComputeSSAO(normals, depths, full, ssao, jobs);
+	Difference single = Compare(ssao, ideal, 2.0f / 255.0f);
+	printf("    vs SSAO averaged over every random vector:\n");
+	printf("      64 samples, 1 frame:    mean error %.5f, %5.1f%% of pixels off by more than 2/255\n",
+		single.MeanError, 100.0 * single.PixelsOverThreshold / ((double)width * height));
+
+	for (int samples = 8; samples <= 16; samples *= 2)
+	{
+		SSAOReferenceSettings frame = still;
+		frame.Samples = samples;
+		history = FloatImage();
+		double time = 0.0;
+		const int frames = 16;
+		for (int f = 0; f < frames; f++)
+		{
+			frame.Jitter = SSAOFrameJitter::ForFrame((unsigned int)f, samples, settings.NoiseSize);
+			frame.HistoryValid = f > 0;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			reference.ComputeSSAO(normals, depths, frame, ssao, jobs);
+			reference.TemporalResolve(ssao, depths, history, frame, resolved, jobs);
+			time += MillisecondsSince(start);
+			std::swap(history, resolved);
+		}
+
+		Difference accumulated = Compare(history, ideal, 2.0f / 255.0f);
+		printf("      %2d samples, %d frames: mean error %.5f, %5.1f%% of pixels off by more than 2/255, %.3f ms a frame\n",
+			samples, frames, accumulated.MeanError, 100.0 * accumulated.PixelsOverThreshold / ((double)width * height), time / frames);
+		if (samples == 16 && accumulated.MeanError > single.MeanError)
+		{
+			printf("      16 samples over %d frames should beat 64 samples in one - FAILED\n", frames);
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+// --------------------------------------------------------
+// The camera looks down at a sphere sitting on the floor in
+// front of a wall, so there's occlusion in the corners, around
+// the sphere's base and at depth edges, and sky above the wall
+// --------------------------------------------------------
+void SSAOReference::BuildTestScene(int width, int height, SSAOReferenceSettings& settings, FloatImage& normals, FloatImage& depths, JobSystem* jobs)
+{
+	settings = SSAOReferenceSettings();
+	XMMATRIX view = XMMatrixLookToLH(XMVectorSet(0.0f, 2.0f, -5.0f, 0.0f), XMVectorSet(0.0f, -0.3f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, width / (float)height, 0.1f, 100.0f);
+	XMStoreFloat4x4(&settings.View, view);
+	XMStoreFloat4x4(&settings.Projection, projection);
+	XMStoreFloat4x4(&settings.PreviousViewProjection, XMMatrixMultiply(view, projection));
+
+	// The same random numbers each time, so runs compare
+	PCG32 random(1234);
+	GenerateSSAOKernel(SSAO_KERNEL_RANDOM, settings.Offsets, 64, random);
+	settings.NoiseSize = GenerateSSAONoise(SSAO_NOISE_WHITE, settings.RandomVectors, random, jobs);
+
+	// Sky pixels are left at depth 1 with no normal, as the
+	// G-buffer is cleared
+	normals.Resize(width, height, 3);
+	depths.Resize(width, height, 1);
+	std::fill(normals.Pixels.begin(), normals.Pixels.end(), 0.0f);
+	std::fill(depths.Pixels.begin(), depths.Pixels.end(), 1.0f);
+
+	XMMATRIX viewProj = XMMatrixMultiply(view, projection);
+	XMMATRIX invViewProj = XMMatrixInverse(0, viewProj);
+	const XMFLOAT3 center(0.0f, 1.0f, 0.0f);
+	const float radius = 1.0f;
+	const float wallZ = 2.0f;
+	const float wallHeight = 3.0f;
+
+	ForEach(height, jobs, [&](int y)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float ndcX = (x + 0.5f) / width * 2.0f - 1.0f;
+			float ndcY = 1.0f - (y + 0.5f) / height * 2.0f;
+			XMFLOAT3 origin, end;
+			XMStoreFloat3(&origin, XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0.0f, 1.0f), invViewProj));
+			XMStoreFloat3(&end, XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), invViewProj));
+			XMFLOAT3 direction(end.x - origin.x, end.y - origin.y, end.z - origin.z);
+
+			// Closest hit, along the ray from the near plane (0) to the far plane (1)
+			float t = 1.0f;
+			XMFLOAT3 normal(0.0f, 0.0f, 0.0f);
+			if (direction.y < 0.0f && -origin.y / direction.y < t)
+			{
+				t = -origin.y / direction.y;
+				normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			}
+			if (direction.z > 0.0f)
+			{
+				float wallT = (wallZ - origin.z) / direction.z;
+				if (wallT < t && origin.y + direction.y * wallT < wallHeight)
+				{
+					t = wallT;
+					normal = XMFLOAT3(0.0f, 0.0f, -1.0f);
+				}
+			}
+			XMFLOAT3 toOrigin(origin.x - center.x, origin.y - center.y, origin.z - center.z);
+			float a = Dot3(direction, direction);
+			float b = Dot3(toOrigin, direction);
+			float c = Dot3(toOrigin, toOrigin) - radius * radius;
+			float discriminant = b * b - a * c;
+			if (discriminant > 0.0f)
+			{
+				float sphereT = (-b - sqrtf(discriminant)) / a;
+				if (sphereT > 0.0f && sphereT < t)
+				{
+					t = sphereT;
+					normal = XMFLOAT3(
+						(toOrigin.x + direction.x * t) / radius,
+						(toOrigin.y + direction.y * t) / radius,
+						(toOrigin.z + direction.z * t) / radius);
+				}
+			}
+			if (t >= 1.0f)
+				continue;
+
+			XMFLOAT3 projected;
+			XMVECTOR hit = XMVectorSet(origin.x + direction.x * t, origin.y + direction.y * t, origin.z + direction.z * t, 1.0f);
+			XMStoreFloat3(&projected, XMVector3TransformCoord(hit, viewProj));
+			depths.Row(y)[x] = projected.z;
+
+			float* encoded = normals.Row(y) + x * 3;
+			encoded[0] = normal.x * 0.5f + 0.5f;
+			encoded[1] = normal.y * 0.5f + 0.5f;
+			encoded[2] = normal.z * 0.5f + 0.5f;
+		}
+	});
+}
+
+bool SSAOReference::RunTests()
+{
+	const int width = 320;
+	const int height = 180;
+	JobSystem jobs(JobSystem::GetHardwareThreadCount());
+	SSAOReferenceSettings settings;
+	FloatImage normals, depths;
+	BuildTestScene(width, height, settings, normals, depths, &jobs);
+	printf("SSAO tests: %dx%d test scene\n", width, height);
+
+	bool hiZPassed = HiZPyramid::Test(depths, &jobs);
+	bool encodingPassed = TestNormalEncoding();
+	bool blueNoisePassed = TestBlueNoise(&jobs);
+	bool temporalPassed = TestTemporal(normals, depths, settings, &jobs);
+	bool passed = hiZPassed && encodingPassed && blueNoisePassed && temporalPassed;
+	printf("SSAO tests %s\n", passed ? "passed" : "FAILED");
+	return passed;
+}
+
+// --------------------------------------------------------
+// Each kernel and noise is measured against its own converged
+// result (every sample, averaged over 16 random vectors), as
+// the SSAO pass runs them: the first samples of the kernel, in
+// a single frame.  The random kernel's lengths grow with the
+// index, so its first samples are all short ones, while every
+// prefix of the Halton kernel covers every length.
+// --------------------------------------------------------
+void SSAOReference::BenchmarkKernels(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, JobSystem* jobs)
+{
+	SSAOReference reference;
+	const float threshold = 2.0f / 255.0f;
+
+	printf("  Kernels and random vectors (mean error against each one's own 64 sample result, before / after the blur):\n");
+	printf("                      ");
+	for (int samples = 8; samples <= 64; samples *= 2)
+		printf("   %2d samples     ", samples);
+	printf("\n");
+
+	for (int kernel = SSAO_KERNEL_RANDOM; kernel <= SSAO_KERNEL_HALTON; kernel++)
+	{
+		for (int noise = SSAO_NOISE_WHITE; noise <= SSAO_NOISE_BLUE; noise++)
+		{
+			// The same random numbers each time, so runs compare
+			PCG32 random(1234);
+			SSAOReferenceSettings config = settings;
+			config.Algorithm = SSAO_ALGORITHM_HEMISPHERE;
+			config.UseHiZ = false;
+			config.Jitter = SSAOFrameJitter();
+			config.Samples = 64;
+			GenerateSSAOKernel(kernel, config.Offsets, 64, random);
+			config.NoiseSize = GenerateSSAONoise(noise, config.RandomVectors, random, jobs);
+
+			FloatImage truth, ssao, blurred;
+			ComputeIdealSSAO(normals, depths, config, truth, jobs);
+
+			printf("    %-6s %2dx%-2d %-5s ",
+				kernel == SSAO_KERNEL_HALTON ? "Halton" : "Random",
+				config.NoiseSize, config.NoiseSize,
+				noise == SSAO_NOISE_BLUE ? "blue" : "white");
+			for (int samples = 8; samples <= 64; samples *= 2)
+			{
+				config.Samples = samples;
+				reference.ComputeSSAO(normals, depths, config, ssao, jobs);
+				reference.Blur(ssao, normals, depths, config, blurred, jobs);
+				Difference raw = Compare(ssao, truth, threshold);
+				Difference smooth = Compare(blurred, truth, threshold);
+				printf("  %.4f / %.4f  ", raw.MeanError, smooth.MeanError);
+			}
+			printf("\n");
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Each algorithm is measured against what it converges to -
+// the hemisphere kernel averaged over every random vector, and
+// GTAO with many slices and steps - since they estimate
+// slightly different things (GTAO is cosine weighted).  The
+// hemisphere kernel takes evenly spaced offsets from the full
+// kernel, and GTAO uses four steps each way per slice.
+// --------------------------------------------------------
+void SSAOReference::BenchmarkAlgorithms(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, JobSystem* jobs)
+{
+	SSAOReference reference;
+	const float threshold = 2.0f / 255.0f;
+	double pixels = (double)depths.Width * depths.Height;
+
+	SSAOReferenceSettings hemisphere = settings;
+	hemisphere.Algorithm = SSAO_ALGORITHM_HEMISPHERE;
+	hemisphere.Jitter = SSAOFrameJitter();
+	hemisphere.Samples = 64;
+	FloatImage hemisphereTruth;
+	ComputeIdealSSAO(normals, depths, hemisphere, hemisphereTruth, jobs);
+
+	SSAOReferenceSettings gtao = settings;
+	gtao.Algorithm = SSAO_ALGORITHM_GTAO;
+	gtao.Jitter = SSAOFrameJitter();
+	gtao.GTAOSlices = 16;
+	gtao.GTAOSteps = 16;
+	FloatImage gtaoTruth;
+	reference.ComputeSSAO(normals, depths, gtao, gtaoTruth, jobs);
+
+	Difference between = Compare(hemisphereTruth, gtaoTruth, threshold);
+	printf("  Hemisphere vs GTAO at equal depth samples per pixel (converged results differ by %.4f on average):\n", between.MeanError);
+
+	FloatImage ssao;
+	for (int samples = 8; samples <= 64; samples *= 2)
+	{
+		hemisphere.Samples = samples;
+		hemisphere.Jitter.SampleStride = 64 / samples;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		reference.ComputeSSAO(normals, depths, hemisphere, ssao, jobs);
+		double hemisphereTime = MillisecondsSince(start);
+		Difference hemisphereError = Compare(ssao, hemisphereTruth, threshold);
+
+		gtao.GTAOSteps = 4;
+		gtao.GTAOSlices = samples / (gtao.GTAOSteps * 2);
+		start = std::chrono::steady_clock::now();
+		reference.ComputeSSAO(normals, depths, gtao, ssao, jobs);
+		double gtaoTime = MillisecondsSince(start);
+		Difference gtaoError = Compare(ssao, gtaoTruth, threshold);
+
+		printf("    %2d samples: hemisphere %8.3f ms, mean error %.5f, %5.1f%% over 2/255 | GTAO (%d slice(s)) %8.3f ms, mean error %.5f, %5.1f%% over 2/255\n",
+			samples,
+			hemisphereTime, hemisphereError.MeanError, 100.0 * hemisphereError.PixelsOverThreshold / pixels,
+			gtao.GTAOSlices, gtaoTime, gtaoError.MeanError, 100.0 * gtaoError.PixelsOverThreshold / pixels);
+	}
+}
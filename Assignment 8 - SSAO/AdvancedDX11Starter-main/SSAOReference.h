@@ -0,0 +1,204 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+#include "FloatImage.h"
+#include "HiZPyramid.h"
+#include "JobSystem.h"
+
+// Which ambient occlusion algorithm the SSAO pass uses
+#define SSAO_ALGORITHM_HEMISPHERE	0 // SSAOPS - samples in a hemisphere kernel
+#define SSAO_ALGORITHM_GTAO			1 // GTAOPS - horizon search in screen space slices
+
+// --------------------------------------------------------
+// What changes from frame to frame with temporal SSAO: the
+// random vectors are rotated and shifted across the screen,
+// and each frame uses a different subset of the kernel.
+// The defaults are plain (non-temporal) SSAO.
+// --------------------------------------------------------
+struct SSAOFrameJitter
+{
+	float RotationCos = 1.0f;
+	float RotationSin = 0.0f;
+	int NoiseOffsetX = 0;
+	int NoiseOffsetY = 0;
+
+	// Sample i uses kernel offset i * SampleStride + SampleOffset
+	int SampleStride = 1;
+	int SampleOffset = 0;
+
+	static SSAOFrameJitter ForFrame(unsigned int frame, int samples, int noiseSize);
+};
+
+// --------------------------------------------------------
+// Everything the SSAO pass uses besides the G-buffer: the
+// camera, the sample kernel and the random vectors (see
+// SSAOSampling.h), tiled across the screen.
+// Saved as plain text, so captures are easy to inspect.
+// --------------------------------------------------------
+struct SSAOReferenceSettings
+{
+	DirectX::XMFLOAT4X4 View;
+	DirectX::XMFLOAT4X4 Projection;
+	DirectX::XMFLOAT4 Offsets[64];
+	std::vector<DirectX::XMFLOAT4> RandomVectors; // NoiseSize * NoiseSize, row by row
+	int NoiseSize = 4;
+	float Radius = 1.0f;
+	int Samples = 64;
+
+	// GTAO runs slices * steps * 2 depth samples per pixel
+	int Algorithm = SSAO_ALGORITHM_HEMISPHERE;
+	int GTAOSlices = 2;
+	int GTAOSteps = 4;
+
+	// Should the hemisphere kernel read further samples from
+	// coarser mips of the Hi-Z pyramid?  (mip 0 is full size)
+	bool UseHiZ = false;
+
+	// SSAO runs at 1/ResolutionScale size on each axis, and
+	// is upsampled with this much preference for similar depths
+	int ResolutionScale = 1;
+	float UpsampleSharpness = 20.0f;
+
+	// The bilateral blur's radius (in pixels, each way) and
+	// how quickly it stops blending across depth and normals
+	int BlurRadius = 4;
+	float BlurDepthSharpness = 20.0f;
+	float BlurNormalPower = 8.0f;
+
+	// Temporal accumulation - this frame's jitter, last frame's
+	// camera, how much history can be kept and how big a change
+	// in depth (relative) throws it out
+	SSAOFrameJitter Jitter;
+	DirectX::XMFLOAT4X4 PreviousViewProjection;
+	bool HistoryValid = false;
+	float HistoryWeight = 0.9f;
+	float DisocclusionThreshold = 0.05f;
+
+	bool Load(const std::string& file);
+	bool Save(const std::string& file) const;
+};
+
+// --------------------------------------------------------
+// CPU versions of SSAOPS, GTAOPS, BlurSSAOPS and the other
+// SSAO shaders, using the same math and sampling as the
+// shaders, so the results can be checked (and timed) without
+// a GPU.
+//
+// The image is split into tiles, which are spread across the
+// job system's threads.  Within a tile, SSAO is worked out
+// for four neighboring pixels at once, one per SIMD lane.
+// GTAO's horizon search branches too much per pixel for that,
+// so it runs one pixel at a time.
+// Tiles never share output, so the results are identical on
+// any number of threads.
+// --------------------------------------------------------
+class SSAOReference
+{
+public:
+	static const int TileSize = 32;
+
+	// Depths holds the G-buffer's post-projection depth, and
+	// normals its 0-1 encoded world space normals.  Runs SSAOPS
+	// or GTAOPS, depending on the settings' algorithm.  With
+	// UseHiZ, the hemisphere kernel's samples come from hiZ.
+	void ComputeSSAO(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& ssao, JobSystem* jobs,
+		const HiZPyramid* hiZ = 0);
+	void Blur(const FloatImage& ssao, const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& blurred, JobSystem* jobs);
+	void Combine(const FloatImage& colors, const FloatImage& ambient, const FloatImage& ssaoBlur, FloatImage& output, JobSystem* jobs);
+
+	// DownsampleSSAOPS and UpsampleSSAOPS, for SSAO at a lower
+	// resolution - see the shaders for the details
+	void Downsample(const FloatImage& normals, const FloatImage& depths, int factor, FloatImage& lowNormals, FloatImage& lowDepths, JobSystem* jobs);
+	void Upsample(const FloatImage& lowAO, const FloatImage& lowDepths, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& ao, JobSystem* jobs);
+
+	// Where a pixel was last frame.  currentToPrevious takes this
+	// frame's NDC positions to last frame's clip space.  Returns
+	// false if it was behind the camera or off screen.
+	static DirectX::XMFLOAT4X4 CurrentToPrevious(const SSAOReferenceSettings& settings);
+	static bool Reproject(const DirectX::XMFLOAT4X4& currentToPrevious, float u, float v, float depth, float& previousU, float& previousV, float& previousDepth);
+
+	// TemporalSSAOPS - blends this frame's SSAO with the history
+	// (AO, view space depth, frame count) reprojected from last
+	// frame, and writes the new history
+	void TemporalResolve(const FloatImage& ssao, const FloatImage& depths, const FloatImage& history, const SSAOReferenceSettings& settings, FloatImage& output, JobSystem* jobs);
+
+	// Every pass but the combine, at the settings' resolution
+	// scale.  The SSAO and blur results are at the reduced size,
+	// while ao is always full size (what the combine uses).  With
+	// a history, the SSAO is accumulated into newHistory first.
+	// The Hi-Z pyramid is built from the full size depths.
+	void Run(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& ssao, FloatImage& blurred, FloatImage& ao, JobSystem* jobs,
+		const FloatImage* history = 0, FloatImage* newHistory = 0);
+
+	// The 4x4 box blur BlurSSAOPS used before the bilateral
+	// blur, kept to compare against
+	void BoxBlur(const FloatImage& ssao, FloatImage& blurred, JobSystem* jobs);
+
+	// Differences in the first channel of two images
+	struct Difference
+	{
+		float MaxError = 0.0f;
+		float MeanError = 0.0f;
+		int PixelsOverThreshold = 0;
+	};
+	static Difference Compare(const FloatImage& a, const FloatImage& b, float threshold);
+
+	// Runs every pass on a capture folder (see
+	// Game::CaptureSSAOReference) on more and more threads,
+	// reports the timings and any difference from the GPU's
+	// results, and saves the CPU results alongside them.  Also
+	// compares each lower resolution against full resolution,
+	// and SSAO with the Hi-Z pyramid against without it, and
+	// checks the G-buffer's normal encoding and the blue noise.
+	static bool RunFolder(const std::string& folder, int iterations);
+
+	// Compares the box and bilateral blurs: texture fetches per
+	// pixel, time, and error (overall and near depth edges)
+	// against SSAO averaged over all 16 random vectors
+	static void BenchmarkBlur(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, JobSystem* jobs);
+
+	// Checks the reprojection and history rejection, and compares
+	// accumulating fewer samples over several frames to every
+	// sample in a single frame.  Returns false if a check fails.
+	static bool TestTemporal(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, JobSystem* jobs);
+
+	// A floor, a wall and a sphere, ray traced into a G-buffer
+	// (0-1 normals and post-projection depths) with a camera,
+	// kernel and random vectors to match, so the checks above
+	// can run without a capture
+	static void BuildTestScene(int width, int height, SSAOReferenceSettings& settings, FloatImage& normals, FloatImage& depths, JobSystem* jobs);
+
+	// Runs every check that doesn't need a capture on the test
+	// scene.  Returns false if any of them fails.
+	static bool RunTests();
+
+	// Compares the random and Halton kernels, each with white and
+	// blue noise random vectors, at several sample counts: error
+	// against each one's own 64 sample result, before and after
+	// the blur
+	static void BenchmarkKernels(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, JobSystem* jobs);
+
+	// Compares the hemisphere kernel and GTAO at the same number
+	// of depth samples per pixel: time, and error against each
+	// algorithm's own result with many more samples
+	static void BenchmarkAlgorithms(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, JobSystem* jobs);
+
+private:
+	FloatImage blurTemp;
+	FloatImage blurDepths;
+	FloatImage blurNormals;
+	FloatImage lowNormals;
+	FloatImage lowDepths;
+	HiZPyramid hiZ;
+
+	// GTAOPS for every pixel
+	void ComputeGTAO(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& ssao, JobSystem* jobs);
+
+	// SSAO averaged over 16 of the random vectors (all of them
+	// for 4x4 noise) at every pixel
+	static void ComputeIdealSSAO(const FloatImage& normals, const FloatImage& depths, const SSAOReferenceSettings& settings, FloatImage& ideal, JobSystem* jobs);
+
+	void BilateralPass(const FloatImage& input, FloatImage& output, bool horizontal, const FloatImage& depths, const SSAOReferenceSettings& settings, JobSystem* jobs);
+};
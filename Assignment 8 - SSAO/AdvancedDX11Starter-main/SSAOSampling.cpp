@@ -0,0 +1,326 @@
+#include "SSAOSampling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace DirectX;
+
+namespace
+{
+	const float TwoPi = 6.28318531f;
+
+	// The energy of every pixel (0 or 1) in the pattern, spread
+	// by a gaussian that wraps around the edges so the texture tiles
+	class NoiseEnergy
+	{
+	public:
+		NoiseEnergy(int size) : size(size), gaussian(size * size), energy(size * size, 0.0f)
+		{
+			// Ulichney's sigma of 1.5
+			for (int y = 0; y < size; y++)
+			{
+				for (int x = 0; x < size; x++)
+				{
+					float dx = (float)(x < size - x ? x : size - x);
+					float dy = (float)(y < size - y ? y : size - y);
+					gaussian[y * size + x] = expf(-(dx * dx + dy * dy) / (2.0f * 1.5f * 1.5f));
+				}
+			}
+		}
+
+		void Splat(int index, float sign)
+		{
+			int px = index % size;
+			int py = index / size;
+			for (int y = 0; y < size; y++)
+			{
+				const float* row = &gaussian[((y - py + size) % size) * size];
+				float* out = &energy[y * size];
+				for (int x = 0; x < size; x++)
+					out[x] += sign * row[(x - px + size) % size];
+			}
+		}
+
+		// The highest (or lowest) energy pixel with this value,
+		// the first one on ties
+		int Find(const std::vector<unsigned char>& pattern, unsigned char value, bool highest) const
+		{
+			int best = -1;
+			for (int i = 0; i < (int)energy.size(); i++)
+			{
+				if (pattern[i] != value)
+					continue;
+				if (best < 0 || (highest ? energy[i] > energy[best] : energy[i] < energy[best]))
+					best = i;
+			}
+			return best;
+		}
+
+		void Clear() { std::fill(energy.begin(), energy.end(), 0.0f); }
+
+	private:
+		int size;
+		std::vector<float> gaussian;
+		std::vector<float> energy;
+	};
+
+	// Rotation angles from one texture's ranks, step offsets from the other's
+	void VectorsFromRanks(const std::vector<int>& rotationRanks, const std::vector<int>& stepRanks, std::vector<XMFLOAT4>& vectors)
+	{
+		float count = (float)rotationRanks.size();
+		vectors.resize(rotationRanks.size());
+		for (size_t i = 0; i < vectors.size(); i++)
+		{
+			float angle = (rotationRanks[i] + 0.5f) / count * TwoPi;
+			vectors[i] = XMFLOAT4(cosf(angle), sinf(angle), 0.0f, (stepRanks[i] + 0.5f) / count);
+		}
+	}
+
+	// The average distance (wrapping around) from each of the
+	// lowest ranked pixels to its nearest neighbor among them
+	float MeanNearestDistance(const std::vector<int>& ranks, int size, int points)
+	{
+		std::vector<int> chosen;
+		for (int i = 0; i < (int)ranks.size(); i++)
+			if (ranks[i] < points)
+				chosen.push_back(i);
+
+		double total = 0.0;
+		for (size_t a = 0; a < chosen.size(); a++)
+		{
+			float nearest = FLT_MAX;
+			for (size_t b = 0; b < chosen.size(); b++)
+			{
+				if (a == b)
+					continue;
+				int dx = abs(chosen[a] % size - chosen[b] % size);
+				int dy = abs(chosen[a] / size - chosen[b] / size);
+				dx = dx < size - dx ? dx : size - dx;
+				dy = dy < size - dy ? dy : size - dy;
+				nearest = fminf(nearest, sqrtf((float)(dx * dx + dy * dy)));
+			}
+			total += nearest;
+		}
+		return chosen.empty() ? 0.0f : (float)(total / chosen.size());
+	}
+
+	const uint64_t BlueNoiseSeeds[2] = { 0x5EED0001ULL, 0x5EED0002ULL };
+
+	void BakeBlueNoiseVectors(std::vector<XMFLOAT4>& vectors, JobSystem* jobs)
+	{
+		std::vector<int> ranks[2];
+		auto bake = [&ranks](int i) { BakeBlueNoise(SSAO_BLUE_NOISE_SIZE, BlueNoiseSeeds[i], ranks[i]); };
+		if (jobs)
+			jobs->ParallelFor(2, bake);
+		else
+			for (int i = 0; i < 2; i++)
+				bake(i);
+		VectorsFromRanks(ranks[0], ranks[1], vectors);
+	}
+}
+
+float RadicalInverse(unsigned int index, unsigned int base)
+{
+	float inverseBase = 1.0f / base;
+	float digitScale = inverseBase;
+	float result = 0.0f;
+	while (index > 0)
+	{
+		result += (index % base) * digitScale;
+		index /= base;
+		digitScale *= inverseBase;
+	}
+	return result;
+}
+
+// --------------------------------------------------------
+// The Halton kernel skips base 2: temporal SSAO takes every
+// 2nd, 4th, ... offset, and those would all share their first
+// base 2 digits (and so cover only part of the range)
+// --------------------------------------------------------
+void GenerateSSAOKernel(int kernel, XMFLOAT4* offsets, int count, PCG32& random)
+{
+	for (int i = 0; i < count; i++)
+	{
+		XMVECTOR direction;
+		float scale;
+		if (kernel == SSAO_KERNEL_HALTON)
+		{
+			// Cosine weighted directions, from the 2nd point on
+			float u = RadicalInverse(i + 1, 3);
+			float angle = RadicalInverse(i + 1, 5) * TwoPi;
+			float r = sqrtf(u);
+			direction = XMVectorSet(r * cosf(angle), r * sinf(angle), sqrtf(1.0f - u), 0);
+			scale = RadicalInverse(i + 1, 7);
+		}
+		else
+		{
+			// Offsets should be in hemisphere ([-1,1], [-1,1], [0,1])
+			direction = XMVector3Normalize(XMVectorSet(
+				random.Range(-1.0f, 1.0f),
+				random.Range(-1.0f, 1.0f),
+				random.Range(0.0f, 1.0f),
+				0));
+			scale = (float)i / count;
+		}
+
+		// Scale such that more of the values are closer to the
+		// minimum than the maximum
+		// Note: Must be stored as float4's due to cbuffer data packing!
+		XMVECTOR acceleratedScale = XMVectorLerp(
+			XMVectorSet(0.1f, 0.1f, 0.1f, 1),
+			XMVectorSet(1, 1, 1, 1),
+			scale * scale);
+		XMStoreFloat4(&offsets[i], direction * acceleratedScale);
+	}
+}
+
+int GenerateSSAONoise(int noise, std::vector<XMFLOAT4>& vectors, PCG32& random, JobSystem* jobs)
+{
+	if (noise == SSAO_NOISE_BLUE)
+	{
+		BakeBlueNoiseVectors(vectors, jobs);
+		return SSAO_BLUE_NOISE_SIZE;
+	}
+
+	// Random directions, with GTAO's steps ordered across the 4x4
+	const int count = SSAO_WHITE_NOISE_SIZE * SSAO_WHITE_NOISE_SIZE;
+	vectors.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		XMVECTOR randomVec = XMVectorSet(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), 0, 0);
+		XMStoreFloat4(&vectors[i], XMVector3Normalize(randomVec));
+		vectors[i].w = (i + 0.5f) / count;
+	}
+	return SSAO_WHITE_NOISE_SIZE;
+}
+
+void BakeBlueNoise(int size, uint64_t seed, std::vector<int>& ranks)
+{
+	int count = size * size;
+	int initialCount = count / 10;
+	NoiseEnergy energy(size);
+	std::vector<unsigned char> pattern(count, 0);
+
+	// A sparse random starting pattern
+	PCG32 random(seed);
+	for (int placed = 0; placed < initialCount;)
+	{
+		int index = (int)random.Range((uint32_t)count);
+		if (pattern[index])
+			continue;
+		pattern[index] = 1;
+		energy.Splat(index, 1.0f);
+		placed++;
+	}
+
+	// Move the tightest cluster to the largest void until it's
+	// already there (capped, in case it ever cycles)
+	for (int i = 0; i < count; i++)
+	{
+		int cluster = energy.Find(pattern, 1, true);
+		pattern[cluster] = 0;
+		energy.Splat(cluster, -1.0f);
+
+		int largestVoid = energy.Find(pattern, 0, false);
+		pattern[largestVoid] = 1;
+		energy.Splat(largestVoid, 1.0f);
+		if (largestVoid == cluster)
+			break;
+	}
+
+	std::vector<unsigned char> initial = pattern;
+	NoiseEnergy initialEnergy = energy;
+	ranks.assign(count, 0);
+
+	// Below the initial pattern: take out the tightest clusters
+	for (int rank = initialCount - 1; rank >= 0; rank--)
+	{
+		int cluster = energy.Find(pattern, 1, true);
+		pattern[cluster] = 0;
+		energy.Splat(cluster, -1.0f);
+		ranks[cluster] = rank;
+	}
+
+	// Up to half full: fill the largest voids
+	pattern = initial;
+	energy = initialEnergy;
+	for (int rank = initialCount; rank < count / 2; rank++)
+	{
+		int largestVoid = energy.Find(pattern, 0, false);
+		pattern[largestVoid] = 1;
+		energy.Splat(largestVoid, 1.0f);
+		ranks[largestVoid] = rank;
+	}
+
+	// The rest: the empty pixels are now the minority, so fill
+	// the tightest clusters of those
+	energy.Clear();
+	for (int i = 0; i < count; i++)
+		if (!pattern[i])
+			energy.Splat(i, 1.0f);
+	for (int rank = count / 2; rank < count; rank++)
+	{
+		int cluster = energy.Find(pattern, 0, true);
+		pattern[cluster] = 1;
+		energy.Splat(cluster, -1.0f);
+		ranks[cluster] = rank;
+	}
+}
+
+bool TestBlueNoise(JobSystem* jobs)
+{
+	printf("  Blue noise:\n");
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<XMFLOAT4> vectors;
+	BakeBlueNoiseVectors(vectors, jobs);
+	double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	std::vector<XMFLOAT4> single;
+	BakeBlueNoiseVectors(single, 0);
+	double singleTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	bool deterministic = vectors.size() == single.size();
+	for (size_t i = 0; deterministic && i < vectors.size(); i++)
+		deterministic = vectors[i].x == single[i].x && vectors[i].y == single[i].y && vectors[i].w == single[i].w;
+
+	// Every rank exactly once
+	const int size = SSAO_BLUE_NOISE_SIZE;
+	const int count = size * size;
+	std::vector<int> ranks;
+	BakeBlueNoise(size, BlueNoiseSeeds[0], ranks);
+	std::vector<int> seen(count, 0);
+	bool permutation = (int)ranks.size() == count;
+	for (size_t i = 0; permutation && i < ranks.size(); i++)
+		permutation = ranks[i] >= 0 && ranks[i] < count && seen[ranks[i]]++ == 0;
+
+	// White noise ranks to compare with: a shuffle
+	std::vector<int> whiteRanks(count);
+	for (int i = 0; i < count; i++)
+		whiteRanks[i] = i;
+	PCG32 random(1);
+	for (int i = count - 1; i > 0; i--)
+		std::swap(whiteRanks[i], whiteRanks[random.Range((uint32_t)(i + 1))]);
+
+	// Blue noise keeps its points apart at every density
+	bool spread = true;
+	int densities[3] = { count / 16, count / 8, count / 4 };
+	for (int d = 0; d < 3; d++)
+	{
+		float blue = MeanNearestDistance(ranks, size, densities[d]);
+		float white = MeanNearestDistance(whiteRanks, size, densities[d]);
+		spread = spread && blue > white;
+		printf("    %4d of %d pixels: nearest neighbor %.3f pixels away on average (white noise %.3f)\n", densities[d], count, blue, white);
+	}
+
+	bool passed = deterministic && permutation && spread;
+	printf("    Two %dx%d textures baked in %.1f ms (%.1f ms on one thread), ranks %s, results on every thread count %s - %s\n",
+		size, size, time, singleTime, permutation ? "all unique" : "REPEATED", deterministic ? "match" : "DIFFER", passed ? "ok" : "FAILED");
+	return passed;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+#include "JobSystem.h"
+#include "Random.h"
+
+// How the hemisphere kernel's offsets are picked
+#define SSAO_KERNEL_RANDOM	0 // Uniform random, as the kernel was first built
+#define SSAO_KERNEL_HALTON	1 // Halton sequence - every prefix is well spread
+
+// How the per pixel random vectors are picked
+#define SSAO_NOISE_WHITE	0 // 4x4 uniform random rotations
+#define SSAO_NOISE_BLUE		1 // 64x64 void and cluster blue noise
+
+#define SSAO_WHITE_NOISE_SIZE	4
+#define SSAO_BLUE_NOISE_SIZE	64
+
+// --------------------------------------------------------
+// Builds the SSAO sample kernel and the random vector texture.
+//
+// Kernel offsets lie in the +Z hemisphere, with lengths from
+// 0.1 to 1 that favor shorter offsets (the accelerating scale
+// the kernel has always used).
+//
+// Random vectors hold a rotation in xy (z is zero) and, in w,
+// an offset in 0-1 for GTAO's steps along each slice.
+// --------------------------------------------------------
+
+// The index'th point (from 0) of the base's van der Corput sequence
+float RadicalInverse(unsigned int index, unsigned int base);
+
+void GenerateSSAOKernel(int kernel, DirectX::XMFLOAT4* offsets, int count, PCG32& random);
+
+// Fills vectors with size * size random vectors, row by row, and
+// returns the size.  Blue noise is baked on the job system (its
+// rotations and step offsets are independent textures).
+int GenerateSSAONoise(int noise, std::vector<DirectX::XMFLOAT4>& vectors, PCG32& random, JobSystem* jobs);
+
+// --------------------------------------------------------
+// Ulichney's void and cluster method: a sparse random pattern
+// is relaxed by moving its tightest cluster to its largest void
+// until nothing moves, then every pixel is ranked by taking
+// clusters out (below the initial pattern) and filling voids
+// (above it).  Thresholding the ranks at any level gives evenly
+// spread pixels, with no low frequencies.  Ranks run from 0 to
+// size * size - 1, and the result only depends on the seed.
+// --------------------------------------------------------
+void BakeBlueNoise(int size, uint64_t seed, std::vector<int>& ranks);
+
+// Checks the ranks are a permutation, that baking gives the same
+// result on any number of threads, and compares how evenly spread
+// thresholded blue and white noise are.  Returns false if a check
+// fails.
+bool TestBlueNoise(JobSystem* jobs);
@@ -0,0 +1,521 @@
+#include "ShaderReflectionCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// --------------------------------------------------------
+// Small helpers for writing and reading fixed-width,
+// little-endian values.  The reader is bounds checked so
+// a truncated or corrupt file simply fails to load.
+// --------------------------------------------------------
+namespace
+{
+	// The fewest bytes each kind of record can take up (names
+	// are a length and then at least zero characters)
+	const size_t MinResourceSize = 4 + 4;
+	const size_t MinVariableSize = 4 + 4 + 4;
+	const size_t MinConstantBufferSize = 4 + 4 + 4 + 4 + 4;
+
+	// Magic, version, bytecode hash and payload hash
+	const size_t HeaderSize = 4 + 4 + 8 + 8;
+
+	// Direct3D 11's limits on what a shader can declare (the
+	// D3D11_COMMONSHADER_*_SLOT_COUNTs and the largest constant
+	// buffer), so a cache file can't claim more than a real shader.
+	// Kept here as plain numbers, as the format doesn't use D3D.
+	const unsigned int MaxConstantBufferSlots = 14;
+	const unsigned int MaxShaderResourceSlots = 128;
+	const unsigned int MaxSamplerSlots = 16;
+	const unsigned int MaxConstantBufferSize = 4096 * 16;
+	const unsigned int MaxConstantBufferType = 3; // D3D_CT_RESOURCE_BIND_INFO
+	const unsigned int TextureBufferType = 1; // D3D_CT_TBUFFER, bound to a texture slot
+
+	void WriteU32(std::vector<unsigned char>& out, unsigned int value)
+	{
+		for (int i = 0; i < 4; i++)
+			out.push_back((unsigned char)((value >> (i * 8)) & 0xFF));
+	}
+
+	void WriteU64(std::vector<unsigned char>& out, unsigned long long value)
+	{
+		for (int i = 0; i < 8; i++)
+			out.push_back((unsigned char)((value >> (i * 8)) & 0xFF));
+	}
+
+	void WriteString(std::vector<unsigned char>& out, const std::string& str)
+	{
+		WriteU32(out, (unsigned int)str.size());
+		out.insert(out.end(), str.begin(), str.end());
+	}
+
+	struct Reader
+	{
+		const unsigned char* data;
+		size_t size;
+		size_t pos;
+
+		bool ReadU32(unsigned int& value)
+		{
+			if (size - pos < 4) return false;
+			value = 0;
+			for (int i = 0; i < 4; i++)
+				value |= (unsigned int)data[pos + i] << (i * 8);
+			pos += 4;
+			return true;
+		}
+
+		bool ReadU64(unsigned long long& value)
+		{
+			if (size - pos < 8) return false;
+			value = 0;
+			for (int i = 0; i < 8; i++)
+				value |= (unsigned long long)data[pos + i] << (i * 8);
+			pos += 8;
+			return true;
+		}
+
+		bool ReadString(std::string& str)
+		{
+			unsigned int length = 0;
+			if (!ReadU32(length) || size - pos < length) return false;
+			str.assign((const char*)data + pos, length);
+			pos += length;
+			return true;
+		}
+
+		// Reads a record count, failing if that many records of at
+		// least the given size couldn't fit in what's left - so a bad
+		// count never turns into a huge allocation
+		bool ReadCount(unsigned int& count, size_t minRecordSize)
+		{
+			return ReadU32(count) && count <= (size - pos) / minRecordSize;
+		}
+
+		bool ReadResources(std::vector<ReflectedResource>& resources, unsigned int maxSlots)
+		{
+			unsigned int count = 0;
+			if (!ReadCount(count, MinResourceSize) || count > maxSlots) return false;
+			resources.resize(count);
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (!ReadString(resources[i].Name) || !ReadU32(resources[i].BindIndex) || resources[i].BindIndex >= maxSlots)
+					return false;
+			}
+			return true;
+		}
+	};
+
+	void WriteResources(std::vector<unsigned char>& out, const std::vector<ReflectedResource>& resources)
+	{
+		WriteU32(out, (unsigned int)resources.size());
+		for (const ReflectedResource& r : resources)
+		{
+			WriteString(out, r.Name);
+			WriteU32(out, r.BindIndex);
+		}
+	}
+}
+
+
+// --------------------------------------------------------
+// 64-bit FNV-1a hash of the shader bytecode
+// --------------------------------------------------------
+unsigned long long ShaderReflectionCache::HashBytecode(const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// --------------------------------------------------------
+// Writes the reflected data to a byte array.  The header
+// ends with a hash of everything after it, filled in last.
+// --------------------------------------------------------
+void ShaderReflectionCache::Serialize(const ReflectedShaderData& data, unsigned long long bytecodeHash, std::vector<unsigned char>& output)
+{
+	output.clear();
+
+	// Header
+	WriteU32(output, Magic);
+	WriteU32(output, Version);
+	WriteU64(output, bytecodeHash);
+	WriteU64(output, 0);
+
+	// Constant buffers and their variables
+	WriteU32(output, (unsigned int)data.ConstantBuffers.size());
+	for (const ReflectedConstantBuffer& cb : data.ConstantBuffers)
+	{
+		WriteString(output, cb.Name);
+		WriteU32(output, cb.Type);
+		WriteU32(output, cb.Size);
+		WriteU32(output, cb.BindIndex);
+
+		WriteU32(output, (unsigned int)cb.Variables.size());
+		for (const ReflectedVariable& v : cb.Variables)
+		{
+			WriteString(output, v.Name);
+			WriteU32(output, v.ByteOffset);
+			WriteU32(output, v.Size);
+		}
+	}
+
+	// Bound resources
+	WriteResources(output, data.ShaderResourceViews);
+	WriteResources(output, data.Samplers);
+
+	// Now the payload is done, its hash goes in the header
+	unsigned long long payloadHash = HashBytecode(output.data() + HeaderSize, output.size() - HeaderSize);
+	for (int i = 0; i < 8; i++)
+		output[HeaderSize - 8 + i] = (unsigned char)((payloadHash >> (i * 8)) & 0xFF);
+}
+
+// --------------------------------------------------------
+// Reads reflected data back from a byte array
+//
+// Returns false if the data is malformed, from a different
+// version, or was generated from different bytecode.  Since
+// SimpleShader writes straight into its constant buffers at
+// these offsets, the payload has to match its hash, and every
+// variable has to fit in its buffer and every bind point in
+// Direct3D's slots.
+// --------------------------------------------------------
+bool ShaderReflectionCache::Deserialize(const void* bytes, size_t size, unsigned long long bytecodeHash, ReflectedShaderData& output)
+{
+	Reader reader = { (const unsigned char*)bytes, size, 0 };
+
+	// Validate the header
+	unsigned int magic = 0;
+	unsigned int version = 0;
+	unsigned long long hash = 0;
+	unsigned long long payloadHash = 0;
+	if (!reader.ReadU32(magic) || magic != Magic) return false;
+	if (!reader.ReadU32(version) || version != Version) return false;
+	if (!reader.ReadU64(hash) || hash != bytecodeHash) return false;
+	if (!reader.ReadU64(payloadHash) || payloadHash != HashBytecode(reader.data + HeaderSize, size - HeaderSize)) return false;
+
+	ReflectedShaderData result;
+
+	// Constant buffers
+	unsigned int cbCount = 0;
+	if (!reader.ReadCount(cbCount, MinConstantBufferSize) || cbCount > MaxConstantBufferSlots + MaxShaderResourceSlots) return false;
+	result.ConstantBuffers.resize(cbCount);
+	for (unsigned int b = 0; b < cbCount; b++)
+	{
+		ReflectedConstantBuffer& cb = result.ConstantBuffers[b];
+		if (!reader.ReadString(cb.Name) ||
+			!reader.ReadU32(cb.Type) ||
+			!reader.ReadU32(cb.Size) ||
+			!reader.ReadU32(cb.BindIndex))
+			return false;
+		unsigned int maxSlots = cb.Type == TextureBufferType ? MaxShaderResourceSlots : MaxConstantBufferSlots;
+		if (cb.Type > MaxConstantBufferType || cb.Size > MaxConstantBufferSize || cb.BindIndex >= maxSlots)
+			return false;
+
+		unsigned int varCount = 0;
+		if (!reader.ReadCount(varCount, MinVariableSize)) return false;
+		cb.Variables.resize(varCount);
+		for (unsigned int v = 0; v < varCount; v++)
+		{
+			ReflectedVariable& var = cb.Variables[v];
+			if (!reader.ReadString(var.Name) ||
+				!reader.ReadU32(var.ByteOffset) ||
+				!reader.ReadU32(var.Size))
+				return false;
+
+			// Written in two steps, so a huge offset can't wrap around
+			if (var.ByteOffset > cb.Size || var.Size > cb.Size - var.ByteOffset)
+				return false;
+		}
+	}
+
+	// Bound resources
+	if (!reader.ReadResources(result.ShaderResourceViews, MaxShaderResourceSlots)) return false;
+	if (!reader.ReadResources(result.Samplers, MaxSamplerSlots)) return false;
+
+	// Trailing garbage means this isn't a file we wrote
+	if (reader.pos != size) return false;
+
+	output = std::move(result);
+	return true;
+}
+
+// --------------------------------------------------------
+// Maps the cache file into memory and deserializes it
+// --------------------------------------------------------
+bool ShaderReflectionCache::Load(const std::wstring& cacheFile, unsigned long long bytecodeHash, ReflectedShaderData& output)
+{
+	bool success = false;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileW(cacheFile.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+	{
+		HANDLE mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+		if (mapping)
+		{
+			const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (view)
+			{
+				success = Deserialize(view, (size_t)fileSize.QuadPart, bytecodeHash, output);
+				UnmapViewOfFile(view);
+			}
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+#else
+	std::string narrowPath(cacheFile.begin(), cacheFile.end());
+	int file = open(narrowPath.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat info = {};
+	if (fstat(file, &info) == 0 && info.st_size > 0)
+	{
+		void* view = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (view != MAP_FAILED)
+		{
+			success = Deserialize(view, (size_t)info.st_size, bytecodeHash, output);
+			munmap(view, (size_t)info.st_size);
+		}
+	}
+	close(file);
+#endif
+
+	return success;
+}
+
+// --------------------------------------------------------
+// Serializes the data and writes it to the cache file
+// --------------------------------------------------------
+bool ShaderReflectionCache::Save(const std::wstring& cacheFile, unsigned long long bytecodeHash, const ReflectedShaderData& data)
+{
+	std::vector<unsigned char> bytes;
+	Serialize(data, bytecodeHash, bytes);
+
+#ifdef _WIN32
+	HANDLE file = CreateFileW(cacheFile.c_str(), GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD written = 0;
+	BOOL result = WriteFile(file, bytes.data(), (DWORD)bytes.size(), &written, 0);
+	CloseHandle(file);
+	return result && written == bytes.size();
+#else
+	std::string narrowPath(cacheFile.begin(), cacheFile.end());
+	FILE* file = fopen(narrowPath.c_str(), "wb");
+	if (!file)
+		return false;
+
+	size_t written = fwrite(bytes.data(), 1, bytes.size(), file);
+	fclose(file);
+	return written == bytes.size();
+#endif
+}
+
+// --------------------------------------------------------
+// Helpers for Test()
+// --------------------------------------------------------
+namespace
+{
+	bool SameResources(const std::vector<ReflectedResource>& a, const std::vector<ReflectedResource>& b)
+	{
+		if (a.size() != b.size()) return false;
+		for (size_t i = 0; i < a.size(); i++)
+			if (a[i].Name != b[i].Name || a[i].BindIndex != b[i].BindIndex)
+				return false;
+		return true;
+	}
+
+	bool SameData(const ReflectedShaderData& a, const ReflectedShaderData& b)
+	{
+		if (a.ConstantBuffers.size() != b.ConstantBuffers.size()) return false;
+		for (size_t i = 0; i < a.ConstantBuffers.size(); i++)
+		{
+			const ReflectedConstantBuffer& cbA = a.ConstantBuffers[i];
+			const ReflectedConstantBuffer& cbB = b.ConstantBuffers[i];
+			if (cbA.Name != cbB.Name || cbA.Type != cbB.Type || cbA.Size != cbB.Size ||
+				cbA.BindIndex != cbB.BindIndex || cbA.Variables.size() != cbB.Variables.size())
+				return false;
+			for (size_t v = 0; v < cbA.Variables.size(); v++)
+			{
+				const ReflectedVariable& varA = cbA.Variables[v];
+				const ReflectedVariable& varB = cbB.Variables[v];
+				if (varA.Name != varB.Name || varA.ByteOffset != varB.ByteOffset || varA.Size != varB.Size)
+					return false;
+			}
+		}
+		return SameResources(a.ShaderResourceViews, b.ShaderResourceViews) && SameResources(a.Samplers, b.Samplers);
+	}
+
+	// Somewhere the test can write its file, rather than
+	// wherever it happens to be run from
+	std::wstring TempFilePath(const wchar_t* name)
+	{
+#ifdef _WIN32
+		wchar_t folder[MAX_PATH + 1] = {};
+		if (GetTempPathW(MAX_PATH + 1, folder) == 0)
+			return name;
+		return std::wstring(folder) + name;
+#else
+		const char* folder = getenv("TMPDIR");
+		std::string narrowFolder = folder && *folder ? folder : "/tmp";
+		return std::wstring(narrowFolder.begin(), narrowFolder.end()) + L"/" + name;
+#endif
+	}
+
+	// Deserialize(), with anything it throws counted as a failure
+	bool DeserializeWithoutThrowing(const std::vector<unsigned char>& bytes, unsigned long long hash, ReflectedShaderData& output, int& throws)
+	{
+		try
+		{
+			return ShaderReflectionCache::Deserialize(bytes.data(), bytes.size(), hash, output);
+		}
+		catch (...)
+		{
+			throws++;
+			return false;
+		}
+	}
+}
+
+bool ShaderReflectionCache::Test()
+{
+	printf("Shader reflection cache:\n");
+
+	// Something shaped like a real pixel shader's reflection
+	ReflectedShaderData data;
+	ReflectedConstantBuffer perFrame;
+	perFrame.Name = "perFrame";
+	perFrame.Size = 96;
+	perFrame.BindIndex = 1;
+	perFrame.Variables.push_back({ "view", 0, 64 });
+	perFrame.Variables.push_back({ "cameraPosition", 64, 12 });
+	perFrame.Variables.push_back({ "lightCount", 76, 4 });
+	ReflectedConstantBuffer empty;
+	empty.Name = "";
+	empty.Type = 1;
+	empty.Size = 16;
+	data.ConstantBuffers.push_back(perFrame);
+	data.ConstantBuffers.push_back(empty);
+	data.ShaderResourceViews.push_back({ "Albedo", 0 });
+	data.ShaderResourceViews.push_back({ "NormalMap", 1 });
+	data.Samplers.push_back({ "BasicSampler", 0 });
+
+	const char bytecode[] = "not really bytecode";
+	unsigned long long hash = HashBytecode(bytecode, sizeof(bytecode));
+	std::vector<unsigned char> bytes;
+	Serialize(data, hash, bytes);
+
+	int throws = 0;
+	ReflectedShaderData result;
+	bool roundTrip = DeserializeWithoutThrowing(bytes, hash, result, throws) && SameData(data, result);
+
+	// A different shader, version or magic, or anything after the end
+	std::vector<unsigned char> altered = bytes;
+	bool staleRejected = !DeserializeWithoutThrowing(bytes, hash + 1, result, throws);
+	altered[4]++;
+	staleRejected = staleRejected && !DeserializeWithoutThrowing(altered, hash, result, throws);
+	altered = bytes;
+	altered[0]++;
+	staleRejected = staleRejected && !DeserializeWithoutThrowing(altered, hash, result, throws);
+	altered = bytes;
+	altered.push_back(0);
+	staleRejected = staleRejected && !DeserializeWithoutThrowing(altered, hash, result, throws);
+
+	// Every truncation, from empty to one byte short
+	int truncationsLoaded = 0;
+	for (size_t length = 0; length < bytes.size(); length++)
+	{
+		std::vector<unsigned char> truncated(bytes.begin(), bytes.begin() + length);
+		if (DeserializeWithoutThrowing(truncated, hash, result, throws))
+			truncationsLoaded++;
+	}
+
+	// Every byte after the bytecode hash set to a few values -
+	// including the counts' high bytes, which once asked for
+	// gigabytes.  The payload hash catches all of these.
+	const unsigned char values[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF };
+	int corruptions = 0;
+	int corruptionsLoaded = 0;
+	for (size_t i = 16; i < bytes.size(); i++)
+	{
+		for (unsigned char value : values)
+		{
+			if (bytes[i] == value)
+				continue;
+			altered = bytes;
+			altered[i] = value;
+			corruptions++;
+			if (DeserializeWithoutThrowing(altered, hash, result, throws))
+				corruptionsLoaded++;
+		}
+	}
+
+	// Data that hashes correctly, but doesn't fit: variables past
+	// the end of their buffer (or wrapping around), buffers bigger
+	// than Direct3D allows and bind points past the last slot
+	int invalidCases = 0;
+	int invalidLoaded = 0;
+	for (int c = 0; c < 7; c++)
+	{
+		ReflectedShaderData invalid = data;
+		ReflectedConstantBuffer& cb = invalid.ConstantBuffers[0];
+		switch (c)
+		{
+		case 0: cb.Variables[2].ByteOffset = cb.Size - 2; break;
+		case 1: cb.Variables[0].Size = cb.Size + 1; break;
+		case 2: cb.Variables[1].ByteOffset = 0xFFFFFFF0; cb.Variables[1].Size = 0x20; break;
+		case 3: cb.Size = 0x7FFFFFFF; break;
+		case 4: cb.BindIndex = 14; break;
+		case 5: invalid.ShaderResourceViews[1].BindIndex = 128; break;
+		case 6: invalid.Samplers[0].BindIndex = 16; break;
+		}
+
+		std::vector<unsigned char> invalidBytes;
+		Serialize(invalid, hash, invalidBytes);
+		invalidCases++;
+		if (DeserializeWithoutThrowing(invalidBytes, hash, result, throws))
+			invalidLoaded++;
+	}
+
+	// Through a file, then the same file cut short
+	std::wstring file = TempFilePath(L"ShaderReflectionCacheTest.refl");
+	std::string narrowFile(file.begin(), file.end());
+	bool fileRoundTrip = Save(file, hash, data) && Load(file, hash, result) && SameData(data, result);
+	FILE* handle = fopen(narrowFile.c_str(), "wb");
+	if (handle)
+	{
+		fwrite(bytes.data(), 1, bytes.size() / 2, handle);
+		fclose(handle);
+	}
+	bool truncatedFileRejected = handle && !Load(file, hash, result);
+	remove(narrowFile.c_str());
+
+	bool passed = roundTrip && fileRoundTrip && staleRejected && truncatedFileRejected &&
+		truncationsLoaded == 0 && corruptionsLoaded == 0 && invalidLoaded == 0 && throws == 0;
+	printf("  %d bytes: round trip in memory %s, through a file %s, stale hash/version/magic and trailing bytes %s\n",
+		(int)bytes.size(), roundTrip ? "ok" : "FAILED", fileRoundTrip ? "ok" : "FAILED", staleRejected ? "rejected" : "NOT REJECTED");
+	printf("  %d truncation(s) loaded, truncated file %s, %d of %d corruption(s) and %d of %d out of range value(s) loaded, %d exception(s) - %s\n",
+		truncationsLoaded, truncatedFileRejected ? "rejected" : "NOT REJECTED", corruptionsLoaded, corruptions, invalidLoaded, invalidCases, throws, passed ? "ok" : "FAILED");
+	return passed;
+}
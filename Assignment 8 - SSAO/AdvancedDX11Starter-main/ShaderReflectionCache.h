@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Reflected metadata for a single shader, in a form that
+// has no dependency on Direct3D.  SimpleShader builds its
+// lookup tables from this, whether it came from D3DReflect
+// or from a cache file on disk.
+// --------------------------------------------------------
+struct ReflectedVariable
+{
+	std::string Name;
+	unsigned int ByteOffset = 0;
+	unsigned int Size = 0;
+};
+
+struct ReflectedConstantBuffer
+{
+	std::string Name;
+	unsigned int Type = 0;		// D3D_CBUFFER_TYPE, stored as a plain integer
+	unsigned int Size = 0;
+	unsigned int BindIndex = 0;
+	std::vector<ReflectedVariable> Variables;
+};
+
+struct ReflectedResource
+{
+	std::string Name;
+	unsigned int BindIndex = 0;
+};
+
+struct ReflectedShaderData
+{
+	std::vector<ReflectedConstantBuffer> ConstantBuffers;
+	std::vector<ReflectedResource> ShaderResourceViews;
+	std::vector<ReflectedResource> Samplers;
+};
+
+// --------------------------------------------------------
+// Binary sidecar format for reflected shader data.
+//
+// All values are written little-endian with fixed widths,
+// so the format is identical on every platform.  The file
+// stores a hash of the shader bytecode, and a load only
+// succeeds if that hash matches the bytecode being loaded.
+// A second hash covers the rest of the file, and offsets,
+// sizes and bind points are range checked, so a damaged file
+// is a cache miss rather than a bad write into a buffer.
+// --------------------------------------------------------
+class ShaderReflectionCache
+{
+public:
+	// Hashes compiled shader bytecode (64-bit FNV-1a)
+	static unsigned long long HashBytecode(const void* data, size_t size);
+
+	// In-memory serialization
+	static void Serialize(const ReflectedShaderData& data, unsigned long long bytecodeHash, std::vector<unsigned char>& output);
+	static bool Deserialize(const void* bytes, size_t size, unsigned long long bytecodeHash, ReflectedShaderData& output);
+
+	// File helpers - Load() maps the whole file in one go
+	static bool Load(const std::wstring& cacheFile, unsigned long long bytecodeHash, ReflectedShaderData& output);
+	static bool Save(const std::wstring& cacheFile, unsigned long long bytecodeHash, const ReflectedShaderData& data);
+
+	// Round trips some reflected data through memory and a file
+	// (in the temp folder), then checks that every truncation, a
+	// stale hash and version, trailing bytes, every corrupt byte
+	// and out of range offsets or bind points are all rejected
+	// without throwing.  Only needs the C runtime, so it runs
+	// anywhere.  Returns false if a check fails.
+	static bool Test();
+
+	// Identifies the file type and layout version
+	static const unsigned int Magic = 0x43525353; // "SSRC"
+	static const unsigned int Version = 2;
+};
@@ -3,6 +3,8 @@
 // Default error reporting state
 bool ISimpleShader::ReportErrors = false;
 bool ISimpleShader::ReportWarnings = false;
+bool ISimpleShader::ReportLoadTimes = false;
+bool ISimpleShader::UseReflectionCache = true;
 
 // To enable error reporting, use either or both 
 // of the following lines somewhere in your program, 
@@ -10,6 +12,10 @@ bool ISimpleShader::ReportWarnings = false;
 // 
 // ISimpleShader::ReportErrors = true;
 // ISimpleShader::ReportWarnings = true;
+//
+// Per-shader load times can be printed the same way:
+//
+// ISimpleShader::ReportLoadTimes = true;
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -29,6 +35,8 @@ ISimpleShader::ISimpleShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Micros
 	this->constantBufferCount = 0;
 	this->constantBuffers = 0;
 	this->shaderValid = false;
+	this->loadedFromCache = false;
+	this->loadTimeMilliseconds = 0.0f;
 }
 
 // --------------------------------------------------------
@@ -72,7 +80,9 @@ void ISimpleShader::CleanUp()
 
 // --------------------------------------------------------
 // Loads the specified shader and builds the variable table 
-// using shader reflection.
+// using shader reflection.  Reflected data is cached in a
+// ".refl" file next to the shader, keyed by a hash of the
+// bytecode, so reflection only runs when the shader changes.
 //
 // shaderFile - A "wide string" specifying the compiled shader to load
 // 
@@ -80,6 +90,11 @@ void ISimpleShader::CleanUp()
 // --------------------------------------------------------
 bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 {
+	// Time the load, so we can see what the cache saves us
+	LARGE_INTEGER frequency, loadStart, loadEnd;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&loadStart);
+
 	// Load the shader to a blob and ensure it worked
 	HRESULT hr = D3DReadFileToBlob(shaderFile, shaderBlob.GetAddressOf());
 	if (hr != S_OK)
@@ -109,6 +124,53 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
+	// Look for reflection data from a previous run first, and only
+	// fall back to (much slower) shader reflection on a cache miss
+	unsigned long long bytecodeHash = ShaderReflectionCache::HashBytecode(
+		shaderBlob->GetBufferPointer(),
+		shaderBlob->GetBufferSize());
+	std::wstring cacheFile = std::wstring(shaderFile) + L".refl";
+
+	ReflectedShaderData reflection;
+	loadedFromCache = UseReflectionCache && ShaderReflectionCache::Load(cacheFile, bytecodeHash, reflection);
+	if (!loadedFromCache)
+	{
+		ReflectShader(reflection);
+
+		// Save for next time - failure here isn't fatal, we
+		// just end up reflecting again on the next run
+		if (UseReflectionCache && !ShaderReflectionCache::Save(cacheFile, bytecodeHash, reflection) && ReportWarnings)
+		{
+			LogWarning("SimpleShader::LoadShaderFile() - Unable to write reflection cache '");
+			LogW(cacheFile);
+			LogWarning("'.\n");
+		}
+	}
+
+	// Set up the tables and constant buffers
+	BuildTables(reflection);
+
+	// Record how long the whole load took
+	QueryPerformanceCounter(&loadEnd);
+	loadTimeMilliseconds = (float)((loadEnd.QuadPart - loadStart.QuadPart) * 1000.0 / frequency.QuadPart);
+	if (ReportLoadTimes)
+	{
+		LogW(shaderFile);
+		Log(std::string(": ") + std::to_string(loadTimeMilliseconds) + " ms" + (loadedFromCache ? " (cached)\n" : " (reflected)\n"));
+	}
+
+	// All set
+	return true;
+}
+
+// --------------------------------------------------------
+// Uses shader reflection to get information about the
+// shader's constant buffers, variables and resources
+//
+// reflection - The structure to fill with the results
+// --------------------------------------------------------
+void ISimpleShader::ReflectShader(ReflectedShaderData& reflection)
+{
 	// Set up shader reflection to get information about
 	// this shader and its variables,  buffers, etc.
 	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
@@ -122,10 +184,6 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 	D3D11_SHADER_DESC shaderDesc;
 	refl->GetDesc(&shaderDesc);
 
-	// Create resource arrays
-	constantBufferCount = shaderDesc.ConstantBuffers;
-	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
-	
 	// Handle bound resources (like shaders and samplers)
 	unsigned int resourceCount = shaderDesc.BoundResources;
 	for (unsigned int r = 0; r < resourceCount; r++)
@@ -139,33 +197,18 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		{
 		case D3D_SIT_STRUCTURED: // Treat structured buffers as texture resources
 		case D3D_SIT_TEXTURE: // A texture resource
-		{
-			// Create the SRV wrapper
-			SimpleSRV* srv = new SimpleSRV();
-			srv->BindIndex = resourceDesc.BindPoint;				// Shader bind point
-			srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
-
-			textureTable.insert(std::pair<std::string, SimpleSRV*>(resourceDesc.Name, srv));
-			shaderResourceViews.push_back(srv);
-		}
+			reflection.ShaderResourceViews.push_back({ resourceDesc.Name, resourceDesc.BindPoint });
 			break;
 
 		case D3D_SIT_SAMPLER: // A sampler resource
-		{
-			// Create the sampler wrapper
-			SimpleSampler* samp = new SimpleSampler();
-			samp->BindIndex = resourceDesc.BindPoint;			// Shader bind point
-			samp->Index = (unsigned int)samplerStates.size();	// Raw index
-
-			samplerTable.insert(std::pair<std::string, SimpleSampler*>(resourceDesc.Name, samp));
-			samplerStates.push_back(samp);
-		}
+			reflection.Samplers.push_back({ resourceDesc.Name, resourceDesc.BindPoint });
 			break;
 		}
 	}
 
 	// Loop through all constant buffers
-	for (unsigned int b = 0; b < constantBufferCount; b++)
+	reflection.ConstantBuffers.resize(shaderDesc.ConstantBuffers);
+	for (unsigned int b = 0; b < shaderDesc.ConstantBuffers; b++)
 	{
 		// Get this buffer
 		ID3D11ShaderReflectionConstantBuffer* cb =
@@ -175,23 +218,85 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		D3D11_SHADER_BUFFER_DESC bufferDesc;
 		cb->GetDesc(&bufferDesc);
 
-		// Save the type, which we reference when setting these buffers
-		constantBuffers[b].Type = bufferDesc.Type;
-		
 		// Get the description of the resource binding, so
 		// we know exactly how it's bound in the shader
 		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
 		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
-		
+
+		ReflectedConstantBuffer& buffer = reflection.ConstantBuffers[b];
+		buffer.Name = bufferDesc.Name;
+		buffer.Type = (unsigned int)bufferDesc.Type;
+		buffer.Size = bufferDesc.Size;
+		buffer.BindIndex = bindDesc.BindPoint;
+
+		// Loop through all variables in this buffer
+		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		{
+			// Get this variable
+			ID3D11ShaderReflectionVariable* var =
+				cb->GetVariableByIndex(v);
+			
+			// Get the description of the variable
+			D3D11_SHADER_VARIABLE_DESC varDesc;
+			var->GetDesc(&varDesc);
+
+			buffer.Variables.push_back({ varDesc.Name, varDesc.StartOffset, varDesc.Size });
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Builds the lookup tables and creates the constant buffers
+// from previously reflected (or cached) shader data
+//
+// reflection - The reflected data for this shader
+// --------------------------------------------------------
+void ISimpleShader::BuildTables(const ReflectedShaderData& reflection)
+{
+	// Create resource arrays
+	constantBufferCount = (unsigned int)reflection.ConstantBuffers.size();
+	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
+
+	// Handle bound resources (like shaders and samplers)
+	for (const ReflectedResource& resource : reflection.ShaderResourceViews)
+	{
+		// Create the SRV wrapper
+		SimpleSRV* srv = new SimpleSRV();
+		srv->BindIndex = resource.BindIndex;					// Shader bind point
+		srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
+
+		textureTable.insert(std::pair<std::string, SimpleSRV*>(resource.Name, srv));
+		shaderResourceViews.push_back(srv);
+	}
+
+	for (const ReflectedResource& resource : reflection.Samplers)
+	{
+		// Create the sampler wrapper
+		SimpleSampler* samp = new SimpleSampler();
+		samp->BindIndex = resource.BindIndex;				// Shader bind point
+		samp->Index = (unsigned int)samplerStates.size();	// Raw index
+
+		samplerTable.insert(std::pair<std::string, SimpleSampler*>(resource.Name, samp));
+		samplerStates.push_back(samp);
+	}
+
+	// Loop through all constant buffers
+	for (unsigned int b = 0; b < constantBufferCount; b++)
+	{
+		const ReflectedConstantBuffer& buffer = reflection.ConstantBuffers[b];
+
+		// Save the type, which we reference when setting these buffers
+		constantBuffers[b].Type = (D3D_CBUFFER_TYPE)buffer.Type;
+
 		// Set up the buffer and put its pointer in the table
-		constantBuffers[b].BindIndex = bindDesc.BindPoint;
-		constantBuffers[b].Name = bufferDesc.Name;
-		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(bufferDesc.Name, &constantBuffers[b]));
+		constantBuffers[b].BindIndex = buffer.BindIndex;
+		constantBuffers[b].Name = buffer.Name;
+		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(buffer.Name, &constantBuffers[b]));
 
 		// Create this constant buffer
 		D3D11_BUFFER_DESC newBuffDesc = {};
 		newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
-		newBuffDesc.ByteWidth = ((bufferDesc.Size + 15) / 16) * 16; // Quick and dirty 16-byte alignment using integer division
+		newBuffDesc.ByteWidth = ((buffer.Size + 15) / 16) * 16; // Quick and dirty 16-byte alignment using integer division
 		newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 		newBuffDesc.CPUAccessFlags = 0;
 		newBuffDesc.MiscFlags = 0;
@@ -199,38 +304,24 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
 
 		// Set up the data buffer for this constant buffer
-		constantBuffers[b].Size = bufferDesc.Size;
-		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
-		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
+		constantBuffers[b].Size = buffer.Size;
+		constantBuffers[b].LocalDataBuffer = new unsigned char[buffer.Size];
+		ZeroMemory(constantBuffers[b].LocalDataBuffer, buffer.Size);
 
 		// Loop through all variables in this buffer
-		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		for (const ReflectedVariable& var : buffer.Variables)
 		{
-			// Get this variable
-			ID3D11ShaderReflectionVariable* var =
-				cb->GetVariableByIndex(v);
-			
-			// Get the description of the variable and its type
-			D3D11_SHADER_VARIABLE_DESC varDesc;
-			var->GetDesc(&varDesc);
-
 			// Create the variable struct
 			SimpleShaderVariable varStruct = {};
 			varStruct.ConstantBufferIndex = b;
-			varStruct.ByteOffset = varDesc.StartOffset;
-			varStruct.Size = varDesc.Size;
-			
-			// Get a string version
-			std::string varName(varDesc.Name);
+			varStruct.ByteOffset = var.ByteOffset;
+			varStruct.Size = var.Size;
 
 			// Add this variable to the table and the constant buffer
-			varTable.insert(std::pair<std::string, SimpleShaderVariable>(varName, varStruct));
+			varTable.insert(std::pair<std::string, SimpleShaderVariable>(var.Name, varStruct));
 			constantBuffers[b].Variables.push_back(varStruct);
 		}
 	}
-
-	// All set
-	return true;
 }
 
 // --------------------------------------------------------
@@ -530,7 +621,7 @@ bool ISimpleShader::SetMatrix4x4(std::string name, const float data[16])
 // --------------------------------------------------------
 // Sets a MATRIX (4x4) variable by name in the local data buffer
 // --------------------------------------------------------
-bool ISimpleShader::SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data)
+bool ISimpleShader::SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4& data)
 {
 	return this->SetData(name, &data, sizeof(float) * 16);
 }
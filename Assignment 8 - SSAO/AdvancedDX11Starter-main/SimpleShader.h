@@ -11,6 +11,8 @@
 #include <vector>
 #include <string>
 
+#include "ShaderReflectionCache.h"
+
 
 // --------------------------------------------------------
 // Used by simple shaders to store information about
@@ -87,7 +89,7 @@ public:
 	bool SetFloat4(std::string name, const float data[4]);
 	bool SetFloat4(std::string name, const DirectX::XMFLOAT4 data);
 	bool SetMatrix4x4(std::string name, const float data[16]);
-	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data);
+	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4& data);
 
 	// Setting shader resources
 	virtual bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) = 0;
@@ -118,13 +120,23 @@ public:
 	// Misc getters
 	Microsoft::WRL::ComPtr<ID3DBlob> GetShaderBlob() { return shaderBlob; }
 
+	// Load details
+	float GetLoadTime() { return loadTimeMilliseconds; }
+	bool WasLoadedFromCache() { return loadedFromCache; }
+
 	// Error reporting
 	static bool ReportErrors;
 	static bool ReportWarnings;
+	static bool ReportLoadTimes;
+
+	// Reflection cache (".refl" files next to each shader)
+	static bool UseReflectionCache;
 
 protected:
 	
 	bool shaderValid;
+	bool loadedFromCache;
+	float loadTimeMilliseconds;
 	Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob;
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
@@ -141,8 +153,10 @@ protected:
 	std::unordered_map<std::string, SimpleSRV*> textureTable;
 	std::unordered_map<std::string, SimpleSampler*> samplerTable;
 
-	// Initialization method
+	// Initialization methods
 	bool LoadShaderFile(LPCWSTR shaderFile);
+	void ReflectShader(ReflectedShaderData& reflection);
+	void BuildTables(const ReflectedShaderData& reflection);
 
 	// Pure virtual functions for dealing with shader types
 	virtual bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob) = 0;
@@ -0,0 +1,64 @@
+cbuffer externalData : register(b0)
+{
+    matrix currentToPrevious; // This frame's NDC to last frame's clip space
+    matrix invProjMatrix; // Inverse of projection matrix
+    float historyWeight; // Most of the history that can be kept
+    float disocclusionThreshold; // Relative depth change that throws history out
+    int historyValid; // Is there a history yet?
+}
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD;
+};
+
+Texture2D SSAO : register(t0); // This frame's (noisy) SSAO
+Texture2D Depths : register(t1); // At the SSAO's resolution
+Texture2D History : register(t2); // AO, view space depth, frames accumulated
+
+
+float LinearDepth(float depth)
+{
+    float4 viewPos = mul(invProjMatrix, float4(0, 0, depth, 1));
+    return viewPos.z / viewPos.w;
+}
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+    // Nothing to accumulate for the sky
+    int2 pixel = int2(input.position.xy);
+    float depth = Depths.Load(int3(pixel, 0)).r;
+    if (depth == 1.0f)
+        return float4(1, LinearDepth(1.0f), 0, 1);
+
+    float ao = SSAO.Load(int3(pixel, 0)).r;
+    float4 result = float4(ao, LinearDepth(depth), 1, 1);
+    if (!historyValid)
+        return result;
+
+    // Where was this pixel last frame?
+    float2 ndc = float2(input.uv.x * 2.0f - 1.0f, 1.0f - input.uv.y * 2.0f);
+    float4 previous = mul(currentToPrevious, float4(ndc, depth, 1));
+    if (previous.w <= 0.0f)
+        return result;
+    previous.xyz /= previous.w;
+    float2 previousUV = float2(previous.x * 0.5f + 0.5f, 0.5f - previous.y * 0.5f);
+    if (any(previousUV < 0.0f) || any(previousUV >= 1.0f))
+        return result;
+
+    // Was something else there?  Compare the depth we'd expect
+    // there against the depth the history actually saw
+    float2 historySize;
+    History.GetDimensions(historySize.x, historySize.y);
+    float3 history = History.Load(int3(previousUV * historySize, 0)).rgb;
+    float expectedZ = LinearDepth(previous.z);
+    if (history.b <= 0.0f || abs(history.g - expectedZ) > disocclusionThreshold * expectedZ)
+        return result;
+
+    // An even average until the history weight is reached
+    float alpha = min(historyWeight, history.b / (history.b + 1.0f));
+    result.r = lerp(ao, history.r, alpha);
+    result.b = min(history.b + 1.0f, 255.0f);
+    return result;
+}
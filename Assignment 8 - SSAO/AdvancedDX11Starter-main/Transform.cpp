@@ -11,7 +11,8 @@ Transform::Transform() :
 	right(1, 0, 0),
 	forward(0, 0, 1),
 	matricesDirty(false),
-	vectorsDirty(false)
+	vectorsDirty(false),
+	version(0)
 {
 	// Start with an identity matrix and basic transform data
 	XMStoreFloat4x4(&worldMatrix, XMMatrixIdentity());
@@ -24,6 +25,7 @@ void Transform::MoveAbsolute(float x, float y, float z)
 	position.y += y;
 	position.z += z;
 	matricesDirty = true;
+	version++;
 }
 
 void Transform::MoveAbsolute(DirectX::XMFLOAT3 offset)
@@ -32,6 +34,7 @@ void Transform::MoveAbsolute(DirectX::XMFLOAT3 offset)
 	position.y += offset.y;
 	position.z += offset.z;
 	matricesDirty = true;
+	version++;
 }
 
 void Transform::MoveRelative(float x, float y, float z)
@@ -47,6 +50,7 @@ void Transform::MoveRelative(float x, float y, float z)
 	// Add and store, and invalidate the matrices
 	XMStoreFloat3(&position, XMLoadFloat3(&position) + dir);
 	matricesDirty = true;
+	version++;
 }
 
 void Transform::MoveRelative(DirectX::XMFLOAT3 offset)
@@ -61,6 +65,7 @@ void Transform::Rotate(float p, float y, float r)
 	pitchYawRoll.y += y;
 	pitchYawRoll.z += r;
 	matricesDirty = true;
+	version++;
 	vectorsDirty = true;
 }
 
@@ -70,6 +75,7 @@ void Transform::Rotate(DirectX::XMFLOAT3 pitchYawRoll)
 	this->pitchYawRoll.y += pitchYawRoll.y;
 	this->pitchYawRoll.z += pitchYawRoll.z;
 	matricesDirty = true;
+	version++;
 	vectorsDirty = true;
 }
 
@@ -79,6 +85,7 @@ void Transform::Scale(float uniformScale)
 	scale.y *= uniformScale;
 	scale.z *= uniformScale;
 	matricesDirty = true;
+	version++;
 }
 
 void Transform::Scale(float x, float y, float z)
@@ -87,6 +94,7 @@ void Transform::Scale(float x, float y, float z)
 	scale.y *= y;
 	scale.z *= z;
 	matricesDirty = true;
+	version++;
 }
 
 void Transform::Scale(DirectX::XMFLOAT3 scale)
@@ -95,6 +103,7 @@ void Transform::Scale(DirectX::XMFLOAT3 scale)
 	this->scale.y *= scale.y;
 	this->scale.z *= scale.z;
 	matricesDirty = true;
+	version++;
 }
 
 void Transform::SetPosition(float x, float y, float z)
@@ -103,12 +112,14 @@ void Transform::SetPosition(float x, float y, float z)
 	position.y = y;
 	position.z = z;
 	matricesDirty = true;
+	version++;
 }
 
 void Transform::SetPosition(DirectX::XMFLOAT3 position)
 {
 	this->position = position;
 	matricesDirty = true;
+	version++;
 }
 
 void Transform::SetRotation(float p, float y, float r)
@@ -117,6 +128,7 @@ void Transform::SetRotation(float p, float y, float r)
 	pitchYawRoll.y = y;
 	pitchYawRoll.z = r;
 	matricesDirty = true;
+	version++;
 	vectorsDirty = true;
 }
 
@@ -124,6 +136,7 @@ void Transform::SetRotation(DirectX::XMFLOAT3 pitchYawRoll)
 {
 	this->pitchYawRoll = pitchYawRoll;
 	matricesDirty = true;
+	version++;
 	vectorsDirty = true;
 }
 
@@ -133,6 +146,7 @@ void Transform::SetScale(float uniformScale)
 	scale.y = uniformScale;
 	scale.z = uniformScale;
 	matricesDirty = true;
+	version++;
 }
 
 void Transform::SetScale(float x, float y, float z)
@@ -141,17 +155,20 @@ void Transform::SetScale(float x, float y, float z)
 	scale.y = y;
 	scale.z = z;
 	matricesDirty = true;
+	version++;
 }
 
 void Transform::SetScale(DirectX::XMFLOAT3 scale)
 {
 	this->scale = scale;
 	matricesDirty = true;
+	version++;
 }
 
 DirectX::XMFLOAT3 Transform::GetPosition() { return position; }
 DirectX::XMFLOAT3 Transform::GetPitchYawRoll() { return pitchYawRoll; }
 DirectX::XMFLOAT3 Transform::GetScale() { return scale; }
+unsigned int Transform::GetVersion() { return version; }
 
 DirectX::XMFLOAT3 Transform::GetUp()
 {
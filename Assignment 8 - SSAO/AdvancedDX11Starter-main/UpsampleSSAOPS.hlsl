@@ -0,0 +1,67 @@
+cbuffer externalData : register(b0)
+{
+    matrix invProjMatrix; // Inverse of projection matrix
+    float2 lowSize; // Size of the low resolution SSAO targets
+    float upsampleSharpness; // How strongly to prefer similar depths
+}
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD;
+};
+
+Texture2D SSAOBlur : register(t0); // Low resolution
+Texture2D LowDepths : register(t1); // Low resolution
+Texture2D Depths : register(t2); // Full resolution
+
+
+float LinearDepth(float depth)
+{
+    float4 viewPos = mul(invProjMatrix, float4(0, 0, depth, 1));
+    return viewPos.z / viewPos.w;
+}
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+    // Sky is never occluded
+    float depth = Depths.Load(int3(input.position.xy, 0)).r;
+    if (depth == 1.0f)
+        return float4(1, 1, 1, 1);
+    float z = LinearDepth(depth);
+
+    // The four nearest low resolution pixels, as a bilinear filter would use
+    float2 lowPos = input.uv * lowSize - 0.5f;
+    float2 base = floor(lowPos);
+    float2 t = lowPos - base;
+
+    // Bilinear weights, scaled down by the difference in view space depth
+    // - If every tap is on another surface, use the one with the closest depth
+    float ao = 0.0f;
+    float totalWeight = 0.0f;
+    float closest = 3.402823466e+38f;
+    float closestAO = 1.0f;
+    for (int i = 0; i < 4; i++)
+    {
+        int2 offset = int2(i & 1, i >> 1);
+        int2 texel = clamp(int2(base) + offset, int2(0, 0), int2(lowSize) - 1);
+
+        float tapAO = SSAOBlur.Load(int3(texel, 0)).r;
+        float difference = abs(LinearDepth(LowDepths.Load(int3(texel, 0)).r) - z) / z;
+        float weight =
+            (offset.x ? t.x : 1.0f - t.x) *
+            (offset.y ? t.y : 1.0f - t.y) *
+            exp(-difference * upsampleSharpness);
+
+        ao += tapAO * weight;
+        totalWeight += weight;
+        if (difference < closest)
+        {
+            closest = difference;
+            closestAO = tapAO;
+        }
+    }
+
+    ao = totalWeight > 0.0001f ? ao / totalWeight : closestAO;
+    return float4(ao.rrr, 1);
+}